@@ -0,0 +1,703 @@
+/***************************************************************************************
+ *
+ *  IMPORTANT: READ BEFORE DOWNLOADING, COPYING, INSTALLING OR USING.
+ *
+ *  By downloading, copying, installing or using the software you agree to this license.
+ *  If you do not agree to this license, do not download, install, 
+ *  copy or use the software.
+ *
+ *  Copyright (C) 2014-2020, Happytimesoft Corporation, all rights reserved.
+ *
+ *  Redistribution and use in binary forms, with or without modification, are permitted.
+ *
+ *  Unless required by applicable law or agreed to in writing, software distributed 
+ *  under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ *  CONDITIONS OF ANY KIND, either express or implied. See the License for the specific
+ *  language governing permissions and limitations under the License.
+ *
+****************************************************************************************/
+
+
+
+
+/**
+ * Depacketizer throughput and heap allocations per packet of the rtp/
+ * receivers, on a synthetic stream of each codec or a captured one
+ *
+ * make bench_depacketize && ./bench_depacketize [codec file.rtpdump]
+ * codec: h264 h265 jpeg mp4v aac pcm
+ */
+
+#include "sys_inc.h"
+#include "sys_buf.h"
+#include "rtp_rx.h"
+#include "h264_rtp_rx.h"
+#include "h265_rtp_rx.h"
+#include "mjpeg_rtp_rx.h"
+#include "mpeg4_rtp_rx.h"
+#include "aac_rtp_rx.h"
+#include "pcm_rtp_rx.h"
+
+#define BENCH_REPEAT        20
+#define BENCH_MTU           1400
+#define BENCH_STREAM_MAX    (32*1024*1024)
+#define BENCH_PKT_MAX       (64*1024)
+
+/***************************************************************************************/
+
+#ifdef __GLIBC__
+
+// count the heap calls of the whole process, glibc only
+extern "C" void * __libc_malloc(size_t size);
+extern "C" void * __libc_calloc(size_t num, size_t size);
+extern "C" void * __libc_realloc(void * ptr, size_t size);
+extern "C" void   __libc_free(void * ptr);
+
+static volatile uint32 bench_allocs = 0;
+
+extern "C" void * malloc(size_t size)
+{
+    bench_allocs++;
+    return __libc_malloc(size);
+}
+
+extern "C" void * calloc(size_t num, size_t size)
+{
+    bench_allocs++;
+    return __libc_calloc(num, size);
+}
+
+extern "C" void * realloc(void * ptr, size_t size)
+{
+    bench_allocs++;
+    return __libc_realloc(ptr, size);
+}
+
+extern "C" void free(void * ptr)
+{
+    __libc_free(ptr);
+}
+
+#define BENCH_ALLOCS()      (bench_allocs)
+
+#else
+
+#define BENCH_ALLOCS()      (0)
+
+#endif
+
+/***************************************************************************************/
+
+typedef struct
+{
+    uint8     * p_buf;                  // packets, back to back
+    int         len;
+    int       * p_off;                  // packet offsets
+    int       * p_len;                  // packet lengths
+    int         cnt;
+    int         max;
+
+    uint16      seq;
+    uint32      seed;
+} BSTREAM;
+
+typedef struct
+{
+    uint32      frames;
+    uint64      bytes;
+} BSTAT;
+
+static double bench_ns()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static BOOL bench_stream_init(BSTREAM * p_bs)
+{
+    memset(p_bs, 0, sizeof(BSTREAM));
+
+    p_bs->max = BENCH_STREAM_MAX / 256;
+    p_bs->p_buf = (uint8 *)malloc(BENCH_STREAM_MAX);
+    p_bs->p_off = (int *)malloc(p_bs->max * sizeof(int));
+    p_bs->p_len = (int *)malloc(p_bs->max * sizeof(int));
+    p_bs->seed = 12345;
+
+    return p_bs->p_buf && p_bs->p_off && p_bs->p_len;
+}
+
+static void bench_stream_free(BSTREAM * p_bs)
+{
+    free(p_bs->p_buf);
+    free(p_bs->p_off);
+    free(p_bs->p_len);
+}
+
+static void bench_random(BSTREAM * p_bs, uint8 * p_buf, int len)
+{
+    int i;
+
+    for (i = 0; i < len; i++)
+    {
+        p_bs->seed = p_bs->seed * 1103515245 + 12345;
+        p_buf[i] = (uint8)(p_bs->seed >> 16);
+    }
+}
+
+/**
+ * Append one RTP packet, hdr (payload header) + data
+ */
+static void bench_put(BSTREAM * p_bs, uint32 ts, BOOL marker, uint8 * p_hdr, int hdr_len, uint8 * p_data, int len)
+{
+    uint8 * p;
+
+    if (p_bs->cnt >= p_bs->max || p_bs->len + 12 + hdr_len + len > BENCH_STREAM_MAX)
+    {
+        return;
+    }
+
+    p = p_bs->p_buf + p_bs->len;
+
+    p[0] = 0x80;
+    p[1] = (marker ? 0x80 : 0) | 96;
+    p[2] = (uint8)(p_bs->seq >> 8);
+    p[3] = (uint8)(p_bs->seq);
+    p[4] = (uint8)(ts >> 24);
+    p[5] = (uint8)(ts >> 16);
+    p[6] = (uint8)(ts >> 8);
+    p[7] = (uint8)(ts);
+    memcpy(p + 8, "\x12\x34\x56\x78", 4);
+
+    memcpy(p + 12, p_hdr, hdr_len);
+    memcpy(p + 12 + hdr_len, p_data, len);
+
+    p_bs->p_off[p_bs->cnt] = p_bs->len;
+    p_bs->p_len[p_bs->cnt] = 12 + hdr_len + len;
+    p_bs->len += 12 + hdr_len + len;
+    p_bs->cnt++;
+    p_bs->seq++;
+}
+
+/**
+ * H.264 (nal_hdr 1 byte, FU-A) or H.265 (nal_hdr 2 bytes, FU) frames, 
+ * a 40KB key frame every 25 frames and 4KB inter frames
+ */
+static void bench_make_avc(BSTREAM * p_bs, int nal_hdr, int frames)
+{
+    int i;
+    uint8 nal[64*1024];
+
+    for (i = 0; i < frames; i++)
+    {
+        BOOL key = (i % 25 == 0);
+        int len = key ? 40*1024 : 4*1024;
+        uint32 ts = i * 3600;
+        uint8 * p = nal + nal_hdr;
+        int left = len - nal_hdr;
+        uint8 fu[3];
+
+        bench_random(p_bs, nal, len);
+
+        if (nal_hdr == 1)
+        {
+            nal[0] = key ? 0x65 : 0x41;
+            fu[0] = (nal[0] & 0xE0) | 28;
+            fu[1] = nal[0] & 0x1F;
+        }
+        else
+        {
+            nal[0] = key ? (19 << 1) : (1 << 1);
+            nal[1] = 0x01;
+            fu[0] = (nal[0] & 0x81) | (49 << 1);
+            fu[1] = nal[1];
+            fu[2] = (nal[0] >> 1) & 0x3F;
+        }
+
+        while (left > 0)
+        {
+            int n = left > BENCH_MTU ? BENCH_MTU : left;
+            uint8 * p_fu = &fu[nal_hdr];
+            uint8 type = *p_fu & 0x3F;
+
+            *p_fu = type;
+            if (p == nal + nal_hdr)
+            {
+                *p_fu |= 0x80;
+            }
+            if (n == left)
+            {
+                *p_fu |= 0x40;
+            }
+
+            bench_put(p_bs, ts, n == left, fu, nal_hdr + 1, p, n);
+
+            p += n;
+            left -= n;
+        }
+    }
+}
+
+/**
+ * RFC 2435 JPEG, 640x480 Q 50 type 1, 20KB scans
+ */
+static void bench_make_jpeg(BSTREAM * p_bs, int frames)
+{
+    int i, len = 20*1024;
+    uint8 scan[20*1024];
+    uint8 hdr[8];
+
+    for (i = 0; i < frames; i++)
+    {
+        int off = 0;
+
+        bench_random(p_bs, scan, len);
+
+        while (off < len)
+        {
+            int n = len - off > BENCH_MTU ? BENCH_MTU : len - off;
+
+            hdr[0] = 0;
+            hdr[1] = (uint8)(off >> 16);
+            hdr[2] = (uint8)(off >> 8);
+            hdr[3] = (uint8)(off);
+            hdr[4] = 1;
+            hdr[5] = 50;
+            hdr[6] = 640 / 8;
+            hdr[7] = 480 / 8;
+
+            bench_put(p_bs, i * 3600, off + n == len, hdr, 8, scan + off, n);
+
+            off += n;
+        }
+    }
+}
+
+/**
+ * MPEG-4 part 2, 8KB VOPs starting with a start code
+ */
+static void bench_make_mp4v(BSTREAM * p_bs, int frames)
+{
+    int i, len = 8*1024;
+    uint8 vop[8*1024];
+
+    for (i = 0; i < frames; i++)
+    {
+        int off = 0;
+
+        bench_random(p_bs, vop, len);
+        memcpy(vop, "\x00\x00\x01\xB6", 4);
+
+        while (off < len)
+        {
+            int n = len - off > BENCH_MTU ? BENCH_MTU : len - off;
+
+            bench_put(p_bs, i * 3600, off + n == len, NULL, 0, vop + off, n);
+
+            off += n;
+        }
+    }
+}
+
+/**
+ * RFC 3640 AAC-hbr, sizelength 13, indexlength 3, one 300 bytes AU per packet
+ */
+static void bench_make_aac(BSTREAM * p_bs, int frames)
+{
+    int i, len = 300;
+    uint8 au[300];
+    uint8 hdr[4];
+
+    for (i = 0; i < frames; i++)
+    {
+        bench_random(p_bs, au, len);
+
+        hdr[0] = 0;
+        hdr[1] = 16;
+        hdr[2] = (uint8)(len >> 5);
+        hdr[3] = (uint8)((len & 0x1F) << 3);
+
+        bench_put(p_bs, i * 1024, TRUE, hdr, 4, au, len);
+    }
+}
+
+/**
+ * G.711, 20ms packets
+ */
+static void bench_make_pcm(BSTREAM * p_bs, int frames)
+{
+    int i;
+    uint8 pcm[160];
+
+    for (i = 0; i < frames; i++)
+    {
+        bench_random(p_bs, pcm, sizeof(pcm));
+        bench_put(p_bs, i * 160, TRUE, NULL, 0, pcm, sizeof(pcm));
+    }
+}
+
+/**
+ * Load the RTP packets of an rtpdump file (rtptools format)
+ */
+static BOOL bench_load_rtpdump(BSTREAM * p_bs, const char * file)
+{
+    char line[256];
+    uint8 rd[16];
+    uint8 pkt[BENCH_PKT_MAX];
+    FILE * fp = fopen(file, "rb");
+
+    if (NULL == fp)
+    {
+        printf("open %s failed\r\n", file);
+        return FALSE;
+    }
+
+    if (NULL == fgets(line, sizeof(line), fp) || strncmp(line, "#!rtpplay1.0", 12) ||
+        fread(rd, 1, 16, fp) != 16)
+    {
+        printf("%s is not an rtpdump file\r\n", file);
+        fclose(fp);
+        return FALSE;
+    }
+
+    while (fread(rd, 1, 8, fp) == 8)
+    {
+        int len = (rd[0] << 8) | rd[1];
+        int plen = (rd[2] << 8) | rd[3];
+
+        len -= 8;
+        if (len <= 0 || len > BENCH_PKT_MAX || fread(pkt, 1, len, fp) != (size_t)len)
+        {
+            break;
+        }
+
+        // plen 0 - rtcp
+        if (plen == 0 || len < 12 || p_bs->cnt >= p_bs->max || p_bs->len + len > BENCH_STREAM_MAX)
+        {
+            continue;
+        }
+
+        memcpy(p_bs->p_buf + p_bs->len, pkt, len);
+        p_bs->p_off[p_bs->cnt] = p_bs->len;
+        p_bs->p_len[p_bs->cnt] = len;
+        p_bs->len += len;
+        p_bs->cnt++;
+    }
+
+    fclose(fp);
+
+    return p_bs->cnt > 0;
+}
+
+/***************************************************************************************/
+
+static int bench_frame_cb(uint8 * p_data, int len, uint32 ts, uint32 seq, void * p_userdata)
+{
+    BSTAT * p_stat = (BSTAT *)p_userdata;
+
+    p_stat->frames++;
+    p_stat->bytes += len;
+
+    return 0;
+}
+
+static int bench_iov_cb(RTPFRMIOV * p_frm, uint32 ts, uint32 seq, void * p_userdata)
+{
+    BSTAT * p_stat = (BSTAT *)p_userdata;
+
+    p_stat->frames++;
+    p_stat->bytes += p_frm->len;
+
+    return 0;
+}
+
+typedef union
+{
+    H264RXI     h264;
+    H265RXI     h265;
+    MJPEGRXI    mjpeg;
+    MPEG4RXI    mpeg4;
+    AACRXI      aac;
+    PCMRXI      pcm;
+} BRXI;
+
+enum
+{
+    BENCH_H264 = 0,
+    BENCH_H264_IOV,
+    BENCH_H265,
+    BENCH_H265_IOV,
+    BENCH_JPEG,
+    BENCH_MP4V,
+    BENCH_AAC,
+    BENCH_PCM,
+    BENCH_CODEC_NUM
+};
+
+static const char * bench_names[BENCH_CODEC_NUM] = 
+{
+    "h264", "h264-iov", "h265", "h265-iov", "jpeg", "mp4v", "aac", "pcm"
+};
+
+static void bench_rx_init(BRXI * p_rxi, int codec, BSTAT * p_stat)
+{
+    switch (codec)
+    {
+    case BENCH_H264:
+    case BENCH_H264_IOV:
+        h264_rxi_init(&p_rxi->h264, bench_frame_cb, p_stat);
+        if (codec == BENCH_H264_IOV)
+        {
+            h264_rxi_set_iov(&p_rxi->h264, bench_iov_cb);
+        }
+        break;
+
+    case BENCH_H265:
+    case BENCH_H265_IOV:
+        h265_rxi_init(&p_rxi->h265, bench_frame_cb, p_stat);
+        if (codec == BENCH_H265_IOV)
+        {
+            h265_rxi_set_iov(&p_rxi->h265, bench_iov_cb);
+        }
+        break;
+
+    case BENCH_JPEG:
+        mjpeg_rxi_init(&p_rxi->mjpeg, bench_frame_cb, p_stat);
+        break;
+
+    case BENCH_MP4V:
+        mpeg4_rxi_init(&p_rxi->mpeg4, bench_frame_cb, p_stat);
+        break;
+
+    case BENCH_AAC:
+        aac_rxi_init(&p_rxi->aac, bench_frame_cb, p_stat);
+        p_rxi->aac.size_length = 13;
+        p_rxi->aac.index_length = 3;
+        p_rxi->aac.index_delta_length = 3;
+        break;
+
+    case BENCH_PCM:
+        pcm_rxi_init(&p_rxi->pcm, bench_frame_cb, p_stat);
+        break;
+    }
+}
+
+static void bench_rx_deinit(BRXI * p_rxi, int codec)
+{
+    switch (codec)
+    {
+    case BENCH_H264:
+    case BENCH_H264_IOV:
+        h264_rxi_deinit(&p_rxi->h264);
+        break;
+
+    case BENCH_H265:
+    case BENCH_H265_IOV:
+        h265_rxi_deinit(&p_rxi->h265);
+        break;
+
+    case BENCH_JPEG:
+        mjpeg_rxi_deinit(&p_rxi->mjpeg);
+        break;
+
+    case BENCH_MP4V:
+        mpeg4_rxi_deinit(&p_rxi->mpeg4);
+        break;
+
+    case BENCH_AAC:
+        aac_rxi_deinit(&p_rxi->aac);
+        break;
+
+    case BENCH_PCM:
+        pcm_rxi_deinit(&p_rxi->pcm);
+        break;
+    }
+}
+
+/**
+ * Feed one packet the way the rtsp client does, the packet is received
+ * into the socket buffer (the receivers rewrite the payload headers in 
+ * place), or into a reference counted packet buffer in the zero copy modes
+ */
+static void bench_rx(BRXI * p_rxi, int codec, uint8 * p_data, int len)
+{
+    RTPPKTBUF * p_pkt;
+    static uint8 rx_buf[BENCH_PKT_MAX];
+
+    if (codec != BENCH_H264_IOV && codec != BENCH_H265_IOV)
+    {
+        memcpy(rx_buf, p_data, len);
+        p_data = rx_buf;
+    }
+
+    switch (codec)
+    {
+    case BENCH_H264:
+        h264_rtp_rx(&p_rxi->h264, p_data, len);
+        break;
+
+    case BENCH_H265:
+        h265_rtp_rx(&p_rxi->h265, p_data, len);
+        break;
+
+    case BENCH_H264_IOV:
+    case BENCH_H265_IOV:
+        p_pkt = rtp_pkt_buf_dup(p_data, len);
+        if (p_pkt)
+        {
+            if (codec == BENCH_H264_IOV)
+            {
+                h264_rtp_rx_pkt(&p_rxi->h264, p_pkt, p_pkt->data, p_pkt->len);
+            }
+            else
+            {
+                h265_rtp_rx_pkt(&p_rxi->h265, p_pkt, p_pkt->data, p_pkt->len);
+            }
+
+            rtp_pkt_buf_unref(p_pkt);
+        }
+        break;
+
+    case BENCH_JPEG:
+        mjpeg_rtp_rx(&p_rxi->mjpeg, p_data, len);
+        break;
+
+    case BENCH_MP4V:
+        mpeg4_rtp_rx(&p_rxi->mpeg4, p_data, len);
+        break;
+
+    case BENCH_AAC:
+        aac_rtp_rx(&p_rxi->aac, p_data, len);
+        break;
+
+    case BENCH_PCM:
+        pcm_rtp_rx(&p_rxi->pcm, p_data, len);
+        break;
+    }
+}
+
+static void bench_run(int codec, BSTREAM * p_bs)
+{
+    int r, i;
+    uint32 allocs;
+    double t;
+    BSTAT stat;
+    static BRXI rxi;
+
+    memset(&stat, 0, sizeof(stat));
+
+    bench_rx_init(&rxi, codec, &stat);
+
+    // warm up, the buffers grow to the steady state size
+    for (i = 0; i < p_bs->cnt; i++)
+    {
+        bench_rx(&rxi, codec, p_bs->p_buf + p_bs->p_off[i], p_bs->p_len[i]);
+    }
+
+    memset(&stat, 0, sizeof(stat));
+
+    allocs = BENCH_ALLOCS();
+    t = bench_ns();
+
+    for (r = 0; r < BENCH_REPEAT; r++)
+    {
+        for (i = 0; i < p_bs->cnt; i++)
+        {
+            bench_rx(&rxi, codec, p_bs->p_buf + p_bs->p_off[i], p_bs->p_len[i]);
+        }
+    }
+
+    t = bench_ns() - t;
+    allocs = BENCH_ALLOCS() - allocs;
+
+    printf("%-9s %7d pkts %7u frames %9.2f Mpkt/s %8.2f MB/s %6.3f allocs/pkt\r\n", 
+        bench_names[codec], p_bs->cnt, stat.frames / BENCH_REPEAT,
+        (double)p_bs->cnt * BENCH_REPEAT * 1e3 / t, (double)p_bs->len * BENCH_REPEAT * 1e3 / t,
+        (double)allocs / ((double)p_bs->cnt * BENCH_REPEAT));
+
+    bench_rx_deinit(&rxi, codec);
+}
+
+int main(int argc, char * argv[])
+{
+    int codec;
+    BSTREAM bs;
+
+    frm_buf_init(4*1024*1024);
+    rtp_pkt_buf_init(256);
+
+    if (argc > 2)
+    {
+        // captured stream of one codec
+        for (codec = 0; codec < BENCH_CODEC_NUM; codec++)
+        {
+            if (strcasecmp(argv[1], bench_names[codec]) == 0)
+            {
+                break;
+            }
+        }
+
+        if (codec == BENCH_CODEC_NUM || !bench_stream_init(&bs))
+        {
+            printf("unknown codec %s\r\n", argv[1]);
+            return -1;
+        }
+
+        if (!bench_load_rtpdump(&bs, argv[2]))
+        {
+            return -1;
+        }
+
+        bench_run(codec, &bs);
+        bench_stream_free(&bs);
+
+        return 0;
+    }
+
+    for (codec = 0; codec < BENCH_CODEC_NUM; codec++)
+    {
+        if (!bench_stream_init(&bs))
+        {
+            return -1;
+        }
+
+        switch (codec)
+        {
+        case BENCH_H264:
+        case BENCH_H264_IOV:
+            bench_make_avc(&bs, 1, 250);
+            break;
+
+        case BENCH_H265:
+        case BENCH_H265_IOV:
+            bench_make_avc(&bs, 2, 250);
+            break;
+
+        case BENCH_JPEG:
+            bench_make_jpeg(&bs, 250);
+            break;
+
+        case BENCH_MP4V:
+            bench_make_mp4v(&bs, 250);
+            break;
+
+        case BENCH_AAC:
+            bench_make_aac(&bs, 5000);
+            break;
+
+        case BENCH_PCM:
+            bench_make_pcm(&bs, 5000);
+            break;
+        }
+
+        bench_run(codec, &bs);
+        bench_stream_free(&bs);
+    }
+
+    rtp_pkt_buf_deinit();
+    frm_buf_deinit();
+
+    return 0;
+}
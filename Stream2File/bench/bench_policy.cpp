@@ -0,0 +1,136 @@
+/***************************************************************************************
+ *
+ *  IMPORTANT: READ BEFORE DOWNLOADING, COPYING, INSTALLING OR USING.
+ *
+ *  By downloading, copying, installing or using the software you agree to this license.
+ *  If you do not agree to this license, do not download, install, 
+ *  copy or use the software.
+ *
+ *  Copyright (C) 2014-2020, Happytimesoft Corporation, all rights reserved.
+ *
+ *  Redistribution and use in binary forms, with or without modification, are permitted.
+ *
+ *  Unless required by applicable law or agreed to in writing, software distributed 
+ *  under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ *  CONDITIONS OF ANY KIND, either express or implied. See the License for the specific
+ *  language governing permissions and limitations under the License.
+ *
+****************************************************************************************/
+
+
+/**
+ * Per frame cost of the segment switch checks, 
+ * the legacy ftell + time(NULL) check against each policy of r2f_policy
+ *
+ * make bench_policy && ./bench_policy [frames]
+ */
+
+#include "sys_inc.h"
+#include "r2f_policy.h"
+
+#define BENCH_GOP           50          // frames per GOP
+#define BENCH_FRM_LEN       20000       // bytes per frame
+
+static double bench_ns()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void bench_legacy(uint32 frames)
+{
+    uint32 i, hits = 0;
+    time_t start = time(NULL);
+    FILE * fp = tmpfile();
+    double t;
+
+    if (NULL == fp)
+    {
+        return;
+    }
+
+    t = bench_ns();
+
+    for (i = 0; i < frames; i++)
+    {
+        uint64 tlen = ftello(fp);
+
+        if (tlen > (uint64)100 * 1024 * 1024 || time(NULL) - start > 3600)
+        {
+            hits++;
+        }
+    }
+
+    t = bench_ns() - t;
+
+    printf("%-16s %8.2f ns/frame (%u)\r\n", "ftell+time", t / frames, hits);
+
+    fclose(fp);
+}
+
+static void bench_policy(const char * name, R2FPOLICY * p_pol, uint32 frames)
+{
+    uint32 i, hits = 0;
+    R2FPOLSTATE st;
+    double t;
+
+    memset(&st, 0, sizeof(st));
+    r2f_policy_start(&st, p_pol);
+
+    t = bench_ns();
+
+    for (i = 0; i < frames; i++)
+    {
+        BOOL key = (i % BENCH_GOP) == 0;
+
+        if (key && r2f_policy_key(&st))
+        {
+            hits++;
+            r2f_policy_start(&st, p_pol);
+        }
+
+        r2f_policy_frame(&st, BENCH_FRM_LEN, key);
+    }
+
+    t = bench_ns() - t;
+
+    printf("%-16s %8.2f ns/frame (%u segments)\r\n", name, t / frames, hits);
+}
+
+int main(int argc, char * argv[])
+{
+    R2FPOLICY pol;
+    uint32 frames = 10000000;
+
+    if (argc > 1)
+    {
+        frames = atoi(argv[1]);
+    }
+
+    bench_legacy(frames);
+
+    r2f_policy_set(&pol, 100 * 1024, 0, 0, 0, FALSE);
+    bench_policy("size", &pol, frames);
+
+    r2f_policy_set(&pol, 0, 3600, 0, 0, FALSE);
+    bench_policy("time", &pol, frames);
+
+    r2f_policy_set(&pol, 0, 0, 3600, 0, FALSE);
+    bench_policy("wall", &pol, frames);
+
+    r2f_policy_set(&pol, 0, 0, 0, 60, FALSE);
+    bench_policy("gop", &pol, frames);
+
+    r2f_policy_set(&pol, 100 * 1024, 0, 0, 0, TRUE);
+    bench_policy("bitrate", &pol, frames);
+
+    r2f_policy_set(&pol, 100 * 1024, 3600, 3600, 60, TRUE);
+    bench_policy("all", &pol, frames);
+
+    return 0;
+}
+
+
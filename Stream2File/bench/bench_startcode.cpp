@@ -0,0 +1,215 @@
+/***************************************************************************************
+ *
+ *  IMPORTANT: READ BEFORE DOWNLOADING, COPYING, INSTALLING OR USING.
+ *
+ *  By downloading, copying, installing or using the software you agree to this license.
+ *  If you do not agree to this license, do not download, install, 
+ *  copy or use the software.
+ *
+ *  Copyright (C) 2014-2020, Happytimesoft Corporation, all rights reserved.
+ *
+ *  Redistribution and use in binary forms, with or without modification, are permitted.
+ *
+ *  Unless required by applicable law or agreed to in writing, software distributed 
+ *  under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ *  CONDITIONS OF ANY KIND, either express or implied. See the License for the specific
+ *  language governing permissions and limitations under the License.
+ *
+****************************************************************************************/
+
+
+
+/**
+ * Start code scan throughput, the legacy byte by byte avc_split_nalu
+ * against the scalar, SSE2 and AVX2 kernels of avc_find_startcode
+ *
+ * make bench_startcode && ./bench_startcode [nal_kb] [mb]
+ */
+
+#include "sys_inc.h"
+#include "media_util.h"
+
+#define BENCH_REPEAT        20
+
+static double bench_ns()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/**
+ * The avc_split_nalu before the kernels, a 4 byte compare at every offset
+ */
+static uint8 * bench_split_legacy(uint8 * e_buf, int e_len, int * s_len, int * d_len)
+{
+    int e_i = 4;
+    uint32 tmp_w;
+    uint32 split_w1 = 0x01000000;
+
+    *d_len = 0;
+
+    memcpy(&tmp_w, e_buf, 4);
+
+    if (tmp_w == split_w1)
+    {
+        *s_len = 4;
+    }
+    else
+    {
+        return NULL;
+    }
+
+    while (e_i < e_len)
+    {
+        if (e_i >= (e_len-4))
+        {
+            e_i = e_len;
+            break;
+        }
+
+        memcpy(&tmp_w, e_buf+e_i, 4);
+
+        if (tmp_w == split_w1)
+        {
+            break;
+        }
+
+        e_i++;
+    }
+
+    *d_len = e_i;
+
+    if (e_i >= e_len)
+    {
+        return NULL;
+    }
+
+    return (e_buf+e_i);
+}
+
+/**
+ * Random payload with the emulation prevention applied, no start code 
+ * inside a nal unit, every nal_len bytes a 4 (or 3) byte start code
+ */
+static void bench_fill(uint8 * p_buf, int len, int nal_len, int sc_len)
+{
+    int i, zeros = 0;
+    uint32 seed = 12345;
+
+    for (i = 0; i < len; i++)
+    {
+        uint8 b;
+
+        if (i % nal_len == 0 && i + sc_len < len)
+        {
+            memcpy(p_buf + i, sc_len == 4 ? "\x00\x00\x00\x01" : "\x00\x00\x01", sc_len);
+            i += sc_len;
+            p_buf[i] = 0x65;
+            zeros = 0;
+            continue;
+        }
+
+        seed = seed * 1103515245 + 12345;
+        b = (uint8)(seed >> 16);
+
+        // compressed data has about as many zero bytes as the other values
+        if (zeros >= 2 && b <= 3)
+        {
+            b = 3;
+        }
+
+        zeros = (b == 0) ? zeros + 1 : 0;
+        p_buf[i] = b;
+    }
+}
+
+typedef uint8 * (*split_fn)(uint8 * e_buf, int e_len, int * s_len, int * d_len);
+
+static int bench_run(const char * name, split_fn split, uint8 * p_buf, int len)
+{
+    int r, nals = 0, s_len, n_len;
+    double t = bench_ns();
+
+    for (r = 0; r < BENCH_REPEAT; r++)
+    {
+        int parse_len = len;
+        uint8 * p_cur = p_buf;
+
+        nals = 0;
+
+        while (p_cur)
+        {
+            uint8 * p_next = split(p_cur, parse_len, &s_len, &n_len);
+            if (n_len <= 0)
+            {
+                break;
+            }
+
+            nals++;
+            parse_len -= n_len;
+            p_cur = p_next;
+        }
+    }
+
+    t = bench_ns() - t;
+
+    printf("%-12s %8d nals %8.2f GB/s\r\n", name, nals, (double)len * BENCH_REPEAT / t);
+
+    return nals;
+}
+
+int main(int argc, char * argv[])
+{
+    int nal_len = (argc > 1 ? atoi(argv[1]) : 64) * 1024;
+    int len = (argc > 2 ? atoi(argv[2]) : 4) * 1024 * 1024;
+    int sc, ref = 0, nals;
+    uint8 * p_buf = (uint8 *)malloc(len);
+
+    if (NULL == p_buf || nal_len <= 0)
+    {
+        return -1;
+    }
+
+    for (sc = 4; sc >= 3; sc--)
+    {
+        printf("%d MB, %d KB nal units, %d byte start codes\r\n", len >> 20, nal_len >> 10, sc);
+
+        bench_fill(p_buf, len, nal_len, sc);
+
+        if (sc == 4)
+        {
+            ref = bench_run("legacy", bench_split_legacy, p_buf, len);
+        }
+        else
+        {
+            ref = (len + nal_len - 1) / nal_len;
+        }
+
+        avc_startcode_select(STARTCODE_C);
+        nals = bench_run("scalar", avc_split_nalu, p_buf, len);
+
+        if (avc_startcode_select(STARTCODE_SSE2) == STARTCODE_SSE2)
+        {
+            nals += bench_run("sse2", avc_split_nalu, p_buf, len) - ref;
+        }
+
+        if (avc_startcode_select(STARTCODE_AVX2) == STARTCODE_AVX2)
+        {
+            nals += bench_run("avx2", avc_split_nalu, p_buf, len) - ref;
+        }
+
+        if (nals != ref)
+        {
+            printf("nal count mismatch\r\n");
+            return -1;
+        }
+    }
+
+    free(p_buf);
+
+    return 0;
+}
+
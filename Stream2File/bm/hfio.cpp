@@ -0,0 +1,1357 @@
+/***************************************************************************************
+ *
+ *  IMPORTANT: READ BEFORE DOWNLOADING, COPYING, INSTALLING OR USING.
+ *
+ *  By downloading, copying, installing or using the software you agree to this license.
+ *  If you do not agree to this license, do not download, install, 
+ *  copy or use the software.
+ *
+ *  Copyright (C) 2014-2020, Happytimesoft Corporation, all rights reserved.
+ *
+ *  Redistribution and use in binary forms, with or without modification, are permitted.
+ *
+ *  Unless required by applicable law or agreed to in writing, software distributed 
+ *  under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ *  CONDITIONS OF ANY KIND, either express or implied. See the License for the specific
+ *  language governing permissions and limitations under the License.
+ *
+****************************************************************************************/
+
+#include "sys_inc.h"
+#include "hfio.h"
+
+#if __LINUX_OS__
+#include <sys/sendfile.h>
+#endif
+
+#if __LINUX_OS__ && defined(IO_URING)
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#endif
+
+#if __WINDOWS_OS__
+#define hfio_atomic_inc(p)  InterlockedIncrement((LONG volatile *)(p))
+#define hfio_atomic_dec(p)  InterlockedDecrement((LONG volatile *)(p))
+#else
+#define hfio_atomic_inc(p)  __sync_add_and_fetch(p, 1)
+#define hfio_atomic_dec(p)  __sync_sub_and_fetch(p, 1)
+#endif
+
+/***********************************************************/
+
+typedef struct
+{
+    int         backend;                // backend of the new files
+    BOOL        direct;                 // open the block descriptors with O_DIRECT
+    int         buf_size;               // stdio buffer / block size
+
+    void      * pool_mutex;
+    char      * pool_buf;               // pooled block buffers, one allocation
+    HFIOBLK   * pool_blks;
+    HFIOBLK   * pool_free;              // free list
+    int         pool_cnt;
+
+#if __LINUX_OS__ && defined(IO_URING)
+    int         ring_fd;
+    BOOL        registered;             // the pooled buffers are registered
+    void      * sq_mutex;
+    pthread_t   cq_tid;                 // completion thread
+    volatile BOOL cq_run;
+
+    uint8     * sq_ptr;
+    uint8     * cq_ptr;
+    size_t      sq_size;
+    size_t      cq_size;
+    uint32    * sq_head;
+    uint32    * sq_tail;
+    uint32    * sq_mask;
+    uint32    * sq_entries;
+    uint32    * sq_array;
+    struct io_uring_sqe * sqes;
+    size_t      sqes_size;
+    uint32    * cq_head;
+    uint32    * cq_tail;
+    uint32    * cq_mask;
+    struct io_uring_cqe * cqes;
+#endif
+} HFIOCTX;
+
+static HFIOCTX g_hfio = {HFIO_STDIO, FALSE, HFIO_BUF_DEF};
+
+/***********************************************************/
+
+static char * hfio_buf_alloc(int size)
+{
+#if __WINDOWS_OS__
+    return (char *)_aligned_malloc(size, HFIO_BLK_ALIGN);
+#else
+    void * p_buf = NULL;
+
+    if (posix_memalign(&p_buf, HFIO_BLK_ALIGN, size) != 0)
+    {
+        return NULL;
+    }
+
+    return (char *)p_buf;
+#endif
+}
+
+static void hfio_buf_free(char * p_buf)
+{
+#if __WINDOWS_OS__
+    _aligned_free(p_buf);
+#else
+    free(p_buf);
+#endif
+}
+
+#if __LINUX_OS__
+
+/**
+ * Take a block from the pool, a new one is allocated when the pool is exhausted
+ */
+static HFIOBLK * hfio_blk_get()
+{
+    HFIOBLK * p_blk = NULL;
+
+    if (g_hfio.pool_mutex)
+    {
+        sys_os_mutex_enter(g_hfio.pool_mutex);
+        
+        p_blk = g_hfio.pool_free;
+        if (p_blk)
+        {
+            g_hfio.pool_free = p_blk->next;
+        }
+        
+        sys_os_mutex_leave(g_hfio.pool_mutex);
+    }
+
+    if (NULL == p_blk)
+    {
+        p_blk = (HFIOBLK *)malloc(sizeof(HFIOBLK));
+        if (NULL == p_blk)
+        {
+            return NULL;
+        }
+
+        p_blk->buf = hfio_buf_alloc(g_hfio.buf_size);
+        if (NULL == p_blk->buf)
+        {
+            free(p_blk);
+            return NULL;
+        }
+
+        p_blk->index = -1;
+    }
+
+    p_blk->next = NULL;
+    p_blk->file = NULL;
+    p_blk->len = 0;
+    p_blk->off = 0;
+
+    return p_blk;
+}
+
+static void hfio_blk_put(HFIOBLK * p_blk)
+{
+    if (p_blk->index < 0)
+    {
+        hfio_buf_free(p_blk->buf);
+        free(p_blk);
+        return;
+    }
+
+    sys_os_mutex_enter(g_hfio.pool_mutex);
+    
+    p_blk->next = g_hfio.pool_free;
+    g_hfio.pool_free = p_blk;
+    
+    sys_os_mutex_leave(g_hfio.pool_mutex);
+}
+
+static int hfio_pwrite_(int fd, const char * p_data, int len, int64 off)
+{
+    int wlen = 0;
+
+    while (wlen < len)
+    {
+        ssize_t ret = pwrite(fd, p_data + wlen, len - wlen, off + wlen);
+        if (ret < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+
+            log_print(HT_LOG_ERR, "%s, pwrite failed, err[%d] [%s]\r\n", __FUNCTION__, errno, strerror(errno));
+            return -1;
+        }
+
+        wlen += ret;
+    }
+
+    return wlen;
+}
+
+static int hfio_pread_(int fd, char * p_data, int len, int64 off)
+{
+    int rlen = 0;
+
+    while (rlen < len)
+    {
+        ssize_t ret = pread(fd, p_data + rlen, len - rlen, off + rlen);
+        if (ret < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        else if (ret <= 0)
+        {
+            log_print(HT_LOG_ERR, "%s, pread failed, err[%d] [%s]\r\n", __FUNCTION__, errno, strerror(errno));
+            return -1;
+        }
+
+        rlen += ret;
+    }
+
+    return rlen;
+}
+
+/**
+ * Copy a file range in the kernel, copy_file_range first, then sendfile, 
+ * and through a buffer at last
+ */
+static int hfio_copy_range(int in_fd, int64 in_off, int out_fd, int64 out_off, int64 len)
+{
+    int64 done = 0;
+
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 27))
+    while (done < len)
+    {
+        loff_t i_off = in_off + done;
+        loff_t o_off = out_off + done;
+        
+        ssize_t ret = copy_file_range(in_fd, &i_off, out_fd, &o_off, (size_t)(len - done), 0);
+        if (ret < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        else if (ret <= 0)
+        {
+            // EXDEV, ENOSYS or EINVAL, not supported by the file systems
+            break;
+        }
+
+        done += ret;
+    }
+#endif
+
+    if (done < len && lseek(out_fd, out_off + done, SEEK_SET) >= 0)
+    {
+        while (done < len)
+        {
+            off_t i_off = in_off + done;
+            
+            ssize_t ret = sendfile(out_fd, in_fd, &i_off, (size_t)(len - done));
+            if (ret < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            else if (ret <= 0)
+            {
+                break;
+            }
+
+            done += ret;
+        }
+    }
+
+    if (done < len)
+    {
+        char * p_buf = (char *)malloc(HFIO_BLK_ALIGN * 16);
+        if (NULL == p_buf)
+        {
+            return -1;
+        }
+
+        while (done < len)
+        {
+            int n = (int)((len - done) < HFIO_BLK_ALIGN * 16 ? (len - done) : HFIO_BLK_ALIGN * 16);
+
+            if (hfio_pread_(in_fd, p_buf, n, in_off + done) < 0 || 
+                hfio_pwrite_(out_fd, p_buf, n, out_off + done) < 0)
+            {
+                break;
+            }
+
+            done += n;
+        }
+
+        free(p_buf);
+    }
+
+    return done == len ? 0 : -1;
+}
+
+static void hfio_blk_done(HFIOBLK * p_blk, int res)
+{
+    HFIO * p_file = p_blk->file;
+
+    if (res != p_blk->len)
+    {
+        log_print(HT_LOG_ERR, "%s, block write failed, off %lld, len %d, res %d\r\n", 
+            __FUNCTION__, p_blk->off, p_blk->len, res);
+            
+        p_file->err_flag = 1;
+    }
+
+    hfio_blk_put(p_blk);
+
+    // the file may be closed right after the decrement
+    sys_os_sig_sign(p_file->p_sig);
+    hfio_atomic_dec(&p_file->inflight);
+}
+
+#endif // __LINUX_OS__
+
+/***********************************************************/
+
+#if __LINUX_OS__ && defined(IO_URING)
+
+static int hfio_uring_setup(uint32 entries, struct io_uring_params * p)
+{
+    return (int) syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int hfio_uring_enter(int fd, uint32 to_submit, uint32 min_complete, uint32 flags)
+{
+    return (int) syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static int hfio_uring_register(int fd, uint32 opcode, void * arg, uint32 nr_args)
+{
+    return (int) syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+/**
+ * Reap the completions of all files, one io_uring_enter returns a batch
+ */
+static void * hfio_cq_thread(void * argv)
+{
+    uint32 head, tail;
+
+    while (g_hfio.cq_run)
+    {
+        if (hfio_uring_enter(g_hfio.ring_fd, 0, 1, IORING_ENTER_GETEVENTS) < 0 && errno != EINTR)
+        {
+            log_print(HT_LOG_ERR, "%s, io_uring_enter failed, err[%d]\r\n", __FUNCTION__, errno);
+            usleep(1000);
+        }
+
+        head = *g_hfio.cq_head;
+        tail = __atomic_load_n(g_hfio.cq_tail, __ATOMIC_ACQUIRE);
+
+        while (head != tail)
+        {
+            struct io_uring_cqe * p_cqe = &g_hfio.cqes[head & *g_hfio.cq_mask];
+            HFIOBLK * p_blk = (HFIOBLK *)(uintptr_t)p_cqe->user_data;
+            
+            if (p_blk)
+            {
+                hfio_blk_done(p_blk, p_cqe->res);
+            }
+
+            head++;
+        }
+
+        __atomic_store_n(g_hfio.cq_head, head, __ATOMIC_RELEASE);
+    }
+
+    g_hfio.cq_tid = 0;
+
+    log_print(HT_LOG_INFO, "%s, exit\r\n", __FUNCTION__);
+
+    return NULL;
+}
+
+/**
+ * Queue one write, or a wake up nop when p_blk is NULL
+ */
+static int hfio_uring_submit(HFIOBLK * p_blk)
+{
+    int ret;
+    uint32 head, tail, idx;
+    struct io_uring_sqe * p_sqe;
+
+    sys_os_mutex_enter(g_hfio.sq_mutex);
+
+    head = __atomic_load_n(g_hfio.sq_head, __ATOMIC_ACQUIRE);
+    tail = *g_hfio.sq_tail;
+
+    if (tail - head >= *g_hfio.sq_entries)
+    {
+        sys_os_mutex_leave(g_hfio.sq_mutex);
+        return -1;
+    }
+
+    idx = tail & *g_hfio.sq_mask;
+    p_sqe = &g_hfio.sqes[idx];
+
+    memset(p_sqe, 0, sizeof(struct io_uring_sqe));
+
+    if (NULL == p_blk)
+    {
+        p_sqe->opcode = IORING_OP_NOP;
+    }
+    else if (p_blk->index >= 0 && g_hfio.registered)
+    {
+        p_sqe->opcode = IORING_OP_WRITE_FIXED;
+        p_sqe->fd = p_blk->file->fd;
+        p_sqe->addr = (uint64)(uintptr_t)p_blk->buf;
+        p_sqe->len = p_blk->len;
+        p_sqe->off = p_blk->off;
+        p_sqe->buf_index = p_blk->index;
+    }
+    else
+    {
+        p_blk->iov.iov_base = p_blk->buf;
+        p_blk->iov.iov_len = p_blk->len;
+        
+        p_sqe->opcode = IORING_OP_WRITEV;
+        p_sqe->fd = p_blk->file->fd;
+        p_sqe->addr = (uint64)(uintptr_t)&p_blk->iov;
+        p_sqe->len = 1;
+        p_sqe->off = p_blk->off;
+    }
+
+    p_sqe->user_data = (uint64)(uintptr_t)p_blk;
+
+    g_hfio.sq_array[idx] = idx;
+    __atomic_store_n(g_hfio.sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+    while ((ret = hfio_uring_enter(g_hfio.ring_fd, 1, 0, 0)) < 0)
+    {
+        if (errno != EINTR && errno != EAGAIN && errno != EBUSY)
+        {
+            log_print(HT_LOG_ERR, "%s, io_uring_enter failed, err[%d]\r\n", __FUNCTION__, errno);
+            break;
+        }
+
+        usleep(1000);
+    }
+
+    if (ret < 0)
+    {
+        // take the entry back unless the kernel consumed it, the caller writes the block
+        if (__atomic_load_n(g_hfio.sq_head, __ATOMIC_ACQUIRE) != tail + 1)
+        {
+            __atomic_store_n(g_hfio.sq_tail, tail, __ATOMIC_RELEASE);
+
+            sys_os_mutex_leave(g_hfio.sq_mutex);
+            return -1;
+        }
+    }
+
+    sys_os_mutex_leave(g_hfio.sq_mutex);
+
+    return 0;
+}
+
+static BOOL hfio_uring_init()
+{
+    struct io_uring_params params;
+
+    memset(&params, 0, sizeof(params));
+
+    g_hfio.ring_fd = hfio_uring_setup(HFIO_URING_DEPTH, &params);
+    if (g_hfio.ring_fd < 0)
+    {
+        log_print(HT_LOG_WARN, "%s, io_uring_setup failed, err[%d]\r\n", __FUNCTION__, errno);
+        return FALSE;
+    }
+
+    g_hfio.sq_size = params.sq_off.array + params.sq_entries * sizeof(uint32);
+    g_hfio.cq_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        if (g_hfio.cq_size > g_hfio.sq_size)
+        {
+            g_hfio.sq_size = g_hfio.cq_size;
+        }
+        
+        g_hfio.cq_size = g_hfio.sq_size;
+    }
+
+    g_hfio.sq_ptr = (uint8 *)mmap(NULL, g_hfio.sq_size, PROT_READ | PROT_WRITE, 
+        MAP_SHARED | MAP_POPULATE, g_hfio.ring_fd, IORING_OFF_SQ_RING);
+    if (MAP_FAILED == g_hfio.sq_ptr)
+    {
+        goto FAILED;
+    }
+
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        g_hfio.cq_ptr = g_hfio.sq_ptr;
+    }
+    else
+    {
+        g_hfio.cq_ptr = (uint8 *)mmap(NULL, g_hfio.cq_size, PROT_READ | PROT_WRITE, 
+            MAP_SHARED | MAP_POPULATE, g_hfio.ring_fd, IORING_OFF_CQ_RING);
+        if (MAP_FAILED == g_hfio.cq_ptr)
+        {
+            g_hfio.cq_ptr = NULL;
+            goto FAILED;
+        }
+    }
+
+    g_hfio.sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    g_hfio.sqes = (struct io_uring_sqe *)mmap(NULL, g_hfio.sqes_size, PROT_READ | PROT_WRITE, 
+        MAP_SHARED | MAP_POPULATE, g_hfio.ring_fd, IORING_OFF_SQES);
+    if (MAP_FAILED == (void *)g_hfio.sqes)
+    {
+        g_hfio.sqes = NULL;
+        goto FAILED;
+    }
+
+    g_hfio.sq_head = (uint32 *)(g_hfio.sq_ptr + params.sq_off.head);
+    g_hfio.sq_tail = (uint32 *)(g_hfio.sq_ptr + params.sq_off.tail);
+    g_hfio.sq_mask = (uint32 *)(g_hfio.sq_ptr + params.sq_off.ring_mask);
+    g_hfio.sq_entries = (uint32 *)(g_hfio.sq_ptr + params.sq_off.ring_entries);
+    g_hfio.sq_array = (uint32 *)(g_hfio.sq_ptr + params.sq_off.array);
+    g_hfio.cq_head = (uint32 *)(g_hfio.cq_ptr + params.cq_off.head);
+    g_hfio.cq_tail = (uint32 *)(g_hfio.cq_ptr + params.cq_off.tail);
+    g_hfio.cq_mask = (uint32 *)(g_hfio.cq_ptr + params.cq_off.ring_mask);
+    g_hfio.cqes = (struct io_uring_cqe *)(g_hfio.cq_ptr + params.cq_off.cqes);
+
+    // registered buffers save the page pinning of every write
+    if (g_hfio.pool_cnt > 0)
+    {
+        int i;
+        HFIOV * p_iov = (HFIOV *)malloc(g_hfio.pool_cnt * sizeof(HFIOV));
+        
+        if (p_iov)
+        {
+            for (i = 0; i < g_hfio.pool_cnt; i++)
+            {
+                p_iov[i].iov_base = g_hfio.pool_blks[i].buf;
+                p_iov[i].iov_len = g_hfio.buf_size;
+            }
+
+            if (hfio_uring_register(g_hfio.ring_fd, IORING_REGISTER_BUFFERS, p_iov, g_hfio.pool_cnt) == 0)
+            {
+                g_hfio.registered = TRUE;
+            }
+            else
+            {
+                log_print(HT_LOG_WARN, "%s, register buffers failed, err[%d]\r\n", __FUNCTION__, errno);
+            }
+
+            free(p_iov);
+        }
+    }
+
+    g_hfio.sq_mutex = sys_os_create_mutex();
+    g_hfio.cq_run = TRUE;
+    g_hfio.cq_tid = sys_os_create_thread((void *)hfio_cq_thread, NULL);
+    if (g_hfio.cq_tid == 0)
+    {
+        g_hfio.cq_run = FALSE;
+        sys_os_destroy_sig_mutex(g_hfio.sq_mutex);
+        g_hfio.sq_mutex = NULL;
+        goto FAILED;
+    }
+
+    log_print(HT_LOG_INFO, "%s, sq entries %u, cq entries %u, registered buffers %d\r\n", 
+        __FUNCTION__, params.sq_entries, params.cq_entries, g_hfio.registered ? g_hfio.pool_cnt : 0);
+
+    return TRUE;
+
+FAILED:
+
+    log_print(HT_LOG_WARN, "%s, io_uring mmap failed, err[%d]\r\n", __FUNCTION__, errno);
+
+    if (g_hfio.sqes)
+    {
+        munmap(g_hfio.sqes, g_hfio.sqes_size);
+        g_hfio.sqes = NULL;
+    }
+
+    if (g_hfio.cq_ptr && g_hfio.cq_ptr != g_hfio.sq_ptr)
+    {
+        munmap(g_hfio.cq_ptr, g_hfio.cq_size);
+    }
+
+    if (g_hfio.sq_ptr && MAP_FAILED != g_hfio.sq_ptr)
+    {
+        munmap(g_hfio.sq_ptr, g_hfio.sq_size);
+    }
+
+    g_hfio.sq_ptr = g_hfio.cq_ptr = NULL;
+    g_hfio.registered = FALSE;
+
+    close(g_hfio.ring_fd);
+    g_hfio.ring_fd = -1;
+
+    return FALSE;
+}
+
+static void hfio_uring_deinit()
+{
+    g_hfio.cq_run = FALSE;
+    
+    // wake up the completion thread
+    hfio_uring_submit(NULL);
+
+    while (g_hfio.cq_tid)
+    {
+        usleep(10*1000);
+    }
+
+    munmap(g_hfio.sqes, g_hfio.sqes_size);
+
+    if (g_hfio.cq_ptr != g_hfio.sq_ptr)
+    {
+        munmap(g_hfio.cq_ptr, g_hfio.cq_size);
+    }
+
+    munmap(g_hfio.sq_ptr, g_hfio.sq_size);
+
+    // the buffers are unregistered when the ring is closed
+    close(g_hfio.ring_fd);
+
+    sys_os_destroy_sig_mutex(g_hfio.sq_mutex);
+
+    g_hfio.sq_mutex = NULL;
+    g_hfio.sqes = NULL;
+    g_hfio.sq_ptr = g_hfio.cq_ptr = NULL;
+    g_hfio.registered = FALSE;
+    g_hfio.ring_fd = -1;
+}
+
+#endif // IO_URING
+
+/***********************************************************/
+
+#if __LINUX_OS__
+
+static void hfio_wait(HFIO * p_file)
+{
+    while (p_file->inflight > 0)
+    {
+        sys_os_sig_wait_timeout(p_file->p_sig, 10);
+    }
+}
+
+/**
+ * Write the full block, it is handed over and released by the backend
+ */
+static int hfio_submit(HFIO * p_file, HFIOBLK * p_blk)
+{
+    int ret;
+    
+    p_blk->file = p_file;
+
+#ifdef IO_URING
+    if (HFIO_URING == p_file->backend)
+    {
+        while (p_file->inflight >= HFIO_FILE_BLKS)
+        {
+            sys_os_sig_wait_timeout(p_file->p_sig, 10);
+        }
+
+        hfio_atomic_inc(&p_file->inflight);
+        
+        if (hfio_uring_submit(p_blk) == 0)
+        {
+            return 0;
+        }
+
+        // the submission queue is full or failed, write it here
+        hfio_atomic_dec(&p_file->inflight);
+    }
+#endif
+
+    ret = hfio_pwrite_(p_file->fd, p_blk->buf, p_blk->len, p_blk->off);
+
+    hfio_blk_put(p_blk);
+
+    if (ret < 0)
+    {
+        p_file->err_flag = 1;
+    }
+
+    return ret < 0 ? -1 : 0;
+}
+
+/**
+ * Write the filled part of the current block through the buffered descriptor,
+ * the block stays in memory and is written again when it is full
+ */
+static int hfio_flush_tail(HFIO * p_file)
+{
+    HFIOBLK * p_blk = p_file->cur;
+
+    if (NULL == p_blk || p_blk->len <= p_file->tail_done)
+    {
+        return 0;
+    }
+
+    if (hfio_pwrite_(p_file->bfd, p_blk->buf + p_file->tail_done, p_blk->len - p_file->tail_done, 
+            p_blk->off + p_file->tail_done) < 0)
+    {
+        p_file->err_flag = 1;
+        return -1;
+    }
+
+    p_file->tail_done = p_blk->len;
+
+    return 0;
+}
+
+/**
+ * Overwrite the data before the end of the file (the headers),
+ * the part in the current block is patched in memory
+ */
+static int hfio_overwrite(HFIO * p_file, const char * p_data, int len)
+{
+    int64 cut = p_file->cur ? p_file->cur->off : p_file->end;
+
+    if (p_file->pos < cut)
+    {
+        int n = (int)((cut - p_file->pos) < len ? (cut - p_file->pos) : len);
+
+        // the blocks in flight may cover the range
+        hfio_wait(p_file);
+
+        if (hfio_pwrite_(p_file->bfd, p_data, n, p_file->pos) < 0)
+        {
+            p_file->err_flag = 1;
+            return -1;
+        }
+
+        p_file->pos += n;
+        p_data += n;
+        len -= n;
+    }
+
+    if (len > 0)
+    {
+        int off = (int)(p_file->pos - p_file->cur->off);
+        
+        memcpy(p_file->cur->buf + off, p_data, len);
+
+        if (p_file->tail_done > off)
+        {
+            p_file->tail_done = off;
+        }
+
+        p_file->pos += len;
+    }
+
+    return 0;
+}
+
+static int hfio_blk_write(HFIO * p_file, const char * p_data, int len)
+{
+    int n, wlen = len;
+
+    if (p_file->err_flag)
+    {
+        return -1;
+    }
+
+    if (p_file->pos < p_file->end)
+    {
+        n = (int)((p_file->end - p_file->pos) < len ? (p_file->end - p_file->pos) : len);
+
+        if (hfio_overwrite(p_file, p_data, n) < 0)
+        {
+            return -1;
+        }
+
+        p_data += n;
+        len -= n;
+    }
+
+    while (len > 0)
+    {
+        if (NULL == p_file->cur)
+        {
+            p_file->cur = hfio_blk_get();
+            if (NULL == p_file->cur)
+            {
+                log_print(HT_LOG_ERR, "%s, get block failed\r\n", __FUNCTION__);
+                return -1;
+            }
+
+            // only full blocks are submitted, the end is block aligned here
+            p_file->cur->off = p_file->end;
+            p_file->tail_done = 0;
+        }
+
+        n = g_hfio.buf_size - p_file->cur->len;
+        if (n > len)
+        {
+            n = len;
+        }
+
+        memcpy(p_file->cur->buf + p_file->cur->len, p_data, n);
+
+        p_file->cur->len += n;
+        p_file->pos += n;
+        p_file->end += n;
+        p_data += n;
+        len -= n;
+
+        if (p_file->cur->len == g_hfio.buf_size)
+        {
+            HFIOBLK * p_blk = p_file->cur;
+
+            p_file->cur = NULL;
+            
+            if (hfio_submit(p_file, p_blk) < 0)
+            {
+                return -1;
+            }
+        }
+    }
+
+    return wlen;
+}
+
+/**
+ * Complete the current block from the source file, copy the whole blocks in the kernel, 
+ * and load the rest into a new current block, the blocks stay aligned
+ */
+static int64 hfio_blk_splice(HFIO * p_file, int fd, int64 off, int64 len)
+{
+    int64 n, wlen = len;
+
+    if (p_file->err_flag)
+    {
+        return -1;
+    }
+
+    p_file->pos = p_file->end;
+
+    if (p_file->cur)
+    {
+        n = g_hfio.buf_size - p_file->cur->len;
+        if (n > len)
+        {
+            n = len;
+        }
+
+        if (hfio_pread_(fd, p_file->cur->buf + p_file->cur->len, (int)n, off) < 0)
+        {
+            return -1;
+        }
+
+        p_file->cur->len += (int)n;
+        p_file->pos += n;
+        p_file->end += n;
+        off += n;
+        len -= n;
+
+        if (p_file->cur->len == g_hfio.buf_size)
+        {
+            HFIOBLK * p_blk = p_file->cur;
+
+            p_file->cur = NULL;
+            
+            if (hfio_submit(p_file, p_blk) < 0)
+            {
+                return -1;
+            }
+        }
+    }
+
+    n = len - len % g_hfio.buf_size;
+    if (n > 0)
+    {
+        if (hfio_copy_range(fd, off, p_file->bfd, p_file->end, n) < 0)
+        {
+            log_print(HT_LOG_ERR, "%s, copy range failed, err[%d]\r\n", __FUNCTION__, errno);
+            p_file->err_flag = 1;
+            return -1;
+        }
+
+        p_file->pos += n;
+        p_file->end += n;
+        off += n;
+        len -= n;
+    }
+
+    if (len > 0)
+    {
+        p_file->cur = hfio_blk_get();
+        if (NULL == p_file->cur)
+        {
+            log_print(HT_LOG_ERR, "%s, get block failed\r\n", __FUNCTION__);
+            return -1;
+        }
+
+        p_file->cur->off = p_file->end;
+        p_file->tail_done = 0;
+
+        if (hfio_pread_(fd, p_file->cur->buf, (int)len, off) < 0)
+        {
+            return -1;
+        }
+
+        p_file->cur->len = (int)len;
+        p_file->pos += len;
+        p_file->end += len;
+    }
+
+    return wlen;
+}
+
+#endif // __LINUX_OS__
+
+/***********************************************************/
+
+HT_API BOOL hfio_init(int backend, BOOL direct, int buf_size, int blocks)
+{
+    int i;
+
+    if (buf_size > 0)
+    {
+        // whole aligned blocks
+        g_hfio.buf_size = (buf_size + HFIO_BLK_ALIGN - 1) & ~(HFIO_BLK_ALIGN - 1);
+    }
+
+    g_hfio.direct = direct;
+    g_hfio.backend = HFIO_STDIO;
+
+#if __LINUX_OS__
+    if (HFIO_STDIO == backend)
+    {
+        return TRUE;
+    }
+
+    if (blocks < 0)
+    {
+        blocks = 0;
+    }
+
+    if (blocks > 0)
+    {
+        g_hfio.pool_blks = (HFIOBLK *)calloc(blocks, sizeof(HFIOBLK));
+        g_hfio.pool_buf = hfio_buf_alloc(blocks * g_hfio.buf_size);
+        
+        if (NULL == g_hfio.pool_blks || NULL == g_hfio.pool_buf)
+        {
+            log_print(HT_LOG_ERR, "%s, alloc block pool failed, blocks %d\r\n", __FUNCTION__, blocks);
+
+            if (g_hfio.pool_blks)
+            {
+                free(g_hfio.pool_blks);
+                g_hfio.pool_blks = NULL;
+            }
+
+            if (g_hfio.pool_buf)
+            {
+                hfio_buf_free(g_hfio.pool_buf);
+                g_hfio.pool_buf = NULL;
+            }
+            
+            blocks = 0;
+        }
+    }
+
+    for (i = 0; i < blocks; i++)
+    {
+        g_hfio.pool_blks[i].buf = g_hfio.pool_buf + i * g_hfio.buf_size;
+        g_hfio.pool_blks[i].index = i;
+        g_hfio.pool_blks[i].next = (i + 1 < blocks) ? &g_hfio.pool_blks[i+1] : NULL;
+    }
+
+    g_hfio.pool_cnt = blocks;
+    g_hfio.pool_free = blocks > 0 ? g_hfio.pool_blks : NULL;
+    g_hfio.pool_mutex = sys_os_create_mutex();
+    g_hfio.backend = HFIO_PWRITE;
+
+#ifdef IO_URING
+    if (HFIO_URING == backend)
+    {
+        if (hfio_uring_init())
+        {
+            g_hfio.backend = HFIO_URING;
+        }
+        else
+        {
+            log_print(HT_LOG_WARN, "%s, io_uring not available, use pwrite\r\n", __FUNCTION__);
+        }
+    }
+#endif
+
+    log_print(HT_LOG_INFO, "%s, backend %d, direct %d, block size %d, blocks %d\r\n", 
+        __FUNCTION__, g_hfio.backend, g_hfio.direct, g_hfio.buf_size, g_hfio.pool_cnt);
+#endif
+
+    return TRUE;
+}
+
+HT_API void hfio_deinit()
+{
+#if __LINUX_OS__
+#ifdef IO_URING
+    if (HFIO_URING == g_hfio.backend)
+    {
+        hfio_uring_deinit();
+    }
+#endif
+
+    if (g_hfio.pool_mutex)
+    {
+        sys_os_destroy_sig_mutex(g_hfio.pool_mutex);
+        g_hfio.pool_mutex = NULL;
+    }
+
+    if (g_hfio.pool_buf)
+    {
+        hfio_buf_free(g_hfio.pool_buf);
+        g_hfio.pool_buf = NULL;
+    }
+
+    if (g_hfio.pool_blks)
+    {
+        free(g_hfio.pool_blks);
+        g_hfio.pool_blks = NULL;
+    }
+
+    g_hfio.pool_free = NULL;
+    g_hfio.pool_cnt = 0;
+#endif
+
+    g_hfio.backend = HFIO_STDIO;
+}
+
+HT_API int hfio_backend()
+{
+    return g_hfio.backend;
+}
+
+HT_API HFIO * hfio_open(const char * filename)
+{
+    HFIO * p_file = (HFIO *)malloc(sizeof(HFIO));
+    if (NULL == p_file)
+    {
+        return NULL;
+    }
+
+    memset(p_file, 0, sizeof(HFIO));
+
+    p_file->backend = g_hfio.backend;
+    p_file->fd = -1;
+    p_file->bfd = -1;
+
+#if __LINUX_OS__
+    if (HFIO_STDIO != p_file->backend)
+    {
+        int flags = O_WRONLY | O_CREAT | O_TRUNC;
+        
+        if (g_hfio.direct)
+        {
+            p_file->fd = open(filename, flags | O_DIRECT, 0644);
+            if (p_file->fd < 0)
+            {
+                log_print(HT_LOG_WARN, "%s, O_DIRECT open [%s] failed, err[%d]\r\n", __FUNCTION__, filename, errno);
+            }
+            else
+            {
+                p_file->direct_flag = 1;
+                p_file->bfd = open(filename, O_WRONLY);
+            }
+        }
+
+        if (p_file->fd < 0)
+        {
+            p_file->fd = open(filename, flags, 0644);
+            p_file->bfd = p_file->fd;
+        }
+
+        if (p_file->fd < 0 || p_file->bfd < 0)
+        {
+            log_print(HT_LOG_ERR, "%s, open [%s] failed, err[%d]\r\n", __FUNCTION__, filename, errno);
+            goto FAILED;
+        }
+
+        p_file->p_sig = sys_os_create_sig();
+
+        return p_file;
+    }
+#endif
+
+    p_file->fp = fopen(filename, "wb+");
+    if (NULL == p_file->fp)
+    {
+        log_print(HT_LOG_ERR, "%s, fopen [%s] failed\r\n", __FUNCTION__, filename);
+        goto FAILED;
+    }
+
+    // the writes are coalesced in the aligned buffer
+    p_file->sbuf = hfio_buf_alloc(g_hfio.buf_size);
+    if (p_file->sbuf)
+    {
+        setvbuf(p_file->fp, p_file->sbuf, _IOFBF, g_hfio.buf_size);
+    }
+
+    return p_file;
+
+FAILED:
+
+#if __LINUX_OS__
+    if (p_file->bfd >= 0 && p_file->bfd != p_file->fd)
+    {
+        close(p_file->bfd);
+    }
+
+    if (p_file->fd >= 0)
+    {
+        close(p_file->fd);
+    }
+#endif
+
+    free(p_file);
+
+    return NULL;
+}
+
+HT_API void hfio_close(HFIO * p_file)
+{
+    if (NULL == p_file)
+    {
+        return;
+    }
+
+    if (p_file->fp)
+    {
+        fclose(p_file->fp);
+
+        // after fclose, the stream no longer uses it
+        if (p_file->sbuf)
+        {
+            hfio_buf_free(p_file->sbuf);
+        }
+    }
+#if __LINUX_OS__
+    else
+    {
+        hfio_flush_tail(p_file);
+        hfio_wait(p_file);
+
+        if (p_file->cur)
+        {
+            hfio_blk_put(p_file->cur);
+        }
+
+        if (p_file->bfd != p_file->fd)
+        {
+            close(p_file->bfd);
+        }
+
+        close(p_file->fd);
+
+        sys_os_destroy_sig_mutex(p_file->p_sig);
+    }
+#endif
+
+    free(p_file);
+}
+
+HT_API int hfio_write(HFIO * p_file, const void * p_data, int len)
+{
+    if (p_file->fp)
+    {
+        return fwrite(p_data, len, 1, p_file->fp) == 1 ? len : -1;
+    }
+
+#if __LINUX_OS__
+    return hfio_blk_write(p_file, (const char *)p_data, len);
+#else
+    return -1;
+#endif
+}
+
+HT_API int hfio_writev(HFIO * p_file, HFIOV * p_iov, int cnt)
+{
+    int i, len = 0;
+
+    for (i = 0; i < cnt; i++)
+    {
+        len += p_iov[i].iov_len;
+    }
+
+#if __LINUX_OS__
+    if (p_file->fp && len >= g_hfio.buf_size / 2)
+    {
+        int64 pos;
+        int fd = fileno(p_file->fp);
+
+        // the buffered data first, then the slices with one system call
+        fflush(p_file->fp);
+
+        pos = ftell(p_file->fp);
+
+        while (cnt > 0)
+        {
+            ssize_t wlen = writev(fd, p_iov, cnt > IOV_MAX ? IOV_MAX : cnt);
+            if (wlen < 0)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                
+                return -1;
+            }
+
+            // skip the written slices, adjust the partially written one
+            while (cnt > 0 && wlen >= (ssize_t)p_iov->iov_len)
+            {
+                wlen -= p_iov->iov_len;
+                p_iov++;
+                cnt--;
+            }
+
+            if (cnt > 0 && wlen > 0)
+            {
+                p_iov->iov_base = (char *)p_iov->iov_base + wlen;
+                p_iov->iov_len -= wlen;
+            }
+        }
+
+        // the file position of the stream follows the descriptor
+        fseek(p_file->fp, pos + len, SEEK_SET);
+
+        return len;
+    }
+#endif
+
+    for (i = 0; i < cnt; i++)
+    {
+        if (hfio_write(p_file, p_iov[i].iov_base, p_iov[i].iov_len) < 0)
+        {
+            return -1;
+        }
+    }
+
+    return len;
+}
+
+HT_API int64 hfio_splice(HFIO * p_file, int fd, int64 off, int64 len)
+{
+#if __LINUX_OS__
+    if (p_file->fp)
+    {
+        int64 pos;
+
+        // the buffered data first, then the range behind it
+        if (fflush(p_file->fp) != 0 || fseeko(p_file->fp, 0, SEEK_END) < 0)
+        {
+            return -1;
+        }
+
+        pos = ftello(p_file->fp);
+
+        if (hfio_copy_range(fd, off, fileno(p_file->fp), pos, len) < 0)
+        {
+            log_print(HT_LOG_ERR, "%s, copy range failed, err[%d]\r\n", __FUNCTION__, errno);
+            return -1;
+        }
+
+        // the file position of the stream follows the descriptor
+        fseeko(p_file->fp, pos + len, SEEK_SET);
+
+        return len;
+    }
+
+    return hfio_blk_splice(p_file, fd, off, len);
+#else
+    return -1;
+#endif
+}
+
+HT_API int64 hfio_tell(HFIO * p_file)
+{
+    if (p_file->fp)
+    {
+#if __WINDOWS_OS__
+        return _ftelli64(p_file->fp);
+#else
+        return ftello(p_file->fp);
+#endif
+    }
+
+    return p_file->pos;
+}
+
+HT_API int hfio_seek(HFIO * p_file, int64 off, int whence)
+{
+    if (p_file->fp)
+    {
+#if __WINDOWS_OS__
+        return _fseeki64(p_file->fp, off, whence);
+#else
+        return fseeko(p_file->fp, (off_t)off, whence);
+#endif
+    }
+
+    if (SEEK_END == whence)
+    {
+        off += p_file->end;
+    }
+    else if (SEEK_CUR == whence)
+    {
+        off += p_file->pos;
+    }
+
+    if (off < 0 || off > p_file->end)
+    {
+        return -1;
+    }
+
+    p_file->pos = off;
+
+    return 0;
+}
+
+HT_API int hfio_flush(HFIO * p_file)
+{
+    if (p_file->fp)
+    {
+        return fflush(p_file->fp);
+    }
+
+#if __LINUX_OS__
+    return hfio_flush_tail(p_file);
+#else
+    return -1;
+#endif
+}
+
+HT_API int hfio_sync(HFIO * p_file)
+{
+    if (hfio_flush(p_file) < 0)
+    {
+        return -1;
+    }
+
+#if __WINDOWS_OS__
+    return _commit(_fileno(p_file->fp));
+#else
+    if (p_file->fp)
+    {
+        return fdatasync(fileno(p_file->fp));
+    }
+
+    hfio_wait(p_file);
+
+    return fdatasync(p_file->fd);
+#endif
+}
+
+
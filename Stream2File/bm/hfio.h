@@ -0,0 +1,135 @@
+/***************************************************************************************
+ *
+ *  IMPORTANT: READ BEFORE DOWNLOADING, COPYING, INSTALLING OR USING.
+ *
+ *  By downloading, copying, installing or using the software you agree to this license.
+ *  If you do not agree to this license, do not download, install, 
+ *  copy or use the software.
+ *
+ *  Copyright (C) 2014-2020, Happytimesoft Corporation, all rights reserved.
+ *
+ *  Redistribution and use in binary forms, with or without modification, are permitted.
+ *
+ *  Unless required by applicable law or agreed to in writing, software distributed 
+ *  under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ *  CONDITIONS OF ANY KIND, either express or implied. See the License for the specific
+ *  language governing permissions and limitations under the License.
+ *
+****************************************************************************************/
+
+#ifndef	HFIO_H
+#define	HFIO_H
+
+
+/***********************************************************/
+#define HFIO_STDIO          0           // buffered stdio stream
+#define HFIO_PWRITE         1           // aligned blocks, written with pwrite
+#define HFIO_URING          2           // aligned blocks, submitted to io_uring
+
+#define HFIO_BLK_ALIGN      4096        // block buffer alignment, also the O_DIRECT unit
+#define HFIO_BUF_DEF        (1024*1024) // default stdio buffer / block size
+#define HFIO_BLKS_DEF       64          // default pooled (registered) blocks
+#define HFIO_FILE_BLKS      4           // max in flight blocks per file
+#define HFIO_URING_DEPTH    1024        // submission queue entries
+
+/***********************************************************/
+#if __LINUX_OS__
+typedef struct iovec HFIOV;
+#else
+typedef struct
+{
+    void      * iov_base;
+    size_t      iov_len;
+} HFIOV;
+#endif
+
+typedef struct hfio_blk
+{
+    struct hfio_blk  * next;            // pool free list
+    struct hfio_file * file;            // owner file while in flight
+    char      * buf;                    // aligned data buffer
+    int         index;                  // registered buffer index, -1 - not pooled
+    int         len;                    // data length
+    int64       off;                    // file offset, block aligned
+    HFIOV       iov;                    // IORING_OP_WRITEV vector of the unregistered blocks
+} HFIOBLK;
+
+typedef struct hfio_file
+{
+    int         backend;                // HFIO_STDIO, HFIO_PWRITE or HFIO_URING
+    uint32      direct_flag : 1;        // fd is opened with O_DIRECT
+    uint32      err_flag    : 1;        // a block write failed
+    uint32      reserved    : 30;
+
+    FILE      * fp;                     // HFIO_STDIO stream
+    char      * sbuf;                   // HFIO_STDIO aligned stream buffer
+    
+    int         fd;                     // block descriptor
+    int         bfd;                    // buffered descriptor for the unaligned updates and the tail, 
+                                        // the same as fd without O_DIRECT
+    HFIOBLK   * cur;                    // block being filled
+    int         tail_done;              // bytes of cur already written through bfd
+    int64       pos;                    // current position
+    int64       end;                    // file length, the buffered data included
+
+    volatile long inflight;             // blocks submitted and not completed
+    void      * p_sig;                  // block completion signal
+} HFIO;
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/***********************************************************/
+
+/**
+ * Select the backend of the files opened afterwards, buf_size is the stdio buffer 
+ * and the block size, blocks is the size of the shared block pool. 
+ * HFIO_URING falls back to HFIO_PWRITE when io_uring is not available, 
+ * the block backends fall back to HFIO_STDIO on the other platforms
+ */
+HT_API BOOL      hfio_init(int backend, BOOL direct, int buf_size, int blocks);
+HT_API void      hfio_deinit();
+HT_API int       hfio_backend();
+
+/**
+ * Create or truncate the file for writing
+ */
+HT_API HFIO    * hfio_open(const char * filename);
+
+/**
+ * Write the buffered data and wait for the blocks in flight, then close the file
+ */
+HT_API void      hfio_close(HFIO * p_file);
+
+/**
+ * Write at the current position, appending or overwriting the written data.
+ * Return len, or -1 on error
+ */
+HT_API int       hfio_write(HFIO * p_file, const void * p_data, int len);
+HT_API int       hfio_writev(HFIO * p_file, HFIOV * p_iov, int cnt);
+
+/**
+ * Append len bytes of the file fd from off at the end of the file, 
+ * copied in the kernel with copy_file_range or sendfile when possible. 
+ * Return len, or -1 on error
+ */
+HT_API int64     hfio_splice(HFIO * p_file, int fd, int64 off, int64 len);
+
+HT_API int64     hfio_tell(HFIO * p_file);
+HT_API int       hfio_seek(HFIO * p_file, int64 off, int whence);
+
+/**
+ * Hand the buffered data to the system, fdatasync it with hfio_sync
+ */
+HT_API int       hfio_flush(HFIO * p_file);
+HT_API int       hfio_sync(HFIO * p_file);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // HFIO_H
+
+
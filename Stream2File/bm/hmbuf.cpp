@@ -0,0 +1,204 @@
+/***************************************************************************************
+ *
+ *  IMPORTANT: READ BEFORE DOWNLOADING, COPYING, INSTALLING OR USING.
+ *
+ *  By downloading, copying, installing or using the software you agree to this license.
+ *  If you do not agree to this license, do not download, install, 
+ *  copy or use the software.
+ *
+ *  Copyright (C) 2014-2020, Happytimesoft Corporation, all rights reserved.
+ *
+ *  Redistribution and use in binary forms, with or without modification, are permitted.
+ *
+ *  Unless required by applicable law or agreed to in writing, software distributed 
+ *  under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ *  CONDITIONS OF ANY KIND, either express or implied. See the License for the specific
+ *  language governing permissions and limitations under the License.
+ *
+****************************************************************************************/
+
+
+#include "sys_inc.h"
+#include "hmbuf.h"
+
+/***********************************************************/
+
+#if __LINUX_OS__
+
+static int hmbuf_grow(HMBUF * p_buf, int64 need)
+{
+    int64 size = p_buf->size;
+    void * p_data;
+
+    while (size < need)
+    {
+        size *= 2;
+    }
+
+    if (ftruncate(p_buf->fd, size) < 0)
+    {
+        log_print(HT_LOG_ERR, "%s, ftruncate [%s] failed, err[%d]\r\n", __FUNCTION__, p_buf->path, errno);
+        return -1;
+    }
+
+    p_data = mremap(p_buf->data, p_buf->size, size, MREMAP_MAYMOVE);
+    if (MAP_FAILED == p_data)
+    {
+        log_print(HT_LOG_ERR, "%s, mremap [%s] failed, err[%d]\r\n", __FUNCTION__, p_buf->path, errno);
+        return -1;
+    }
+
+    p_buf->data = (char *)p_data;
+    p_buf->size = size;
+
+    return 0;
+}
+
+#else
+
+static int hmbuf_grow(HMBUF * p_buf, int64 need)
+{
+    int64 size = p_buf->size;
+    char * p_data;
+
+    while (size < need)
+    {
+        size *= 2;
+    }
+
+    p_data = (char *)realloc(p_buf->data, (size_t)size);
+    if (NULL == p_data)
+    {
+        log_print(HT_LOG_ERR, "%s, realloc failed\r\n", __FUNCTION__);
+        return -1;
+    }
+
+    p_buf->data = p_data;
+    p_buf->size = size;
+
+    return 0;
+}
+
+#endif
+
+/***********************************************************/
+
+HT_API HMBUF * hmbuf_open(const char * filename, int64 size)
+{
+    HMBUF * p_buf = (HMBUF *)malloc(sizeof(HMBUF));
+    if (NULL == p_buf)
+    {
+        return NULL;
+    }
+
+    memset(p_buf, 0, sizeof(HMBUF));
+
+    p_buf->fd = -1;
+    p_buf->size = size > 0 ? size : HMBUF_SIZE_DEF;
+
+    strncpy(p_buf->path, filename, sizeof(p_buf->path) - 1);
+
+#if __LINUX_OS__
+    p_buf->fd = open(filename, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (p_buf->fd < 0)
+    {
+        log_print(HT_LOG_ERR, "%s, open [%s] failed, err[%d]\r\n", __FUNCTION__, filename, errno);
+        goto FAILED;
+    }
+
+    if (ftruncate(p_buf->fd, p_buf->size) < 0)
+    {
+        log_print(HT_LOG_ERR, "%s, ftruncate [%s] failed, err[%d]\r\n", __FUNCTION__, filename, errno);
+        goto FAILED;
+    }
+
+    p_buf->data = (char *)mmap(NULL, p_buf->size, PROT_READ | PROT_WRITE, MAP_SHARED, p_buf->fd, 0);
+    if (MAP_FAILED == (void *)p_buf->data)
+    {
+        log_print(HT_LOG_ERR, "%s, mmap [%s] failed, err[%d]\r\n", __FUNCTION__, filename, errno);
+        p_buf->data = NULL;
+        goto FAILED;
+    }
+#else
+    p_buf->data = (char *)malloc((size_t)p_buf->size);
+    if (NULL == p_buf->data)
+    {
+        goto FAILED;
+    }
+#endif
+
+    return p_buf;
+
+FAILED:
+
+#if __LINUX_OS__
+    if (p_buf->fd >= 0)
+    {
+        close(p_buf->fd);
+        unlink(filename);
+    }
+#endif
+
+    free(p_buf);
+
+    return NULL;
+}
+
+HT_API void hmbuf_close(HMBUF * p_buf, BOOL b_remove)
+{
+    if (NULL == p_buf)
+    {
+        return;
+    }
+
+#if __LINUX_OS__
+    munmap(p_buf->data, p_buf->size);
+
+    if (b_remove)
+    {
+        unlink(p_buf->path);
+    }
+    else if (ftruncate(p_buf->fd, p_buf->len) < 0)
+    {
+        log_print(HT_LOG_WARN, "%s, ftruncate [%s] failed, err[%d]\r\n", __FUNCTION__, p_buf->path, errno);
+    }
+
+    close(p_buf->fd);
+#else
+    free(p_buf->data);
+#endif
+
+    free(p_buf);
+}
+
+HT_API void * hmbuf_append(HMBUF * p_buf, int len)
+{
+    char * p;
+
+    if (p_buf->len + len > p_buf->size)
+    {
+        if (hmbuf_grow(p_buf, p_buf->len + len) < 0)
+        {
+            return NULL;
+        }
+    }
+
+    p = p_buf->data + p_buf->len;
+    p_buf->len += len;
+
+    return p;
+}
+
+HT_API int hmbuf_sync(HMBUF * p_buf, BOOL b_wait)
+{
+#if __LINUX_OS__
+    if (p_buf->len > 0)
+    {
+        return msync(p_buf->data, (size_t)p_buf->len, b_wait ? MS_SYNC : MS_ASYNC);
+    }
+#endif
+
+    return 0;
+}
+
+
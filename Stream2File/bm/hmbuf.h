@@ -0,0 +1,75 @@
+/***************************************************************************************
+ *
+ *  IMPORTANT: READ BEFORE DOWNLOADING, COPYING, INSTALLING OR USING.
+ *
+ *  By downloading, copying, installing or using the software you agree to this license.
+ *  If you do not agree to this license, do not download, install, 
+ *  copy or use the software.
+ *
+ *  Copyright (C) 2014-2020, Happytimesoft Corporation, all rights reserved.
+ *
+ *  Redistribution and use in binary forms, with or without modification, are permitted.
+ *
+ *  Unless required by applicable law or agreed to in writing, software distributed 
+ *  under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ *  CONDITIONS OF ANY KIND, either express or implied. See the License for the specific
+ *  language governing permissions and limitations under the License.
+ *
+****************************************************************************************/
+
+
+#ifndef	HMBUF_H
+#define	HMBUF_H
+
+
+/***********************************************************/
+#define HMBUF_SIZE_DEF      (64*1024)   // default initial size
+
+/***********************************************************/
+typedef struct hmbuf
+{
+    int         fd;                     // backing file, -1 - the data is in the heap
+    char      * data;                   // mapped data
+    int64       len;                    // appended length
+    int64       size;                   // mapped size, doubled when it is full
+    char        path[256];              // backing file path
+} HMBUF;
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/***********************************************************/
+
+/**
+ * Create or truncate the backing file and map size bytes of it, 
+ * the heap is used instead on the platforms without mmap
+ */
+HT_API HMBUF   * hmbuf_open(const char * filename, int64 size);
+
+/**
+ * Unmap and close, the backing file is truncated to the appended length, 
+ * or removed if b_remove is TRUE
+ */
+HT_API void      hmbuf_close(HMBUF * p_buf, BOOL b_remove);
+
+/**
+ * Reserve len bytes at the end and return the address to fill them, 
+ * the mapping grows geometrically, no system call is made until it is full.
+ * Return NULL on error
+ */
+HT_API void    * hmbuf_append(HMBUF * p_buf, int len);
+
+/**
+ * Write the appended data back to the backing file, b_wait to wait for it
+ */
+HT_API int       hmbuf_sync(HMBUF * p_buf, BOOL b_wait);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // HMBUF_H
+
+
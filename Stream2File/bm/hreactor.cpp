@@ -0,0 +1,593 @@
+/***************************************************************************************
+ *
+ *  IMPORTANT: READ BEFORE DOWNLOADING, COPYING, INSTALLING OR USING.
+ *
+ *  By downloading, copying, installing or using the software you agree to this license.
+ *  If you do not agree to this license, do not download, install,
+ *  copy or use the software.
+ *
+ *  Copyright (C) 2014-2020, Happytimesoft Corporation, all rights reserved.
+ *
+ *  Redistribution and use in binary forms, with or without modification, are permitted.
+ *
+ *  Unless required by applicable law or agreed to in writing, software distributed
+ *  under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ *  CONDITIONS OF ANY KIND, either express or implied. See the License for the specific
+ *  language governing permissions and limitations under the License.
+ *
+****************************************************************************************/
+
+#include "sys_inc.h"
+#include "hreactor.h"
+
+#if __LINUX_OS__
+#include <sys/eventfd.h>
+#endif
+
+/***********************************************************/
+
+static HRLOOP   g_hr_loops[HR_MAX_LOOPS];
+static int      g_hr_nloops = 0;
+static BOOL     g_hr_running = FALSE;
+
+/***********************************************************/
+
+#if __LINUX_OS__
+
+static void hr_wakeup(HRLOOP * p_loop)
+{
+    uint64 val = 1;
+
+    if (pthread_equal(pthread_self(), p_loop->tid))
+    {
+        return;
+    }
+
+    if (write(p_loop->wakefd, &val, sizeof(val)) != sizeof(val))
+    {
+        log_print(HT_LOG_WARN, "%s, write eventfd failed\r\n", __FUNCTION__);
+    }
+}
+
+static void hr_ev_link(HREVENT ** p_list, HREVENT * p_ev)
+{
+    p_ev->prev = NULL;
+    p_ev->next = *p_list;
+
+    if (*p_list)
+    {
+        (*p_list)->prev = p_ev;
+    }
+
+    *p_list = p_ev;
+}
+
+static void hr_ev_unlink(HREVENT ** p_list, HREVENT * p_ev)
+{
+    if (p_ev->prev)
+    {
+        p_ev->prev->next = p_ev->next;
+    }
+    else
+    {
+        *p_list = p_ev->next;
+    }
+
+    if (p_ev->next)
+    {
+        p_ev->next->prev = p_ev->prev;
+    }
+
+    p_ev->prev = NULL;
+    p_ev->next = NULL;
+}
+
+/**
+ * Return the epoll_wait timeout, till the nearest timer expires
+ */
+static int hr_next_timeout(HRLOOP * p_loop)
+{
+    int timeout = 1000;
+    uint32 now = sys_os_get_ms();
+    HREVENT * p_ev;
+
+    sys_os_mutex_enter(p_loop->mutex);
+
+    for (p_ev = p_loop->timers; p_ev; p_ev = p_ev->next)
+    {
+        if (!p_ev->armed_flag)
+        {
+            continue;
+        }
+
+        int32 left = (int32)(p_ev->expire - now);
+        if (left <= 0)
+        {
+            timeout = 0;
+            break;
+        }
+        else if (left < timeout)
+        {
+            timeout = left;
+        }
+    }
+
+    sys_os_mutex_leave(p_loop->mutex);
+
+    return timeout;
+}
+
+static void hr_dispatch(HRLOOP * p_loop, HREVENT * p_ev)
+{
+    sys_os_mutex_enter(p_loop->mutex);
+
+    if (p_ev->del_flag)
+    {
+        sys_os_mutex_leave(p_loop->mutex);
+        return;
+    }
+
+    p_loop->cur = p_ev;
+
+    sys_os_mutex_leave(p_loop->mutex);
+
+    if (p_ev->timer_flag)
+    {
+        p_ev->tm_cb(p_ev->arg);
+    }
+    else
+    {
+        p_ev->io_cb(p_ev->fd, p_ev->arg);
+    }
+
+    sys_os_mutex_enter(p_loop->mutex);
+    p_loop->cur = NULL;
+
+    // deleted by the callback or by another thread while it was running
+    if (p_ev->del_flag)
+    {
+        p_ev->next = p_loop->garbage;
+        p_loop->garbage = p_ev;
+    }
+
+    sys_os_mutex_leave(p_loop->mutex);
+}
+
+static void hr_run_timers(HRLOOP * p_loop)
+{
+    uint32 now = sys_os_get_ms();
+    HREVENT * p_ev;
+
+    while (1)
+    {
+        sys_os_mutex_enter(p_loop->mutex);
+
+        for (p_ev = p_loop->timers; p_ev; p_ev = p_ev->next)
+        {
+            if (p_ev->armed_flag && (int32)(p_ev->expire - now) <= 0)
+            {
+                break;
+            }
+        }
+
+        if (NULL == p_ev)
+        {
+            sys_os_mutex_leave(p_loop->mutex);
+            break;
+        }
+
+        if (p_ev->interval > 0)
+        {
+            p_ev->expire = now + p_ev->interval;
+        }
+        else
+        {
+            p_ev->armed_flag = 0;
+        }
+
+        sys_os_mutex_leave(p_loop->mutex);
+
+        hr_dispatch(p_loop, p_ev);
+    }
+}
+
+static void hr_free_garbage(HRLOOP * p_loop)
+{
+    HREVENT * p_ev;
+    HREVENT * p_next;
+
+    sys_os_mutex_enter(p_loop->mutex);
+    p_ev = p_loop->garbage;
+    p_loop->garbage = NULL;
+    sys_os_mutex_leave(p_loop->mutex);
+
+    while (p_ev)
+    {
+        p_next = p_ev->next;
+        free(p_ev);
+        p_ev = p_next;
+    }
+}
+
+static void * hr_loop_thread(void * argv)
+{
+    int i, nfds;
+    uint64 val;
+    HRLOOP * p_loop = (HRLOOP *)argv;
+    struct epoll_event events[HR_MAX_EVENTS];
+
+    p_loop->tid = pthread_self();
+
+    while (g_hr_running)
+    {
+        nfds = epoll_wait(p_loop->epfd, events, HR_MAX_EVENTS, hr_next_timeout(p_loop));
+        if (nfds < 0 && errno != EINTR)
+        {
+            log_print(HT_LOG_ERR, "%s, epoll_wait failed, err = %s\r\n", __FUNCTION__, sys_os_get_socket_error());
+            break;
+        }
+
+        for (i = 0; i < nfds; i++)
+        {
+            HREVENT * p_ev = (HREVENT *)events[i].data.ptr;
+            if (NULL == p_ev)
+            {
+                if (read(p_loop->wakefd, &val, sizeof(val)) < 0)
+                {
+                }
+                continue;
+            }
+
+            hr_dispatch(p_loop, p_ev);
+        }
+
+        hr_run_timers(p_loop);
+
+        hr_free_garbage(p_loop);
+    }
+
+    p_loop->exit_flag = 1;
+
+    log_print(HT_LOG_DBG, "%s, exit\r\n", __FUNCTION__);
+
+    return NULL;
+}
+
+static BOOL hr_loop_init(HRLOOP * p_loop)
+{
+    struct epoll_event ev;
+
+    memset(p_loop, 0, sizeof(HRLOOP));
+
+    p_loop->epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (p_loop->epfd < 0)
+    {
+        log_print(HT_LOG_ERR, "%s, epoll_create1 failed, err = %s\r\n", __FUNCTION__, sys_os_get_socket_error());
+        return FALSE;
+    }
+
+    p_loop->wakefd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (p_loop->wakefd < 0)
+    {
+        log_print(HT_LOG_ERR, "%s, eventfd failed, err = %s\r\n", __FUNCTION__, sys_os_get_socket_error());
+        close(p_loop->epfd);
+        return FALSE;
+    }
+
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.ptr = NULL;
+
+    epoll_ctl(p_loop->epfd, EPOLL_CTL_ADD, p_loop->wakefd, &ev);
+
+    p_loop->mutex = sys_os_create_mutex();
+
+    return TRUE;
+}
+
+static void hr_loop_deinit(HRLOOP * p_loop)
+{
+    HREVENT * p_ev;
+    HREVENT * p_next;
+
+    for (p_ev = p_loop->timers; p_ev; p_ev = p_next)
+    {
+        p_next = p_ev->next;
+        free(p_ev);
+    }
+
+    p_loop->timers = NULL;
+
+    // the sockets are closed by their owners
+    for (p_ev = p_loop->fds; p_ev; p_ev = p_next)
+    {
+        p_next = p_ev->next;
+        free(p_ev);
+    }
+
+    p_loop->fds = NULL;
+
+    hr_free_garbage(p_loop);
+
+    close(p_loop->wakefd);
+    close(p_loop->epfd);
+
+    sys_os_destroy_sig_mutex(p_loop->mutex);
+
+    memset(p_loop, 0, sizeof(HRLOOP));
+}
+
+#endif // __LINUX_OS__
+
+/***********************************************************/
+
+HT_API BOOL hreactor_init(int threads)
+{
+#if __LINUX_OS__
+    int i;
+
+    if (g_hr_running)
+    {
+        return TRUE;
+    }
+
+    if (threads <= 0)
+    {
+        threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    }
+
+    if (threads <= 0)
+    {
+        threads = 1;
+    }
+    else if (threads > HR_MAX_LOOPS)
+    {
+        threads = HR_MAX_LOOPS;
+    }
+
+    for (i = 0; i < threads; i++)
+    {
+        if (!hr_loop_init(&g_hr_loops[i]))
+        {
+            break;
+        }
+    }
+
+    g_hr_nloops = i;
+    if (g_hr_nloops == 0)
+    {
+        return FALSE;
+    }
+
+    g_hr_running = TRUE;
+
+    for (i = 0; i < g_hr_nloops; i++)
+    {
+        g_hr_loops[i].tid = sys_os_create_thread((void *)hr_loop_thread, &g_hr_loops[i]);
+        if (g_hr_loops[i].tid == 0)
+        {
+            g_hr_loops[i].exit_flag = 1;
+        }
+    }
+
+    log_print(HT_LOG_INFO, "%s, %d event loops started\r\n", __FUNCTION__, g_hr_nloops);
+
+    return TRUE;
+#else
+    return FALSE;
+#endif
+}
+
+HT_API void hreactor_deinit()
+{
+#if __LINUX_OS__
+    int i;
+
+    if (!g_hr_running)
+    {
+        return;
+    }
+
+    g_hr_running = FALSE;
+
+    for (i = 0; i < g_hr_nloops; i++)
+    {
+        hr_wakeup(&g_hr_loops[i]);
+    }
+
+    for (i = 0; i < g_hr_nloops; i++)
+    {
+        while (!g_hr_loops[i].exit_flag)
+        {
+            usleep(10*1000);
+        }
+
+        hr_loop_deinit(&g_hr_loops[i]);
+    }
+
+    g_hr_nloops = 0;
+#endif
+}
+
+HT_API HRLOOP * hreactor_get_loop()
+{
+#if __LINUX_OS__
+    int i;
+    HRLOOP * p_loop = NULL;
+
+    if (!g_hr_running)
+    {
+        return NULL;
+    }
+
+    for (i = 0; i < g_hr_nloops; i++)
+    {
+        if (g_hr_loops[i].exit_flag)
+        {
+            continue;
+        }
+
+        if (NULL == p_loop || g_hr_loops[i].nfds < p_loop->nfds)
+        {
+            p_loop = &g_hr_loops[i];
+        }
+    }
+
+    return p_loop;
+#else
+    return NULL;
+#endif
+}
+
+HT_API HREVENT * hreactor_add_fd(HRLOOP * p_loop, SOCKET fd, HRIOCB cb, void * arg)
+{
+#if __LINUX_OS__
+    struct epoll_event ev;
+
+    HREVENT * p_ev = (HREVENT *)malloc(sizeof(HREVENT));
+    if (NULL == p_ev)
+    {
+        return NULL;
+    }
+
+    memset(p_ev, 0, sizeof(HREVENT));
+
+    p_ev->fd = fd;
+    p_ev->io_cb = cb;
+    p_ev->arg = arg;
+    p_ev->loop = p_loop;
+
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.ptr = p_ev;
+
+    sys_os_mutex_enter(p_loop->mutex);
+
+    if (epoll_ctl(p_loop->epfd, EPOLL_CTL_ADD, fd, &ev) < 0)
+    {
+        sys_os_mutex_leave(p_loop->mutex);
+
+        log_print(HT_LOG_ERR, "%s, epoll_ctl fd %d failed, err = %s\r\n", __FUNCTION__, fd, sys_os_get_socket_error());
+        free(p_ev);
+        return NULL;
+    }
+
+    p_loop->nfds++;
+
+    hr_ev_link(&p_loop->fds, p_ev);
+
+    sys_os_mutex_leave(p_loop->mutex);
+
+    return p_ev;
+#else
+    return NULL;
+#endif
+}
+
+HT_API HREVENT * hreactor_add_timer(HRLOOP * p_loop, uint32 ms, BOOL repeat, HRTMCB cb, void * arg)
+{
+#if __LINUX_OS__
+    HREVENT * p_ev = (HREVENT *)malloc(sizeof(HREVENT));
+    if (NULL == p_ev)
+    {
+        return NULL;
+    }
+
+    memset(p_ev, 0, sizeof(HREVENT));
+
+    p_ev->timer_flag = 1;
+    p_ev->armed_flag = 1;
+    p_ev->tm_cb = cb;
+    p_ev->arg = arg;
+    p_ev->loop = p_loop;
+    p_ev->interval = repeat ? ms : 0;
+    p_ev->expire = sys_os_get_ms() + ms;
+
+    sys_os_mutex_enter(p_loop->mutex);
+    hr_ev_link(&p_loop->timers, p_ev);
+    sys_os_mutex_leave(p_loop->mutex);
+
+    hr_wakeup(p_loop);
+
+    return p_ev;
+#else
+    return NULL;
+#endif
+}
+
+HT_API void hreactor_set_timer(HREVENT * p_ev, uint32 ms)
+{
+#if __LINUX_OS__
+    HRLOOP * p_loop = p_ev->loop;
+
+    sys_os_mutex_enter(p_loop->mutex);
+    p_ev->expire = sys_os_get_ms() + ms;
+    p_ev->armed_flag = 1;
+    sys_os_mutex_leave(p_loop->mutex);
+
+    hr_wakeup(p_loop);
+#endif
+}
+
+HT_API void hreactor_del(HREVENT * p_ev)
+{
+#if __LINUX_OS__
+    HRLOOP * p_loop = p_ev->loop;
+
+    sys_os_mutex_enter(p_loop->mutex);
+
+    if (p_ev->del_flag)
+    {
+        sys_os_mutex_leave(p_loop->mutex);
+        return;
+    }
+
+    if (p_ev->timer_flag)
+    {
+        hr_ev_unlink(&p_loop->timers, p_ev);
+    }
+    else
+    {
+        epoll_ctl(p_loop->epfd, EPOLL_CTL_DEL, p_ev->fd, NULL);
+        p_loop->nfds--;
+
+        hr_ev_unlink(&p_loop->fds, p_ev);
+    }
+
+    p_ev->del_flag = 1;
+
+    // the event may be returned by the current epoll_wait, free it later.
+    // The running event is queued by hr_dispatch when its callback returns
+    if (p_loop->cur != p_ev)
+    {
+        p_ev->next = p_loop->garbage;
+        p_loop->garbage = p_ev;
+    }
+
+    sys_os_mutex_leave(p_loop->mutex);
+#endif
+}
+
+HT_API void hreactor_sync(HRLOOP * p_loop, void * arg)
+{
+#if __LINUX_OS__
+    if (pthread_equal(pthread_self(), p_loop->tid))
+    {
+        return;
+    }
+
+    sys_os_mutex_enter(p_loop->mutex);
+
+    while (p_loop->cur && p_loop->cur->arg == arg)
+    {
+        sys_os_mutex_leave(p_loop->mutex);
+        usleep(1000);
+        sys_os_mutex_enter(p_loop->mutex);
+    }
+
+    sys_os_mutex_leave(p_loop->mutex);
+#endif
+}
+
+
+
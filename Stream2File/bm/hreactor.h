@@ -0,0 +1,112 @@
+/***************************************************************************************
+ *
+ *  IMPORTANT: READ BEFORE DOWNLOADING, COPYING, INSTALLING OR USING.
+ *
+ *  By downloading, copying, installing or using the software you agree to this license.
+ *  If you do not agree to this license, do not download, install,
+ *  copy or use the software.
+ *
+ *  Copyright (C) 2014-2020, Happytimesoft Corporation, all rights reserved.
+ *
+ *  Redistribution and use in binary forms, with or without modification, are permitted.
+ *
+ *  Unless required by applicable law or agreed to in writing, software distributed
+ *  under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ *  CONDITIONS OF ANY KIND, either express or implied. See the License for the specific
+ *  language governing permissions and limitations under the License.
+ *
+****************************************************************************************/
+
+#ifndef	HREACTOR_H
+#define	HREACTOR_H
+
+
+/***********************************************************/
+#define HR_MAX_LOOPS        64          // max event loop threads
+#define HR_MAX_EVENTS       64          // max events per epoll_wait
+
+/***********************************************************/
+typedef void (*HRIOCB)(SOCKET fd, void * arg);
+typedef void (*HRTMCB)(void * arg);
+
+typedef struct hr_event
+{
+    uint32      timer_flag  : 1;        // timer event, otherwise socket event
+    uint32      armed_flag  : 1;        // timer is armed
+    uint32      del_flag    : 1;        // event deleted, freed by the loop thread once its callback returns
+    uint32      reserved    : 29;
+
+    SOCKET      fd;                     // socket event fd
+    HRIOCB      io_cb;                  // socket readable callback
+    HRTMCB      tm_cb;                  // timer expire callback
+    void *      arg;                    // callback user argument
+
+    uint32      interval;               // timer interval (ms), 0 - one shot timer
+    uint32      expire;                 // timer expire time, sys_os_get_ms based
+
+    struct hr_loop  * loop;
+    struct hr_event * prev;
+    struct hr_event * next;
+} HREVENT;
+
+typedef struct hr_loop
+{
+    int         epfd;                   // epoll fd
+    int         wakefd;                 // eventfd, wake up epoll_wait
+    pthread_t   tid;                    // loop thread id
+    uint32      exit_flag   : 1;        // loop thread exited
+    uint32      reserved    : 31;
+    uint32      nfds;                   // number of registered sockets
+    void *      mutex;
+
+    HREVENT *   cur;                    // event being dispatched
+    HREVENT *   timers;                 // timer list
+    HREVENT *   fds;                    // socket event list
+    HREVENT *   garbage;                // deleted events
+} HRLOOP;
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/***********************************************************/
+
+/**
+ * Start the event loop threads, threads = 0 means one per core.
+ * Only available on linux, return FALSE on other platforms.
+ */
+HT_API BOOL      hreactor_init(int threads);
+HT_API void      hreactor_deinit();
+
+/**
+ * Get the least loaded event loop, return NULL if the reactor is not running.
+ * All events of one session should be added to the same loop,
+ * so its callbacks never run concurrently.
+ */
+HT_API HRLOOP  * hreactor_get_loop();
+
+HT_API HREVENT * hreactor_add_fd(HRLOOP * p_loop, SOCKET fd, HRIOCB cb, void * arg);
+HT_API HREVENT * hreactor_add_timer(HRLOOP * p_loop, uint32 ms, BOOL repeat, HRTMCB cb, void * arg);
+HT_API void      hreactor_set_timer(HREVENT * p_ev, uint32 ms);
+
+/**
+ * Delete the event, it does not wait for a running callback. The event is freed
+ * by the loop thread after the callback returns, so it is safe to be called from
+ * any callback of any loop. Use hreactor_sync before the callback argument is freed.
+ */
+HT_API void      hreactor_del(HREVENT * p_ev);
+
+/**
+ * Wait for the running callback with the user argument to return
+ */
+HT_API void      hreactor_sync(HRLOOP * p_loop, void * arg);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // HREACTOR_H
+
+
+
@@ -26,6 +26,23 @@ PPSN_CTX * net_buf_fl = NULL;
 
 PPSN_CTX * hdrv_buf_fl = NULL;
 
+typedef struct frm_buf_node
+{
+    struct frm_buf_node * next;
+} FRMBUFN;
+
+typedef struct
+{
+    void      * mutex;
+    int         max_size;               // buffer size cap
+    FRMBUFN   * idle[FRM_BUF_CLASSES];  // idle buffers of each size class
+    int         idle_num[FRM_BUF_CLASSES];
+    uint32      idle_bytes;
+    uint32      used_bytes;
+} FRMBUFPOOL;
+
+static FRMBUFPOOL frm_pool = {NULL, FRM_BUF_MAX_DEF};
+
 
 /***************************************************************************************/
 HT_API BOOL net_buf_init(int num, int size)
@@ -172,6 +189,193 @@ HT_API void hdrv_ctx_free(PPSN_CTX * p_ctx)
 }
 
 
+static int frm_buf_class(int size)
+{
+    int idx = 0;
+    
+    while (idx < FRM_BUF_CLASSES && (FRM_BUF_MIN << idx) < size)
+    {
+        idx++;
+    }
+
+    return idx;
+}
+
+HT_API BOOL frm_buf_init(int max_size)
+{
+    if (frm_pool.mutex)
+    {
+        return TRUE;
+    }
+    
+    frm_pool.mutex = sys_os_create_mutex();
+    if (NULL == frm_pool.mutex)
+    {
+        return FALSE;
+    }
+
+    if (max_size < FRM_BUF_MIN)
+    {
+        max_size = FRM_BUF_MAX_DEF;
+    }
+    else if (max_size > (FRM_BUF_MIN << (FRM_BUF_CLASSES - 1)))
+    {
+        max_size = (FRM_BUF_MIN << (FRM_BUF_CLASSES - 1));
+    }
+    
+    frm_pool.max_size = max_size;
+
+    log_print(HT_LOG_INFO, "%s, max size = %d\r\n", __FUNCTION__, max_size);
+    
+    return TRUE;
+}
+
+HT_API void frm_buf_deinit()
+{
+    int i;
+
+    if (NULL == frm_pool.mutex)
+    {
+        return;
+    }
+    
+    sys_os_mutex_enter(frm_pool.mutex);
+    
+    for (i = 0; i < FRM_BUF_CLASSES; i++)
+    {
+        while (frm_pool.idle[i])
+        {
+            FRMBUFN * p_node = frm_pool.idle[i];
+            frm_pool.idle[i] = p_node->next;
+            free(p_node);
+        }
+
+        frm_pool.idle_num[i] = 0;
+    }
+
+    frm_pool.idle_bytes = 0;
+    
+    sys_os_mutex_leave(frm_pool.mutex);
+
+    sys_os_destroy_sig_mutex(frm_pool.mutex);
+    frm_pool.mutex = NULL;
+}
+
+HT_API uint8 * frm_buf_get(int size, int * p_size)
+{
+    int idx;
+    uint8 * p_buf = NULL;
+
+    if (size > frm_pool.max_size)
+    {
+        return NULL;
+    }
+    
+    idx = frm_buf_class(size);
+    if (idx >= FRM_BUF_CLASSES)
+    {
+        return NULL;
+    }
+
+    if (frm_pool.mutex)
+    {
+        sys_os_mutex_enter(frm_pool.mutex);
+        
+        if (frm_pool.idle[idx])
+        {
+            p_buf = (uint8 *)frm_pool.idle[idx];
+            frm_pool.idle[idx] = frm_pool.idle[idx]->next;
+            frm_pool.idle_num[idx]--;
+            frm_pool.idle_bytes -= (FRM_BUF_MIN << idx);
+        }
+
+        frm_pool.used_bytes += (FRM_BUF_MIN << idx);
+        
+        sys_os_mutex_leave(frm_pool.mutex);
+    }
+
+    if (NULL == p_buf)
+    {
+        p_buf = (uint8 *)malloc(FRM_BUF_MIN << idx);
+        if (NULL == p_buf)
+        {
+            log_print(HT_LOG_ERR, "%s, malloc %d failed\r\n", __FUNCTION__, FRM_BUF_MIN << idx);
+
+            if (frm_pool.mutex)
+            {
+                sys_os_mutex_enter(frm_pool.mutex);
+                frm_pool.used_bytes -= (FRM_BUF_MIN << idx);
+                sys_os_mutex_leave(frm_pool.mutex);
+            }
+            
+            return NULL;
+        }
+    }
+
+    if (p_size)
+    {
+        *p_size = (FRM_BUF_MIN << idx);
+    }
+    
+    return p_buf;
+}
+
+HT_API void frm_buf_free(uint8 * p_buf, int size)
+{
+    int idx;
+    
+    if (NULL == p_buf)
+    {
+        return;
+    }
+
+    idx = frm_buf_class(size);
+    
+    if (NULL == frm_pool.mutex || idx >= FRM_BUF_CLASSES)
+    {
+        free(p_buf);
+        return;
+    }
+
+    sys_os_mutex_enter(frm_pool.mutex);
+
+    frm_pool.used_bytes -= (FRM_BUF_MIN << idx);
+    
+    if (frm_pool.idle_num[idx] < FRM_BUF_IDLE)
+    {
+        FRMBUFN * p_node = (FRMBUFN *)p_buf;
+
+        p_node->next = frm_pool.idle[idx];
+        frm_pool.idle[idx] = p_node;
+        frm_pool.idle_num[idx]++;
+        frm_pool.idle_bytes += (FRM_BUF_MIN << idx);
+
+        p_buf = NULL;
+    }
+    
+    sys_os_mutex_leave(frm_pool.mutex);
+
+    if (p_buf)
+    {
+        free(p_buf);
+    }
+}
+
+HT_API int frm_buf_max_size()
+{
+    return frm_pool.max_size;
+}
+
+HT_API uint32 frm_buf_idle_bytes()
+{
+    return frm_pool.idle_bytes;
+}
+
+HT_API uint32 frm_buf_used_bytes()
+{
+    return frm_pool.used_bytes;
+}
+
 HT_API BOOL sys_buf_init(int nums)
 {
 	if (net_buf_init(nums, 2048) == FALSE)
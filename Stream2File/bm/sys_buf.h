@@ -28,6 +28,11 @@
 #define MAX_NUML			64
 #define MAX_UA_ALT_NUM		8
 
+#define FRM_BUF_MIN         (4*1024)        // smallest frame buffer size class, fits the audio frames
+#define FRM_BUF_CLASSES     14              // size classes, FRM_BUF_MIN << 0 ~ 13 (4K ~ 32M)
+#define FRM_BUF_IDLE        8               // max idle buffers cached per size class
+#define FRM_BUF_MAX_DEF     (8*1024*1024)   // default frame buffer cap
+
 
 /***************************************************************************************/
 typedef struct header_value
@@ -98,6 +103,26 @@ HT_API uint32   hdrv_buf_idle_num();
 HT_API void     hdrv_ctx_ul_init(PPSN_CTX * ul_ctx);
 HT_API void     hdrv_ctx_free(PPSN_CTX * p_ctx);
 
+/***********************************************************************/
+
+/**
+ * Process-wide frame buffer pool, the buffers are power of two size classes
+ * from FRM_BUF_MIN up to the max_size cap, the freed buffers are cached
+ * and shared by all streams. Without frm_buf_init, buffers are allocated
+ * and freed directly
+ */
+HT_API BOOL     frm_buf_init(int max_size);
+HT_API void     frm_buf_deinit();
+
+/**
+ * Get a buffer of at least size bytes, return the actual size class in p_size
+ */
+HT_API uint8  * frm_buf_get(int size, int * p_size);
+HT_API void     frm_buf_free(uint8 * p_buf, int size);
+HT_API int      frm_buf_max_size();
+HT_API uint32   frm_buf_idle_bytes();
+HT_API uint32   frm_buf_used_bytes();
+
 /***********************************************************************/
 HT_API BOOL     sys_buf_init(int nums);
 HT_API void     sys_buf_deinit();
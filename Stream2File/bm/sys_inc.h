@@ -114,6 +114,8 @@ typedef unsigned __int64    uint64;
 #include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/time.h>
+#include <sys/uio.h>
+#include <limits.h>
 #include <ctype.h>
 #include <unistd.h>
 #include <stdarg.h>
@@ -162,6 +164,8 @@ typedef unsigned long long  uint64;
 #include "word_analyse.h"
 #include "sys_buf.h"
 #include "util.h"
+#include "hfio.h"
+#include "hmbuf.h"
 
 
 #ifdef __cplusplus
@@ -183,6 +187,8 @@ HT_API void         sys_os_sig_sign(void * p_sig);
 HT_API pthread_t    sys_os_create_thread(void * thread_func, void * argv);
 
 HT_API uint32       sys_os_get_ms();
+HT_API uint32       sys_os_get_coarse_ms();
+HT_API int64        sys_os_get_us();
 HT_API uint32       sys_os_get_uptime();
 HT_API char       * sys_os_get_socket_error();
 
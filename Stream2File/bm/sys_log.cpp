@@ -20,10 +20,77 @@
 #include "sys_inc.h"
 #include "sys_log.h"
 
+/***************************************************************************************
+ * The messages are formatted on the logging thread into a per thread ring (single
+ * producer, single consumer, no lock), a background thread merges the rings by time
+ * and writes them to the file in batches. A full ring drops the message and counts it
+ * instead of blocking the caller.
+ ***************************************************************************************/
+
+#define LOG_RING_SIZE		(64*1024)		// per thread ring, power of 2
+#define LOG_MSG_MAX			2048			// longer messages are truncated
+#define LOG_BATCH_SIZE		(256*1024)		// writer batch buffer
+#define LOG_FLUSH_MS		100				// writer wake up interval
+#define LOG_PREFIX_LEN		64
+
+#if __WINDOWS_OS__
+#define log_mb()			MemoryBarrier()
+#else
+#define log_mb()			__sync_synchronize()
+#endif
+
+typedef struct
+{
+	uint32		len;						// message length
+	uint32		level;
+	int64		ms;							// wall clock, ms
+} LOGREC;
+
+typedef struct
+{
+	time_t		sec;						// second of str
+	char		str[32];					// "[YYYY-MM-DD HH:MM:SS"
+	int			len;
+} LOGTSC;
+
+typedef struct log_ring
+{
+	struct log_ring * next;
+
+	volatile uint32 head;					// written by the logging thread
+	volatile uint32 tail;					// written by the writer thread
+	volatile uint32 dropped;				// messages dropped, ring full
+	uint32		reported;					// drops already reported in the file
+	volatile int dead;						// the thread exited, freed once drained
+
+	uint8		buf[LOG_RING_SIZE];
+} LOGRING;
+
 /***************************************************************************************/
 static FILE * g_pLogFile  = NULL;
 static void * g_pLogMutex = NULL;
-static int    g_log_level = HT_LOG_ERR;
+HT_API int    g_log_level = HT_LOG_ERR;
+
+static char   g_log_fname[256];
+static uint32 g_log_rotate_size = 0;		// bytes, 0 - no size rotation
+static uint32 g_log_rotate_secs = 0;		// seconds, 0 - no time rotation
+static uint32 g_log_file_size = 0;
+static time_t g_log_file_time = 0;
+
+static LOGRING * volatile g_log_rings = NULL;
+static void * g_log_ring_mutex = NULL;		// ring list changes
+static void * g_log_sig = NULL;
+static volatile int g_log_run = 0;
+static volatile pthread_t g_log_tid = 0;
+static int    g_log_key_init = 0;
+static LOGTSC g_log_tsc_async = {-1};	// used by the writer thread
+static LOGTSC g_log_tsc_sync = {-1};		// used under g_pLogMutex
+
+#if __WINDOWS_OS__
+static DWORD  g_log_key = FLS_OUT_OF_INDEXES;
+#else
+static pthread_key_t g_log_key;
+#endif
 
 static const char * g_log_level_str[] = 
 {
@@ -35,6 +102,395 @@ static const char * g_log_level_str[] =
 	"FATAL"
 };
 
+/***************************************************************************************/
+
+static int64 log_wall_ms()
+{
+#if __WINDOWS_OS__
+	FILETIME ft;
+	int64 t;
+
+	GetSystemTimeAsFileTime(&ft);
+
+	t = ((int64)ft.dwHighDateTime << 32) | ft.dwLowDateTime;
+
+	// 100ns since 1601 to ms since 1970
+	return t / 10000 - 11644473600000LL;
+#else
+	struct timespec ts;
+
+#ifdef CLOCK_REALTIME_COARSE
+	clock_gettime(CLOCK_REALTIME_COARSE, &ts);
+#else
+	clock_gettime(CLOCK_REALTIME, &ts);
+#endif
+
+	return (int64)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+#endif
+}
+
+/**
+ * "[YYYY-MM-DD HH:MM:SS.mmm] : [LEVEL] ", the local time is only 
+ * converted when the second changes
+ */
+static int log_prefix(LOGTSC * p_tsc, char * p_buf, int64 ms, int level)
+{
+	time_t sec = (time_t)(ms / 1000);
+
+	if (sec != p_tsc->sec)
+	{
+		struct tm st;
+
+#if __WINDOWS_OS__
+		localtime_s(&st, &sec);
+#else
+		localtime_r(&sec, &st);
+#endif
+
+		p_tsc->len = snprintf(p_tsc->str, sizeof(p_tsc->str), "[%04d-%02d-%02d %02d:%02d:%02d", 
+			st.tm_year+1900, st.tm_mon+1, st.tm_mday, st.tm_hour, st.tm_min, st.tm_sec);
+		p_tsc->sec = sec;
+	}
+
+	memcpy(p_buf, p_tsc->str, p_tsc->len);
+
+	return p_tsc->len + sprintf(p_buf + p_tsc->len, ".%03d] : [%s] ", (int)(ms % 1000), g_log_level_str[level]);
+}
+
+static void log_ring_exit(void * p)
+{
+	LOGRING * p_ring = (LOGRING *)p;
+
+	if (p_ring)
+	{
+		p_ring->dead = 1;
+	}
+}
+
+#if __WINDOWS_OS__
+static void WINAPI log_ring_fls_exit(void * p)
+{
+	log_ring_exit(p);
+}
+#endif
+
+static LOGRING * log_ring_get()
+{
+	LOGRING * p_ring;
+	
+#if __WINDOWS_OS__
+	p_ring = (LOGRING *)FlsGetValue(g_log_key);
+#else
+	p_ring = (LOGRING *)pthread_getspecific(g_log_key);
+#endif
+
+	if (p_ring)
+	{
+		return p_ring;
+	}
+
+	p_ring = (LOGRING *)malloc(sizeof(LOGRING));
+	if (NULL == p_ring)
+	{
+		return NULL;
+	}
+
+	memset(p_ring, 0, sizeof(LOGRING) - LOG_RING_SIZE);
+
+#if __WINDOWS_OS__
+	FlsSetValue(g_log_key, p_ring);
+#else
+	pthread_setspecific(g_log_key, p_ring);
+#endif
+
+	sys_os_mutex_enter(g_log_ring_mutex);
+	p_ring->next = g_log_rings;
+	log_mb();
+	g_log_rings = p_ring;
+	sys_os_mutex_leave(g_log_ring_mutex);
+
+	return p_ring;
+}
+
+static void log_ring_copy_in(LOGRING * p_ring, uint32 pos, const void * p_data, uint32 len)
+{
+	uint32 off = pos & (LOG_RING_SIZE - 1);
+	uint32 n = LOG_RING_SIZE - off;
+
+	if (n >= len)
+	{
+		memcpy(p_ring->buf + off, p_data, len);
+	}
+	else
+	{
+		memcpy(p_ring->buf + off, p_data, n);
+		memcpy(p_ring->buf, (uint8 *)p_data + n, len - n);
+	}
+}
+
+static void log_ring_copy_out(LOGRING * p_ring, uint32 pos, void * p_data, uint32 len)
+{
+	uint32 off = pos & (LOG_RING_SIZE - 1);
+	uint32 n = LOG_RING_SIZE - off;
+
+	if (n >= len)
+	{
+		memcpy(p_data, p_ring->buf + off, len);
+	}
+	else
+	{
+		memcpy(p_data, p_ring->buf + off, n);
+		memcpy((uint8 *)p_data + n, p_ring->buf, len - n);
+	}
+}
+
+static BOOL log_ring_peek(LOGRING * p_ring, LOGREC * p_rec)
+{
+	if (p_ring->head == p_ring->tail)
+	{
+		return FALSE;
+	}
+
+	// read the record after the head
+	log_mb();
+
+	log_ring_copy_out(p_ring, p_ring->tail, p_rec, sizeof(LOGREC));
+
+	return TRUE;
+}
+
+/***************************************************************************************/
+
+/**
+ * Called with g_pLogMutex held
+ */
+static void log_rotate()
+{
+	char fpath[300];
+	int len, seq = 0;
+	FILE * fp;
+	time_t now = time(NULL);
+	struct tm st;
+
+	if (NULL == g_pLogFile || g_log_fname[0] == '\0')
+	{
+		return;
+	}
+
+	if (!(g_log_rotate_size > 0 && g_log_file_size >= g_log_rotate_size) &&
+		!(g_log_rotate_secs > 0 && (uint32)(now - g_log_file_time) >= g_log_rotate_secs))
+	{
+		return;
+	}
+
+#if __WINDOWS_OS__
+	localtime_s(&st, &now);
+#else
+	localtime_r(&now, &st);
+#endif
+
+	len = snprintf(fpath, sizeof(fpath), "%s.%04d%02d%02d_%02d%02d%02d", g_log_fname,
+		st.tm_year+1900, st.tm_mon+1, st.tm_mday, st.tm_hour, st.tm_min, st.tm_sec);
+
+	// several rotations in one second
+	while (len > 0 && len < (int)sizeof(fpath) - 8 && (fp = fopen(fpath, "r")) != NULL)
+	{
+		fclose(fp);
+		sprintf(fpath + len, "_%d", ++seq);
+	}
+
+	fclose(g_pLogFile);
+	rename(g_log_fname, fpath);
+	
+	g_pLogFile = fopen(g_log_fname, "w+");
+	g_log_file_size = 0;
+	g_log_file_time = now;
+}
+
+static void log_write_batch(char * p_buf, int len)
+{
+	if (len <= 0)
+	{
+		return;
+	}
+	
+	sys_os_mutex_enter(g_pLogMutex);
+
+	if (g_pLogFile)
+	{
+		fwrite(p_buf, 1, len, g_pLogFile);
+		fflush(g_pLogFile);
+		
+		g_log_file_size += len;
+
+		log_rotate();
+	}
+
+	sys_os_mutex_leave(g_pLogMutex);
+}
+
+/**
+ * Merge the pending messages of all rings in time order into the batch buffer
+ */
+static int log_drain(char * p_batch)
+{
+	int cnt = 0, blen = 0;
+	LOGRING * p_ring;
+	LOGRING ** pp_ring;
+
+	for (;;)
+	{
+		LOGRING * p_min = NULL;
+		LOGREC  rec, min_rec;
+
+		for (p_ring = g_log_rings; p_ring; p_ring = p_ring->next)
+		{
+			if (p_ring->dropped != p_ring->reported && blen + LOG_PREFIX_LEN * 2 <= LOG_BATCH_SIZE)
+			{
+				uint32 dropped = p_ring->dropped;
+				
+				blen += log_prefix(&g_log_tsc_async, p_batch + blen, log_wall_ms(), HT_LOG_WARN);
+				blen += sprintf(p_batch + blen, "log ring full, %u messages dropped\r\n", dropped - p_ring->reported);
+				
+				p_ring->reported = dropped;
+			}
+			
+			if (log_ring_peek(p_ring, &rec) && (NULL == p_min || rec.ms < min_rec.ms))
+			{
+				p_min = p_ring;
+				min_rec = rec;
+			}
+		}
+
+		if (NULL == p_min)
+		{
+			break;
+		}
+
+		if (blen + LOG_PREFIX_LEN + (int)min_rec.len > LOG_BATCH_SIZE)
+		{
+			log_write_batch(p_batch, blen);
+			blen = 0;
+		}
+
+		blen += log_prefix(&g_log_tsc_async, p_batch + blen, min_rec.ms, min_rec.level);
+		log_ring_copy_out(p_min, p_min->tail + sizeof(LOGREC), p_batch + blen, min_rec.len);
+		blen += min_rec.len;
+
+		// the space is released after it is read
+		log_mb();
+		p_min->tail += sizeof(LOGREC) + min_rec.len;
+		cnt++;
+	}
+
+	log_write_batch(p_batch, blen);
+
+	// free the rings of the exited threads, only this thread unlinks
+	sys_os_mutex_enter(g_log_ring_mutex);
+	
+	pp_ring = (LOGRING **)&g_log_rings;
+	while (*pp_ring)
+	{
+		p_ring = *pp_ring;
+		
+		if (p_ring->dead && p_ring->head == p_ring->tail)
+		{
+			*pp_ring = p_ring->next;
+			free(p_ring);
+		}
+		else
+		{
+			pp_ring = &p_ring->next;
+		}
+	}
+	
+	sys_os_mutex_leave(g_log_ring_mutex);
+
+	return cnt;
+}
+
+static void * log_writer_thread(void * argv)
+{
+	char * p_batch = (char *)malloc(LOG_BATCH_SIZE);
+
+	while (g_log_run)
+	{
+		sys_os_sig_wait_timeout(g_log_sig, LOG_FLUSH_MS);
+
+		if (p_batch)
+		{
+			log_drain(p_batch);
+		}
+	}
+
+	if (p_batch)
+	{
+		log_drain(p_batch);
+		free(p_batch);
+	}
+
+	g_log_tid = 0;
+
+	return NULL;
+}
+
+static void log_writer_start()
+{
+	if (!g_log_key_init)
+	{
+#if __WINDOWS_OS__
+		g_log_key = FlsAlloc(log_ring_fls_exit);
+		if (FLS_OUT_OF_INDEXES == g_log_key)
+		{
+			return;
+		}
+#else
+		if (pthread_key_create(&g_log_key, log_ring_exit) != 0)
+		{
+			return;
+		}
+#endif
+
+		g_log_ring_mutex = sys_os_create_mutex();
+		g_log_key_init = 1;
+	}
+
+	g_log_sig = sys_os_create_sig();
+	if (NULL == g_log_sig)
+	{
+		return;
+	}
+
+	g_log_run = 1;
+	g_log_tid = sys_os_create_thread((void *)log_writer_thread, NULL);
+	if (0 == g_log_tid)
+	{
+		g_log_run = 0;
+		
+		sys_os_destroy_sig_mutex(g_log_sig);
+		g_log_sig = NULL;
+	}
+}
+
+static void log_writer_stop()
+{
+	if (0 == g_log_tid)
+	{
+		return;
+	}
+
+	g_log_run = 0;
+	sys_os_sig_sign(g_log_sig);
+
+	while (g_log_tid)
+	{
+		usleep(10*1000);
+	}
+
+	sys_os_destroy_sig_mutex(g_log_sig);
+	g_log_sig = NULL;
+}
+
 /***************************************************************************************/
 HT_API int log_init(const char * log_fname)
 {
@@ -47,12 +503,19 @@ HT_API int log_init(const char * log_fname)
 		return -1;
 	}
 
+	strncpy(g_log_fname, log_fname, sizeof(g_log_fname)-1);
+	g_log_file_size = 0;
+	g_log_file_time = time(NULL);
+
 	g_pLogMutex = sys_os_create_mutex();
 	if (g_pLogMutex == NULL)
 	{
 		printf("log init mutex failed[%s]\r\n", strerror(errno));
 		return -1;
 	}
+
+	// without the writer thread the messages are written synchronously
+	log_writer_start();
 	
 	return 0;
 }
@@ -82,9 +545,15 @@ HT_API int log_reinit(const char * log_fname)
     g_pLogFile = fopen(log_fname, "w+");
 	if (g_pLogFile == NULL)
 	{
+		sys_os_mutex_leave(g_pLogMutex);
+		
 		printf("log init fopen[%s] failed[%s]\r\n", log_fname, strerror(errno));
 		return -1;
 	}
+
+	strncpy(g_log_fname, log_fname, sizeof(g_log_fname)-1);
+	g_log_file_size = 0;
+	g_log_file_time = time(NULL);
 	
     sys_os_mutex_leave(g_pLogMutex);
 
@@ -105,6 +574,9 @@ HT_API int log_time_reinit(const char * fname_prev)
 
 HT_API void log_close()
 {
+	// the pending messages are written before the file is closed
+	log_writer_stop();
+	
     sys_os_mutex_enter(g_pLogMutex);
     
 	if (g_pLogFile)
@@ -122,27 +594,45 @@ HT_API void log_close()
 	}
 }
 
-int _log_print(int level, const char *fmt, va_list argptr)
+HT_API void log_set_rotate(uint32 max_size, uint32 max_secs)
 {
-	int slen = 0;
-	time_t time_now;
-	struct tm * st;
+	g_log_rotate_size = max_size;
+	g_log_rotate_secs = max_secs;
+}
 
-	if (g_pLogFile == NULL || g_pLogMutex == NULL)
+HT_API uint32 log_get_dropped()
+{
+	uint32 dropped = 0;
+	LOGRING * p_ring;
+
+	if (!g_log_key_init)
 	{
 		return 0;
 	}
 	
-	time_now = time(NULL);
-	st = localtime(&(time_now));
+	sys_os_mutex_enter(g_log_ring_mutex);
+
+	for (p_ring = g_log_rings; p_ring; p_ring = p_ring->next)
+	{
+		dropped += p_ring->dropped;
+	}
+	
+	sys_os_mutex_leave(g_log_ring_mutex);
+
+	return dropped;
+}
+
+static int _log_print_sync(int level, const char *fmt, va_list argptr)
+{
+	int slen = 0;
+	char prefix[LOG_PREFIX_LEN];
 		
 	sys_os_mutex_enter(g_pLogMutex);
 
 	if (g_pLogFile)
     {
-    	fprintf(g_pLogFile, "[%04d-%02d-%02d %02d:%02d:%02d] : [%s] ", 
-    		st->tm_year+1900, st->tm_mon+1, st->tm_mday, st->tm_hour, st->tm_min, st->tm_sec, 
-    		g_log_level_str[level]);
+    	log_prefix(&g_log_tsc_sync, prefix, log_wall_ms(), level);
+    	fputs(prefix, g_pLogFile);
     	
     	slen = vfprintf(g_pLogFile,fmt,argptr);
     	fflush(g_pLogFile);
@@ -153,8 +643,65 @@ int _log_print(int level, const char *fmt, va_list argptr)
 	return slen;
 }
 
+int _log_print(int level, const char *fmt, va_list argptr)
+{
+	int slen;
+	uint32 used;
+	LOGREC rec;
+	LOGRING * p_ring;
+	char msg[LOG_MSG_MAX];
+
+	if (g_pLogFile == NULL || g_pLogMutex == NULL)
+	{
+		return 0;
+	}
+
+	if (0 == g_log_tid || NULL == (p_ring = log_ring_get()))
+	{
+		return _log_print_sync(level, fmt, argptr);
+	}
+
+	slen = vsnprintf(msg, sizeof(msg), fmt, argptr);
+	if (slen < 0)
+	{
+		return 0;
+	}
+	else if (slen >= (int)sizeof(msg))
+	{
+		slen = sizeof(msg) - 1;
+	}
+
+	rec.len = slen;
+	rec.level = level;
+	rec.ms = log_wall_ms();
+
+	used = p_ring->head - p_ring->tail;
+	if (LOG_RING_SIZE - used < sizeof(LOGREC) + slen)
+	{
+		p_ring->dropped++;
+		return 0;
+	}
+
+	log_ring_copy_in(p_ring, p_ring->head, &rec, sizeof(LOGREC));
+	log_ring_copy_in(p_ring, p_ring->head + sizeof(LOGREC), msg, slen);
+
+	// the record must be visible before the new head
+	log_mb();
+	p_ring->head += sizeof(LOGREC) + slen;
+
+	// errors and a half full ring are written without waiting for the interval
+	if (level >= HT_LOG_ERR || used + sizeof(LOGREC) + slen >= LOG_RING_SIZE / 2)
+	{
+		sys_os_sig_sign(g_log_sig);
+	}
+
+	return slen;
+}
+
 #ifndef IOS
 
+#undef log_print
+
 HT_API int log_print(int level, const char * fmt,...)
 {
     if (level < g_log_level || level > HT_LOG_FATAL)
@@ -42,11 +42,27 @@ HT_API void log_close();
 HT_API void log_set_level(int level);
 HT_API int  log_get_level();
 
+/**
+ * Rotate the log file when it reaches max_size bytes or is max_secs old,
+ * the full file is renamed to <name>.YYYYMMDD_HHMMSS, 0 - disabled
+ */
+HT_API void log_set_rotate(uint32 max_size, uint32 max_secs);
+
+/**
+ * Messages dropped because the per thread ring was full
+ */
+HT_API uint32 log_get_dropped();
+
+extern HT_API int g_log_level;
+
 #ifdef IOS
 HT_API int  log_printfff(int level, const char * fmt,...);
 #define log_print log_printfff
 #else
 HT_API int  log_print(int level, const char * fmt,...);
+
+// the level is checked inline, nothing is evaluated or formatted for a disabled level
+#define log_print(level, ...)	((level) < g_log_level ? 0 : log_print(level, __VA_ARGS__))
 #endif
 
 HT_API int  log_lock_start(const char * fmt,...);
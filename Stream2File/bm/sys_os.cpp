@@ -344,6 +344,62 @@ HT_API uint32 sys_os_get_ms()
 	return ms;
 }
 
+/**
+ * Monotonic ms of the scheduler tick resolution (1 ~ 10 ms), 
+ * cheap enough to be read on every frame
+ */
+HT_API uint32 sys_os_get_coarse_ms()
+{
+	uint32 ms = 0;
+
+#if __LINUX_OS__
+
+	struct timespec ts;
+
+#ifdef CLOCK_MONOTONIC_COARSE
+	clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+#else
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+#endif
+
+	ms = (uint32)(ts.tv_sec * 1000 + ts.tv_nsec / 1000000);
+
+#elif __WINDOWS_OS__
+
+	ms = GetTickCount();
+
+#endif
+
+	return ms;
+}
+
+/**
+ * Monotonic us, the time base of the rtp packet arrival time
+ */
+HT_API int64 sys_os_get_us()
+{
+	int64 us = 0;
+
+#if __LINUX_OS__
+
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	us = (int64)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+
+#elif __WINDOWS_OS__
+
+	LARGE_INTEGER freq, cnt;
+	QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&cnt);
+
+	us = (cnt.QuadPart / freq.QuadPart) * 1000000 + (cnt.QuadPart % freq.QuadPart) * 1000000 / freq.QuadPart;
+
+#endif
+
+	return us;
+}
+
 HT_API uint32 sys_os_get_uptime()
 {
 	uint32 upt = 0;
@@ -85,8 +85,9 @@ int main(int argc, char * argv[])
     SetConsoleCtrlHandler(sig_handler, TRUE);
 #endif
 
+    // r2f_start applies the configured level
     log_init("stream2file.log");
-    log_set_level(HT_LOG_DBG);
+    log_set_level(HT_LOG_ERR);
 		
 	r2f_start(); 
 	
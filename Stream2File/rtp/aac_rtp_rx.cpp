@@ -24,25 +24,16 @@
 
 BOOL aac_data_rx(AACRXI * p_rxi, uint8 * p_data, int len)
 {
-	struct AUHeader 
-	{
-		uint32 size;
-		uint32 index; // indexDelta for the 2nd & subsequent headers
-	};
-
 	uint8* headerStart = p_data;
 	uint32 packetSize = len;
 	uint32 resultSpecialHeaderSize;
 
 	uint32 fNumAUHeaders; // in the most recently read packet
-  	uint32 fNextAUHeader; // index of the next AU Header to read
-  	struct AUHeader* fAUHeaders;
+	uint32 auSize;
 
 	// default values:
 	resultSpecialHeaderSize = 0;
 	fNumAUHeaders = 0;
-	fNextAUHeader = 0;
-	fAUHeaders = NULL;
 
 	if (p_rxi->size_length == 0) 
 	{
@@ -72,33 +63,26 @@ BOOL aac_data_rx(AACRXI * p_rxi, uint8 * p_data, int len)
 		fNumAUHeaders = 1 + bitsAvail / (p_rxi->size_length + p_rxi->index_delta_length);
 	}
 	
-	if (fNumAUHeaders > 0) 
+	if (fNumAUHeaders == 0)
 	{
-		fAUHeaders = new AUHeader[fNumAUHeaders];
-		// Fill in each header:
-		BitVector bv(&headerStart[2], 0, AU_headers_length);
-		fAUHeaders[0].size = bv.getBits(p_rxi->size_length);
-		fAUHeaders[0].index = bv.getBits(p_rxi->index_length);
-
-		for (uint32 i = 1; i < fNumAUHeaders; ++i) 
-		{
-			fAUHeaders[i].size = bv.getBits(p_rxi->size_length);
-			fAUHeaders[i].index = bv.getBits(p_rxi->index_delta_length);
-		}
+		return TRUE;
 	}
 
+	// The AU-headers are read while the frames are delivered,
+	// no per packet header array
+	BitVector bv(&headerStart[2], 0, AU_headers_length);
+	auSize = bv.getBits(p_rxi->size_length);
+	bv.skipBits(p_rxi->index_length);
+
 	p_data += resultSpecialHeaderSize;
 	len -= resultSpecialHeaderSize;
 	
-	if (fNumAUHeaders == 1 && (uint32) len < fAUHeaders[0].size) 
+	if (fNumAUHeaders == 1 && (uint32) len < auSize) 
 	{
-		if (fAUHeaders[0].size > RTP_MAX_AUDIO_BUFF) 
+		// fragmented access unit
+		if (auSize > (uint32) p_rxi->buf_len || p_rxi->d_offset + len > p_rxi->buf_len) 
 		{
-		    if (fAUHeaders)
-        	{
-        		delete[] fAUHeaders;
-        	}
-            	
+			p_rxi->d_offset = 0;
             return FALSE;
         }
 
@@ -107,13 +91,8 @@ BOOL aac_data_rx(AACRXI * p_rxi, uint8 * p_data, int len)
 
 		if (p_rxi->rtprxi.rxf_marker)
 		{
-			if (p_rxi->d_offset != fAUHeaders[0].size) 
+			if ((uint32) p_rxi->d_offset != auSize) 
 			{
-			    if (fAUHeaders)
-            	{
-            		delete[] fAUHeaders;
-            	}
-	
 				p_rxi->d_offset = 0;
 				return FALSE;
 			}
@@ -122,36 +101,34 @@ BOOL aac_data_rx(AACRXI * p_rxi, uint8 * p_data, int len)
 	  		{
 	  			p_rxi->pkt_func(p_rxi->p_buf, p_rxi->d_offset, p_rxi->rtprxi.prev_ts, p_rxi->rtprxi.prev_seq, p_rxi->user_data);
 	  		}
+
+	  		p_rxi->d_offset = 0;
 		}
 	}
 	else
 	{
 		for (uint32 i = 0; i < fNumAUHeaders; i++)
 		{
-			if ((uint32) len < fAUHeaders[i].size) 
+			if (i > 0)
+			{
+				auSize = bv.getBits(p_rxi->size_length);
+				bv.skipBits(p_rxi->index_delta_length);
+			}
+			
+			if ((uint32) len < auSize) 
 			{
-			    if (fAUHeaders)
-            	{
-            		delete[] fAUHeaders;
-            	}
-	
 	    		return FALSE;
 			}
 
-			memcpy(p_rxi->p_buf, p_data, fAUHeaders[i].size);
-			p_data += fAUHeaders[i].size;
-			len -= fAUHeaders[i].size;
-
+			// complete access units are delivered in place
 			if (p_rxi->pkt_func)
 	  		{
-	  			p_rxi->pkt_func(p_rxi->p_buf, fAUHeaders[i].size, p_rxi->rtprxi.prev_ts, p_rxi->rtprxi.prev_seq, p_rxi->user_data);
+	  			p_rxi->pkt_func(p_data, auSize, p_rxi->rtprxi.prev_ts, p_rxi->rtprxi.prev_seq, p_rxi->user_data);
 	  		}
-		}
-	}
 
-	if (fAUHeaders)
-	{
-		delete[] fAUHeaders;
+			p_data += auSize;
+			len -= auSize;
+		}
 	}
 
 	return TRUE;
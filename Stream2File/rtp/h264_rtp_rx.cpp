@@ -76,11 +76,58 @@ void h264_save_parameters(H264RXI * p_rxi, uint8 * p_data, int len)
 	}
 }
 
+void h264_iov_deliver(H264RXI * p_rxi)
+{
+	if (p_rxi->iov_func && p_rxi->p_iov->nal_cnt > 0)
+	{
+		p_rxi->iov_func(p_rxi->p_iov, p_rxi->rtprxi.prev_ts, p_rxi->rtprxi.prev_seq, p_rxi->user_data);
+	}
+
+	rtp_frm_iov_reset(p_rxi->p_iov);
+}
+
+BOOL h264_handle_aggregated_packet_iov(H264RXI * p_rxi, uint8 * p_data, int len)
+{
+    uint8 *src  = p_data;
+    int src_len = len;
+
+    while (src_len > 2) 
+    {
+        uint16 nal_size = ((src[0] << 8) | src[1]);
+
+        src     += 2;
+        src_len -= 2;
+
+        if (nal_size > src_len) 
+        {
+            log_print(HT_LOG_ERR, "%s, nal size exceeds length: %d %d\n", __FUNCTION__, nal_size, src_len);
+            return FALSE;
+        }
+
+        h264_save_parameters(p_rxi, src, nal_size);
+
+        if (!rtp_frm_iov_put(p_rxi->p_iov, p_rxi->p_pkt, src, nal_size, TRUE))
+        {
+            return FALSE;
+        }
+
+        src     += nal_size;
+        src_len -= nal_size;
+    }
+
+    if (p_rxi->rtprxi.rxf_marker)
+	{
+		h264_iov_deliver(p_rxi);
+	}
+
+    return TRUE;
+}
+
 BOOL h264_handle_aggregated_packet(H264RXI * p_rxi, uint8 * p_data, int len)
 {
     int pass         = 0;
     int total_length = 0;
-    uint8 *dst       = p_rxi->p_buf + p_rxi->d_offset;
+    uint8 *dst       = NULL;
 
     // first we are going to figure out the total size
     for (pass = 0; pass < 2; pass++) 
@@ -88,6 +135,9 @@ BOOL h264_handle_aggregated_packet(H264RXI * p_rxi, uint8 * p_data, int len)
         uint8 *src  = p_data;
         int src_len = len;
 
+        // the buffer may be reallocated while counting
+        dst = p_rxi->frm.p_buf + p_rxi->d_offset;
+
         while (src_len > 2) 
         {
             uint16 nal_size = ((src[0] << 8) | src[1]);
@@ -103,7 +153,7 @@ BOOL h264_handle_aggregated_packet(H264RXI * p_rxi, uint8 * p_data, int len)
                     // counting
                     total_length += 4 + nal_size;
 
-                    if ((p_rxi->d_offset + total_length) >= RTP_MAX_VIDEO_BUFF)
+                    if (!rtp_frm_buf_reserve(&p_rxi->frm, p_rxi->d_offset, p_rxi->d_offset + total_length))
                 	{
                 	    if (p_rxi->rtprxi.rxf_marker)
                 	    {
@@ -145,7 +195,7 @@ BOOL h264_handle_aggregated_packet(H264RXI * p_rxi, uint8 * p_data, int len)
 	{
 		if (p_rxi->pkt_func)
   		{
-  			p_rxi->pkt_func(p_rxi->p_buf, p_rxi->d_offset+total_length, p_rxi->rtprxi.prev_ts, p_rxi->rtprxi.prev_seq, p_rxi->user_data);
+  			p_rxi->pkt_func(p_rxi->frm.p_buf, p_rxi->d_offset+total_length, p_rxi->rtprxi.prev_ts, p_rxi->rtprxi.prev_seq, p_rxi->user_data);
   		}
 
 		p_rxi->d_offset = 0;
@@ -173,6 +223,11 @@ BOOL h264_data_rx(H264RXI * p_rxi, uint8 * p_data, int len)
     {
         // Packet loss, discard the previously cached packets
         p_rxi->d_offset = 0;
+
+        if (p_rxi->p_iov)
+        {
+            rtp_frm_iov_reset(p_rxi->p_iov);
+        }
     }
     
 	fCurPacketNALUnitType = (headerStart[0] & 0x1F);
@@ -181,6 +236,11 @@ BOOL h264_data_rx(H264RXI * p_rxi, uint8 * p_data, int len)
 	{
 	case 24:  					// STAP-A
         numBytesToSkip = 1; 	// discard the type byte
+        if (p_rxi->p_iov)
+        {
+            return h264_handle_aggregated_packet_iov(p_rxi, p_data+numBytesToSkip, len-numBytesToSkip);
+        }
+        
         return h264_handle_aggregated_packet(p_rxi, p_data+numBytesToSkip, len-numBytesToSkip);
 	
 	case 25: case 26: case 27:  // STAP-B, MTAP16, or MTAP24
@@ -242,7 +302,23 @@ BOOL h264_data_rx(H264RXI * p_rxi, uint8 * p_data, int len)
 
     h264_save_parameters(p_rxi, headerStart + numBytesToSkip, packetSize - numBytesToSkip);
 
-  	if ((p_rxi->d_offset + 4 + packetSize - numBytesToSkip) >= RTP_MAX_VIDEO_BUFF)
+	if (p_rxi->p_iov)
+	{
+		// zero copy, the frame chain refers to the packet payload
+		if (!rtp_frm_iov_put(p_rxi->p_iov, p_rxi->p_pkt, headerStart + numBytesToSkip, packetSize - numBytesToSkip, fCurrentPacketBeginsFrame))
+		{
+			return FALSE;
+		}
+
+		if (fCurrentPacketCompletesFrame && p_rxi->rtprxi.rxf_marker)
+		{
+			h264_iov_deliver(p_rxi);
+		}
+
+		return TRUE;
+	}
+	
+  	if (!rtp_frm_buf_reserve(&p_rxi->frm, p_rxi->d_offset + 4, p_rxi->d_offset + 8 + packetSize - numBytesToSkip))
 	{
 	    if (p_rxi->rtprxi.rxf_marker)
 	    {
@@ -253,31 +329,31 @@ BOOL h264_data_rx(H264RXI * p_rxi, uint8 * p_data, int len)
 		return FALSE;
 	}
 	
-	memcpy(p_rxi->p_buf + p_rxi->d_offset + 4, headerStart + numBytesToSkip, packetSize - numBytesToSkip);
+	memcpy(p_rxi->frm.p_buf + p_rxi->d_offset + 4, headerStart + numBytesToSkip, packetSize - numBytesToSkip);
 	p_rxi->d_offset += packetSize - numBytesToSkip;
 
 	if (fCurrentPacketCompletesFrame)
 	{
 		if (p_rxi->rtprxi.rxf_marker)
 		{
-    		p_rxi->p_buf[0] = 0;
-    		p_rxi->p_buf[1] = 0;
-    		p_rxi->p_buf[2] = 0;
-    		p_rxi->p_buf[3] = 1;
+    		p_rxi->frm.p_buf[0] = 0;
+    		p_rxi->frm.p_buf[1] = 0;
+    		p_rxi->frm.p_buf[2] = 0;
+    		p_rxi->frm.p_buf[3] = 1;
 
     		if (p_rxi->pkt_func)
       		{
-      			p_rxi->pkt_func(p_rxi->p_buf, p_rxi->d_offset + 4, p_rxi->rtprxi.prev_ts, p_rxi->rtprxi.prev_seq, p_rxi->user_data);
+      			p_rxi->pkt_func(p_rxi->frm.p_buf, p_rxi->d_offset + 4, p_rxi->rtprxi.prev_ts, p_rxi->rtprxi.prev_seq, p_rxi->user_data);
       		}
 
     		p_rxi->d_offset = 0;
 		}
 		else
 		{
-		    p_rxi->p_buf[p_rxi->d_offset + 4 + 0] = 0;
-    		p_rxi->p_buf[p_rxi->d_offset + 4 + 1] = 0;
-    		p_rxi->p_buf[p_rxi->d_offset + 4 + 2] = 0;
-    		p_rxi->p_buf[p_rxi->d_offset + 4 + 3] = 1;
+		    p_rxi->frm.p_buf[p_rxi->d_offset + 4 + 0] = 0;
+    		p_rxi->frm.p_buf[p_rxi->d_offset + 4 + 1] = 0;
+    		p_rxi->frm.p_buf[p_rxi->d_offset + 4 + 2] = 0;
+    		p_rxi->frm.p_buf[p_rxi->d_offset + 4 + 3] = 1;
     		p_rxi->d_offset += 4;
 		}
 	} 
@@ -300,20 +376,33 @@ BOOL h264_rtp_rx(H264RXI * p_rxi, uint8 * p_data, int len)
 	return h264_data_rx(p_rxi, p_rxi->rtprxi.p_data, p_rxi->rtprxi.len);
 }
 
+BOOL h264_rtp_rx_pkt(H264RXI * p_rxi, RTPPKTBUF * p_pkt, uint8 * p_data, int len)
+{
+	BOOL ret;
+	
+	if (p_rxi == NULL)
+	{
+		return FALSE;
+	}
+
+	p_rxi->p_pkt = p_pkt;
+	
+	ret = h264_rtp_rx(p_rxi, p_data, len);
+
+	p_rxi->p_pkt = NULL;
+
+	return ret;
+}
+
 BOOL h264_rxi_init(H264RXI * p_rxi, VRTPRXCBF cbf, void * p_userdata)
 {
 	memset(p_rxi, 0, sizeof(H264RXI));
 
-	p_rxi->buf_len = RTP_MAX_VIDEO_BUFF;
-	
-	p_rxi->p_buf_org = (uint8 *)malloc(p_rxi->buf_len);
-	if (p_rxi->p_buf_org == NULL)
+	if (!rtp_frm_buf_init(&p_rxi->frm, RTP_VIDEO_BUFF_INIT - RTP_BUFF_HEAD))
 	{
 		return -1;
-    }
-    
-	p_rxi->p_buf = p_rxi->p_buf_org + 32;
-	p_rxi->buf_len -= 32;
+	}
+	
 	p_rxi->pkt_func = cbf;
     p_rxi->user_data = p_userdata;
 
@@ -322,13 +411,31 @@ BOOL h264_rxi_init(H264RXI * p_rxi, VRTPRXCBF cbf, void * p_userdata)
 
 void h264_rxi_deinit(H264RXI * p_rxi)
 {
-	if (p_rxi->p_buf_org)
+	rtp_frm_buf_deinit(&p_rxi->frm, "h264");
+
+	if (p_rxi->p_iov)
 	{
-		free(p_rxi->p_buf_org);
-    }
-    
+		rtp_frm_iov_free(p_rxi->p_iov);
+	}
+	
 	memset(p_rxi, 0, sizeof(H264RXI));
 }
 
+BOOL h264_rxi_set_iov(H264RXI * p_rxi, VRTPIOVCBF cbf)
+{
+	if (NULL == p_rxi->p_iov)
+	{
+		p_rxi->p_iov = rtp_frm_iov_new(RTP_FRM_IOV_MAX);
+		if (NULL == p_rxi->p_iov)
+		{
+			return FALSE;
+		}
+	}
+
+	p_rxi->iov_func = cbf;
+
+	return TRUE;
+}
+
 
 
@@ -28,14 +28,16 @@ typedef struct h264_rtp_rx_info
 {
     RTPRXI      rtprxi;
 
-	uint8     * p_buf_org;				// Allocated buffer
-	uint8     * p_buf;					// = p_buf_org + 32
-	int         buf_len;				// Buffer length -32 
+	RTPFRMBUF   frm;                    // pooled frame buffer
 	int         d_offset;				// Data offset 
 
 	VRTPRXCBF   pkt_func;				// callback function
     void      * user_data;              // user data
 
+    VRTPIOVCBF  iov_func;               // frame chain callback, zero copy mode
+    RTPFRMIOV * p_iov;                  // frame chain, NULL - copy mode
+    RTPPKTBUF * p_pkt;                  // reference counted buffer of the packet being parsed
+
     H264ParamSets   param_sets;         // h264 sps pps parameter sets
 } H264RXI;
 
@@ -45,9 +47,16 @@ extern "C" {
 
 BOOL h264_data_rx(H264RXI * p_rxi, uint8 * p_data, int len);
 BOOL h264_rtp_rx(H264RXI * p_rxi, uint8 * p_data, int len);
+BOOL h264_rtp_rx_pkt(H264RXI * p_rxi, RTPPKTBUF * p_pkt, uint8 * p_data, int len);
 BOOL h264_rxi_init(H264RXI * p_rxi, VRTPRXCBF cbf, void * p_userdata);
 void h264_rxi_deinit(H264RXI * p_rxi);
 
+/**
+ * Switch to the zero copy mode, the frames are delivered to cbf as
+ * slice chains of the received packets instead of the frame buffer
+ */
+BOOL h264_rxi_set_iov(H264RXI * p_rxi, VRTPIOVCBF cbf);
+
 #ifdef __cplusplus
 }
 #endif
@@ -99,11 +99,59 @@ void h265_save_parameters(H265RXI * p_rxi, uint8 * p_data, int len)
 	}
 }
 
+void h265_iov_deliver(H265RXI * p_rxi)
+{
+	if (p_rxi->iov_func && p_rxi->p_iov->nal_cnt > 0)
+	{
+		p_rxi->iov_func(p_rxi->p_iov, p_rxi->rtprxi.prev_ts, p_rxi->rtprxi.prev_seq, p_rxi->user_data);
+	}
+
+	rtp_frm_iov_reset(p_rxi->p_iov);
+}
+
+BOOL h265_handle_aggregated_packet_iov(H265RXI * p_rxi, uint8 * p_data, int len)
+{
+    uint8 *src  = p_data;
+    int src_len = len;
+    int skip_between = p_rxi->rxf_don ? 1 : 0;
+
+    while (src_len > 2) 
+    {
+        uint16 nal_size = ((src[0] << 8) | src[1]);
+
+        src     += 2;
+        src_len -= 2;
+
+        if (nal_size > src_len) 
+        {
+            log_print(HT_LOG_ERR, "%s, nal size exceeds length: %d %d\n", __FUNCTION__, nal_size, src_len);
+            return FALSE;
+        }
+
+        h265_save_parameters(p_rxi, src, nal_size);
+
+        if (!rtp_frm_iov_put(p_rxi->p_iov, p_rxi->p_pkt, src, nal_size, TRUE))
+        {
+            return FALSE;
+        }
+
+        src     += nal_size + skip_between;
+        src_len -= nal_size + skip_between;
+    }
+
+    if (p_rxi->rtprxi.rxf_marker)
+	{
+		h265_iov_deliver(p_rxi);
+	}
+
+    return TRUE;
+}
+
 BOOL h265_handle_aggregated_packet(H265RXI * p_rxi, uint8 * p_data, int len)
 {
     int pass         = 0;
     int total_length = 0;
-    uint8 *dst       = p_rxi->p_buf + p_rxi->d_offset;
+    uint8 *dst       = NULL;
     int skip_between = p_rxi->rxf_don ? 1 : 0;
     
     // first we are going to figure out the total size
@@ -112,6 +160,9 @@ BOOL h265_handle_aggregated_packet(H265RXI * p_rxi, uint8 * p_data, int len)
         uint8 *src  = p_data;
         int src_len = len;
 
+        // the buffer may be reallocated while counting
+        dst = p_rxi->frm.p_buf + p_rxi->d_offset;
+
         while (src_len > 2) 
         {
             uint16 nal_size = ((src[0] << 8) | src[1]);
@@ -127,7 +178,7 @@ BOOL h265_handle_aggregated_packet(H265RXI * p_rxi, uint8 * p_data, int len)
                     // counting
                     total_length += 4 + nal_size;
 
-                    if ((p_rxi->d_offset + total_length) >= RTP_MAX_VIDEO_BUFF)
+                    if (!rtp_frm_buf_reserve(&p_rxi->frm, p_rxi->d_offset, p_rxi->d_offset + total_length))
                 	{
                 	    if (p_rxi->rtprxi.rxf_marker)
                 	    {
@@ -169,7 +220,7 @@ BOOL h265_handle_aggregated_packet(H265RXI * p_rxi, uint8 * p_data, int len)
 	{
 		if (p_rxi->pkt_func)
   		{
-  			p_rxi->pkt_func(p_rxi->p_buf, p_rxi->d_offset+total_length, p_rxi->rtprxi.prev_ts, p_rxi->rtprxi.prev_seq, p_rxi->user_data);
+  			p_rxi->pkt_func(p_rxi->frm.p_buf, p_rxi->d_offset+total_length, p_rxi->rtprxi.prev_ts, p_rxi->rtprxi.prev_seq, p_rxi->user_data);
   		}
 
 		p_rxi->d_offset = 0;
@@ -198,6 +249,11 @@ BOOL h265_data_rx(H265RXI * p_rxi, uint8 * p_data, int len)
     {
         // Packet loss, discard the previously cached packets
         p_rxi->d_offset = 0;
+
+        if (p_rxi->p_iov)
+        {
+            rtp_frm_iov_reset(p_rxi->p_iov);
+        }
     }
     
 	fCurPacketNALUnitType = (headerStart[0] & 0x7E) >> 1;
@@ -223,6 +279,11 @@ BOOL h265_data_rx(H265RXI * p_rxi, uint8 * p_data, int len)
 			numBytesToSkip = 2;
 		}
 
+		if (p_rxi->p_iov)
+		{
+			return h265_handle_aggregated_packet_iov(p_rxi, p_data+numBytesToSkip, len-numBytesToSkip);
+		}
+		
 		return h265_handle_aggregated_packet(p_rxi, p_data+numBytesToSkip, len-numBytesToSkip);
 	}
 		
@@ -320,7 +381,23 @@ BOOL h265_data_rx(H265RXI * p_rxi, uint8 * p_data, int len)
 
     h265_save_parameters(p_rxi, headerStart + numBytesToSkip, packetSize - numBytesToSkip);
     
-  	if ((p_rxi->d_offset + 4 + packetSize - numBytesToSkip) >= RTP_MAX_VIDEO_BUFF)
+	if (p_rxi->p_iov)
+	{
+		// zero copy, the frame chain refers to the packet payload
+		if (!rtp_frm_iov_put(p_rxi->p_iov, p_rxi->p_pkt, headerStart + numBytesToSkip, packetSize - numBytesToSkip, fCurrentPacketBeginsFrame))
+		{
+			return FALSE;
+		}
+
+		if (fCurrentPacketCompletesFrame && p_rxi->rtprxi.rxf_marker)
+		{
+			h265_iov_deliver(p_rxi);
+		}
+
+		return TRUE;
+	}
+	
+  	if (!rtp_frm_buf_reserve(&p_rxi->frm, p_rxi->d_offset + 4, p_rxi->d_offset + 8 + packetSize - numBytesToSkip))
 	{
 	    if (p_rxi->rtprxi.rxf_marker)
 	    {
@@ -331,31 +408,31 @@ BOOL h265_data_rx(H265RXI * p_rxi, uint8 * p_data, int len)
 		return FALSE;
 	}
 	
-	memcpy(p_rxi->p_buf + p_rxi->d_offset + 4, headerStart + numBytesToSkip, packetSize - numBytesToSkip);
+	memcpy(p_rxi->frm.p_buf + p_rxi->d_offset + 4, headerStart + numBytesToSkip, packetSize - numBytesToSkip);
 	p_rxi->d_offset += packetSize - numBytesToSkip;
 
 	if (fCurrentPacketCompletesFrame)
 	{
 		if (p_rxi->rtprxi.rxf_marker)
 		{
-    		p_rxi->p_buf[0] = 0;
-    		p_rxi->p_buf[1] = 0;
-    		p_rxi->p_buf[2] = 0;
-    		p_rxi->p_buf[3] = 1;
+    		p_rxi->frm.p_buf[0] = 0;
+    		p_rxi->frm.p_buf[1] = 0;
+    		p_rxi->frm.p_buf[2] = 0;
+    		p_rxi->frm.p_buf[3] = 1;
 
     		if (p_rxi->pkt_func)
       		{
-      			p_rxi->pkt_func(p_rxi->p_buf, p_rxi->d_offset + 4, p_rxi->rtprxi.prev_ts, p_rxi->rtprxi.prev_seq, p_rxi->user_data);
+      			p_rxi->pkt_func(p_rxi->frm.p_buf, p_rxi->d_offset + 4, p_rxi->rtprxi.prev_ts, p_rxi->rtprxi.prev_seq, p_rxi->user_data);
       		}
 
     		p_rxi->d_offset = 0;
 		}
 		else
 		{
-		    p_rxi->p_buf[p_rxi->d_offset + 4 + 0] = 0;
-    		p_rxi->p_buf[p_rxi->d_offset + 4 + 1] = 0;
-    		p_rxi->p_buf[p_rxi->d_offset + 4 + 2] = 0;
-    		p_rxi->p_buf[p_rxi->d_offset + 4 + 3] = 1;
+		    p_rxi->frm.p_buf[p_rxi->d_offset + 4 + 0] = 0;
+    		p_rxi->frm.p_buf[p_rxi->d_offset + 4 + 1] = 0;
+    		p_rxi->frm.p_buf[p_rxi->d_offset + 4 + 2] = 0;
+    		p_rxi->frm.p_buf[p_rxi->d_offset + 4 + 3] = 1;
     		p_rxi->d_offset += 4;
 		}
 	} 
@@ -378,20 +455,33 @@ BOOL h265_rtp_rx(H265RXI * p_rxi, uint8 * p_data, int len)
 	return h265_data_rx(p_rxi, p_rxi->rtprxi.p_data, p_rxi->rtprxi.len);
 }
 
+BOOL h265_rtp_rx_pkt(H265RXI * p_rxi, RTPPKTBUF * p_pkt, uint8 * p_data, int len)
+{
+	BOOL ret;
+	
+	if (p_rxi == NULL)
+	{
+		return FALSE;
+	}
+
+	p_rxi->p_pkt = p_pkt;
+	
+	ret = h265_rtp_rx(p_rxi, p_data, len);
+
+	p_rxi->p_pkt = NULL;
+
+	return ret;
+}
+
 BOOL h265_rxi_init(H265RXI * p_rxi, VRTPRXCBF cbf, void * p_userdata)
 {
 	memset(p_rxi, 0, sizeof(H265RXI));
 	
-	p_rxi->buf_len = RTP_MAX_VIDEO_BUFF;
-	
-	p_rxi->p_buf_org = (uint8 *)malloc(p_rxi->buf_len);	
-	if (p_rxi->p_buf_org == NULL)
+	if (!rtp_frm_buf_init(&p_rxi->frm, RTP_VIDEO_BUFF_INIT - RTP_BUFF_HEAD))
 	{
 		return -1;
 	}
 	
-	p_rxi->p_buf = p_rxi->p_buf_org + 32;
-	p_rxi->buf_len -= 32;
 	p_rxi->pkt_func = cbf;
 	p_rxi->user_data = p_userdata;
 
@@ -400,14 +490,31 @@ BOOL h265_rxi_init(H265RXI * p_rxi, VRTPRXCBF cbf, void * p_userdata)
 
 void h265_rxi_deinit(H265RXI * p_rxi)
 {
-	if (p_rxi->p_buf_org)
+	rtp_frm_buf_deinit(&p_rxi->frm, "h265");
+
+	if (p_rxi->p_iov)
 	{
-		free(p_rxi->p_buf_org);
+		rtp_frm_iov_free(p_rxi->p_iov);
 	}
 	
 	memset(p_rxi, 0, sizeof(H265RXI));
 }
 
+BOOL h265_rxi_set_iov(H265RXI * p_rxi, VRTPIOVCBF cbf)
+{
+	if (NULL == p_rxi->p_iov)
+	{
+		p_rxi->p_iov = rtp_frm_iov_new(RTP_FRM_IOV_MAX);
+		if (NULL == p_rxi->p_iov)
+		{
+			return FALSE;
+		}
+	}
+
+	p_rxi->iov_func = cbf;
+
+	return TRUE;
+}
 
 
 
@@ -21,6 +21,7 @@
 #include "bs.h"
 #include "h265.h"
 #include "h265_util.h"
+#include "media_util.h"
 
 
 void h265_parser_init(h265_t * h)
@@ -41,22 +42,7 @@ int h265_parser_parse(h265_t * h, uint8 * p_data, int len)
 		return -1;
     }
     
-	memcpy(bufs, p_data, len);
-
-	uint8 * ptr = bufs;
-	
-	do {
-		if (*ptr == 0x00 && *(ptr+1) == 0x00 && *(ptr+2) == 0x03)
-		{
-			memmove(ptr+2, ptr+3, len-(ptr-bufs)-2-1);
-			ptr += 2;
-			len--;
-		}
-		else
-		{
-			ptr++;
-		}	
-	} while ((ptr-bufs) < (len-3));
+	len = remove_emulation_bytes(bufs, sizeof(bufs), p_data, len);
 
 	bs_init(&s, bufs, len);
 
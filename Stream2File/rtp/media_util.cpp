@@ -19,38 +19,33 @@
 
 #include "media_util.h"
 
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define STARTCODE_X86       1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define STARTCODE_TARGET(isa)
+#define STARTCODE_CTZ(x)    avc_ctz(x)
+#else
+#define STARTCODE_TARGET(isa)   __attribute__((target(isa)))
+#define STARTCODE_CTZ(x)    __builtin_ctz(x)
+#endif
+#else
+#define STARTCODE_X86       0
+#endif
 
-uint32 remove_emulation_bytes(uint8* to, uint32 toMaxSize, uint8* from, uint32 fromSize) 
-{
-	uint32 toSize = 0;
-	uint32 i = 0;
-	
-	while (i < fromSize && toSize+1 < toMaxSize) 
-	{
-		if (i+2 < fromSize && from[i] == 0 && from[i+1] == 0 && from[i+2] == 3) 
-		{
-			to[toSize] = to[toSize+1] = 0;
-			toSize += 2;
-			i += 3;
-		}
-		else 
-		{
-			to[toSize] = from[i];
-			toSize += 1;
-			i += 1;
-		}
-	}
 
-	return toSize;
-}
-
-static uint8 * avc_find_startcode_internal(uint8 *p, uint8 *end)
+/**
+ * Scalar search, 4 bytes at a time, returns the first 00 00 code or end.
+ * code 1 is the start code, 3 the emulation prevention byte
+ */
+static uint8 * avc_find_startcode_c(uint8 *p, uint8 *end, uint8 code)
 {
     uint8 *a = p + 4 - ((intptr_t)p & 3);
 
     for (end -= 3; p < a && p < end; p++) 
     {
-        if (p[0] == 0 && p[1] == 0 && p[2] == 1)
+        if (p[0] == 0 && p[1] == 0 && p[2] == code)
         {
         	return p;
 		}          
@@ -64,12 +59,12 @@ static uint8 * avc_find_startcode_internal(uint8 *p, uint8 *end)
         { // generic
             if (p[1] == 0) 
             {
-                if (p[0] == 0 && p[2] == 1)
+                if (p[0] == 0 && p[2] == code)
                 {
                     return p;
                 }
                 
-                if (p[2] == 0 && p[3] == 1)
+                if (p[2] == 0 && p[3] == code)
                 {
                     return p+1;
                 }    
@@ -77,12 +72,12 @@ static uint8 * avc_find_startcode_internal(uint8 *p, uint8 *end)
             
             if (p[3] == 0) 
             {
-                if (p[2] == 0 && p[4] == 1)
+                if (p[2] == 0 && p[4] == code)
                 {
                     return p+2;
                 }
                 
-                if (p[4] == 0 && p[5] == 1)
+                if (p[4] == 0 && p[5] == code)
                 {
                     return p+3;
                 }    
@@ -90,20 +85,201 @@ static uint8 * avc_find_startcode_internal(uint8 *p, uint8 *end)
         }
     }
 
-    for (end += 3; p < end; p++) 
+    // the last start code may end at the last byte
+    for (end += 4; p < end; p++) 
     {
-        if (p[0] == 0 && p[1] == 0 && p[2] == 1)
+        if (p[0] == 0 && p[1] == 0 && p[2] == code)
         {
         	return p;
         }
     }
 
-    return end + 3;
+    return end + 2;
+}
+
+#if STARTCODE_X86
+
+#if defined(_MSC_VER)
+static __forceinline int avc_ctz(uint32 x)
+{
+    unsigned long i;
+
+    _BitScanForward(&i, x);
+
+    return (int)i;
+}
+#endif
+
+/**
+ * Compare 16 (32) positions at a time, p[i] == 0 && p[i+1] == 0 && p[i+2] == code,
+ * the unaligned loads at +1 and +2 stay inside the buffer
+ */
+STARTCODE_TARGET("sse2")
+static uint8 * avc_find_startcode_sse2(uint8 *p, uint8 *end, uint8 code)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i pat = _mm_set1_epi8((char)code);
+
+    while (end - p >= 18)
+    {
+        __m128i v0 = _mm_loadu_si128((const __m128i *)p);
+        __m128i v1 = _mm_loadu_si128((const __m128i *)(p + 1));
+        __m128i v2 = _mm_loadu_si128((const __m128i *)(p + 2));
+        __m128i m = _mm_and_si128(_mm_and_si128(_mm_cmpeq_epi8(v0, zero), 
+            _mm_cmpeq_epi8(v1, zero)), _mm_cmpeq_epi8(v2, pat));
+        int mask = _mm_movemask_epi8(m);
+
+        if (mask)
+        {
+            return p + STARTCODE_CTZ(mask);
+        }
+
+        p += 16;
+    }
+
+    return avc_find_startcode_c(p, end, code);
+}
+
+STARTCODE_TARGET("avx2")
+static uint8 * avc_find_startcode_avx2(uint8 *p, uint8 *end, uint8 code)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i pat = _mm256_set1_epi8((char)code);
+
+    while (end - p >= 34)
+    {
+        __m256i v0 = _mm256_loadu_si256((const __m256i *)p);
+        __m256i v1 = _mm256_loadu_si256((const __m256i *)(p + 1));
+        __m256i v2 = _mm256_loadu_si256((const __m256i *)(p + 2));
+        __m256i m = _mm256_and_si256(_mm256_and_si256(_mm256_cmpeq_epi8(v0, zero), 
+            _mm256_cmpeq_epi8(v1, zero)), _mm256_cmpeq_epi8(v2, pat));
+        uint32 mask = (uint32)_mm256_movemask_epi8(m);
+
+        if (mask)
+        {
+            return p + STARTCODE_CTZ(mask);
+        }
+
+        p += 32;
+    }
+
+    return avc_find_startcode_sse2(p, end, code);
+}
+
+static BOOL avc_cpu_avx2()
+{
+#if defined(_MSC_VER)
+    int info[4];
+
+    __cpuid(info, 0);
+    if (info[0] < 7)
+    {
+        return FALSE;
+    }
+
+    // the os saves the ymm registers
+    __cpuid(info, 1);
+    if ((info[2] & (1 << 27)) == 0 || (_xgetbv(0) & 6) != 6)
+    {
+        return FALSE;
+    }
+
+    __cpuidex(info, 7, 0);
+
+    return (info[1] & (1 << 5)) ? TRUE : FALSE;
+#else
+    __builtin_cpu_init();
+
+    return __builtin_cpu_supports("avx2") ? TRUE : FALSE;
+#endif
+}
+
+#endif // STARTCODE_X86
+
+static uint8 * avc_find_startcode_auto(uint8 *p, uint8 *end, uint8 code);
+
+// selected on the first call, all threads resolve the same kernel
+static uint8 * (* avc_find_startcode_internal)(uint8 *p, uint8 *end, uint8 code) = avc_find_startcode_auto;
+
+int avc_startcode_select(int kernel)
+{
+#if STARTCODE_X86
+    if (kernel < 0 || kernel > STARTCODE_AVX2)
+    {
+        kernel = avc_cpu_avx2() ? STARTCODE_AVX2 : STARTCODE_SSE2;
+    }
+    else if (STARTCODE_AVX2 == kernel && !avc_cpu_avx2())
+    {
+        kernel = STARTCODE_SSE2;
+    }
+
+    if (STARTCODE_AVX2 == kernel)
+    {
+        avc_find_startcode_internal = avc_find_startcode_avx2;
+    }
+    else if (STARTCODE_SSE2 == kernel)
+    {
+        avc_find_startcode_internal = avc_find_startcode_sse2;
+    }
+    else
+    {
+        avc_find_startcode_internal = avc_find_startcode_c;
+    }
+#else
+    kernel = STARTCODE_C;
+    avc_find_startcode_internal = avc_find_startcode_c;
+#endif
+
+    return kernel;
+}
+
+static uint8 * avc_find_startcode_auto(uint8 *p, uint8 *end, uint8 code)
+{
+    avc_startcode_select(-1);
+
+    return avc_find_startcode_internal(p, end, code);
+}
+
+/**
+ * The runs between the 00 00 03 sequences are copied in bulk
+ */
+uint32 remove_emulation_bytes(uint8* to, uint32 toMaxSize, uint8* from, uint32 fromSize) 
+{
+	uint32 n, toSize = 0;
+	uint8 * p = from;
+	uint8 * end = from + fromSize;
+	
+	while (p < end && toSize+1 < toMaxSize) 
+	{
+		uint8 * q = avc_find_startcode_internal(p, end, 3);
+
+		n = (uint32)(q - p);
+		if (n > toMaxSize - 1 - toSize)
+		{
+			n = toMaxSize - 1 - toSize;
+		}
+
+		memcpy(to + toSize, p, n);
+		toSize += n;
+		p += n;
+
+		if (p < q || q >= end || toSize+1 >= toMaxSize)
+		{
+			break;
+		}
+
+		// 00 00 03 -> 00 00
+		to[toSize] = to[toSize+1] = 0;
+		toSize += 2;
+		p = q + 3;
+	}
+
+	return toSize;
 }
 
 uint8 * avc_find_startcode(uint8 *p, uint8 *end)
 {
-    uint8 *out = avc_find_startcode_internal(p, end);
+    uint8 *out = avc_find_startcode_internal(p, end, 1);
     if (p<out && out<end && !out[-1])
     {
     	out--;
@@ -115,55 +291,35 @@ uint8 * avc_find_startcode(uint8 *p, uint8 *end)
 
 uint8 * avc_split_nalu(uint8 * e_buf, int e_len, int * s_len, int * d_len)
 {
-	int e_i = 4;
-	int nalu_len = 0;
+	uint8 * p_next;
+	uint8 * p_end = e_buf + e_len;
 
 	*d_len = 0;
-	uint32 tmp_w;
-	uint32 split_w1 = 0x01000000;
-	uint32 split_w2 = 0x00010000;
-
-	memcpy(&tmp_w, e_buf, 4);
 
-	if (tmp_w == split_w1)
+	if (e_len >= 4 && e_buf[0] == 0 && e_buf[1] == 0 && e_buf[2] == 0 && e_buf[3] == 1)
 	{
 		*s_len = 4;
 	}
+	else if (e_len >= 3 && e_buf[0] == 0 && e_buf[1] == 0 && e_buf[2] == 1)
+	{
+		*s_len = 3;
+	}
 	else
 	{
 		return NULL;
 	}
 	
 	// Find the next start code or the end of the file
-	while (e_i < e_len)
-	{
-		if (e_i >= (e_len-4))
-		{
-			e_i = e_len;
-			break;
-		}
-
-		memcpy(&tmp_w, e_buf+e_i, 4);
-		
-		if (tmp_w == split_w1)
-		{
-			break;
-		}
-
-		e_i++;
-	}
+	p_next = avc_find_startcode(e_buf + *s_len, p_end);
 
-	*d_len = e_i;
-
-	if (e_i >= e_len)
+	if (p_next >= p_end)
 	{
+		*d_len = e_len;
 		return NULL;
 	}
+
+	*d_len = (int)(p_next - e_buf);
 	
-	return (e_buf+e_i);	// Starting position of next data frame 
+	return p_next;	// Starting position of next data frame 
 }
 
-
-
-
-
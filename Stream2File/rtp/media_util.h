@@ -36,6 +36,10 @@ extern "C"
 }
 #endif
 
+#define STARTCODE_C         0           // scalar, 4 bytes at a time
+#define STARTCODE_SSE2      1
+#define STARTCODE_AVX2      2
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -44,6 +48,12 @@ uint32  remove_emulation_bytes(uint8* to, uint32 toMaxSize, uint8* from, uint32
 uint8 * avc_find_startcode(uint8 *p, uint8 *end);
 uint8 * avc_split_nalu(uint8 * e_buf, int e_len, int * s_len, int * d_len);
 
+/**
+ * Select the start code search kernel, -1 - the best one the cpu supports.
+ * An unsupported kernel falls back, return the selected one
+ */
+int     avc_startcode_select(int kernel);
+
 #ifdef __cplusplus
 }
 #endif
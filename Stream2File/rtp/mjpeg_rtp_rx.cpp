@@ -199,6 +199,57 @@ void mjpeg_make_default_qtables(uint8* resultTables, uint32 Q)
 	}
 }
 
+/**
+ * Get the JPEG header for the frame, the default tables of a Q and
+ * the header are only computed when the parameters change
+ */
+static int mjpeg_get_header
+(
+MJPEGHDR * p_hdr, uint32 type, uint32 Q,
+uint32 w, uint32 h,
+uint8 const* qtables, uint32 qtlen,
+uint32 dri
+)
+{
+	if (p_hdr->hdr_len > 0 && p_hdr->type == type && p_hdr->q == Q && 
+		p_hdr->width == w && p_hdr->height == h && p_hdr->dri == dri &&
+		p_hdr->qtlen == qtlen && (qtlen == 0 || memcmp(p_hdr->qtables, qtables, qtlen) == 0))
+	{
+		return p_hdr->hdr_len;
+	}
+
+	p_hdr->hdr_len = 0;
+
+	if (qtlen > MJPEG_QT_MAX)
+	{
+		return 0;
+	}
+
+	p_hdr->type = type;
+	p_hdr->q = Q;
+	p_hdr->width = w;
+	p_hdr->height = h;
+	p_hdr->dri = dri;
+	p_hdr->qtlen = qtlen;
+
+	if (qtlen == 0) 
+	{
+		// A quantization table was not present in the RTP JPEG header,
+		// so use the default tables, scaled according to the "Q" factor:
+		uint8 newQtables[MJPEG_QT_MAX];
+		
+		mjpeg_make_default_qtables(newQtables, Q);
+		p_hdr->hdr_len = mjpeg_create_header(p_hdr->hdr, type, w, h, newQtables, sizeof(newQtables), dri);
+	}
+	else
+	{
+		memcpy(p_hdr->qtables, qtables, qtlen);
+		p_hdr->hdr_len = mjpeg_create_header(p_hdr->hdr, type, w, h, qtables, qtlen, dri);
+	}
+
+	return p_hdr->hdr_len;
+}
+
 BOOL mjpeg_data_rx(MJPEGRXI * p_rxi, uint8 * p_data, int len)
 {
 	uint8* headerStart = p_data;
@@ -221,6 +272,10 @@ BOOL mjpeg_data_rx(MJPEGRXI * p_rxi, uint8 * p_data, int len)
 	 */
 
   	resultSpecialHeaderSize = 8;
+	if (packetSize < resultSpecialHeaderSize)
+	{
+		return FALSE;
+	}
 
 	uint32 Offset = (uint32)((uint32)headerStart[1] << 16 | (uint32)headerStart[2] << 8 | (uint32)headerStart[3]);
 	uint32 Type = (uint32)headerStart[4];
@@ -298,40 +353,43 @@ BOOL mjpeg_data_rx(MJPEGRXI * p_rxi, uint8 * p_data, int len)
 	// If this is the first (or only) fragment of a JPEG frame
 	if (Offset == 0) 
 	{
-		uint8 newQtables[128];
-		if (qtlen == 0) 
+		int hdr_len = mjpeg_get_header(&p_rxi->hdr, type, Q, width, height, qtables, qtlen, dri);
+		if (hdr_len <= 0)
 		{
-			// A quantization table was not present in the RTP JPEG header,
-			// so use the default tables, scaled according to the "Q" factor:
-			mjpeg_make_default_qtables(newQtables, Q);
-			qtables = newQtables;
-			qtlen = sizeof newQtables;
+			p_rxi->d_offset = 0;
+			return FALSE;
 		}
 		
-		p_rxi->d_offset = mjpeg_create_header(p_rxi->p_buf, type, width, height, qtables, qtlen, dri);
+		memcpy(p_rxi->frm.p_buf, p_rxi->hdr.hdr, hdr_len);
+		p_rxi->d_offset = hdr_len;
+	}
+	else if (p_rxi->d_offset == 0)
+	{
+		// the first fragment is lost
+		return FALSE;
 	}
 
-	if ((p_rxi->d_offset + packetSize - resultSpecialHeaderSize) >= RTP_MAX_VIDEO_BUFF)
+	if (!rtp_frm_buf_reserve(&p_rxi->frm, p_rxi->d_offset, p_rxi->d_offset + 2 + packetSize - resultSpecialHeaderSize))
 	{
 		log_print(HT_LOG_ERR, "%s, fragment packet too big %d!!!", __FUNCTION__, p_rxi->d_offset + packetSize - resultSpecialHeaderSize);
 		return FALSE;
 	}
 	
-	memcpy(p_rxi->p_buf + p_rxi->d_offset, headerStart + resultSpecialHeaderSize, packetSize - resultSpecialHeaderSize);
+	memcpy(p_rxi->frm.p_buf + p_rxi->d_offset, headerStart + resultSpecialHeaderSize, packetSize - resultSpecialHeaderSize);
 	p_rxi->d_offset += packetSize - resultSpecialHeaderSize;
 		
 	// The RTP "M" (marker) bit indicates the last fragment of a frame:
 	if (p_rxi->rtprxi.rxf_marker)
 	{
-		if (p_rxi->d_offset >= 2 && !(p_rxi->p_buf[p_rxi->d_offset-2] == 0xFF && p_rxi->p_buf[p_rxi->d_offset-1] == MARKER_EOI)) 
+		if (p_rxi->d_offset >= 2 && !(p_rxi->frm.p_buf[p_rxi->d_offset-2] == 0xFF && p_rxi->frm.p_buf[p_rxi->d_offset-1] == MARKER_EOI)) 
 		{
-    		p_rxi->p_buf[p_rxi->d_offset++] = 0xFF;
-    		p_rxi->p_buf[p_rxi->d_offset++] = MARKER_EOI;
+    		p_rxi->frm.p_buf[p_rxi->d_offset++] = 0xFF;
+    		p_rxi->frm.p_buf[p_rxi->d_offset++] = MARKER_EOI;
   		}
 
   		if (p_rxi->pkt_func)
   		{
-  			p_rxi->pkt_func(p_rxi->p_buf, p_rxi->d_offset, p_rxi->rtprxi.prev_ts, p_rxi->rtprxi.prev_seq, p_rxi->user_data);
+  			p_rxi->pkt_func(p_rxi->frm.p_buf, p_rxi->d_offset, p_rxi->rtprxi.prev_ts, p_rxi->rtprxi.prev_seq, p_rxi->user_data);
   		}
 
   		p_rxi->d_offset = 0;
@@ -359,16 +417,11 @@ BOOL mjpeg_rxi_init(MJPEGRXI * p_rxi, VRTPRXCBF cbf, void * p_userdata)
 {
 	memset(p_rxi, 0, sizeof(MJPEGRXI));
 
-	p_rxi->buf_len = RTP_MAX_VIDEO_BUFF;
-	
-	p_rxi->p_buf_org = (uint8 *)malloc(p_rxi->buf_len);
-	if (p_rxi->p_buf_org == NULL)
+	if (!rtp_frm_buf_init(&p_rxi->frm, RTP_VIDEO_BUFF_INIT - RTP_BUFF_HEAD))
 	{
 		return FALSE;
-    }
-    
-	p_rxi->p_buf = p_rxi->p_buf_org + 32;
-	p_rxi->buf_len -= 32;
+	}
+	
 	p_rxi->pkt_func = cbf;
     p_rxi->user_data = p_userdata;
 
@@ -377,11 +430,8 @@ BOOL mjpeg_rxi_init(MJPEGRXI * p_rxi, VRTPRXCBF cbf, void * p_userdata)
 
 void mjpeg_rxi_deinit(MJPEGRXI * p_rxi)
 {
-	if (p_rxi->p_buf_org)
-	{
-		free(p_rxi->p_buf_org);
-    }
-    
+	rtp_frm_buf_deinit(&p_rxi->frm, "mjpeg");
+	
 	memset(p_rxi, 0, sizeof(MJPEGRXI));
 }
 
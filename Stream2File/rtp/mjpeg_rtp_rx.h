@@ -22,15 +22,35 @@
 #include "rtp_rx.h"
 
 
+#define MJPEG_QT_MAX            128         // luma and chroma 8 bits tables
+#define MJPEG_HDR_MAX           640         // header with two tables and a restart interval
+
+/**
+ * The JPEG header of the last frame, rebuilt only when the RTP JPEG
+ * type, Q, size, restart interval or in band tables change
+ */
+typedef struct
+{
+	int         hdr_len;                // 0 - not built yet
+	uint32      type;
+	uint32      q;
+	uint32      width;
+	uint32      height;
+	uint32      dri;
+	uint32      qtlen;                  // in band tables length, Q > 127
+	uint8       qtables[MJPEG_QT_MAX];  // in band tables, Q > 127
+	uint8       hdr[MJPEG_HDR_MAX];
+} MJPEGHDR;
+
 typedef struct mjpeg_rtp_rx_info
 {
 	RTPRXI      rtprxi;
 
-	uint8     * p_buf_org;				// Allocated buffer
-	uint8     * p_buf;					// = p_buf_org + 32
-	int         buf_len;				// Buffer length -32 
+	RTPFRMBUF   frm;                    // pooled frame buffer
 	int         d_offset;				// Data offset
 
+	MJPEGHDR    hdr;                    // cached jpeg header
+
 	VRTPRXCBF   pkt_func;				// callback function
     void      * user_data;              // user data
 } MJPEGRXI;
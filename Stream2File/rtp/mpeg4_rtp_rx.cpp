@@ -51,20 +51,20 @@ BOOL mpeg4_data_rx(MPEG4RXI * p_rxi, uint8 * p_data, int len)
         }
     }
     
-  	if ((p_rxi->d_offset + len + p_rxi->hdr_len) >= RTP_MAX_VIDEO_BUFF)
+  	if (!rtp_frm_buf_reserve(&p_rxi->frm, p_rxi->d_offset + p_rxi->hdr_len, p_rxi->d_offset + len + p_rxi->hdr_len))
 	{
 		log_print(HT_LOG_ERR, "%s, fragment packet too big %d!!!", __FUNCTION__, p_rxi->d_offset + len + p_rxi->hdr_len);
 		return FALSE;
 	}
 
-	memcpy(p_rxi->p_buf + p_rxi->d_offset + p_rxi->hdr_len, p_data, len);
+	memcpy(p_rxi->frm.p_buf + p_rxi->d_offset + p_rxi->hdr_len, p_data, len);
 	p_rxi->d_offset += len;
 	
 	if (p_rxi->rtprxi.rxf_marker)
 	{
 		if (p_rxi->pkt_func)
   		{
-  			p_rxi->pkt_func(p_rxi->p_buf, p_rxi->d_offset + p_rxi->hdr_len, p_rxi->rtprxi.prev_ts, p_rxi->rtprxi.prev_seq, p_rxi->user_data);
+  			p_rxi->pkt_func(p_rxi->frm.p_buf, p_rxi->d_offset + p_rxi->hdr_len, p_rxi->rtprxi.prev_ts, p_rxi->rtprxi.prev_seq, p_rxi->user_data);
   		}
 
 		p_rxi->d_offset = 0;
@@ -92,16 +92,11 @@ BOOL mpeg4_rxi_init(MPEG4RXI * p_rxi, VRTPRXCBF cbf, void * p_userdata)
 {
 	memset(p_rxi, 0, sizeof(MPEG4RXI));
 
-	p_rxi->buf_len = RTP_MAX_VIDEO_BUFF;
-	
-	p_rxi->p_buf_org = (uint8 *)malloc(p_rxi->buf_len);
-	if (p_rxi->p_buf_org == NULL)
+	if (!rtp_frm_buf_init(&p_rxi->frm, RTP_VIDEO_BUFF_INIT - RTP_BUFF_HEAD))
 	{
 		return FALSE;
-    }
-    
-	p_rxi->p_buf = p_rxi->p_buf_org + 32;
-	p_rxi->buf_len -= 32;
+	}
+	
 	p_rxi->pkt_func = cbf;
     p_rxi->user_data = p_userdata;
 
@@ -110,11 +105,8 @@ BOOL mpeg4_rxi_init(MPEG4RXI * p_rxi, VRTPRXCBF cbf, void * p_userdata)
 
 void mpeg4_rxi_deinit(MPEG4RXI * p_rxi)
 {
-	if (p_rxi->p_buf_org)
-	{
-		free(p_rxi->p_buf_org);
-    }
-    
+	rtp_frm_buf_deinit(&p_rxi->frm, "mpeg4");
+	
 	memset(p_rxi, 0, sizeof(MPEG4RXI));
 }
 
@@ -27,9 +27,7 @@ typedef struct mpeg4_rtp_rx_info
 {
 	RTPRXI      rtprxi;
 
-	uint8     * p_buf_org;				// Allocated buffer
-	uint8     * p_buf;					// = p_buf_org + 32
-	int         buf_len;				// Buffer length -32 
+	RTPFRMBUF   frm;                    // pooled frame buffer
 	int         d_offset;				// Data offset
 
 	VRTPRXCBF   pkt_func;				// callback function
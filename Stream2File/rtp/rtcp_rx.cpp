@@ -0,0 +1,263 @@
+/***************************************************************************************
+ *
+ *  IMPORTANT: READ BEFORE DOWNLOADING, COPYING, INSTALLING OR USING.
+ *
+ *  By downloading, copying, installing or using the software you agree to this license.
+ *  If you do not agree to this license, do not download, install, 
+ *  copy or use the software.
+ *
+ *  Copyright (C) 2014-2020, Happytimesoft Corporation, all rights reserved.
+ *
+ *  Redistribution and use in binary forms, with or without modification, are permitted.
+ *
+ *  Unless required by applicable law or agreed to in writing, software distributed 
+ *  under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ *  CONDITIONS OF ANY KIND, either express or implied. See the License for the specific
+ *  language governing permissions and limitations under the License.
+ *
+****************************************************************************************/
+
+#include "sys_inc.h"
+#include "rtcp_rx.h"
+
+
+#define RTP_MAX_DROPOUT     3000
+#define RTP_MAX_MISORDER    100
+
+/***************************************************************************************/
+
+void rtcp_rxi_init(RTCPRXI * p_rxi, uint32 clock_rate)
+{
+    memset(p_rxi, 0, sizeof(RTCPRXI));
+
+    p_rxi->clock_rate = clock_rate ? clock_rate : 90000;
+}
+
+static void rtcp_seq_init(RTCPRXI * p_rxi, uint16 seq)
+{
+    p_rxi->base_seq = seq;
+    p_rxi->max_seq = seq;
+    p_rxi->cycles = 0;
+    p_rxi->received = 0;
+    p_rxi->received_prior = 0;
+    p_rxi->expected_prior = 0;
+}
+
+void rtcp_rtp_update(RTCPRXI * p_rxi, uint8 * p_data, int len, int64 arrival)
+{
+    if (len < 12)
+    {
+        return;
+    }
+
+    uint16 seq = ntohs(*(uint16 *)(p_data + 2));
+    uint32 ts = ntohl(*(uint32 *)(p_data + 4));
+    uint32 ssrc = ntohl(*(uint32 *)(p_data + 8));
+
+    if (!p_rxi->rxf_rtp || p_rxi->ssrc != ssrc)
+    {
+        p_rxi->rxf_rtp = 1;
+        p_rxi->ssrc = ssrc;
+        p_rxi->transit = 0;
+        p_rxi->jitter = 0;
+        
+        rtcp_seq_init(p_rxi, seq);
+    }
+    else
+    {
+        uint16 udelta = seq - (uint16)p_rxi->max_seq;
+
+        if (udelta < RTP_MAX_DROPOUT)
+        {
+            // in order, with permissible gap
+            if (seq < (uint16)p_rxi->max_seq)
+            {
+                p_rxi->cycles += RTP_SEQ_MOD;
+            }
+            
+            p_rxi->max_seq = seq;
+        }
+        else if (udelta <= RTP_SEQ_MOD - RTP_MAX_MISORDER)
+        {
+            // the sequence number made a very large jump
+            rtcp_seq_init(p_rxi, seq);
+        }
+    }
+
+    p_rxi->received++;
+
+    // interarrival jitter, in timestamp units, 
+    // the seconds and the microseconds are scaled apart to keep the product in range
+    uint32 arrival_ts = (uint32)((arrival / 1000000) * p_rxi->clock_rate + 
+                                 (arrival % 1000000) * p_rxi->clock_rate / 1000000);
+    uint32 transit = arrival_ts - ts;
+
+    if (p_rxi->transit)
+    {
+        int d = (int)(transit - p_rxi->transit);
+        if (d < 0)
+        {
+            d = -d;
+        }
+
+        p_rxi->jitter += d - ((p_rxi->jitter + 8) >> 4);
+    }
+
+    p_rxi->transit = transit;
+}
+
+BOOL rtcp_rx(RTCPRXI * p_rxi, uint8 * p_data, int len)
+{
+    while (len >= 4)
+    {
+        uint8  pt = p_data[1];
+        uint32 pkt_len = (ntohs(*(uint16 *)(p_data + 2)) + 1) * 4;
+
+        if ((p_data[0] & 0xC0) != 0x80 || pkt_len > (uint32)len)
+        {
+            log_print(HT_LOG_WARN, "%s, invalid rtcp packet, len = %d\r\n", __FUNCTION__, len);
+            return FALSE;
+        }
+
+        if (RTCP_SR == pt && pkt_len >= 28)
+        {
+            uint32 ssrc = ntohl(*(uint32 *)(p_data + 4));
+            
+            if (p_rxi->ssrc == 0 || p_rxi->ssrc == ssrc)
+            {
+                p_rxi->rxf_sr = 1;
+                p_rxi->sr_ntp_sec = ntohl(*(uint32 *)(p_data + 8));
+                p_rxi->sr_ntp_frac = ntohl(*(uint32 *)(p_data + 12));
+                p_rxi->sr_rtp_ts = ntohl(*(uint32 *)(p_data + 16));
+                p_rxi->sr_psent = ntohl(*(uint32 *)(p_data + 20));
+                p_rxi->sr_osent = ntohl(*(uint32 *)(p_data + 24));
+                p_rxi->sr_recv_time = sys_os_get_ms();
+            }
+        }
+        else if (RTCP_BYE == pt)
+        {
+            log_print(HT_LOG_INFO, "%s, rtcp bye, ssrc[%u]\r\n", __FUNCTION__, p_rxi->ssrc);
+        }
+
+        p_data += pkt_len;
+        len -= pkt_len;
+    }
+
+    return TRUE;
+}
+
+int rtcp_build_rr(RTCPRXI * p_rxi, uint32 ssrc, const char * cname, uint8 * p_buf, int max_len)
+{
+    int    offset = 0;
+    int    cname_len = (int)strlen(cname);
+    int    sdes_len;
+
+    if (cname_len > RTP_MAX_SDES)
+    {
+        cname_len = RTP_MAX_SDES;
+    }
+
+    // header + ssrc + item (type, length, text) + end, padded to 32 bits
+    sdes_len = (8 + 2 + cname_len + 1 + 3) & ~3;
+
+    if (max_len < 8 + 24 + sdes_len)
+    {
+        return 0;
+    }
+
+    p_buf[0] = 0x80 | (p_rxi->rxf_rtp ? 1 : 0);
+    p_buf[1] = RTCP_RR;
+    *(uint16 *)(p_buf + 2) = htons(p_rxi->rxf_rtp ? 7 : 1);
+    *(uint32 *)(p_buf + 4) = htonl(ssrc);
+    offset = 8;
+
+    if (p_rxi->rxf_rtp)
+    {
+        uint32 extended_max = p_rxi->cycles + p_rxi->max_seq;
+        uint32 expected = extended_max - p_rxi->base_seq + 1;
+        int    lost = (int)(expected - p_rxi->received);
+        uint32 expected_interval = expected - p_rxi->expected_prior;
+        uint32 received_interval = p_rxi->received - p_rxi->received_prior;
+        int    lost_interval = (int)(expected_interval - received_interval);
+        uint32 fraction = 0;
+        uint32 lsr = 0;
+        uint32 dlsr = 0;
+
+        p_rxi->expected_prior = expected;
+        p_rxi->received_prior = p_rxi->received;
+
+        if (expected_interval > 0 && lost_interval > 0)
+        {
+            fraction = ((uint32)lost_interval << 8) / expected_interval;
+        }
+
+        if (lost > 0x7FFFFF)
+        {
+            lost = 0x7FFFFF;
+        }
+        else if (lost < -0x800000)
+        {
+            lost = -0x800000;
+        }
+
+        if (p_rxi->rxf_sr)
+        {
+            lsr = ((p_rxi->sr_ntp_sec & 0xFFFF) << 16) | (p_rxi->sr_ntp_frac >> 16);
+            dlsr = (uint32)((uint64)(sys_os_get_ms() - p_rxi->sr_recv_time) * 65536 / 1000);
+        }
+
+        *(uint32 *)(p_buf + offset) = htonl(p_rxi->ssrc);
+        *(uint32 *)(p_buf + offset + 4) = htonl((fraction << 24) | ((uint32)lost & 0xFFFFFF));
+        *(uint32 *)(p_buf + offset + 8) = htonl(extended_max);
+        *(uint32 *)(p_buf + offset + 12) = htonl(p_rxi->jitter >> 4);
+        *(uint32 *)(p_buf + offset + 16) = htonl(lsr);
+        *(uint32 *)(p_buf + offset + 20) = htonl(dlsr);
+        offset += 24;
+    }
+
+    // SDES CNAME is mandatory in the compound packet
+    memset(p_buf + offset, 0, sdes_len);
+    p_buf[offset] = 0x81;
+    p_buf[offset + 1] = RTCP_SDES;
+    *(uint16 *)(p_buf + offset + 2) = htons(sdes_len / 4 - 1);
+    *(uint32 *)(p_buf + offset + 4) = htonl(ssrc);
+    p_buf[offset + 8] = 1;                      // CNAME
+    p_buf[offset + 9] = (uint8)cname_len;
+    memcpy(p_buf + offset + 10, cname, cname_len);
+    offset += sdes_len;
+
+    return offset;
+}
+
+BOOL rtcp_rtp_to_ntp(RTCPRXI * p_rxi, uint32 rtp_ts, uint64 * p_ntp)
+{
+    if (!p_rxi->rxf_sr)
+    {
+        return FALSE;
+    }
+
+    uint64 ntp = ((uint64)p_rxi->sr_ntp_sec << 32) | p_rxi->sr_ntp_frac;
+    int32  delta = (int32)(rtp_ts - p_rxi->sr_rtp_ts);
+    uint64 mag = (delta < 0) ? (uint64)(-(int64)delta) : (uint64)delta;
+    uint64 rate = p_rxi->clock_rate;
+    uint64 offset;
+
+    // shift the magnitude, split to avoid the overflow of mag * 2^32
+    offset = ((mag / rate) << 32) + (((mag % rate) << 32) / rate);
+
+    if (delta < 0)
+    {
+        ntp -= offset;
+    }
+    else
+    {
+        ntp += offset;
+    }
+
+    *p_ntp = ntp;
+
+    return TRUE;
+}
+
+
+
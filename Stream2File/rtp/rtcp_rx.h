@@ -0,0 +1,96 @@
+/***************************************************************************************
+ *
+ *  IMPORTANT: READ BEFORE DOWNLOADING, COPYING, INSTALLING OR USING.
+ *
+ *  By downloading, copying, installing or using the software you agree to this license.
+ *  If you do not agree to this license, do not download, install, 
+ *  copy or use the software.
+ *
+ *  Copyright (C) 2014-2020, Happytimesoft Corporation, all rights reserved.
+ *
+ *  Redistribution and use in binary forms, with or without modification, are permitted.
+ *
+ *  Unless required by applicable law or agreed to in writing, software distributed 
+ *  under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ *  CONDITIONS OF ANY KIND, either express or implied. See the License for the specific
+ *  language governing permissions and limitations under the License.
+ *
+****************************************************************************************/
+
+#ifndef RTCP_RX_H
+#define RTCP_RX_H
+
+#include "rtp.h"
+
+
+#define RTCP_RR_INTERVAL        5000        // receiver report interval, ms
+#define RTCP_MAX_LEN            256         // max length of the reports we send
+
+#define RTCP_NTP_OFFSET         2208988800U // seconds from 1900 to 1970
+
+
+typedef struct rtcp_rx_info
+{
+    uint32      rxf_rtp     : 1;            // rtp packet received
+    uint32      rxf_sr      : 1;            // sender report received
+    uint32      res1        : 30;
+
+    uint32      ssrc;                       // media source ssrc
+    uint32      clock_rate;                 // rtp timestamp clock rate
+
+    // rtp statistics, see RFC 3550 A.1 and A.8
+    uint32      max_seq;                    // highest seq. number seen
+    uint32      cycles;                     // shifted count of seq. number cycles
+    uint32      base_seq;                   // base seq number
+    uint32      received;                   // packets received
+    uint32      expected_prior;             // packet expected at last interval
+    uint32      received_prior;             // packet received at last interval
+    uint32      transit;                    // relative trans time for prev pkt
+    uint32      jitter;                     // estimated jitter, scaled by 16
+
+    // the last sender report
+    uint32      sr_ntp_sec;                 // NTP timestamp
+    uint32      sr_ntp_frac;
+    uint32      sr_rtp_ts;                  // RTP timestamp of the same instant
+    uint32      sr_psent;                   // sender's packet count
+    uint32      sr_osent;                   // sender's octet count
+    uint32      sr_recv_time;               // local time the report received, ms
+} RTCPRXI;
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void rtcp_rxi_init(RTCPRXI * p_rxi, uint32 clock_rate);
+
+/**
+ * Update the reception statistics with a rtp packet,
+ * arrival is the packet arrival time in monotonic microseconds (sys_os_get_us)
+ */
+void rtcp_rtp_update(RTCPRXI * p_rxi, uint8 * p_data, int len, int64 arrival);
+
+/**
+ * Parse a compound rtcp packet from the sender
+ */
+BOOL rtcp_rx(RTCPRXI * p_rxi, uint8 * p_data, int len);
+
+/**
+ * Build a compound RR + SDES(CNAME) packet, return the length
+ */
+int  rtcp_build_rr(RTCPRXI * p_rxi, uint32 ssrc, const char * cname, uint8 * p_buf, int max_len);
+
+/**
+ * Map a rtp timestamp to the 64 bits NTP time with the last sender report
+ */
+BOOL rtcp_rtp_to_ntp(RTCPRXI * p_rxi, uint32 rtp_ts, uint64 * p_ntp);
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif	// RTCP_RX_H
+
+
+
@@ -20,6 +20,18 @@
 #include "sys_inc.h"
 #include "rtp_rx.h"
 
+#if __WINDOWS_OS__
+#define rtp_atomic_inc(p)   InterlockedIncrement((LONG volatile *)(p))
+#define rtp_atomic_dec(p)   InterlockedDecrement((LONG volatile *)(p))
+#else
+#define rtp_atomic_inc(p)   __sync_add_and_fetch(p, 1)
+#define rtp_atomic_dec(p)   __sync_sub_and_fetch(p, 1)
+#endif
+
+static PPSN_CTX * rtp_pkt_fl = NULL;
+
+static uint8 rtp_start_code[4] = {0, 0, 0, 1};
+
 
 
 BOOL rtp_data_rx(RTPRXI * p_rxi, uint8 * p_data, int len)
@@ -108,6 +120,715 @@ BOOL rtp_data_rx(RTPRXI * p_rxi, uint8 * p_data, int len)
     return TRUE;
 }
 
+/***************************************************************************************/
+
+#define RTP_MAX_MISORDER    100         // older packets mean the sequence number restarted
+
+static void rtp_reorder_drain(RTPREORDER * p_ro)
+{
+    RTPSLOT * p_slot = &p_ro->slots[p_ro->base];
+
+    while (p_slot->len != 0)
+    {
+        // an oversize packet was delivered on arrival
+        if (p_slot->len > 0)
+        {
+            p_ro->pkt_func(p_slot->p_pkt, p_slot->p_data, p_slot->len, p_ro->channel, p_ro->user_data);
+        }
+
+        if (p_slot->p_pkt)
+        {
+            rtp_pkt_buf_unref(p_slot->p_pkt);
+            p_slot->p_pkt = NULL;
+        }
+        
+        p_slot->len = 0;
+        p_ro->count--;
+        p_ro->next_seq++;
+        p_ro->base = (p_ro->base + 1) % p_ro->depth;
+
+        p_slot = &p_ro->slots[p_ro->base];
+    }
+}
+
+/**
+ * Skip the missing sequence numbers till the next held packet
+ */
+static void rtp_reorder_skip(RTPREORDER * p_ro)
+{
+    while (p_ro->count > 0 && p_ro->slots[p_ro->base].len == 0)
+    {
+        p_ro->lost++;
+        p_ro->next_seq++;
+        p_ro->base = (p_ro->base + 1) % p_ro->depth;
+    }
+
+    rtp_reorder_drain(p_ro);
+
+    if (p_ro->count > 0)
+    {
+        int i;
+
+        for (i = 0; i < p_ro->depth; i++)
+        {
+            RTPSLOT * p_slot = &p_ro->slots[(p_ro->base + i) % p_ro->depth];
+            if (p_slot->len != 0)
+            {
+                p_ro->hold_time = p_slot->rx_time;
+                break;
+            }
+        }
+    }
+}
+
+BOOL rtp_frm_buf_init(RTPFRMBUF * p_frm, int size)
+{
+	memset(p_frm, 0, sizeof(RTPFRMBUF));
+
+	p_frm->p_buf_org = frm_buf_get(size + RTP_BUFF_HEAD, &p_frm->alloc_len);
+	if (NULL == p_frm->p_buf_org)
+	{
+		return FALSE;
+	}
+
+	p_frm->p_buf = p_frm->p_buf_org + RTP_BUFF_HEAD;
+	p_frm->buf_len = p_frm->alloc_len - RTP_BUFF_HEAD;
+
+	return TRUE;
+}
+
+void rtp_frm_buf_deinit(RTPFRMBUF * p_frm, const char * name)
+{
+	if (p_frm->peak_len > 0)
+	{
+		log_print(HT_LOG_INFO, "%s, %s peak frame %u, buffer %d, grow %u, drop %u\r\n", 
+			__FUNCTION__, name, p_frm->peak_len, p_frm->buf_len, p_frm->grow_cnt, p_frm->drop_cnt);
+	}
+	
+	frm_buf_free(p_frm->p_buf_org, p_frm->alloc_len);
+	
+	memset(p_frm, 0, sizeof(RTPFRMBUF));
+}
+
+BOOL rtp_frm_buf_reserve(RTPFRMBUF * p_frm, int used, int need)
+{
+	int size, alloc_len;
+	uint8 * p_buf_org;
+	
+	if ((uint32)need > p_frm->peak_len)
+	{
+		p_frm->peak_len = need;
+	}
+	
+	if (need <= p_frm->buf_len)
+	{
+		return TRUE;
+	}
+
+	size = p_frm->buf_len > 0 ? p_frm->buf_len + RTP_BUFF_HEAD : RTP_VIDEO_BUFF_INIT;
+	while (size < need + RTP_BUFF_HEAD)
+	{
+		size *= 2;
+	}
+
+	if (size > frm_buf_max_size() && need + RTP_BUFF_HEAD <= frm_buf_max_size())
+	{
+		size = frm_buf_max_size();
+	}
+	
+	p_buf_org = frm_buf_get(size, &alloc_len);
+	if (NULL == p_buf_org)
+	{
+		p_frm->drop_cnt++;
+		return FALSE;
+	}
+
+	if (p_frm->p_buf_org)
+	{
+		if (used > 0)
+		{
+			memcpy(p_buf_org + RTP_BUFF_HEAD, p_frm->p_buf, used);
+		}
+		
+		frm_buf_free(p_frm->p_buf_org, p_frm->alloc_len);
+	}
+
+	p_frm->p_buf_org = p_buf_org;
+	p_frm->p_buf = p_buf_org + RTP_BUFF_HEAD;
+	p_frm->alloc_len = alloc_len;
+	p_frm->buf_len = alloc_len - RTP_BUFF_HEAD;
+	p_frm->grow_cnt++;
+
+	return TRUE;
+}
+
+BOOL rtp_pkt_buf_init(int num)
+{
+	rtp_pkt_fl = pps_ctx_fl_init(num, sizeof(RTPPKTBUF), TRUE);
+	if (NULL == rtp_pkt_fl)
+	{
+		return FALSE;
+	}
+
+	log_print(HT_LOG_INFO, "%s, num = %lu\r\n", __FUNCTION__, rtp_pkt_fl->node_num);
+
+	return TRUE;
+}
+
+void rtp_pkt_buf_deinit()
+{
+	if (rtp_pkt_fl)
+	{
+		pps_fl_free(rtp_pkt_fl);
+		rtp_pkt_fl = NULL;
+	}
+}
+
+RTPPKTBUF * rtp_pkt_buf_get()
+{
+	RTPPKTBUF * p_pkt = NULL;
+
+	if (rtp_pkt_fl)
+	{
+		p_pkt = (RTPPKTBUF *)pps_fl_pop(rtp_pkt_fl);
+	}
+
+	if (NULL == p_pkt)
+	{
+		// pool exhausted, the buffer is freed directly when released
+		p_pkt = (RTPPKTBUF *)malloc(sizeof(RTPPKTBUF));
+		if (NULL == p_pkt)
+		{
+			return NULL;
+		}
+	}
+
+	p_pkt->ref = 1;
+	p_pkt->len = 0;
+
+	return p_pkt;
+}
+
+RTPPKTBUF * rtp_pkt_buf_alloc(int size)
+{
+	RTPPKTBUF * p_pkt;
+
+	if (size < RTP_PKT_BUF_SIZE)
+	{
+		size = RTP_PKT_BUF_SIZE;
+	}
+	
+	p_pkt = (RTPPKTBUF *)malloc(sizeof(RTPPKTBUF) - RTP_PKT_BUF_SIZE + size);
+	if (p_pkt)
+	{
+		p_pkt->ref = 1;
+		p_pkt->len = 0;
+	}
+
+	return p_pkt;
+}
+
+RTPPKTBUF * rtp_pkt_buf_dup(uint8 * p_data, int len)
+{
+	RTPPKTBUF * p_pkt;
+	
+	if (len > RTP_PKT_BUF_SIZE)
+	{
+		// large packet, not from the pool
+		p_pkt = rtp_pkt_buf_alloc(len);
+	}
+	else
+	{
+		p_pkt = rtp_pkt_buf_get();
+	}
+	
+	if (p_pkt)
+	{
+		memcpy(p_pkt->data, p_data, len);
+		p_pkt->len = len;
+	}
+
+	return p_pkt;
+}
+
+void rtp_pkt_buf_ref(RTPPKTBUF * p_pkt)
+{
+	rtp_atomic_inc(&p_pkt->ref);
+}
+
+void rtp_pkt_buf_unref(RTPPKTBUF * p_pkt)
+{
+	if (NULL == p_pkt || rtp_atomic_dec(&p_pkt->ref) > 0)
+	{
+		return;
+	}
+
+	if (rtp_pkt_fl && pps_safe_node(rtp_pkt_fl, p_pkt))
+	{
+		pps_fl_push_tail(rtp_pkt_fl, p_pkt);
+	}
+	else
+	{
+		free(p_pkt);
+	}
+}
+
+#define RTP_FRM_ARRAY_SIZE(iov_max, nal_max) \
+	((iov_max) * (sizeof(RTPIOV) + sizeof(RTPPKTBUF *)) + (nal_max) * sizeof(int))
+
+static void rtp_frm_iov_layout(RTPFRMIOV * p_frm, uint8 * p_mem, int iov_max, int nal_max)
+{
+	// iov first, it has the stricter alignment
+	p_frm->iov = (RTPIOV *)p_mem;
+	p_frm->pkts = (RTPPKTBUF **)(p_frm->iov + iov_max);
+	p_frm->nal_idx = (int *)(p_frm->pkts + iov_max);
+	p_frm->iov_max = iov_max;
+	p_frm->nal_max = nal_max;
+}
+
+static RTPFRMIOV * rtp_frm_iov_alloc(int iov_max, int nal_max)
+{
+	RTPFRMIOV * p_frm;
+	int size = sizeof(RTPFRMIOV) + RTP_FRM_ARRAY_SIZE(iov_max, nal_max);
+
+	p_frm = (RTPFRMIOV *)malloc(size);
+	if (NULL == p_frm)
+	{
+		log_print(HT_LOG_ERR, "%s, malloc failed, size %d\r\n", __FUNCTION__, size);
+		return NULL;
+	}
+
+	memset(p_frm, 0, sizeof(RTPFRMIOV));
+
+	rtp_frm_iov_layout(p_frm, (uint8 *)(p_frm + 1), iov_max, nal_max);
+
+	return p_frm;
+}
+
+/**
+ * Move the arrays to a larger slab, the slices already in the chain are kept
+ */
+static BOOL rtp_frm_iov_grow(RTPFRMIOV * p_frm, int iov_max, int nal_max)
+{
+	uint8 * p_slab;
+	int size;
+	RTPFRMIOV old = *p_frm;
+
+	if (iov_max > RTP_FRM_IOV_LIMIT || nal_max > RTP_FRM_NAL_LIMIT)
+	{
+		return FALSE;
+	}
+
+	size = RTP_FRM_ARRAY_SIZE(iov_max, nal_max);
+	
+	p_slab = (uint8 *)malloc(size);
+	if (NULL == p_slab)
+	{
+		log_print(HT_LOG_ERR, "%s, malloc failed, size %d\r\n", __FUNCTION__, size);
+		return FALSE;
+	}
+
+	rtp_frm_iov_layout(p_frm, p_slab, iov_max, nal_max);
+
+	memcpy(p_frm->iov, old.iov, old.iov_cnt * sizeof(RTPIOV));
+	memcpy(p_frm->pkts, old.pkts, old.pkt_cnt * sizeof(RTPPKTBUF *));
+	memcpy(p_frm->nal_idx, old.nal_idx, old.nal_cnt * sizeof(int));
+
+	if (old.p_slab)
+	{
+		free(old.p_slab);
+	}
+	
+	p_frm->p_slab = p_slab;
+
+	log_print(HT_LOG_INFO, "%s, frame chain grown to %d slices, %d nal units\r\n", 
+		__FUNCTION__, iov_max, nal_max);
+	
+	return TRUE;
+}
+
+RTPFRMIOV * rtp_frm_iov_new(int iov_max)
+{
+	return rtp_frm_iov_alloc(iov_max, RTP_FRM_NAL_MAX);
+}
+
+RTPFRMIOV * rtp_frm_iov_clone(RTPFRMIOV * p_frm)
+{
+	int i;
+	RTPFRMIOV * p_new = rtp_frm_iov_alloc(p_frm->iov_cnt > 0 ? p_frm->iov_cnt : 1, 
+		p_frm->nal_cnt > 0 ? p_frm->nal_cnt : 1);
+	if (NULL == p_new)
+	{
+		return NULL;
+	}
+
+	p_new->iov_cnt = p_frm->iov_cnt;
+	p_new->len = p_frm->len;
+	p_new->nal_cnt = p_frm->nal_cnt;
+	memcpy(p_new->nal_idx, p_frm->nal_idx, p_frm->nal_cnt * sizeof(int));
+	memcpy(p_new->iov, p_frm->iov, p_frm->iov_cnt * sizeof(RTPIOV));
+	
+	for (i = 0; i < p_frm->pkt_cnt; i++)
+	{
+		rtp_pkt_buf_ref(p_frm->pkts[i]);
+		p_new->pkts[i] = p_frm->pkts[i];
+	}
+
+	p_new->pkt_cnt = p_frm->pkt_cnt;
+
+	return p_new;
+}
+
+void rtp_frm_iov_free(RTPFRMIOV * p_frm)
+{
+	rtp_frm_iov_reset(p_frm);
+
+	if (p_frm->p_slab)
+	{
+		free(p_frm->p_slab);
+	}
+	
+	free(p_frm);
+}
+
+void rtp_frm_iov_reset(RTPFRMIOV * p_frm)
+{
+	int i;
+
+	for (i = 0; i < p_frm->pkt_cnt; i++)
+	{
+		rtp_pkt_buf_unref(p_frm->pkts[i]);
+	}
+
+	p_frm->pkt_cnt = 0;
+	p_frm->iov_cnt = 0;
+	p_frm->nal_cnt = 0;
+	p_frm->len = 0;
+}
+
+BOOL rtp_frm_iov_nal(RTPFRMIOV * p_frm)
+{
+	if (p_frm->iov_cnt >= p_frm->iov_max || p_frm->nal_cnt >= p_frm->nal_max)
+	{
+		int iov_max = p_frm->iov_cnt >= p_frm->iov_max ? p_frm->iov_max * 2 : p_frm->iov_max;
+		int nal_max = p_frm->nal_cnt >= p_frm->nal_max ? p_frm->nal_max * 2 : p_frm->nal_max;
+
+		if (!rtp_frm_iov_grow(p_frm, iov_max, nal_max))
+		{
+			return FALSE;
+		}
+	}
+
+	p_frm->nal_idx[p_frm->nal_cnt++] = p_frm->iov_cnt;
+	
+	p_frm->iov[p_frm->iov_cnt].iov_base = rtp_start_code;
+	p_frm->iov[p_frm->iov_cnt].iov_len = 4;
+	p_frm->iov_cnt++;
+	p_frm->len += 4;
+
+	return TRUE;
+}
+
+BOOL rtp_frm_iov_add(RTPFRMIOV * p_frm, RTPPKTBUF * p_pkt, uint8 * p_data, int len)
+{
+	if (p_frm->iov_cnt >= p_frm->iov_max || p_frm->pkt_cnt >= p_frm->iov_max)
+	{
+		if (!rtp_frm_iov_grow(p_frm, p_frm->iov_max * 2, p_frm->nal_max))
+		{
+			return FALSE;
+		}
+	}
+
+	if (len <= 0)
+	{
+		return TRUE;
+	}
+	
+	// one reference for all slices of the same packet
+	if (p_frm->pkt_cnt == 0 || p_frm->pkts[p_frm->pkt_cnt-1] != p_pkt)
+	{
+		rtp_pkt_buf_ref(p_pkt);
+		p_frm->pkts[p_frm->pkt_cnt++] = p_pkt;
+	}
+
+	p_frm->iov[p_frm->iov_cnt].iov_base = p_data;
+	p_frm->iov[p_frm->iov_cnt].iov_len = len;
+	p_frm->iov_cnt++;
+	p_frm->len += len;
+
+	return TRUE;
+}
+
+BOOL rtp_frm_iov_put(RTPFRMIOV * p_frm, RTPPKTBUF * p_pkt, uint8 * p_data, int len, BOOL new_nal)
+{
+	BOOL ret;
+	RTPPKTBUF * p_dup = NULL;
+
+	if (!new_nal && p_frm->nal_cnt == 0)
+	{
+		// the nal unit start is missed
+		return FALSE;
+	}
+	
+	if (NULL == p_pkt)
+	{
+		p_dup = rtp_pkt_buf_dup(p_data, len);
+		if (NULL == p_dup)
+		{
+			return FALSE;
+		}
+
+		p_pkt = p_dup;
+		p_data = p_dup->data;
+	}
+
+	ret = (!new_nal || rtp_frm_iov_nal(p_frm)) && rtp_frm_iov_add(p_frm, p_pkt, p_data, len);
+
+	if (p_dup)
+	{
+		rtp_pkt_buf_unref(p_dup);	// the frame chain holds its own reference
+	}
+
+	if (!ret)
+	{
+		log_print(HT_LOG_ERR, "%s, too many slices %d, nal units %d, drop frame\r\n", 
+			__FUNCTION__, p_frm->iov_cnt, p_frm->nal_cnt);
+		
+		rtp_frm_iov_reset(p_frm);
+	}
+
+	return ret;
+}
+
+int rtp_frm_iov_nal_range(RTPFRMIOV * p_frm, int nal, int * p_first, int * p_cnt)
+{
+	int i, len = 0;
+	int first = p_frm->nal_idx[nal];
+	int last = (nal + 1 < p_frm->nal_cnt) ? p_frm->nal_idx[nal+1] : p_frm->iov_cnt;
+
+	for (i = first; i < last; i++)
+	{
+		len += p_frm->iov[i].iov_len;
+	}
+
+	*p_first = first;
+	*p_cnt = last - first;
+
+	return len;
+}
+
+int rtp_frm_iov_copy(RTPFRMIOV * p_frm, int first, int cnt, uint8 * p_buf)
+{
+	int i, len = 0;
+
+	for (i = first; i < first + cnt; i++)
+	{
+		memcpy(p_buf + len, p_frm->iov[i].iov_base, p_frm->iov[i].iov_len);
+		len += p_frm->iov[i].iov_len;
+	}
+
+	return len;
+}
+
+BOOL rtp_reorder_init(RTPREORDER * p_ro, int depth, uint32 depth_ms, RTPPKTCBF cbf, int channel, void * p_userdata)
+{
+    int i;
+    
+    memset(p_ro, 0, sizeof(RTPREORDER));
+
+    if (depth <= 0)
+    {
+        return TRUE;
+    }
+    else if (depth > RTP_REORDER_MAX)
+    {
+        depth = RTP_REORDER_MAX;
+    }
+
+    p_ro->p_buf = (uint8 *)malloc(depth * RTP_REORDER_PKT_SIZE);
+    if (NULL == p_ro->p_buf)
+    {
+        log_print(HT_LOG_ERR, "%s, malloc failed\r\n", __FUNCTION__);
+        return FALSE;
+    }
+
+    for (i = 0; i < depth; i++)
+    {
+        p_ro->slots[i].p_buf = p_ro->p_buf + i * RTP_REORDER_PKT_SIZE;
+    }
+
+    p_ro->depth = depth;
+    p_ro->depth_ms = depth_ms;
+    p_ro->pkt_func = cbf;
+    p_ro->channel = channel;
+    p_ro->user_data = p_userdata;
+
+    return TRUE;
+}
+
+void rtp_reorder_deinit(RTPREORDER * p_ro)
+{
+    int i;
+    
+    for (i = 0; i < p_ro->depth; i++)
+    {
+        if (p_ro->slots[i].p_pkt)
+        {
+            rtp_pkt_buf_unref(p_ro->slots[i].p_pkt);
+        }
+    }
+    
+    if (p_ro->depth > 0)
+    {
+        log_print(HT_LOG_INFO, "%s, channel %d, reordered %u, lost %u, late %u\r\n", 
+            __FUNCTION__, p_ro->channel, p_ro->reordered, p_ro->lost, p_ro->late);
+    }
+    
+    if (p_ro->p_buf)
+    {
+        free(p_ro->p_buf);
+    }
+
+    memset(p_ro, 0, sizeof(RTPREORDER));
+}
+
+/**
+ * The window expired, declare the missing packets lost
+ */
+static void rtp_reorder_expire(RTPREORDER * p_ro, uint32 now)
+{
+    while (p_ro->count > 0 && 
+        (p_ro->count >= p_ro->depth - 1 || now - p_ro->hold_time >= p_ro->depth_ms))
+    {
+        rtp_reorder_skip(p_ro);
+    }
+}
+
+/**
+ * Release all the held packets in sequence order
+ */
+void rtp_reorder_flush(RTPREORDER * p_ro)
+{
+    while (p_ro->count > 0)
+    {
+        rtp_reorder_skip(p_ro);
+    }
+}
+
+void rtp_reorder_put(RTPREORDER * p_ro, RTPPKTBUF * p_pkt, uint8 * p_data, int len)
+{
+    if (p_ro->depth == 0)
+    {
+        p_ro->pkt_func(p_pkt, p_data, len, p_ro->channel, p_ro->user_data);
+        return;
+    }
+    
+    if (len < 12)
+    {
+        return;
+    }
+
+    uint16 seq = ntohs(*(uint16 *)(p_data + 2));
+    uint32 now = sys_os_get_ms();
+
+    if (!p_ro->rxf_init)
+    {
+        p_ro->rxf_init = 1;
+        p_ro->next_seq = seq;
+    }
+
+    int diff = (short)(seq - (uint16)p_ro->next_seq);
+    if (diff < 0)
+    {
+        if (diff >= -RTP_MAX_MISORDER)
+        {
+            p_ro->late++;   // duplicated or already declared lost
+            return;
+        }
+
+        // sequence number restarted
+        rtp_reorder_flush(p_ro);
+        p_ro->next_seq = seq;
+        diff = 0;
+    }
+    else if (diff >= p_ro->depth)
+    {
+        // out of the window, release all and continue from this packet
+        rtp_reorder_flush(p_ro);
+
+        p_ro->lost += (uint16)(seq - (uint16)p_ro->next_seq);
+        p_ro->next_seq = seq;
+        diff = 0;
+    }
+
+    if (diff == 0)
+    {
+        // in order, no copy
+        p_ro->pkt_func(p_pkt, p_data, len, p_ro->channel, p_ro->user_data);
+        
+        p_ro->next_seq++;
+        p_ro->base = (p_ro->base + 1) % p_ro->depth;
+
+        if (p_ro->count > 0)
+        {
+            rtp_reorder_drain(p_ro);
+        }
+    }
+    else
+    {
+        RTPSLOT * p_slot = &p_ro->slots[(p_ro->base + diff) % p_ro->depth];
+        if (p_slot->len != 0)
+        {
+            p_ro->late++;   // duplicated
+            return;
+        }
+
+        if (p_pkt)
+        {
+            // hold the packet buffer, no copy
+            rtp_pkt_buf_ref(p_pkt);
+            p_slot->p_pkt = p_pkt;
+            p_slot->p_data = p_data;
+            p_slot->len = len;
+        }
+        else if (len > RTP_REORDER_PKT_SIZE)
+        {
+            // does not fit the slot, pass it through and keep its sequence number
+            p_ro->pkt_func(NULL, p_data, len, p_ro->channel, p_ro->user_data);
+            p_slot->len = -1;
+        }
+        else
+        {
+            memcpy(p_slot->p_buf, p_data, len);
+            p_slot->p_data = p_slot->p_buf;
+            p_slot->len = len;
+        }
+        
+        p_slot->rx_time = now;
+
+        if (p_ro->count == 0)
+        {
+            p_ro->hold_time = now;
+        }
+        
+        p_ro->count++;
+        p_ro->reordered++;
+    }
+
+    rtp_reorder_expire(p_ro, now);
+}
+
+/**
+ * Called periodically by the receiving thread, the held packets of
+ * a stream that stopped sending are released after depth_ms
+ */
+void rtp_reorder_timer(RTPREORDER * p_ro)
+{
+    if (p_ro->depth > 0 && p_ro->count > 0)
+    {
+        rtp_reorder_expire(p_ro, sys_os_get_ms());
+    }
+}
 
 
 
@@ -21,11 +21,29 @@
 #define RTP_RX_H
 
 
-#define RTP_MAX_VIDEO_BUFF      (1024*1024)
+#define RTP_VIDEO_BUFF_INIT     (64*1024)   // initial video frame buffer, grows up to frm_buf_max_size()
 #define RTP_MAX_AUDIO_BUFF      (8*1024)
+#define RTP_BUFF_HEAD           32          // reserved room before the frame data
+
+#define RTP_REORDER_MAX         128         // max reorder depth, packets
+#define RTP_REORDER_PKT_SIZE    2048        // max reorder packet size
+
+#define RTP_PKT_BUF_SIZE        2048        // reference counted packet buffer size
+#define RTP_FRM_IOV_MAX         1024        // initial slices of one frame chain
+#define RTP_FRM_NAL_MAX         128         // initial nal units of one frame chain
+#define RTP_FRM_IOV_LIMIT       16384       // the chain grows up to, beyond the frame buffer cap
+#define RTP_FRM_NAL_LIMIT       4096
+
+// the frame slices are written to the file as they are
+typedef HFIOV RTPIOV;
 
 
 typedef int (*VRTPRXCBF)(uint8 * p_data, int len, uint32 ts, uint32 seq, void * p_userdata);
+struct rtp_pkt_buf;
+typedef void (*RTPPKTCBF)(struct rtp_pkt_buf * p_pkt, uint8 * p_data, int len, int channel, void * p_userdata);
+
+struct rtp_frame_iov;
+typedef int (*VRTPIOVCBF)(struct rtp_frame_iov * p_frm, uint32 ts, uint32 seq, void * p_userdata);
 
 
 typedef struct
@@ -43,11 +61,159 @@ typedef struct
     int         len;
 } RTPRXI;
 
+/**
+ * Frame assembly buffer, allocated from the frame buffer pool and grown
+ * geometrically when a frame does not fit
+ */
+typedef struct
+{
+    uint8     * p_buf_org;              // pooled buffer
+    uint8     * p_buf;                  // = p_buf_org + RTP_BUFF_HEAD
+    int         buf_len;                // usable length
+    int         alloc_len;              // pool size class of p_buf_org
+    
+    uint32      peak_len;               // largest frame seen
+    uint32      grow_cnt;               // buffer grow times
+    uint32      drop_cnt;               // frames dropped over the cap
+} RTPFRMBUF;
+
+/**
+ * Reference counted packet buffer, the frame chains keep the packets
+ * alive until the frame is written
+ */
+typedef struct rtp_pkt_buf
+{
+    volatile long ref;                  // reference count
+    int         len;                    // data length
+    uint8       data[RTP_PKT_BUF_SIZE];  // longer when not from the pool
+} RTPPKTBUF;
+
+/**
+ * Scatter-gather frame, the payload slices point into the received packets,
+ * each nal unit is preceded by a 4 bytes start code slice.
+ * The arrays follow the structure, they are moved to p_slab when a large
+ * frame needs more room, and stay grown for the next frames
+ */
+typedef struct rtp_frame_iov
+{
+    int         iov_cnt;                // used slices
+    int         iov_max;                // slice capacity, also bounds pkt_cnt
+    int         len;                    // total length, start codes included
+    int         nal_cnt;                // nal units
+    int         nal_max;                // nal unit capacity
+    int       * nal_idx;                // start code slice index of each nal unit
+    int         pkt_cnt;                // referenced packets
+    RTPPKTBUF **pkts;
+    RTPIOV    * iov;
+    void      * p_slab;                 // grown arrays, NULL - the arrays follow the structure
+} RTPFRMIOV;
+
+typedef struct
+{
+    uint8     * p_buf;                  // slot copy buffer
+    RTPPKTBUF * p_pkt;                  // held packet buffer, NULL - copied into p_buf
+    uint8     * p_data;                 // held packet data
+    int         len;                    // packet length, 0 - empty slot, -1 - oversize packet passed through
+    uint32      rx_time;                // arrival time, ms
+} RTPSLOT;
+
+/**
+ * RTP reorder buffer, holds the out of order packets until the missing 
+ * sequence numbers arrive, or the window (packets or ms) expires
+ */
+typedef struct
+{
+    uint32      rxf_init    : 1;        // next_seq is valid
+    uint32      res1        : 15;
+    uint32      next_seq    : 16;       // next expected sequence number
+
+    int         depth;                  // max held packets, 0 - disabled
+    uint32      depth_ms;               // max hold time, ms
+    int         base;                   // slot index of next_seq
+    int         count;                  // held packets
+    uint32      hold_time;              // arrival time of the first held packet
+
+    uint32      reordered;              // packets held out of order
+    uint32      lost;                   // packets declared lost
+    uint32      late;                   // packets arrived after declared lost
+    
+    uint8     * p_buf;                  // slot buffers
+    RTPSLOT     slots[RTP_REORDER_MAX];
+
+    RTPPKTCBF   pkt_func;               // in order packet callback
+    int         channel;                // passed back to pkt_func
+    void      * user_data;
+} RTPREORDER;
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
-int rtp_data_rx(RTPRXI * p_rxi, uint8 * p_data, int len);
+int  rtp_data_rx(RTPRXI * p_rxi, uint8 * p_data, int len);
+
+BOOL rtp_frm_buf_init(RTPFRMBUF * p_frm, int size);
+void rtp_frm_buf_deinit(RTPFRMBUF * p_frm, const char * name);
+
+/**
+ * Make room for need bytes of frame data, the first used bytes are kept.
+ * Return FALSE when need exceeds the frame buffer cap
+ */
+BOOL rtp_frm_buf_reserve(RTPFRMBUF * p_frm, int used, int need);
+
+BOOL        rtp_pkt_buf_init(int num);
+void        rtp_pkt_buf_deinit();
+RTPPKTBUF * rtp_pkt_buf_get();
+RTPPKTBUF * rtp_pkt_buf_dup(uint8 * p_data, int len);
+
+/**
+ * Allocate a reference counted buffer with room for size bytes, not from the pool
+ */
+RTPPKTBUF * rtp_pkt_buf_alloc(int size);
+void        rtp_pkt_buf_ref(RTPPKTBUF * p_pkt);
+void        rtp_pkt_buf_unref(RTPPKTBUF * p_pkt);
+
+/**
+ * Allocate a frame chain with room for iov_max slices and RTP_FRM_NAL_MAX nal units,
+ * the chain grows up to RTP_FRM_IOV_LIMIT slices and RTP_FRM_NAL_LIMIT nal units
+ */
+RTPFRMIOV * rtp_frm_iov_new(int iov_max);
+
+/**
+ * Copy the chain into an exact sized new one, the packets are shared 
+ * by taking another reference, so the clone may outlive the source
+ */
+RTPFRMIOV * rtp_frm_iov_clone(RTPFRMIOV * p_frm);
+void rtp_frm_iov_free(RTPFRMIOV * p_frm);
+
+void rtp_frm_iov_reset(RTPFRMIOV * p_frm);
+BOOL rtp_frm_iov_nal(RTPFRMIOV * p_frm);
+BOOL rtp_frm_iov_add(RTPFRMIOV * p_frm, RTPPKTBUF * p_pkt, uint8 * p_data, int len);
+
+/**
+ * Append the payload to the frame chain, a new nal unit is started if new_nal is set.
+ * When p_pkt is NULL the payload is not in a reference counted buffer and is copied
+ */
+BOOL rtp_frm_iov_put(RTPFRMIOV * p_frm, RTPPKTBUF * p_pkt, uint8 * p_data, int len, BOOL new_nal);
+
+/**
+ * Get the slice range and length of the nal unit, the start code is included
+ */
+int  rtp_frm_iov_nal_range(RTPFRMIOV * p_frm, int nal, int * p_first, int * p_cnt);
+
+/**
+ * Gather cnt slices from first into p_buf, return the copied length
+ */
+int  rtp_frm_iov_copy(RTPFRMIOV * p_frm, int first, int cnt, uint8 * p_buf);
+
+BOOL rtp_reorder_init(RTPREORDER * p_ro, int depth, uint32 depth_ms, RTPPKTCBF cbf, int channel, void * p_userdata);
+void rtp_reorder_deinit(RTPREORDER * p_ro);
+/**
+ * Put the packet in, a packet in a reference counted buffer is held by 
+ * taking a reference, otherwise it is copied into the slot (p_pkt is NULL)
+ */
+void rtp_reorder_put(RTPREORDER * p_ro, RTPPKTBUF * p_pkt, uint8 * p_data, int len);
+void rtp_reorder_flush(RTPREORDER * p_ro);
+void rtp_reorder_timer(RTPREORDER * p_ro);
 
 #ifdef __cplusplus
 }
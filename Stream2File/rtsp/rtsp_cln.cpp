@@ -56,6 +56,55 @@ void * rtsp_udp_rx_thread(void * argv)
 	return NULL;
 }
 
+void rtsp_tcp_rx_cb(SOCKET fd, void * arg)
+{
+	CRtspClient * pRtsp = (CRtspClient *)arg;
+
+	pRtsp->tcp_rx_event(fd);
+}
+
+void rtsp_udp_rx_cb(SOCKET fd, void * arg)
+{
+	CRtspClient * pRtsp = (CRtspClient *)arg;
+
+	pRtsp->udp_rx_event(fd);
+}
+
+void rtsp_udp_rtp_cb(RTPPKTBUF * p_pkt, uint8 * p_data, int len, int channel, void * arg)
+{
+	CRtspClient * pRtsp = (CRtspClient *)arg;
+
+	pRtsp->udp_rtp_rx(p_pkt, p_data, len, channel);
+}
+
+void rtsp_keep_alive_cb(void * arg)
+{
+	CRtspClient * pRtsp = (CRtspClient *)arg;
+
+	pRtsp->keep_alive_timer();
+}
+
+void rtsp_rtcp_cb(void * arg)
+{
+	CRtspClient * pRtsp = (CRtspClient *)arg;
+
+	pRtsp->rtcp_timer();
+}
+
+void rtsp_reorder_cb(void * arg)
+{
+	CRtspClient * pRtsp = (CRtspClient *)arg;
+
+	pRtsp->reorder_timer();
+}
+
+void rtsp_nodata_cb(void * arg)
+{
+	CRtspClient * pRtsp = (CRtspClient *)arg;
+
+	pRtsp->nodata_timer();
+}
+
 int video_data_cb(uint8 * p_data, int len, uint32 ts, uint32 seq, void * p_userdata)
 {
 	CRtspClient * pthis = (CRtspClient *)p_userdata;
@@ -65,6 +114,15 @@ int video_data_cb(uint8 * p_data, int len, uint32 ts, uint32 seq, void * p_userd
 	return 0;
 }
 
+int video_iov_data_cb(RTPFRMIOV * p_frm, uint32 ts, uint32 seq, void * p_userdata)
+{
+	CRtspClient * pthis = (CRtspClient *)p_userdata;
+
+	pthis->rtsp_video_iov_data_cb(p_frm, ts, seq);
+
+	return 0;
+}
+
 int audio_data_cb(uint8 * p_data, int len, uint32 ts, uint32 seq, void * p_userdata)
 {
 	CRtspClient * pthis = (CRtspClient *)p_userdata;
@@ -82,16 +140,41 @@ CRtspClient::CRtspClient(void)
 	m_pNotify = NULL;
 	m_pUserdata = NULL;
 	m_pVideoCB = NULL;
+	m_pVideoIovCB = NULL;
 	m_pAudioCB = NULL;
 #ifdef METADATA	
 	m_pMetadataCB = NULL;
 #endif	
 	m_pMutex = sys_os_create_mutex();
+	m_pEvMutex = sys_os_create_mutex();
 	
     m_bRunning = TRUE;
 	m_tcpRxTid = 0;
 	m_udpRxTid = 0;
 
+	m_pLoop = NULL;
+	m_pTcpEv = NULL;
+	memset(m_pUdpEv, 0, sizeof(m_pUdpEv));
+	m_pKeepTm = NULL;
+	m_pNodataTm = NULL;
+	m_nRxTime = 0;
+	m_bNodata = FALSE;
+	m_nRxBufSize = RTSP_RX_BUF_SIZE;
+	m_nUdpRcvBuf = RTSP_UDP_RCVBUF;
+	m_nUdpTstamp = 0;
+	memset(m_pUdpPkt, 0, sizeof(m_pUdpPkt));
+	m_pRxPkt = NULL;
+	m_pRxRing = NULL;
+	m_nReorderDepth = RTSP_REORDER_DEPTH;
+	m_nReorderTime = RTSP_REORDER_TIME;
+	memset(m_reorder, 0, sizeof(m_reorder));
+	m_pReorderTm = NULL;
+	memset(m_rtcp, 0, sizeof(m_rtcp));
+	m_nRtcpSsrc = 0;
+	m_nRtcpTime = 0;
+	m_pRtcpTm = NULL;
+	memset(m_pRtcpEv, 0, sizeof(m_pRtcpEv));
+
 	memset(&h265rxi, 0, sizeof(H265RXI));
 	memset(&aacrxi, 0, sizeof(AACRXI));
 	memset(&rtprxi, 0, sizeof(RTPRXI));
@@ -108,6 +191,21 @@ CRtspClient::~CRtspClient(void)
 		sys_os_destroy_sig_mutex(m_pMutex);
 		m_pMutex = NULL;
 	}
+
+	if (m_pEvMutex)
+	{
+		sys_os_destroy_sig_mutex(m_pEvMutex);
+		m_pEvMutex = NULL;
+	}
+
+	for (int i = 0; i < RTSP_UDP_BATCH; i++)
+	{
+		if (m_pUdpPkt[i])
+		{
+			rtp_pkt_buf_unref(m_pUdpPkt[i]);
+			m_pUdpPkt[i] = NULL;
+		}
+	}
 }
 
 void CRtspClient::set_default()
@@ -119,6 +217,8 @@ void CRtspClient::set_default()
     m_nport = 554;
     m_rua.rtp_tcp = 1;  // default RTP over RTSP
 	m_rua.session_timeout = 60;
+	m_rua.udp_rcvbuf = m_nUdpRcvBuf;
+	m_rua.udp_tstamp = m_nUdpTstamp;
 	strcpy(m_rua.user_agent, "happytimesoft rtsp client");
         
     m_pAudioConfig = NULL;
@@ -311,7 +411,7 @@ void CRtspClient::rtsp_get_mpeg4_config(RCUA * p_rua)
     if (configData)
     {				
     	mpeg4rxi.hdr_len = configLen;
-    	memcpy(mpeg4rxi.p_buf, configData, configLen);
+    	memcpy(mpeg4rxi.frm.p_buf, configData, configLen);
 
         delete[] configData;   
     }
@@ -405,7 +505,7 @@ BOOL CRtspClient::rtsp_get_transport_info(RCUA * p_rua, HRTSP_MSG * rx_msg, int
 	}
 	else
 	{
-	    ret = rtsp_get_udp_transport_info(rx_msg, &p_rua->channels[av_t].l_port, &p_rua->channels[av_t].r_port);
+	    ret = rtsp_get_udp_transport_info(rx_msg, &p_rua->channels[av_t].l_port, &p_rua->channels[av_t].r_port, &p_rua->channels[av_t].r_rtcp_port);
     }
 
     return ret;
@@ -800,6 +900,25 @@ BOOL CRtspClient::rtsp_play_res(RCUA * p_rua, HRTSP_MSG * rx_msg)
 		p_rua->state = RCS_PLAYING;
 		p_rua->keepalive_time = sys_os_get_ms();
 
+		sys_os_mutex_enter(m_pEvMutex);
+		if (m_pLoop)
+		{
+			int timeout = p_rua->session_timeout > 11 ? p_rua->session_timeout - 10 : 1;
+
+			if (m_pKeepTm)
+			{
+				hreactor_del(m_pKeepTm);
+			}
+
+			m_pKeepTm = hreactor_add_timer(m_pLoop, timeout * 1000, TRUE, rtsp_keep_alive_cb, this);
+
+			if (NULL == m_pRtcpTm)
+			{
+				m_pRtcpTm = hreactor_add_timer(m_pLoop, RTCP_RR_INTERVAL, TRUE, rtsp_rtcp_cb, this);
+			}
+		}
+		sys_os_mutex_leave(m_pEvMutex);
+
 		log_print(HT_LOG_DBG, "%s, session timeout : %d\n", __FUNCTION__, p_rua->session_timeout);
 
 		if (m_AudioCodec == AUDIO_CODEC_AAC)
@@ -1232,6 +1351,48 @@ void CRtspClient::set_replay_range(time_t start, time_t end)
 
 #endif // REPLAY
 
+void CRtspClient::set_rx_buf_size(int size)
+{
+	if (size < RTSP_RX_BUF_MIN)
+	{
+		size = RTSP_RX_BUF_MIN;
+	}
+	else if (size > RTSP_RX_BUF_MAX)
+	{
+		size = RTSP_RX_BUF_MAX;
+	}
+
+	m_nRxBufSize = size;
+}
+
+void CRtspClient::set_udp_rcvbuf(int size)
+{
+	m_nUdpRcvBuf = size;
+	m_rua.udp_rcvbuf = size;
+}
+
+void CRtspClient::set_udp_timestamp(int flag)
+{
+	m_nUdpTstamp = flag ? 1 : 0;
+	m_rua.udp_tstamp = m_nUdpTstamp;
+}
+
+uint32 CRtspClient::get_udp_drops(int av_t)
+{
+	if (av_t < 0 || av_t >= AV_MAX_CHS)
+	{
+		return 0;
+	}
+
+	return m_rua.channels[av_t].rx_drops;
+}
+
+void CRtspClient::set_reorder_depth(int depth, int ms)
+{
+	m_nReorderDepth = depth;
+	m_nReorderTime = ms;
+}
+
 #ifdef OVER_HTTP
 
 void CRtspClient::set_rtsp_over_http(int flag, int port)
@@ -1485,16 +1646,33 @@ BOOL CRtspClient::rtsp_client_state(RCUA * p_rua, HRTSP_MSG * rx_msg)
 }
 
 BOOL CRtspClient::make_prepare_play()
-{    
+{
+	m_nRtcpSsrc = (uint32)rand() ^ (uint32)(size_t)this ^ sys_os_get_ms();
+	m_nRtcpTime = sys_os_get_ms();
+	
+	rtcp_rxi_init(&m_rtcp[AV_VIDEO_CH], 90000);
+	rtcp_rxi_init(&m_rtcp[AV_AUDIO_CH], m_nSamplerate > 0 ? m_nSamplerate : 8000);
+	rtcp_rxi_init(&m_rtcp[AV_METADATA_CH], 90000);
+	
 	if (m_rua.channels[AV_VIDEO_CH].ctl[0] != '\0')
 	{
 		if (m_VideoCodec == VIDEO_CODEC_H264)
 		{
 			h264_rxi_init(&h264rxi, video_data_cb, this);
+
+			if (m_pVideoIovCB)
+			{
+				h264_rxi_set_iov(&h264rxi, video_iov_data_cb);
+			}
 		}
 		else if (m_VideoCodec == VIDEO_CODEC_H265)
 		{
 			h265_rxi_init(&h265rxi, video_data_cb, this);
+
+			if (m_pVideoIovCB)
+			{
+				h265_rxi_set_iov(&h265rxi, video_iov_data_cb);
+			}
 		}
 		else if (m_VideoCodec == VIDEO_CODEC_JPEG)
 		{
@@ -1520,7 +1698,19 @@ BOOL CRtspClient::make_prepare_play()
 
 	if (!m_rua.rtp_tcp)
 	{
-    	m_udpRxTid = sys_os_create_thread((void *)rtsp_udp_rx_thread, this);
+		for (int i = 0; i < AV_METADATA_CH+1; i++)
+		{
+			rtp_reorder_init(&m_reorder[i], m_nReorderDepth, m_nReorderTime, rtsp_udp_rtp_cb, i, this);
+		}
+		
+		if (m_pLoop)
+		{
+			rx_attach_udp();
+		}
+		else
+		{
+    		m_udpRxTid = sys_os_create_thread((void *)rtsp_udp_rx_thread, this);
+    	}
     }
 
     return TRUE;
@@ -1531,17 +1721,33 @@ void CRtspClient::tcp_data_rx(uint8 * lpData, int rlen)
 	RILF * p_rilf = (RILF *)lpData;
 	uint8 * p_rtp = (uint8 *)p_rilf + 4;
 	uint32 rtp_len = rlen - 4;
+	RTPPKTBUF * p_pkt = m_pRxPkt;
 
-	if (rtp_len >= 2 && RTP_PT_IS_RTCP(p_rtp[1])) // now, don't handle rtcp packet ...
+	// set by rtsp_tcp_rx_data when the packet is in the receive ring
+	m_pRxPkt = NULL;
+
+	if (rtp_len >= 2 && RTP_PT_IS_RTCP(p_rtp[1]))
 	{
+		for (int i = 0; i < AV_METADATA_CH+1; i++)
+		{
+			if (m_rua.channels[i].ctl[0] != '\0' &&
+				(p_rilf->channel == m_rua.channels[i].interleaved || p_rilf->channel == m_rua.channels[i].interleaved + 1))
+			{
+				rtcp_rx(&m_rtcp[i], p_rtp, rtp_len);
+				break;
+			}
+		}
+		
 		return;
 	}
 	
 	if (p_rilf->channel == m_rua.channels[AV_VIDEO_CH].interleaved)
 	{
+		rtcp_rtp_update(&m_rtcp[AV_VIDEO_CH], p_rtp, rtp_len, sys_os_get_us());
+		
 		if (VIDEO_CODEC_H264 == m_VideoCodec)
 		{
-			h264_rtp_rx(&h264rxi, p_rtp, rtp_len);
+			h264_rtp_rx_pkt(&h264rxi, p_pkt, p_rtp, rtp_len);
 		}
 		else if (VIDEO_CODEC_JPEG == m_VideoCodec)
 		{
@@ -1553,11 +1759,13 @@ void CRtspClient::tcp_data_rx(uint8 * lpData, int rlen)
 		}
 		else if (VIDEO_CODEC_H265 == m_VideoCodec)
 		{
-			h265_rtp_rx(&h265rxi, p_rtp, rtp_len);
+			h265_rtp_rx_pkt(&h265rxi, p_pkt, p_rtp, rtp_len);
 		}
 	}
 	else if (p_rilf->channel == m_rua.channels[AV_AUDIO_CH].interleaved)
 	{
+		rtcp_rtp_update(&m_rtcp[AV_AUDIO_CH], p_rtp, rtp_len, sys_os_get_us());
+		
 		if (AUDIO_CODEC_AAC == m_AudioCodec)
 		{
 			aac_rtp_rx(&aacrxi, p_rtp, rtp_len);
@@ -1582,17 +1790,48 @@ void CRtspClient::udp_data_rx(uint8 * lpData, int rlen, int type)
 {
 	uint8 * p_rtp = lpData;
 	uint32 rtp_len = rlen;
+	RTPPKTBUF * p_pkt = m_pRxPkt;
 
-	if (rtp_len >= 2 && RTP_PT_IS_RTCP(p_rtp[1])) // now, don't handle rtcp packet ...
+	// only the direct dispatch may refer to the receive buffer
+	m_pRxPkt = NULL;
+	
+	if (type >= AV_MAX_CHS)
 	{
 		return;
 	}
 	
+	if (rtp_len >= 2 && RTP_PT_IS_RTCP(p_rtp[1])) // rtcp multiplexed with rtp
+	{
+		rtcp_rx(&m_rtcp[type], p_rtp, rtp_len);
+		return;
+	}
+
+	int64 arrival = m_rua.channels[type].rx_arrival;
+	if (arrival == 0)
+	{
+		arrival = sys_os_get_us();
+	}
+
+	rtcp_rtp_update(&m_rtcp[type], p_rtp, rtp_len, arrival);
+
+	if (m_reorder[type].depth > 0)
+	{
+		// udp_rtp_rx is called with the packets in sequence order
+		rtp_reorder_put(&m_reorder[type], p_pkt, p_rtp, rtp_len);
+	}
+	else
+	{
+		udp_rtp_rx(p_pkt, p_rtp, rtp_len, type);
+	}
+}
+
+void CRtspClient::udp_rtp_rx(RTPPKTBUF * p_pkt, uint8 * p_rtp, int rtp_len, int type)
+{
 	if (AV_TYPE_VIDEO == type)
 	{
 		if (VIDEO_CODEC_H264 == m_VideoCodec)
 		{
-			h264_rtp_rx(&h264rxi, p_rtp, rtp_len);
+			h264_rtp_rx_pkt(&h264rxi, p_pkt, p_rtp, rtp_len);
 		}
 		else if (VIDEO_CODEC_JPEG == m_VideoCodec)
 		{
@@ -1604,7 +1843,7 @@ void CRtspClient::udp_data_rx(uint8 * lpData, int rlen, int type)
 		}
 		else if (VIDEO_CODEC_H265 == m_VideoCodec)
 		{
-			h265_rtp_rx(&h265rxi, p_rtp, rtp_len);
+			h265_rtp_rx_pkt(&h265rxi, p_pkt, p_rtp, rtp_len);
 		}
 	}
 	else if (AV_TYPE_AUDIO == type)
@@ -1631,11 +1870,25 @@ void CRtspClient::udp_data_rx(uint8 * lpData, int rlen, int type)
 
 int CRtspClient::rtsp_msg_parser(RCUA * p_rua)
 {
-	int rtsp_pkt_len = rtsp_pkt_find_end(p_rua->rcv_buf);
+	char * p_buf = p_rua->rcv_buf + p_rua->rcv_off;
+	int max_len = (int)net_buf_get_size() - 1; // the message is copied into a net buffer
+	int rtsp_pkt_len = rtsp_pkt_find_end(p_buf);
 	if (rtsp_pkt_len == 0) // wait for next recv
 	{
+		if (p_rua->rcv_dlen > max_len)
+		{
+			log_print(HT_LOG_ERR, "%s, rtsp header too long, dlen=%d!!!\r\n", __FUNCTION__, p_rua->rcv_dlen);
+			return RTSP_PARSE_FAIL;
+		}
+		
 		return RTSP_PARSE_MOREDATE;
 	}
+
+	if (rtsp_pkt_len > max_len)
+	{
+		log_print(HT_LOG_ERR, "%s, rtsp header too long, len=%d!!!\r\n", __FUNCTION__, rtsp_pkt_len);
+		return RTSP_PARSE_FAIL;
+	}
 	
 	HRTSP_MSG * rx_msg = rtsp_get_msg_buf();
 	if (rx_msg == NULL)
@@ -1644,7 +1897,7 @@ int CRtspClient::rtsp_msg_parser(RCUA * p_rua)
 		return RTSP_PARSE_FAIL;
 	}
 	
-	memcpy(rx_msg->msg_buf, p_rua->rcv_buf, rtsp_pkt_len);
+	memcpy(rx_msg->msg_buf, p_buf, rtsp_pkt_len);
 	rx_msg->msg_buf[rtsp_pkt_len] = '\0';
 
 	log_print(HT_LOG_DBG, "RX << %s\r\n", rx_msg->msg_buf);
@@ -1659,6 +1912,15 @@ int CRtspClient::rtsp_msg_parser(RCUA * p_rua)
 		return RTSP_PARSE_FAIL;
 	}
 	
+	if (rx_msg->ctx_len < 0 || rx_msg->ctx_len > max_len - rtsp_pkt_len)
+	{
+		log_print(HT_LOG_ERR, "%s, invalid content length %d, rtsp_pkt_len=%d!!!\r\n", __FUNCTION__, rx_msg->ctx_len, rtsp_pkt_len);
+		rtsp_free_msg(rx_msg);
+
+		p_rua->rcv_dlen = 0;
+		return RTSP_PARSE_FAIL;
+	}
+	
 	if (rx_msg->ctx_len > 0)	
 	{
 		if (p_rua->rcv_dlen < (parse_len + rx_msg->ctx_len))
@@ -1667,7 +1929,7 @@ int CRtspClient::rtsp_msg_parser(RCUA * p_rua)
 			return RTSP_PARSE_MOREDATE;
 		}
 
-		memcpy(rx_msg->msg_buf+rtsp_pkt_len, p_rua->rcv_buf+rtsp_pkt_len, rx_msg->ctx_len);
+		memcpy(rx_msg->msg_buf+rtsp_pkt_len, p_buf+rtsp_pkt_len, rx_msg->ctx_len);
         rx_msg->msg_buf[rtsp_pkt_len+rx_msg->ctx_len] = '\0';
 
         log_print(HT_LOG_DBG, "%s\r\n", rx_msg->msg_buf+rtsp_pkt_len);
@@ -1681,16 +1943,18 @@ int CRtspClient::rtsp_msg_parser(RCUA * p_rua)
 	
 	if (parse_len < p_rua->rcv_dlen)
 	{
-		while (p_rua->rcv_buf[parse_len] == ' ' || p_rua->rcv_buf[parse_len] == '\r' || p_rua->rcv_buf[parse_len] == '\n')
+		while (parse_len < p_rua->rcv_dlen && 
+			(p_buf[parse_len] == ' ' || p_buf[parse_len] == '\r' || p_buf[parse_len] == '\n'))
 		{
 			parse_len++;
 		}
 		
-		memmove(p_rua->rcv_buf, p_rua->rcv_buf + parse_len, p_rua->rcv_dlen - parse_len);
+		p_rua->rcv_off += parse_len;
 		p_rua->rcv_dlen -= parse_len;
 	}
 	else
 	{
+		p_rua->rcv_off = 0;
 		p_rua->rcv_dlen = 0;
 	}
 	
@@ -1736,114 +2000,151 @@ int CRtspClient::rtsp_tcp_rx()
     {
         return RTSP_RX_TIMEOUT;
     }
-    
-	if (p_rua->rtp_rcv_buf == NULL || p_rua->rtp_t_len == 0)
+
+    return rtsp_tcp_rx_data(fd);
+}
+
+int CRtspClient::rtsp_tcp_rx_data(SOCKET fd)
+{
+	RCUA * p_rua = &(this->m_rua);
+	char * p_buf;
+	int    need = 0;
+
+	if (NULL == p_rua->rcv_buf)
 	{
-		int rlen = recv(fd, p_rua->rcv_buf+p_rua->rcv_dlen, 2048-p_rua->rcv_dlen, 0);
-		if (rlen <= 0)
+		m_pRxRing = rtp_pkt_buf_alloc(m_nRxBufSize);
+		if (NULL == m_pRxRing)
 		{
-			log_print(HT_LOG_WARN, "%s, thread exit, ret = %d, err = %s\r\n", __FUNCTION__, rlen, sys_os_get_socket_error());	//recv error, connection maybe disconn?
+			log_print(HT_LOG_ERR, "%s, malloc %d failed\r\n", __FUNCTION__, m_nRxBufSize);
 			return RTSP_RX_FAIL;
 		}
 
-		p_rua->rcv_dlen += rlen;
+		p_rua->rcv_buf = (char *)m_pRxRing->data;
+		p_rua->rcv_size = m_nRxBufSize;
+		p_rua->rcv_off = 0;
+		p_rua->rcv_dlen = 0;
+	}
 
-		if (p_rua->rcv_dlen < 16)
-		{
-			return RTSP_RX_SUCC;
-		}
+	p_buf = p_rua->rcv_buf + p_rua->rcv_off;
+	
+	if (p_rua->rcv_dlen >= 4 && p_buf[0] == 0x24)
+	{
+		need = ntohs(((RILF *)p_buf)->rtp_len) + 4;
 	}
-	else
+
+	// move the last partial packet to the front only when the tail space is not enough,
+	// one byte is reserved for the rtsp message terminator
+	BOOL full = (p_rua->rcv_size - 1 - p_rua->rcv_off - p_rua->rcv_dlen < RTSP_RX_MIN_READ ||
+		 p_rua->rcv_off + need > p_rua->rcv_size - 1);
+		
+	if (m_pRxRing->ref > 1)
 	{
-		int rlen = recv(fd, p_rua->rtp_rcv_buf+p_rua->rtp_rcv_len, p_rua->rtp_t_len-p_rua->rtp_rcv_len, 0);
-		if (rlen <= 0)
+		// the frame chains refer to the ring data, continue in a new ring
+		if (p_rua->rcv_off > 0 && full)
 		{
-			log_print(HT_LOG_WARN, "%s, thread exit, ret = %d, err = %s\r\n", __FUNCTION__, rlen, sys_os_get_socket_error());	//recv error, connection maybe disconn?
-			return RTSP_RX_FAIL;
-		}
+			RTPPKTBUF * p_ring = rtp_pkt_buf_alloc(p_rua->rcv_size);
+			if (NULL == p_ring)
+			{
+				log_print(HT_LOG_ERR, "%s, malloc %d failed\r\n", __FUNCTION__, p_rua->rcv_size);
+				return RTSP_RX_FAIL;
+			}
 
-		p_rua->rtp_rcv_len += rlen;
-		if (p_rua->rtp_rcv_len == p_rua->rtp_t_len)
-		{
-			tcp_data_rx((uint8*)p_rua->rtp_rcv_buf, p_rua->rtp_rcv_len);
+			memcpy(p_ring->data, p_buf, p_rua->rcv_dlen);
+
+			rtp_pkt_buf_unref(m_pRxRing);
+			m_pRxRing = p_ring;
 			
-			free(p_rua->rtp_rcv_buf);
-			p_rua->rtp_rcv_buf = NULL;
-			p_rua->rtp_rcv_len = 0;
-			p_rua->rtp_t_len = 0;
+			p_rua->rcv_buf = (char *)p_ring->data;
+			p_rua->rcv_off = 0;
 		}
-		
-		return RTSP_RX_SUCC;
 	}
-
-rx_point:
-
-	if (rtsp_is_rtsp_msg(p_rua->rcv_buf))	//Is RTSP Packet?
+	else if (p_rua->rcv_dlen == 0)
 	{
-		int ret = rtsp_msg_parser(p_rua);
-		if (ret == RTSP_PARSE_FAIL)
-		{
-			return RTSP_RX_FAIL;
-		}
-		else if (ret == RTSP_PARSE_MOREDATE)
-		{
-			return RTSP_RX_SUCC;
-		}
+		p_rua->rcv_off = 0;
+	}
+	else if (p_rua->rcv_off > 0 && full)
+	{
+		memmove(p_rua->rcv_buf, p_buf, p_rua->rcv_dlen);
+		p_rua->rcv_off = 0;
+	}
 
-		if (p_rua->rcv_dlen >= 16)
-		{
-			goto rx_point;
-		}
+	int free_len = p_rua->rcv_size - 1 - p_rua->rcv_off - p_rua->rcv_dlen;
+	if (free_len <= 0)
+	{
+		log_print(HT_LOG_ERR, "%s, rtsp message too large, dlen = %d\r\n", __FUNCTION__, p_rua->rcv_dlen);
+		return RTSP_RX_FAIL;
 	}
-	else
+	
+	int rlen = recv(fd, p_rua->rcv_buf+p_rua->rcv_off+p_rua->rcv_dlen, free_len, 0);
+	if (rlen <= 0)
 	{
-		RILF * p_rilf = (RILF *)(p_rua->rcv_buf);
-		if (p_rilf->magic != 0x24)
-		{		
-			log_print(HT_LOG_WARN, "%s, p_rilf->magic[0x%02X]!!!\r\n", __FUNCTION__, p_rilf->magic);
-			return RTSP_RX_FAIL;
-		}
+		log_print(HT_LOG_WARN, "%s, thread exit, ret = %d, err = %s\r\n", __FUNCTION__, rlen, sys_os_get_socket_error());	//recv error, connection maybe disconn?
+		return RTSP_RX_FAIL;
+	}
+
+	p_rua->rcv_dlen += rlen;
+	p_rua->rcv_buf[p_rua->rcv_off+p_rua->rcv_dlen] = '\0';
+
+	while (p_rua->rcv_dlen >= 16)
+	{
+		p_buf = p_rua->rcv_buf + p_rua->rcv_off;
 		
-		uint16 rtp_len = ntohs(p_rilf->rtp_len);
-		if (rtp_len > (p_rua->rcv_dlen - 4))
+		if (rtsp_is_rtsp_msg(p_buf))	//Is RTSP Packet?
 		{
-			if (p_rua->rtp_rcv_buf)
+			int ret = rtsp_msg_parser(p_rua);
+			if (ret == RTSP_PARSE_FAIL)
 			{
-				free(p_rua->rtp_rcv_buf);
+				return RTSP_RX_FAIL;
 			}
-			
-			p_rua->rtp_rcv_buf = (char *)malloc(rtp_len+4);
-			if (p_rua->rtp_rcv_buf == NULL) 
+			else if (ret == RTSP_PARSE_MOREDATE)
 			{
-			    return RTSP_RX_FAIL;
+				break;
 			}
-			
-			memcpy(p_rua->rtp_rcv_buf, p_rua->rcv_buf, p_rua->rcv_dlen);
-			p_rua->rtp_rcv_len = p_rua->rcv_dlen;
-			p_rua->rtp_t_len = rtp_len+4;
-
-			p_rua->rcv_dlen = 0;
-
-			return RTSP_RX_SUCC;
 		}
+		else
+		{
+			RILF * p_rilf = (RILF *)p_buf;
+			if (p_rilf->magic != 0x24)
+			{		
+				log_print(HT_LOG_WARN, "%s, p_rilf->magic[0x%02X]!!!\r\n", __FUNCTION__, p_rilf->magic);
+				return RTSP_RX_FAIL;
+			}
 			
-		tcp_data_rx((uint8*)p_rilf, rtp_len+4);
+			int pkt_len = ntohs(p_rilf->rtp_len) + 4;
+			if (pkt_len > p_rua->rcv_dlen)
+			{
+				break;  // wait for the rest of the packet
+			}
 
-		p_rua->rcv_dlen -= rtp_len+4;
-		if (p_rua->rcv_dlen > 0)
-		{
-			memmove(p_rua->rcv_buf, p_rua->rcv_buf+rtp_len+4, p_rua->rcv_dlen);
-		}
+			// the packet is handled in place, the frame chains refer to it by the ring reference
+			m_pRxPkt = m_pRxRing;
+			tcp_data_rx((uint8*)p_rilf, pkt_len);
+			m_pRxPkt = NULL;
 
-		if (p_rua->rcv_dlen >= 16)
-		{
-			goto rx_point;
+			p_rua->rcv_off += pkt_len;
+			p_rua->rcv_dlen -= pkt_len;
 		}
 	}
 
 	return RTSP_RX_SUCC;
 }
 
+void CRtspClient::rtsp_rx_buf_free()
+{
+	if (m_pRxRing)
+	{
+		// freed when the last frame chain releases it
+		rtp_pkt_buf_unref(m_pRxRing);
+		m_pRxRing = NULL;
+	}
+
+	m_rua.rcv_buf = NULL;
+
+	m_rua.rcv_size = 0;
+	m_rua.rcv_off = 0;
+	m_rua.rcv_dlen = 0;
+}
+
 int CRtspClient::rtsp_udp_rx()
 {
 	int i, max_fd = 0;
@@ -1858,6 +2159,12 @@ int CRtspClient::rtsp_udp_rx()
             FD_SET(m_rua.channels[i].udp_fd, &fdr);
             max_fd = (max_fd >= (int)m_rua.channels[i].udp_fd)? max_fd : (int)m_rua.channels[i].udp_fd;
         }
+
+        if (m_rua.channels[i].rtcp_fd)
+        {
+            FD_SET(m_rua.channels[i].rtcp_fd, &fdr);
+            max_fd = (max_fd >= (int)m_rua.channels[i].rtcp_fd)? max_fd : (int)m_rua.channels[i].rtcp_fd;
+        }
     }
 
 	struct timeval tv = {0, 100*1000};
@@ -1868,77 +2175,219 @@ int CRtspClient::rtsp_udp_rx()
 		return RTSP_RX_TIMEOUT;
     }
 
-    int alen;
-    char buf[2048];
-    struct sockaddr_in addr;
-    
-	memset(&addr, 0, sizeof(addr));
-	alen = sizeof(struct sockaddr_in);
-
     for (i = 0; i < AV_METADATA_CH; i++)
     {
         if (m_rua.channels[i].udp_fd && FD_ISSET(m_rua.channels[i].udp_fd, &fdr))
         {
-            int rlen = recvfrom(m_rua.channels[i].udp_fd, buf, sizeof(buf), 0, (struct sockaddr *)&addr, (socklen_t*)&alen);
-        	if (rlen <= 12)
-        	{
-        		log_print(HT_LOG_ERR, "%s, recvfrom return %d, err[%s]!!!\r\n", __FUNCTION__, rlen, sys_os_get_socket_error());
-        	}
-        	else
-        	{
-        	    udp_data_rx((uint8*)buf, rlen, i);
-        	}
+            rtsp_udp_rx_data(i);
+        }
+
+        if (m_rua.channels[i].rtcp_fd && FD_ISSET(m_rua.channels[i].rtcp_fd, &fdr))
+        {
+            rtsp_rtcp_rx_data(i);
         }
     }
 			
     return RTSP_RX_SUCC;
 }
 
-BOOL CRtspClient::rtsp_start(const char * url, const char * ip, int port, const char * user, const char * pass)
+int CRtspClient::rtsp_rtcp_rx_data(int av_t)
 {
-	if (m_rua.state != RCS_NULL)
-	{
-		rtsp_play();
-		return TRUE;
-	}
-
-	if (user && user != m_rua.auth_info.auth_name)
-	{
-		strcpy(m_rua.auth_info.auth_name, user);
-	}
-
-	if (pass && pass != m_rua.auth_info.auth_pwd)
-	{
-		strcpy(m_rua.auth_info.auth_pwd, pass);
-	}
-	
-	if (url && url != m_url)
-	{
-		strcpy(m_url, url);
-	}
-	
-	if (ip && ip != m_ip)
-	{
-		strcpy(m_ip, ip);
-	}
-	
-	m_nport = port;
+    uint8 buf[1500];
 
-#ifdef OVER_HTTP
-    // Some rtsp servers do not support http prefixes
-    if (memcmp(m_url, "http://", 7) == 0)
+    int rlen = recv(m_rua.channels[av_t].rtcp_fd, (char *)buf, sizeof(buf), 0);
+    if (rlen < 8)
     {
-        memcpy(m_url, "rtsp", 4);
+        return RTSP_RX_TIMEOUT;
     }
-#endif
 
-    m_bRunning = TRUE;
-	m_tcpRxTid = sys_os_create_thread((void *)rtsp_tcp_rx_thread, this);
-	if (m_tcpRxTid == 0)
-	{
-		log_print(HT_LOG_ERR, "%s, sys_os_create_thread failed!!!\r\n", __FUNCTION__);
-		return FALSE;
-	}
+    rtcp_rx(&m_rtcp[av_t], buf, rlen);
+
+    return RTSP_RX_SUCC;
+}
+
+int CRtspClient::rtsp_udp_rx_data(int av_t)
+{
+#if __LINUX_OS__
+    int i, n;
+    RCMCH * p_ch = &m_rua.channels[av_t];
+    struct mmsghdr msgs[RTSP_UDP_BATCH];
+    struct iovec iovs[RTSP_UDP_BATCH];
+    char ctrl[RTSP_UDP_BATCH][64];
+
+    memset(msgs, 0, sizeof(msgs));
+    
+    for (i = 0; i < RTSP_UDP_BATCH; i++)
+    {
+        if (NULL == m_pUdpPkt[i])
+        {
+            m_pUdpPkt[i] = rtp_pkt_buf_get();
+            if (NULL == m_pUdpPkt[i])
+            {
+                return RTSP_RX_FAIL;
+            }
+        }
+        
+        iovs[i].iov_base = m_pUdpPkt[i]->data;
+        iovs[i].iov_len = RTSP_UDP_PKT_SIZE;
+
+        msgs[i].msg_hdr.msg_iov = &iovs[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+        msgs[i].msg_hdr.msg_control = ctrl[i];
+        msgs[i].msg_hdr.msg_controllen = sizeof(ctrl[i]);
+    }
+
+    // drain the socket, at most RTSP_UDP_BATCH datagrams with one system call
+    n = recvmmsg(p_ch->udp_fd, msgs, RTSP_UDP_BATCH, MSG_DONTWAIT, NULL);
+    if (n <= 0)
+    {
+        if (errno != EAGAIN && errno != EWOULDBLOCK)
+        {
+            log_print(HT_LOG_ERR, "%s, recvmmsg return %d, err[%s]!!!\r\n", __FUNCTION__, n, sys_os_get_socket_error());
+        }
+        return RTSP_RX_TIMEOUT;
+    }
+
+    // offset from the kernel receive timestamp (realtime) to the monotonic arrival time, 
+    // read once for the batch
+    int64 rt_off = 0;
+    
+    for (i = 0; i < n; i++)
+    {
+        struct cmsghdr * p_cmsg;
+
+        p_ch->rx_arrival = 0;
+
+        for (p_cmsg = CMSG_FIRSTHDR(&msgs[i].msg_hdr); p_cmsg; p_cmsg = CMSG_NXTHDR(&msgs[i].msg_hdr, p_cmsg))
+        {
+            if (p_cmsg->cmsg_level != SOL_SOCKET)
+            {
+                continue;
+            }
+#ifdef SO_RXQ_OVFL
+            if (p_cmsg->cmsg_type == SO_RXQ_OVFL)
+            {
+                uint32 drops;
+                memcpy(&drops, CMSG_DATA(p_cmsg), sizeof(drops));
+                
+                if (drops != p_ch->rx_drops)
+                {
+                    log_print(HT_LOG_WARN, "%s, channel %d, kernel dropped %u packets, total %u\r\n", 
+                        __FUNCTION__, av_t, drops - p_ch->rx_drops, drops);
+                    p_ch->rx_drops = drops;
+                }
+            }
+#endif
+#ifdef SCM_TIMESTAMPNS
+            if (p_cmsg->cmsg_type == SCM_TIMESTAMPNS)
+            {
+                struct timespec ts;
+                memcpy(&ts, CMSG_DATA(p_cmsg), sizeof(ts));
+                
+                if (0 == rt_off)
+                {
+                    struct timespec rt;
+                    clock_gettime(CLOCK_REALTIME, &rt);
+
+                    rt_off = sys_os_get_us() - ((int64)rt.tv_sec * 1000000 + rt.tv_nsec / 1000);
+                }
+                
+                p_ch->rx_arrival = (int64)ts.tv_sec * 1000000 + ts.tv_nsec / 1000 + rt_off;
+            }
+#endif
+        }
+
+        if (msgs[i].msg_len <= 12)
+        {
+            continue;
+        }
+
+        p_ch->rx_packets++;
+
+        m_pUdpPkt[i]->len = msgs[i].msg_len;
+        m_pRxPkt = m_pUdpPkt[i];
+        
+        udp_data_rx((uint8*)iovs[i].iov_base, msgs[i].msg_len, av_t);
+
+        m_pRxPkt = NULL;
+        
+        if (m_pUdpPkt[i]->ref > 1)
+        {
+            // still referred by a frame chain, receive into a new buffer
+            rtp_pkt_buf_unref(m_pUdpPkt[i]);
+            m_pUdpPkt[i] = NULL;
+        }
+    }
+
+    return RTSP_RX_SUCC;
+#else
+    int alen;
+    char buf[2048];
+    struct sockaddr_in addr;
+    
+	memset(&addr, 0, sizeof(addr));
+	alen = sizeof(struct sockaddr_in);
+
+    int rlen = recvfrom(m_rua.channels[av_t].udp_fd, buf, sizeof(buf), 0, (struct sockaddr *)&addr, (socklen_t*)&alen);
+	if (rlen <= 12)
+	{
+		log_print(HT_LOG_ERR, "%s, recvfrom return %d, err[%s]!!!\r\n", __FUNCTION__, rlen, sys_os_get_socket_error());
+		return RTSP_RX_TIMEOUT;
+	}
+
+    m_rua.channels[av_t].rx_packets++;
+    
+    udp_data_rx((uint8*)buf, rlen, av_t);
+
+    return RTSP_RX_SUCC;
+#endif
+}
+
+BOOL CRtspClient::rtsp_start(const char * url, const char * ip, int port, const char * user, const char * pass)
+{
+	if (m_rua.state != RCS_NULL)
+	{
+		rtsp_play();
+		return TRUE;
+	}
+
+	if (user && user != m_rua.auth_info.auth_name)
+	{
+		strcpy(m_rua.auth_info.auth_name, user);
+	}
+
+	if (pass && pass != m_rua.auth_info.auth_pwd)
+	{
+		strcpy(m_rua.auth_info.auth_pwd, pass);
+	}
+	
+	if (url && url != m_url)
+	{
+		strcpy(m_url, url);
+	}
+	
+	if (ip && ip != m_ip)
+	{
+		strcpy(m_ip, ip);
+	}
+	
+	m_nport = port;
+
+#ifdef OVER_HTTP
+    // Some rtsp servers do not support http prefixes
+    if (memcmp(m_url, "http://", 7) == 0)
+    {
+        memcpy(m_url, "rtsp", 4);
+    }
+#endif
+
+    m_bRunning = TRUE;
+	m_tcpRxTid = sys_os_create_thread((void *)rtsp_tcp_rx_thread, this);
+	if (m_tcpRxTid == 0)
+	{
+		log_print(HT_LOG_ERR, "%s, sys_os_create_thread failed!!!\r\n", __FUNCTION__);
+		return FALSE;
+	}
 	
 	return TRUE;
 }
@@ -2198,6 +2647,7 @@ BOOL CRtspClient::rtsp_close()
 	sys_os_mutex_enter(m_pMutex);
 	m_pAudioCB = NULL;
 	m_pVideoCB = NULL;
+	m_pVideoIovCB = NULL;
 #ifdef METADATA	
 	m_pMetadataCB = NULL;
 #endif
@@ -2216,13 +2666,40 @@ BOOL CRtspClient::rtsp_close()
 		usleep(10*1000);
 	}
 
+	if (m_pLoop)
+	{
+		rx_detach();
+		
+		hreactor_sync(m_pLoop, this);
+		m_pLoop = NULL;
+
+		if (m_rua.fd > 0)
+		{
+			closesocket(m_rua.fd);
+			m_rua.fd = 0;
+		}
+	}
+
+	rtsp_rx_buf_free();
+
+	m_bNodata = FALSE;
+
     for (int i = 0; i < AV_MAX_CHS; i++)
     {
         if (m_rua.channels[i].udp_fd > 0)
     	{
+    	    log_print(HT_LOG_INFO, "%s, channel %d, udp packets %u, kernel drops %u\r\n", 
+    	        __FUNCTION__, i, m_rua.channels[i].rx_packets, m_rua.channels[i].rx_drops);
+    	        
     		closesocket(m_rua.channels[i].udp_fd);
     		m_rua.channels[i].udp_fd = 0;
     	}
+
+        if (m_rua.channels[i].rtcp_fd > 0)
+    	{
+    		closesocket(m_rua.channels[i].rtcp_fd);
+    		m_rua.channels[i].rtcp_fd = 0;
+    	}
     }
 
 #ifdef BACKCHANNEL
@@ -2269,6 +2746,11 @@ BOOL CRtspClient::rtsp_close()
 	}
 
 	memset(&rtprxi, 0, sizeof(RTPRXI));
+
+	for (int i = 0; i < AV_MAX_CHS; i++)
+	{
+		rtp_reorder_deinit(&m_reorder[i]);
+	}
 	
 	if (m_pAudioConfig)
 	{
@@ -2296,6 +2778,16 @@ void CRtspClient::rtsp_video_data_cb(uint8 * p_data, int len, uint32 ts, uint32
 	sys_os_mutex_leave(m_pMutex);
 }
 
+void CRtspClient::rtsp_video_iov_data_cb(RTPFRMIOV * p_frm, uint32 ts, uint32 seq)
+{
+	sys_os_mutex_enter(m_pMutex);
+	if (m_pVideoIovCB)
+	{
+		m_pVideoIovCB(p_frm, ts, seq, m_pUserdata);
+	}
+	sys_os_mutex_leave(m_pMutex);
+}
+
 void CRtspClient::rtsp_audio_data_cb(uint8 * p_data, int len, uint32 ts, uint32 seq)
 {
 	sys_os_mutex_enter(m_pMutex);
@@ -2313,23 +2805,367 @@ void CRtspClient::rtsp_keep_alive()
 	{
 		m_rua.keepalive_time = ms;
 		
-		m_rua.cseq++;
-		
-		HRTSP_MSG * tx_msg;
+		rtsp_send_keep_alive();
+	}
+}
+
+void CRtspClient::rtsp_send_keep_alive()
+{
+	HRTSP_MSG * tx_msg;
+	
+	m_rua.cseq++;
+
+	if (m_rua.gp_cmd) // the rtsp server supports GET_PARAMETER command
+	{
+		tx_msg = rua_build_get_parameter(&m_rua);
+	}
+	else
+	{
+		tx_msg = rua_build_options(&m_rua);
+	}
+	
+	if (tx_msg)
+	{
+		rcua_send_free_rtsp_msg(&m_rua, tx_msg);
+	}
+}
+
+/**
+ * Register the rtsp socket and the no data timer to the event loop,
+ * the rtsp session is driven by the event loop instead of the rx threads
+ */
+BOOL CRtspClient::rx_attach()
+{
+	SOCKET fd;
+	HRLOOP * p_loop = hreactor_get_loop();
+	if (NULL == p_loop)
+	{
+		return FALSE;
+	}
+
+#ifdef OVER_HTTP    
+    if (m_rua.over_http)
+    {
+        fd = m_rua.rtsp_recv.cfd;
+    }
+    else 
+#endif
+    fd = m_rua.fd;
+
+	sys_os_mutex_enter(m_pEvMutex);
+
+	m_pLoop = p_loop;
+	m_nRxTime = sys_os_get_ms();
+
+	m_pNodataTm = hreactor_add_timer(p_loop, RTSP_NODATA_TIMEOUT, FALSE, rtsp_nodata_cb, this);
+	m_pTcpEv = hreactor_add_fd(p_loop, fd, rtsp_tcp_rx_cb, this);
+	if (NULL == m_pTcpEv)
+	{
+		sys_os_mutex_leave(m_pEvMutex);
+
+		rx_detach();
+		m_pLoop = NULL;
+		return FALSE;
+	}
+
+	sys_os_mutex_leave(m_pEvMutex);
+
+	return TRUE;
+}
+
+void CRtspClient::rx_attach_udp()
+{
+	sys_os_mutex_enter(m_pEvMutex);
 
-		if (m_rua.gp_cmd) // the rtsp server supports GET_PARAMETER command
+	for (int i = 0; i < AV_METADATA_CH && m_pLoop; i++)
+	{
+		if (m_rua.channels[i].udp_fd && NULL == m_pUdpEv[i])
 		{
-			tx_msg = rua_build_get_parameter(&m_rua);
+			m_pUdpEv[i] = hreactor_add_fd(m_pLoop, m_rua.channels[i].udp_fd, rtsp_udp_rx_cb, this);
 		}
-		else
+
+		if (m_rua.channels[i].rtcp_fd && NULL == m_pRtcpEv[i])
 		{
-			tx_msg = rua_build_options(&m_rua);
+			m_pRtcpEv[i] = hreactor_add_fd(m_pLoop, m_rua.channels[i].rtcp_fd, rtsp_udp_rx_cb, this);
 		}
+	}
+
+	// on the session loop, never concurrent with the udp receive callbacks
+	if (m_pLoop && NULL == m_pReorderTm && m_nReorderDepth > 0 && m_nReorderTime > 0)
+	{
+		m_pReorderTm = hreactor_add_timer(m_pLoop, RTSP_REORDER_TICK(m_nReorderTime), TRUE, rtsp_reorder_cb, this);
+	}
+
+	sys_os_mutex_leave(m_pEvMutex);
+}
+
+/**
+ * Remove all the session events from the event loop,
+ * return TRUE if the rtsp socket event was removed by this call
+ */
+BOOL CRtspClient::rx_detach()
+{
+	int i;
+	HREVENT * p_tcp_ev;
+	HREVENT * p_udp_ev[AV_MAX_CHS];
+	HREVENT * p_rtcp_ev[AV_MAX_CHS];
+	HREVENT * p_rtcp_tm;
+	HREVENT * p_reorder_tm;
+	HREVENT * p_keep_tm;
+	HREVENT * p_nodata_tm;
+
+	sys_os_mutex_enter(m_pEvMutex);
+
+	p_tcp_ev = m_pTcpEv;
+	p_keep_tm = m_pKeepTm;
+	p_nodata_tm = m_pNodataTm;
+	memcpy(p_udp_ev, m_pUdpEv, sizeof(p_udp_ev));
+	memcpy(p_rtcp_ev, m_pRtcpEv, sizeof(p_rtcp_ev));
+	p_rtcp_tm = m_pRtcpTm;
+	p_reorder_tm = m_pReorderTm;
+
+	m_pTcpEv = NULL;
+	m_pRtcpTm = NULL;
+	m_pReorderTm = NULL;
+	memset(m_pRtcpEv, 0, sizeof(m_pRtcpEv));
+	m_pKeepTm = NULL;
+	m_pNodataTm = NULL;
+	memset(m_pUdpEv, 0, sizeof(m_pUdpEv));
+
+	sys_os_mutex_leave(m_pEvMutex);
+
+	for (i = 0; i < AV_MAX_CHS; i++)
+	{
+		if (p_udp_ev[i])
+		{
+			hreactor_del(p_udp_ev[i]);
+		}
+
+		if (p_rtcp_ev[i])
+		{
+			hreactor_del(p_rtcp_ev[i]);
+		}
+	}
+
+	if (p_rtcp_tm)
+	{
+		hreactor_del(p_rtcp_tm);
+	}
+
+	if (p_reorder_tm)
+	{
+		hreactor_del(p_reorder_tm);
+	}
+
+	if (p_keep_tm)
+	{
+		hreactor_del(p_keep_tm);
+	}
+
+	if (p_nodata_tm)
+	{
+		hreactor_del(p_nodata_tm);
+	}
+
+	if (p_tcp_ev)
+	{
+		hreactor_del(p_tcp_ev);
+	}
+
+	return (p_tcp_ev != NULL);
+}
+
+void CRtspClient::rx_data_update()
+{
+	m_nRxTime = sys_os_get_ms();
+
+	if (m_bNodata)
+	{
+		m_bNodata = FALSE;
+		send_notify(RTSP_EVE_RESUME);
+	}
+}
+
+void CRtspClient::tcp_rx_event(SOCKET fd)
+{
+	int ret = rtsp_tcp_rx_data(fd);
+	if (ret == RTSP_RX_FAIL)
+	{
+		if (rx_detach())
+		{
+			if (m_rua.fd > 0)
+			{
+				closesocket(m_rua.fd);
+				m_rua.fd = 0;
+			}
+
+			rtsp_rx_buf_free();
+
+			send_notify(RTSP_EVE_STOPPED);
+		}
+	}
+	else if (m_rua.rtp_tcp)
+	{
+		rx_data_update();
+	}
+}
+
+void CRtspClient::udp_rx_event(SOCKET fd)
+{
+	for (int i = 0; i < AV_METADATA_CH; i++)
+	{
+		if (m_rua.channels[i].udp_fd == fd)
+		{
+			if (rtsp_udp_rx_data(i) == RTSP_RX_SUCC)
+			{
+				rx_data_update();
+			}
+			break;
+		}
+		else if (m_rua.channels[i].rtcp_fd == fd)
+		{
+			rtsp_rtcp_rx_data(i);
+			break;
+		}
+	}
+}
+
+void CRtspClient::reorder_timer()
+{
+	for (int i = 0; i < AV_METADATA_CH+1; i++)
+	{
+		rtp_reorder_timer(&m_reorder[i]);
+	}
+}
+
+void CRtspClient::rtcp_timer()
+{
+	if (m_rua.state == RCS_PLAYING)
+	{
+		m_nRtcpTime = sys_os_get_ms();
 		
-		if (tx_msg)
-    	{
-    		rcua_send_free_rtsp_msg(&m_rua, tx_msg);
-    	}
+		rtsp_send_rr();
+	}
+}
+
+void CRtspClient::rtsp_rtcp_check()
+{
+	if (sys_os_get_ms() - m_nRtcpTime >= RTCP_RR_INTERVAL)
+	{
+		m_nRtcpTime = sys_os_get_ms();
+		
+		rtsp_send_rr();
+	}
+}
+
+void CRtspClient::rtsp_send_rr()
+{
+	int  i, len;
+	char cname[64];
+	uint8 buf[4 + RTCP_MAX_LEN];
+
+#ifdef OVER_HTTP
+	if (m_rua.over_http)
+	{
+		return;
+	}
+#endif
+
+	snprintf(cname, sizeof(cname), "stream2file@%u", m_nRtcpSsrc);
+
+	for (i = 0; i < AV_METADATA_CH+1; i++)
+	{
+		RCMCH * p_ch = &m_rua.channels[i];
+		
+		if (p_ch->ctl[0] == '\0' || !m_rtcp[i].rxf_rtp)
+		{
+			continue;
+		}
+
+		len = rtcp_build_rr(&m_rtcp[i], m_nRtcpSsrc, cname, buf + 4, RTCP_MAX_LEN);
+		if (len <= 0)
+		{
+			continue;
+		}
+
+		if (m_rua.rtp_tcp)
+		{
+			RILF * p_rilf = (RILF *)buf;
+			
+			p_rilf->magic = 0x24;
+			p_rilf->channel = p_ch->interleaved + 1;
+			p_rilf->rtp_len = htons(len);
+
+			send(m_rua.fd, (char *)buf, len + 4, 0);
+		}
+		else if (p_ch->rtcp_fd > 0 && p_ch->r_port > 0)
+		{
+			struct sockaddr_in addr;
+
+			memset(&addr, 0, sizeof(addr));
+			addr.sin_family = AF_INET;
+			addr.sin_addr.s_addr = get_address_by_name(m_rua.ripstr);
+			addr.sin_port = htons(p_ch->r_rtcp_port ? p_ch->r_rtcp_port : p_ch->r_port + 1);
+
+			sendto(p_ch->rtcp_fd, (char *)buf + 4, len, 0, (struct sockaddr *)&addr, sizeof(addr));
+		}
+	}
+}
+
+BOOL CRtspClient::get_sr_mapping(int av_t, uint32 * ntp_sec, uint32 * ntp_frac, uint32 * rtp_ts)
+{
+	if (av_t < 0 || av_t >= AV_MAX_CHS || !m_rtcp[av_t].rxf_sr)
+	{
+		return FALSE;
+	}
+
+	*ntp_sec = m_rtcp[av_t].sr_ntp_sec;
+	*ntp_frac = m_rtcp[av_t].sr_ntp_frac;
+	*rtp_ts = m_rtcp[av_t].sr_rtp_ts;
+
+	return TRUE;
+}
+
+BOOL CRtspClient::rtp_to_ntp(int av_t, uint32 rtp_ts, uint64 * p_ntp)
+{
+	if (av_t < 0 || av_t >= AV_MAX_CHS)
+	{
+		return FALSE;
+	}
+
+	return rtcp_rtp_to_ntp(&m_rtcp[av_t], rtp_ts, p_ntp);
+}
+
+void CRtspClient::keep_alive_timer()
+{
+	if (m_rua.state == RCS_PLAYING)
+	{
+		m_rua.keepalive_time = sys_os_get_ms();
+
+		rtsp_send_keep_alive();
+	}
+}
+
+void CRtspClient::nodata_timer()
+{
+	HREVENT * p_tm = m_pNodataTm;
+	uint32 idle = sys_os_get_ms() - m_nRxTime;
+
+	if (idle >= RTSP_NODATA_TIMEOUT)
+	{
+		if (!m_bNodata)
+		{
+			m_bNodata = TRUE;
+			send_notify(RTSP_EVE_NODATA);
+		}
+
+		idle = 0;
+	}
+
+	// a deleted timer is freed after this callback returns, so it is still valid here
+	if (p_tm)
+	{
+		hreactor_set_timer(p_tm, RTSP_NODATA_TIMEOUT - idle);
 	}
 }
 
@@ -2357,6 +3193,12 @@ void CRtspClient::tcp_rx_thread()
 		send_notify(RTSP_EVE_CONNFAIL);
 		goto rtsp_rx_exit;
 	}
+
+	// the event loop takes over the session, this thread only connects
+	if (rx_attach())
+	{
+		goto rtsp_rx_exit;
+	}
     
 	while (m_bRunning)
 	{
@@ -2398,6 +3240,7 @@ void CRtspClient::tcp_rx_thread()
 	    if (m_rua.state == RCS_PLAYING)
 	    {	    	
 	    	rtsp_keep_alive();
+	    	rtsp_rtcp_check();
 	    }
 	}
 
@@ -2407,11 +3250,7 @@ void CRtspClient::tcp_rx_thread()
 		m_rua.fd = 0;
 	}
 
-    if (m_rua.rtp_rcv_buf)
-    {
-        free(m_rua.rtp_rcv_buf);
-        m_rua.rtp_rcv_buf = NULL;
-    }
+    rtsp_rx_buf_free();
     
 	send_notify(RTSP_EVE_STOPPED);
 
@@ -2430,6 +3269,10 @@ void CRtspClient::udp_rx_thread()
     while (m_bRunning)
 	{
 	    ret = rtsp_udp_rx();
+
+	    // the select timeout is the tick of the reorder timer
+	    reorder_timer();
+
 	    if (ret == RTSP_RX_FAIL)
 	    {
 	        break;
@@ -2796,6 +3639,13 @@ void CRtspClient::set_video_cb(video_cb cb)
 	sys_os_mutex_leave(m_pMutex);
 }
 
+void CRtspClient::set_video_iov_cb(video_iov_cb cb) 
+{
+	sys_os_mutex_enter(m_pMutex);
+	m_pVideoIovCB = cb;
+	sys_os_mutex_leave(m_pMutex);
+}
+
 void CRtspClient::set_audio_cb(audio_cb cb)
 {
 	sys_os_mutex_enter(m_pMutex);
@@ -29,10 +29,13 @@
 #include "mpeg4_rtp_rx.h"
 #include "aac_rtp_rx.h"
 #include "pcm_rtp_rx.h"
+#include "hreactor.h"
+#include "rtcp_rx.h"
 
 
 typedef int (*notify_cb)(int, void *);
 typedef int (*video_cb)(uint8 *, int, uint32, uint16, void *);
+typedef int (*video_iov_cb)(RTPFRMIOV *, uint32, uint16, void *);
 typedef int (*audio_cb)(uint8 *, int, uint32, uint16, void *);
 typedef int (*metadata_cb)(uint8 *, int, uint32, uint16, void *);
 
@@ -54,6 +57,21 @@ typedef int (*metadata_cb)(uint8 *, int, uint32, uint16, void *);
 #define RTSP_PARSE_MOREDATE 0
 #define RTSP_PARSE_SUCC		1
 
+#define RTSP_NODATA_TIMEOUT 10000   // no data timeout, ms
+
+#define RTSP_RX_BUF_SIZE    (128*1024)  // default receive ring buffer size
+#define RTSP_RX_BUF_MIN     (64*1024+16)// must hold the max interleaved frame
+#define RTSP_RX_BUF_MAX     (4*1024*1024)
+#define RTSP_RX_MIN_READ    (8*1024)    // compact the ring when less space left
+
+#define RTSP_UDP_BATCH      32          // max datagrams per recvmmsg
+#define RTSP_UDP_PKT_SIZE   RTP_PKT_BUF_SIZE// udp datagram buffer size
+#define RTSP_UDP_RCVBUF     (4*1024*1024)
+
+#define RTSP_REORDER_DEPTH  32          // udp reorder buffer depth, packets
+#define RTSP_REORDER_TIME   100         // udp reorder buffer depth, ms
+#define RTSP_REORDER_TICK(ms)   ((ms) / 2 > 10 ? (ms) / 2 : 10)     // reorder timer period, ms
+
 
 
 class CRtspClient
@@ -78,11 +96,43 @@ public:
 	char *  get_pass() {return m_rua.auth_info.auth_pwd;}
 	void    set_notify_cb(notify_cb notify, void * userdata);
 	void    set_video_cb(video_cb cb);
+
+    /**
+      * @desc : receive the H264/H265 frames as slice chains of the received packets
+      *     instead of the copied frame buffer, the other codecs still use the video_cb
+      */
+	void    set_video_iov_cb(video_iov_cb cb);
 	void    set_audio_cb(audio_cb cb);
 	void    set_metadata_cb(metadata_cb cb);
 	void    set_rtp_multicast(int flag);
 	void    set_rtp_over_udp(int flag);
 	void    set_rtsp_over_http(int flag, int port);
+	void    set_rx_buf_size(int size);
+	void    set_udp_rcvbuf(int size);
+	void    set_udp_timestamp(int flag);
+	uint32  get_udp_drops(int av_t);
+
+    /**
+      * @desc : set the udp rtp reorder buffer depth
+      * @params
+      *    depth : max out of order packets held, 0 - disable reordering
+      *    ms : max time a packet is held waiting for the missing ones
+      */
+	void    set_reorder_depth(int depth, int ms);
+
+    /**
+      * @desc : get the last RTCP sender report mapping of the media channel
+      * @params
+      *    av_t : AV_TYPE_VIDEO or AV_TYPE_AUDIO
+      *    ntp_sec, ntp_frac : the NTP time of the sender report
+      *    rtp_ts : the RTP timestamp corresponding to the same instant
+      */
+	BOOL    get_sr_mapping(int av_t, uint32 * ntp_sec, uint32 * ntp_frac, uint32 * rtp_ts);
+
+    /**
+      * @desc : map the RTP timestamp to the 64 bits NTP time with the last sender report
+      */
+	BOOL    rtp_to_ntp(int av_t, uint32 rtp_ts, uint64 * p_ntp);
 	
 	void 	get_h264_params();
 	BOOL 	get_h264_params(uint8 * p_sps, int * sps_len, uint8 * p_pps, int * pps_len);
@@ -186,7 +236,15 @@ public:
 
     void    tcp_rx_thread();
     void    udp_rx_thread();
+    void    tcp_rx_event(SOCKET fd);
+    void    udp_rx_event(SOCKET fd);
+    void    udp_rtp_rx(RTPPKTBUF * p_pkt, uint8 * lpData, int rlen, int type);
+    void    keep_alive_timer();
+    void    nodata_timer();
+    void    rtcp_timer();
+    void    reorder_timer();
     void    rtsp_video_data_cb(uint8 * p_data, int len, uint32 ts, uint32 seq);
+    void    rtsp_video_iov_data_cb(RTPFRMIOV * p_frm, uint32 ts, uint32 seq);
     void    rtsp_audio_data_cb(uint8 * p_data, int len, uint32 ts, uint32 seq);
 
     static BOOL parse_url(char const* url, char*& user, char*& pass, char*& addr, int& port, char const** suffix);
@@ -199,9 +257,20 @@ private:
 	void    rtsp_client_stop(RCUA * p_rua);
 	BOOL    rtsp_client_state(RCUA * p_rua, HRTSP_MSG * rx_msg);	
     int     rtsp_tcp_rx();
+    int     rtsp_tcp_rx_data(SOCKET fd);
+    void    rtsp_rx_buf_free();
     int     rtsp_udp_rx();
+    int     rtsp_udp_rx_data(int av_t);
     int     rtsp_msg_parser(RCUA * p_rua);
     void    rtsp_keep_alive();
+    void    rtsp_send_keep_alive();
+    BOOL    rx_attach();
+    void    rx_attach_udp();
+    BOOL    rx_detach();
+    void    rx_data_update();
+    int     rtsp_rtcp_rx_data(int av_t);
+    void    rtsp_rtcp_check();
+    void    rtsp_send_rr();
     BOOL    rtsp_setup_channel(RCUA * p_rua, int av_t);
     
     BOOL    make_prepare_play();
@@ -246,6 +315,7 @@ private:
 	notify_cb       m_pNotify;
 	void *          m_pUserdata;
 	video_cb        m_pVideoCB;
+	video_iov_cb    m_pVideoIovCB;
 	audio_cb        m_pAudioCB;
 	metadata_cb     m_pMetadataCB;
 	void *			m_pMutex;
@@ -271,6 +341,31 @@ private:
 	pthread_t       m_tcpRxTid;
 	pthread_t       m_udpRxTid;
 
+	HRLOOP *        m_pLoop;                    // event loop, NULL for rx threads
+	HREVENT *       m_pTcpEv;
+	HREVENT *       m_pUdpEv[AV_MAX_CHS];
+	HREVENT *       m_pKeepTm;                  // keep-alive timer
+	HREVENT *       m_pNodataTm;                // no data timer
+	void *          m_pEvMutex;
+	uint32          m_nRxTime;                  // last data received time
+	BOOL            m_bNodata;
+	int             m_nRxBufSize;               // receive ring buffer size
+	int             m_nUdpRcvBuf;               // udp socket receive buffer size
+	int             m_nUdpTstamp;               // udp SO_TIMESTAMPNS flag
+	RTPPKTBUF *     m_pUdpPkt[RTSP_UDP_BATCH];  // udp batch receive buffers
+	RTPPKTBUF *     m_pRxPkt;                   // buffer of the packet being dispatched
+	RTPPKTBUF *     m_pRxRing;                  // reference counted block of m_rua.rcv_buf
+	int             m_nReorderDepth;            // udp reorder depth, packets
+	int             m_nReorderTime;             // udp reorder depth, ms
+	RTPREORDER      m_reorder[AV_MAX_CHS];      // udp reorder buffers
+	HREVENT *       m_pReorderTm;               // releases the packets held by a paused stream
+
+	RTCPRXI         m_rtcp[AV_MAX_CHS];         // rtcp reception statistics
+	uint32          m_nRtcpSsrc;                // our ssrc in the receiver reports
+	uint32          m_nRtcpTime;                // last receiver report time
+	HREVENT *       m_pRtcpTm;                  // receiver report timer
+	HREVENT *       m_pRtcpEv[AV_MAX_CHS];
+
 	int		        m_VideoCodec;
 	
 	int     		m_AudioCodec;
@@ -617,7 +617,7 @@ BOOL rtsp_get_tcp_transport_info(HRTSP_MSG * rx_msg, uint16 * interleaved)
 	return ret;
 }
 
-BOOL rtsp_get_udp_transport_info(HRTSP_MSG * rx_msg, uint16 * client_port, uint16 * server_port)
+BOOL rtsp_get_udp_transport_info(HRTSP_MSG * rx_msg, uint16 * client_port, uint16 * server_port, uint16 * server_rtcp_port)
 {
     BOOL ret = FALSE;
     
@@ -647,6 +647,13 @@ BOOL rtsp_get_udp_transport_info(HRTSP_MSG * rx_msg, uint16 * client_port, uint1
 		        *server_port = atoi(buff);		        
 		    }
 
+		    // server_port=rtp-rtcp
+		    char * p_sep = strchr(buff, '-');
+		    if (server_rtcp_port && p_sep)
+		    {
+		        *server_rtcp_port = atoi(p_sep + 1);
+		    }
+
 		    ret = TRUE;
 		}
 	}
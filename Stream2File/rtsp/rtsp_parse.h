@@ -102,7 +102,7 @@ BOOL        rtsp_get_msg_cseq(HRTSP_MSG * rx_msg, char *cseq_buf, int len);
 BOOL        rtsp_get_user_agent_info(HRTSP_MSG * rx_msg, char * agent_buf, int max_len);
 BOOL 	    rtsp_get_session_info(HRTSP_MSG * rx_msg, char * session_buf, int max_len, int * timeout);
 BOOL        rtsp_get_tcp_transport_info(HRTSP_MSG * rx_msg, uint16 *interleaved);
-BOOL        rtsp_get_udp_transport_info(HRTSP_MSG * rx_msg, uint16 *client_port, uint16 *server_port);
+BOOL        rtsp_get_udp_transport_info(HRTSP_MSG * rx_msg, uint16 *client_port, uint16 *server_port, uint16 *server_rtcp_port);
 BOOL        rtsp_get_mc_transport_info(HRTSP_MSG * rx_msg, char *destination, uint16 *port);
 BOOL        rtsp_get_cbase_info(HRTSP_MSG * rx_msg, char * cbase_buf, int max_len);
 BOOL 	    rtsp_get_digest_info(HRTSP_MSG * rx_msg, HD_AUTH_INFO * auth_info);
@@ -1011,6 +1011,38 @@ BOOL rua_get_sdp_aac_params(RCUA * p_rua, int *pt, int *sizelength, int *indexle
     return TRUE;
 }
 
+void rua_set_udp_opts(RCUA * p_rua, SOCKET fd)
+{
+    int len = p_rua->udp_rcvbuf > 0 ? p_rua->udp_rcvbuf : 1024*1024;
+
+#if __LINUX_OS__
+    // SO_RCVBUFFORCE ignores rmem_max, but needs CAP_NET_ADMIN
+	if (setsockopt(fd, SOL_SOCKET, SO_RCVBUFFORCE, (char*)&len, sizeof(int)))
+#endif
+	if (setsockopt(fd, SOL_SOCKET, SO_RCVBUF, (char*)&len, sizeof(int)))
+	{
+		log_print(HT_LOG_ERR, "%s, setsockopt SO_RCVBUF error!\r\n", __FUNCTION__);
+	}
+
+#if __LINUX_OS__
+    int opt = 1;
+
+#ifdef SO_RXQ_OVFL
+    if (setsockopt(fd, SOL_SOCKET, SO_RXQ_OVFL, (char*)&opt, sizeof(opt)))
+    {
+        log_print(HT_LOG_WARN, "%s, setsockopt SO_RXQ_OVFL error!\r\n", __FUNCTION__);
+    }
+#endif
+
+#ifdef SO_TIMESTAMPNS
+    if (p_rua->udp_tstamp && setsockopt(fd, SOL_SOCKET, SO_TIMESTAMPNS, (char*)&opt, sizeof(opt)))
+    {
+        log_print(HT_LOG_WARN, "%s, setsockopt SO_TIMESTAMPNS error!\r\n", __FUNCTION__);
+    }
+#endif
+#endif
+}
+
 BOOL rua_init_udp_connection(RCUA * p_rua, int av_t)
 {
     uint16 port;
@@ -1054,15 +1086,28 @@ BOOL rua_init_udp_connection(RCUA * p_rua, int av_t)
 		return FALSE;
 	}
 
-	int len = 1024*1024;
-	if (setsockopt(fd, SOL_SOCKET, SO_RCVBUF, (char*)&len, sizeof(int)))
-	{
-		log_print(HT_LOG_ERR, "%s, setsockopt SO_RCVBUF error!\r\n", __FUNCTION__);
-	}
+	rua_set_udp_opts(p_rua, fd);
 
     p_rua->channels[av_t].udp_fd = fd;
     p_rua->channels[av_t].l_port = port;
 
+    // rtcp socket, the rtp session works without it
+    fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd > 0)
+    {
+        addr.sin_port = htons(port + 1);
+        
+        if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1)
+        {
+            log_print(HT_LOG_WARN, "%s, bind rtcp socket fail, port = %u\r\n", __FUNCTION__, port + 1);
+            closesocket(fd);
+        }
+        else
+        {
+            p_rua->channels[av_t].rtcp_fd = fd;
+        }
+    }
+
 	return TRUE;
 }
 
@@ -1102,11 +1147,7 @@ BOOL rua_init_mc_connection(RCUA * p_rua, int av_t)
         log_print(HT_LOG_WARN, "%s, setsockopt SO_REUSEADDR error!\r\n", __FUNCTION__);
     }
 
-    int len = 1024*1024;
-	if (setsockopt(fd, SOL_SOCKET, SO_RCVBUF, (char*)&len, sizeof(int)))
-	{
-		log_print(HT_LOG_ERR, "%s, setsockopt SO_RCVBUF error!\r\n", __FUNCTION__);
-	}
+    rua_set_udp_opts(p_rua, fd);
     
 	if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1)
 	{
@@ -65,15 +65,21 @@ typedef enum rtsp_client_states
 typedef struct rtsp_client_media_channel
 {
     SOCKET          udp_fd;                     // udp socket
+    SOCKET          rtcp_fd;                    // udp rtcp socket, l_port + 1
     char			ctl[64];                    // control string
     uint16          setup;                      // whether the media channel already be setuped
     uint16	        r_port;                     // remote udp port
+    uint16          r_rtcp_port;                // remote rtcp port, the second server_port value
 	uint16	        l_port;                     // local udp port
 	uint16	        interleaved;	            // rtp channel values
     char            destination[32];            // multicast address
     int				cap_count;                  // Local number of capabilities
 	uint8	        cap[MAX_AVN];               // Local capability
 	char			cap_desc[MAX_AVN][MAX_AVDESCLEN];
+
+	uint32          rx_packets;                 // udp received packets
+	uint32          rx_drops;                   // udp packets dropped by the kernel, SO_RXQ_OVFL
+	int64           rx_arrival;                 // last udp packet arrival time, monotonic us, SO_TIMESTAMPNS
 } RCMCH;
 
 typedef struct rtsp_client_user_agent
@@ -90,7 +96,8 @@ typedef struct rtsp_client_user_agent
     uint32 	        send_bc_data: 1;    // audio backchannel data sending flag
     uint32          replay      : 1;    // replay flag
     uint32          over_http   : 1;    // rtsp over http flag
-    uint32	        reserved	: 19;
+    uint32          udp_tstamp  : 1;    // enable SO_TIMESTAMPNS on the rtp udp sockets
+    uint32	        reserved	: 18;
 
 	int				state;              // state, RCSTATE
 	SOCKET			fd;                 // socket handler
@@ -105,12 +112,12 @@ typedef struct rtsp_client_user_agent
 	char			cbase[256];			// Content-Base: rtsp://221.10.50.195:554/broadcast.sdp/
     char            user_agent[64];     // user agent string 
 	int				session_timeout;	// session timeout value
+	int             udp_rcvbuf;         // rtp udp socket receive buffer size
 	
-	char			rcv_buf[2052];		
-	int				rcv_dlen;			
-	int				rtp_t_len;
-	int				rtp_rcv_len;
-	char *			rtp_rcv_buf;
+	char *			rcv_buf;            // receive ring buffer
+	int				rcv_size;           // receive ring buffer size
+	int				rcv_off;            // unparsed data offset
+	int				rcv_dlen;           // unparsed data length
 
     RCMCH           channels[AV_MAX_CHS];   // media channels
 
@@ -194,6 +201,7 @@ BOOL        rua_get_sdp_aac_params(RCUA * p_rua, int *pt, int *sizelength, int *
 
 BOOL        rua_init_udp_connection(RCUA * p_rua, int av_t);
 BOOL        rua_init_mc_connection(RCUA * p_rua, int av_t);
+void        rua_set_udp_opts(RCUA * p_rua, SOCKET fd);
 
 /*************************************************************************/
 void 		rcua_send_rtsp_msg(RCUA * p_rua,HRTSP_MSG * tx_msg);
@@ -29,6 +29,28 @@
 
 #define AVIIF_KEYFRAME      0x00000010L // this frame is a key frame.
 
+/* Write durability policy */
+#define AVI_SYNC_DEF        0           // use the global setting
+#define AVI_SYNC_NONE       1           // left to the write buffer and the system
+#define AVI_SYNC_FLUSH      2           // flush the write buffer every sync_ms
+#define AVI_SYNC_KEY        3           // flush the write buffer on every key frame
+#define AVI_SYNC_FSYNC      4           // flush and fdatasync every sync_ms
+
+#define AVI_SYNC_MS_DEF     1000
+#define AVI_IDX_SIZE        (64*1024)   // initial size of the mapped index store
+
+/* OpenDML (AVI 2.0) */
+#define AVI_INDEX_OF_INDEXES 0x00       // 'indx' super index, the entries point to the 'ix##' chunks
+#define AVI_INDEX_OF_CHUNKS 0x01        // 'ix##' standard index, the entries point to the data chunks
+
+#ifndef AVI_RIFF_MAX
+#define AVI_RIFF_MAX        (1000*1024*1024) // a RIFF-AVIX is started when the current RIFF would exceed it
+#endif
+
+#define AVI_INDX_ENTRIES    1024        // super index entries reserved in the stream header
+#define AVI_IX_ENTRIES      4096        // standard index entries kept in memory before written into movi
+#define AVI_DMLH_SIZE       248         // 'dmlh' chunk length
+
 #pragma pack(push)
 #pragma pack(1)
 
@@ -116,8 +138,35 @@ typedef struct wave_format
 	// extra information (after cbSize)
 } WAVEFMT;
 
+typedef struct avi_super_index_entry
+{
+	uint64		qwOffset;				// Position of the 'ix##' chunk
+	uint32		dwSize;					// Length of the 'ix##' chunk, the chunk header included
+	uint32		dwDuration;				// Time span of the 'ix##' chunk, in stream ticks
+} AVISIDXE;
+
 #pragma pack(pop)
 
+typedef struct avi_index_entry
+{
+	uint32		fcc;				    // Chunk id, '00dc' or '01wb'
+	uint32		flags;				    // AVIIF_KEYFRAME
+	int64		pos;				    // Position of the chunk header
+	uint32		len;				    // Chunk data length
+} AVIIDXE;
+
+typedef struct avi_odml_index
+{
+	char		fcc[4];				    // Chunk id of the stream, "00dc" or "01wb"
+	int64		indx_pos;			    // Position of the 'indx' chunk in the stream header list
+	AVISIDXE *	indx;				    // Super index entries, AVI_INDX_ENTRIES
+	uint32		indx_cnt;			    // Super index entries in use
+	
+	int64		ix_base;			    // Base offset of the standard index entries
+	uint32 *	ix;					    // Standard index entries (offset, size), AVI_IX_ENTRIES
+	uint32		ix_cnt;				    // Standard index entries in use
+} AVIODML;
+
 typedef struct avi_file_context
 {
 	uint32		ctxf_read	: 1;	    // Read mode
@@ -127,7 +176,7 @@ typedef struct avi_file_context
 	uint32		ctxf_video	: 1;	    // Has video stream
 	uint32		ctxf_sps_f	: 1;	    // Auxiliary calculation of image size usage, already filled in SPS in avcc
 	uint32		ctxf_pps_f	: 1;	    // Auxiliary calculation of image size usage, already filled in PPS in avcc	
-	uint32		ctxf_idx_m	: 1;	    // Index data write mode: = 1, memory mode; = 0, temporary file
+	uint32		ctxf_key	: 1;	    // The frame between avi_write_video_start and avi_write_video_end is a key frame
 	uint32		ctxf_res	: 24;
 
 	AVIMHDR		avi_hdr;                // AVI main header
@@ -136,8 +185,9 @@ typedef struct avi_file_context
 	AVISHDR		str_a;                  // Audio stream header    
 	WAVEFMT		wave;                   // WAVE format
 
-	FILE *		f;					    // Read and write file handle
-	uint32		flen;				    // Total file length, used when reading
+	FILE *		f;					    // Read file handle
+	HFIO *		fio;				    // Write file handle
+	int64		flen;				    // Total file length, used when reading
 	char		filename[256];		    // File full path
 	void *		mutex;				    // Write, close mutex
 
@@ -152,11 +202,18 @@ typedef struct avi_file_context
 	uint8 * 	a_extra;
 	int			a_extra_len;
 
-	int			i_movi;				    // Where the real data starts
-	int			i_movi_end;			    // End of data, where the index starts
-	int			i_riff;				    // After the index, the length of the entire file
+	int64		i_movi;				    // Where the real data starts
+	int64		i_movi_end;			    // End of data of the first RIFF, where the index starts
+	int64		i_riff;				    // After the index, the length of the first RIFF
 
-	int			pkt_offset;			    // Packet offset when reading
+	int			i_riff_cnt;			    // RIFF count, the first RIFF-AVI and the following RIFF-AVIX
+	int64		i_riff_pos;			    // Position of the current RIFF-AVIX
+	int			i_frame_first;		    // Video frames in the first RIFF
+
+	AVIODML		odml_v;				    // OpenDML index of the video stream
+	AVIODML		odml_a;				    // OpenDML index of the audio stream
+
+	int64		pkt_offset;			    // Packet offset when reading
 	int			index_offset;		    // Index position when reading
 	int			back_index;			    // The first read index position when reading in reverse order, usually sps/vps
 
@@ -166,13 +223,16 @@ typedef struct avi_file_context
 	uint32		s_time;				    // Start recording time = first packet write time
 	uint32		e_time;				    // The time when a package was recently written
 
-	int			i_idx_max;			    // The maximum number of indexes currently allocated
 	int			i_idx;				    // Current index number (video index + audio index)
-	int *		idx;				    // Index array
+	int *		idx;				    // Index array, the legacy 'idx1' of the first RIFF when writing
+	AVIIDXE *	idx_e;				    // Index entries when reading
+
+	FILE *		idx_f;				    // Index temporary file when reading
+	HMBUF *		idx_m;				    // Legacy index store when writing, the mapped temporary index file
 
-	FILE *		idx_f;				    // Index temporary file
-	int			idx_fix[128];		    // Index file data is enough to write once for one sector
-	int			idx_fix_off;		    // The index data has been stored in the offset of idx_fix
+	int			sync_mode;			    // Durability policy, AVI_SYNC_NONE ~ AVI_SYNC_FSYNC
+	uint32		sync_ms;			    // Flush / fdatasync interval, ms
+	uint32		sync_time;			    // Last flush time
 
 	// Auxiliary analysis
 	uint32		prev_ts;			    // Last timestamp
@@ -22,6 +22,24 @@
 #include "avi_read.h"
 
 
+static int avi_fseek(FILE * fp, int64 off)
+{
+#if __WINDOWS_OS__
+	return _fseeki64(fp, off, SEEK_SET);
+#else
+	return fseeko(fp, (off_t)off, SEEK_SET);
+#endif
+}
+
+static int64 avi_ftell(FILE * fp)
+{
+#if __WINDOWS_OS__
+	return _ftelli64(fp);
+#else
+	return ftello(fp);
+#endif
+}
+
 /**************************************************************************/
 
 // Find the video description
@@ -44,6 +62,10 @@
  *          )
  *      [ <AVIIndex> ]  --Index block
  *     )
+ * RIFF('AVIX'   --OpenDML (AVI 2.0) continuation, the first RIFF is limited to about 1GB
+ *      LIST('movi' ...)  --The data of each stream is indexed by 'ix##' standard index chunks in movi,
+ *     )                   which are indexed by the 'indx' super index in the stream header list
+ * ...
 **/
 
 // find 'hdrl' list, ret offset, llen = len of list
@@ -51,7 +73,7 @@ int avi_find_hdr_list(AVICTX * p_ctx, int * llen)
 {
 	AVIRIFF riff;
 	uint32 offset = 12, rlen;
-	uint32 tlen = p_ctx->flen - 12;
+	uint32 tlen = (uint32)(p_ctx->i_riff - 12);
 
 	while (offset < tlen)
 	{
@@ -90,6 +112,52 @@ int avi_find_hdr_list(AVICTX * p_ctx, int * llen)
 	return -1;
 }
 
+// read the 'indx' super index, offset is the chunk data
+int avi_read_indx(AVICTX * p_ctx, AVIODML * p_odml, int offset, uint32 len)
+{
+	uint8  hdr[24];
+	uint32 cnt;
+
+	fseek(p_ctx->f, offset, SEEK_SET);
+
+	if (len < sizeof(hdr) || fread(hdr, sizeof(hdr), 1, p_ctx->f) != 1)
+	{
+		return -1;
+	}
+
+	// wLongsPerEntry, bIndexSubType, bIndexType, nEntriesInUse, dwChunkId
+	if (hdr[0] != 4 || hdr[3] != AVI_INDEX_OF_INDEXES)
+	{
+		log_print(HT_LOG_WARN, "%s, unsupported index type %d\r\n", __FUNCTION__, hdr[3]);
+		return -1;
+	}
+
+	memcpy(&cnt, hdr+4, 4);
+	memcpy(p_odml->fcc, hdr+8, 4);
+
+	if (cnt == 0 || cnt > (len - sizeof(hdr)) / sizeof(AVISIDXE))
+	{
+		return 0;
+	}
+
+	p_odml->indx = (AVISIDXE *)malloc(cnt * sizeof(AVISIDXE));
+	if (NULL == p_odml->indx)
+	{
+		return -1;
+	}
+
+	if (fread(p_odml->indx, sizeof(AVISIDXE), cnt, p_ctx->f) != cnt)
+	{
+		free(p_odml->indx);
+		p_odml->indx = NULL;
+		return -1;
+	}
+
+	p_odml->indx_cnt = cnt;
+
+	return cnt;
+}
+
 int avi_parse_stream_list(AVICTX * p_ctx, int offset, int llen)
 {
 	AVIRIFF riff;
@@ -173,7 +241,7 @@ int avi_parse_stream_list(AVICTX * p_ctx, int offset, int llen)
 			}
 			else if (prev_mmio == mmioFOURCC('a','u','d','s'))	//  Audio stream format
 			{
-				if (riff.len != sizeof(WAVEFMT))
+				if (riff.len < sizeof(WAVEFMT))	// extra data may follow
 				{
 					log_print(HT_LOG_ERR, "%s, riff.len=%d, sizeof(WAVEFMT)=%d\r\n", __FUNCTION__, riff.len, sizeof(WAVEFMT));
 					return -1;
@@ -188,6 +256,19 @@ int avi_parse_stream_list(AVICTX * p_ctx, int offset, int llen)
 				a_sf_f = 1;	
 			}
 		}
+		else if (riff.riff == mmioFOURCC('i','n','d','x'))
+		{
+			offset += 8;
+
+			if (prev_mmio == mmioFOURCC('v','i','d','s'))
+			{
+				avi_read_indx(p_ctx, &p_ctx->odml_v, offset, riff.len);
+			}
+			else if (prev_mmio == mmioFOURCC('a','u','d','s'))
+			{
+				avi_read_indx(p_ctx, &p_ctx->odml_a, offset, riff.len);
+			}
+		}
 		else
 		{
 			offset += 8;
@@ -312,7 +393,7 @@ int avi_load_movi_list(AVICTX * p_ctx)
 {
 	AVIRIFF riff;
 	uint32 offset = 12, rlen;
-	uint32 tlen = p_ctx->flen - 12;
+	uint32 tlen = (uint32)(p_ctx->i_riff - 12);
 
 	while (offset < tlen)
 	{
@@ -363,13 +444,141 @@ int avi_load_movi_list(AVICTX * p_ctx)
 	return -1;
 }
 
+int avi_idx_cmp(const void * a, const void * b)
+{
+	int64 pos_a = ((AVIIDXE *)a)->pos;
+	int64 pos_b = ((AVIIDXE *)b)->pos;
+
+	return pos_a < pos_b ? -1 : (pos_a > pos_b ? 1 : 0);
+}
+
+// append the entries of the 'ix##' chunks referenced by the super index
+int avi_load_ix(AVICTX * p_ctx, AVIODML * p_odml, int * p_max)
+{
+	uint32 i, j, cnt;
+	uint8  hdr[32];
+	int64  base;
+	uint32 ent[2];
+
+	for (i = 0; i < p_odml->indx_cnt; i++)
+	{
+		if (avi_fseek(p_ctx->f, p_odml->indx[i].qwOffset) != 0 || fread(hdr, sizeof(hdr), 1, p_ctx->f) != 1)
+		{
+			log_print(HT_LOG_ERR, "%s, read ix[%u] failed\r\n", __FUNCTION__, i);
+			return -1;
+		}
+
+		// fcc, cb, wLongsPerEntry, bIndexSubType, bIndexType, nEntriesInUse, dwChunkId, qwBaseOffset
+		if (hdr[0] != 'i' || hdr[1] != 'x' || hdr[8] != 2 || hdr[11] != AVI_INDEX_OF_CHUNKS)
+		{
+			log_print(HT_LOG_ERR, "%s, invalid ix[%u]\r\n", __FUNCTION__, i);
+			return -1;
+		}
+
+		memcpy(&cnt, hdr+12, 4);
+		memcpy(&base, hdr+20, 8);
+
+		if (p_ctx->i_idx + (int)cnt > *p_max)
+		{
+			AVIIDXE * p_idx = (AVIIDXE *)realloc(p_ctx->idx_e, (p_ctx->i_idx + cnt) * sizeof(AVIIDXE));
+			if (NULL == p_idx)
+			{
+				return -1;
+			}
+
+			p_ctx->idx_e = p_idx;
+			*p_max = p_ctx->i_idx + cnt;
+		}
+
+		for (j = 0; j < cnt; j++)
+		{
+			if (fread(ent, sizeof(ent), 1, p_ctx->f) != 1)
+			{
+				return -1;
+			}
+
+			AVIIDXE * p_entry = &p_ctx->idx_e[p_ctx->i_idx++];
+
+			memcpy(&p_entry->fcc, hdr+16, 4);
+			p_entry->flags = (ent[1] & 0x80000000) ? 0 : AVIIF_KEYFRAME;
+			p_entry->pos = base + ent[0] - 8;
+			p_entry->len = ent[1] & 0x7FFFFFFF;
+		}
+	}
+
+	return p_ctx->i_idx;
+}
+
+// load the OpenDML index of all RIFFs, the entries are sorted in the file order
+int avi_load_odml_idx(AVICTX * p_ctx)
+{
+	int max = 0;
+
+	if (avi_load_ix(p_ctx, &p_ctx->odml_v, &max) < 0 || avi_load_ix(p_ctx, &p_ctx->odml_a, &max) < 0)
+	{
+		if (p_ctx->idx_e)
+		{
+			free(p_ctx->idx_e);
+			p_ctx->idx_e = NULL;
+		}
+
+		p_ctx->i_idx = 0;
+		return -1;
+	}
+
+	if (p_ctx->i_idx > 0)
+	{
+		qsort(p_ctx->idx_e, p_ctx->i_idx, sizeof(AVIIDXE), avi_idx_cmp);
+
+		p_ctx->ctxf_idx = 1;
+	}
+
+	return p_ctx->i_idx;
+}
+
+// convert the legacy 'idx1' entries loaded into idx
+int avi_idx1_to_entries(AVICTX * p_ctx, int cnt)
+{
+	int i;
+
+	p_ctx->idx_e = (AVIIDXE *)malloc(cnt * sizeof(AVIIDXE));
+	if (NULL == p_ctx->idx_e)
+	{
+		return -1;
+	}
+
+	for (i = 0; i < cnt; i++)
+	{
+		p_ctx->idx_e[i].fcc = p_ctx->idx[i * 4];
+		p_ctx->idx_e[i].flags = p_ctx->idx[i * 4 + 1];
+		p_ctx->idx_e[i].pos = (uint32)p_ctx->idx[i * 4 + 2];
+		p_ctx->idx_e[i].len = p_ctx->idx[i * 4 + 3];
+	}
+
+	free(p_ctx->idx);
+	p_ctx->idx = NULL;
+
+	p_ctx->i_idx = cnt;
+
+	return cnt;
+}
+
 int avi_load_idx(AVICTX * p_ctx)
 {
 	AVIRIFF riff;
 	uint32 offset = 12, rlen;
-	uint32 tlen = p_ctx->flen - 12;
+	uint32 tlen = (uint32)(p_ctx->i_riff - 12);
 	int idx_len = 0, idx_offset = 0;
 
+	// the OpenDML index covers all RIFFs, the legacy index only the first one
+	if (p_ctx->odml_v.indx_cnt > 0 || p_ctx->odml_a.indx_cnt > 0)
+	{
+		if (avi_load_odml_idx(p_ctx) > 0)
+		{
+			return p_ctx->i_idx;
+		}
+	}
+
 	while (offset < tlen)
 	{
 		fseek(p_ctx->f, offset, SEEK_SET);
@@ -406,14 +615,14 @@ int avi_load_idx(AVICTX * p_ctx)
 			idx_offset = offset + 8;
 			idx_len = riff.len;
 			
-			if ((idx_len + idx_offset) == p_ctx->flen)	// Fully correct length
+			if ((idx_len + idx_offset) == p_ctx->i_riff)	// Fully correct length
 			{
 				p_ctx->ctxf_idx = 1;
 				break;
 			}
-			else if ((idx_len + idx_offset) > (int) p_ctx->flen) // The index part is not finished, and the exception is closed.
+			else if ((idx_len + idx_offset) > p_ctx->i_riff) // The index part is not finished, and the exception is closed.
 			{
-				idx_len = p_ctx->flen - idx_offset;
+				idx_len = (int)(p_ctx->i_riff - idx_offset);
 			}
 		}
 	}
@@ -452,7 +661,7 @@ int avi_load_idx(AVICTX * p_ctx)
 
 			if (rlen == 1)
 			{
-				p_ctx->i_idx = idx_len / 16;
+				avi_idx1_to_entries(p_ctx, idx_len / 16);
 				return idx_len;
 			}
 		}
@@ -471,7 +680,7 @@ int avi_load_idx(AVICTX * p_ctx)
 		
 		if (rlen == 1)
 		{
-			p_ctx->i_idx = idx_len / 16;
+			avi_idx1_to_entries(p_ctx, idx_len / 16);
 			return idx_len;
 		}
 	}
@@ -481,11 +690,12 @@ int avi_load_idx(AVICTX * p_ctx)
 
 int avi_ctx_init(AVICTX * p_ctx)
 {
-	int rlen = 0, flen;
+	int rlen = 0;
+	int64 flen;
 	AVIRIFF riff;
 
 	fseek(p_ctx->f, 0, SEEK_END);
-	flen = ftell(p_ctx->f);
+	flen = avi_ftell(p_ctx->f);
 	fseek(p_ctx->f, 0, SEEK_SET);
 
 	rlen = fread(&riff, sizeof(riff), 1, p_ctx->f);
@@ -501,12 +711,19 @@ int avi_ctx_init(AVICTX * p_ctx)
 		return -1;
 	}
 
-	if (flen != (riff.len + 8))
+	p_ctx->flen = flen;
+
+	// length of the first RIFF, RIFF-AVIX may follow
+	if ((int64)riff.len + 8 <= flen)
 	{
-	    log_print(HT_LOG_WARN, "%s, flen=%d, riff.len=%d\r\n", __FUNCTION__, flen, riff.len);
+		p_ctx->i_riff = (int64)riff.len + 8;
 	}
+	else
+	{
+	    log_print(HT_LOG_WARN, "%s, flen=%lld, riff.len=%u\r\n", __FUNCTION__, flen, riff.len);
 
-	p_ctx->flen = flen;
+		p_ctx->i_riff = flen < 0xFFFFFFFF ? flen : 0xFFFFFFFF;
+	}
 
 	if (avi_parse_header(p_ctx) < 0)
 	{
@@ -621,6 +838,24 @@ void avi_read_close(AVICTX * p_ctx)
 		p_ctx->idx = NULL;
 	}
 
+	if (p_ctx->idx_e)
+	{
+		free(p_ctx->idx_e);
+		p_ctx->idx_e = NULL;
+	}
+
+	if (p_ctx->odml_v.indx)
+	{
+		free(p_ctx->odml_v.indx);
+		p_ctx->odml_v.indx = NULL;
+	}
+
+	if (p_ctx->odml_a.indx)
+	{
+		free(p_ctx->odml_a.indx);
+		p_ctx->odml_a.indx = NULL;
+	}
+
     // sys_os_destroy_sig_mutex(p_ctx->mutex);
 
 	free(p_ctx);
@@ -631,33 +866,51 @@ int avi_read_pkt(AVICTX * p_ctx, AVIPKT * p_pkt)
 	char riff[4];	    // packet type: 01wb 00dc
 	uint32 len = 0;	    // packet length
 
-	if (p_ctx->pkt_offset >= p_ctx->i_movi_end)
-	{
-		// Already read the end of the packet, the latter should be the index
-		return 0;
-	}
-
 	if (p_ctx->f == NULL)
 	{
 		log_print(HT_LOG_ERR, "%s, p_ctx->f is null!!!\r\n", __FUNCTION__);
 		return -1;
 	}
 
-	fseek(p_ctx->f, p_ctx->pkt_offset, SEEK_SET);
-	
-	if (fread(riff, 4, 1, p_ctx->f) != 1)
+	while (1)
 	{
-		log_print(HT_LOG_ERR, "%s, fread filed\r\n", __FUNCTION__);
-		return -1;
-	}
-	
-	if (fread(&len, 4, 1, p_ctx->f) != 1)
-	{
-		log_print(HT_LOG_ERR, "%s, fread failed\r\n", __FUNCTION__);
-		return -1;
+		if (p_ctx->pkt_offset + 8 > p_ctx->flen)
+		{
+			// Already read the end of the file
+			return 0;
+		}
+
+		avi_fseek(p_ctx->f, p_ctx->pkt_offset);
+		
+		if (fread(riff, 4, 1, p_ctx->f) != 1)
+		{
+			log_print(HT_LOG_ERR, "%s, fread filed\r\n", __FUNCTION__);
+			return -1;
+		}
+		
+		if (fread(&len, 4, 1, p_ctx->f) != 1)
+		{
+			log_print(HT_LOG_ERR, "%s, fread failed\r\n", __FUNCTION__);
+			return -1;
+		}
+
+		if (memcmp(riff, "RIFF", 4) == 0 || memcmp(riff, "LIST", 4) == 0)
+		{
+			// Enter the movi list of the next RIFF-AVIX
+			p_ctx->pkt_offset += 12;
+		}
+		else if ((riff[2] == 'd' && riff[3] == 'c') || (riff[2] == 'w' && riff[3] == 'b'))
+		{
+			break;
+		}
+		else
+		{
+			// Skip the 'idx1', 'ix##' index and 'JUNK' chunks
+			p_ctx->pkt_offset += 8 + len + (len & 1);
+		}
 	}
 
-	if (len < 0 || len > (uint32)(p_ctx->i_movi_end - p_ctx->i_movi) || len > (1024 * 1024))
+	if (len > (uint64)(p_ctx->flen - p_ctx->pkt_offset - 8) || len > (1024 * 1024))
 	{
 		log_print(HT_LOG_ERR, "%s, invalid len (%d)\r\n", __FUNCTION__, len);
 		return -1;
@@ -740,9 +993,9 @@ int avi_seek_pos(AVICTX * p_ctx, long pos, long total)
     // log_print(HT_LOG_ERR, "%s, pos[%d],total[%d],fname[%s]...\r\n", __FUNCTION__, pos, total, p_ctx->filename);
 
 	// Pos is the relative time, total is the total duration
-	if (p_ctx->ctxf_idx != 1 || p_ctx->idx == NULL)	// In case the index is incomplete, the index should be rebuilt
+	if (p_ctx->ctxf_idx != 1 || p_ctx->idx_e == NULL)	// In case the index is incomplete, the index should be rebuilt
 	{
-		log_print(HT_LOG_ERR, "%s, avif_idx[%d],idx[%p]!!!\r\n", __FUNCTION__, p_ctx->ctxf_idx, p_ctx->idx);
+		log_print(HT_LOG_ERR, "%s, avif_idx[%d],idx[%p]!!!\r\n", __FUNCTION__, p_ctx->ctxf_idx, p_ctx->idx_e);
 		return -1;
 	}
 
@@ -763,21 +1016,21 @@ int avi_seek_pos(AVICTX * p_ctx, long pos, long total)
 
     // log_print(HT_LOG_ERR, "%s, index[%d],pos[%d],rate[%.2f],i_frame_video[%d].\r\n", __FUNCTION__, index, pos, rate, p_ctx->i_frame_video);
 
-	while (index < p_ctx->i_idx && p_ctx->idx)
+	while (index < p_ctx->i_idx && p_ctx->idx_e)
 	{
-		if ((p_ctx->idx[index * 4] != mmioFOURCC('0','0','d','c')) || (p_ctx->idx[index * 4 + 1] != AVIIF_KEYFRAME))
+		if ((p_ctx->idx_e[index].fcc != mmioFOURCC('0','0','d','c')) || (p_ctx->idx_e[index].flags != AVIIF_KEYFRAME))
 		{
 			index++;
 			continue;
 		}
 		
-		long fpos_prev = ftell(p_ctx->f);
-		int fpos = p_ctx->idx[index * 4 + 2];
-		int spos = fseek(p_ctx->f, fpos, SEEK_SET);
+		int64 fpos_prev = avi_ftell(p_ctx->f);
+		int64 fpos = p_ctx->idx_e[index].pos;
+		int spos = avi_fseek(p_ctx->f, fpos);
 		
 		if (spos < 0)
 		{
-			log_print(HT_LOG_ERR, "%s, index[%d], fpos[%d], prev pos[%ld]!!!\r\n", __FUNCTION__, index, fpos, fpos_prev);
+			log_print(HT_LOG_ERR, "%s, index[%d], fpos[%lld], prev pos[%lld]!!!\r\n", __FUNCTION__, index, fpos, fpos_prev);
 			return -1;
 		}
 		else
@@ -786,7 +1039,7 @@ int avi_seek_pos(AVICTX * p_ctx, long pos, long total)
 			p_ctx->index_offset = index;
 			p_ctx->back_index = index;
 			
-			log_print(HT_LOG_ERR, "%s, index[%d], new pos[%d], set pos[%d], prev pos[%ld].\r\n", __FUNCTION__, index, fpos, spos, fpos_prev);
+			log_print(HT_LOG_ERR, "%s, index[%d], new pos[%lld], set pos[%d], prev pos[%lld].\r\n", __FUNCTION__, index, fpos, spos, fpos_prev);
 
 			return 0;
 		}
@@ -800,26 +1053,26 @@ int avi_seek_pos(AVICTX * p_ctx, long pos, long total)
 int avi_seek_back_pos(AVICTX * p_ctx)
 {
 	int index = p_ctx->back_index - 1;
-	if (index < 0 || p_ctx->idx == NULL)
+	if (index < 0 || p_ctx->idx_e == NULL)
 	{
 		return -1;
     }
     
 	while (index >= 0 && index < p_ctx->i_idx)
 	{
-		if ((p_ctx->idx[index * 4] != mmioFOURCC('0','0','d','c')) || (p_ctx->idx[index * 4 + 1] != AVIIF_KEYFRAME))
+		if ((p_ctx->idx_e[index].fcc != mmioFOURCC('0','0','d','c')) || (p_ctx->idx_e[index].flags != AVIIF_KEYFRAME))
 		{
 			index--;
 			continue;
 		}
 		
-		long fpos_prev = ftell(p_ctx->f);
-		int fpos = p_ctx->idx[index * 4 + 2];
-		int spos = fseek(p_ctx->f, fpos, SEEK_SET);
+		int64 fpos_prev = avi_ftell(p_ctx->f);
+		int64 fpos = p_ctx->idx_e[index].pos;
+		int spos = avi_fseek(p_ctx->f, fpos);
 		
 		if (spos < 0)
 		{
-		    // log_print(HT_LOG_ERR, "%s, index[%d], fpos[%d], prev pos[%ld]!!!\r\n", __FUNCTION__, index, fpos, fpos_prev);
+		    // log_print(HT_LOG_ERR, "%s, index[%d], fpos[%lld], prev pos[%lld]!!!\r\n", __FUNCTION__, index, fpos, fpos_prev);
 			return -1;
 		}
 		else
@@ -827,7 +1080,7 @@ int avi_seek_back_pos(AVICTX * p_ctx)
 			p_ctx->pkt_offset = fpos;
 			p_ctx->index_offset = index;
 			p_ctx->back_index = index;
-		    // log_print(HT_LOG_ERR, "%s, index[%d], new pos[%d], set pos[%d], prev pos[%ld].\r\n", __FUNCTION__, index, fpos, spos, fpos_prev);
+		    // log_print(HT_LOG_ERR, "%s, index[%d], new pos[%lld], set pos[%d], prev pos[%lld].\r\n", __FUNCTION__, index, fpos, spos, fpos_prev);
 			return 0;
 		}
 	}
@@ -838,26 +1091,26 @@ int avi_seek_back_pos(AVICTX * p_ctx)
 int avi_seek_tail(AVICTX * p_ctx)
 {
 	int index = p_ctx->i_idx - 1;
-	if (index < 0 || p_ctx->idx == NULL)
+	if (index < 0 || p_ctx->idx_e == NULL)
 	{
 		return -1;
     }
     
 	while (index >= 0 && index < p_ctx->i_idx)
 	{
-		if ((p_ctx->idx[index * 4] != mmioFOURCC('0','0','d','c')) || (p_ctx->idx[index * 4 + 1] != AVIIF_KEYFRAME))
+		if ((p_ctx->idx_e[index].fcc != mmioFOURCC('0','0','d','c')) || (p_ctx->idx_e[index].flags != AVIIF_KEYFRAME))
 		{
 			index--;
 			continue;
 		}
 		
-		long fpos_prev = ftell(p_ctx->f);
-		int fpos = p_ctx->idx[index * 4 + 2];
-		int spos = fseek(p_ctx->f, fpos, SEEK_SET);
+		int64 fpos_prev = avi_ftell(p_ctx->f);
+		int64 fpos = p_ctx->idx_e[index].pos;
+		int spos = avi_fseek(p_ctx->f, fpos);
 
 		if (spos < 0)
 		{
-		    // log_print(HT_LOG_ERR, "%s, index[%d], fpos[%d], prev pos[%ld]!!!\r\n", __FUNCTION__, index, fpos, fpos_prev);
+		    // log_print(HT_LOG_ERR, "%s, index[%d], fpos[%lld], prev pos[%lld]!!!\r\n", __FUNCTION__, index, fpos, fpos_prev);
 			return -1;
 		}
 		else
@@ -865,7 +1118,7 @@ int avi_seek_tail(AVICTX * p_ctx)
 			p_ctx->pkt_offset = fpos;
 			p_ctx->index_offset = index;
 			p_ctx->back_index = index;
-		    // log_print(HT_LOG_ERR, "%s, index[%d], new pos[%d], set pos[%d], prev pos[%ld].\r\n", __FUNCTION__, index, fpos, spos, fpos_prev);
+		    // log_print(HT_LOG_ERR, "%s, index[%d], new pos[%lld], set pos[%d], prev pos[%lld].\r\n", __FUNCTION__, index, fpos, spos, fpos_prev);
 			return 0;
 		}
 	}
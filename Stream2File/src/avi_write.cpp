@@ -32,22 +32,22 @@
 
 int avi_write_uint16_(AVICTX * p_ctx, uint16 w)
 {
-	return fwrite(&w, 2, 1, p_ctx->f);
+	return hfio_write(p_ctx->fio, &w, 2) == 2;
 }
 
 int avi_write_uint32_(AVICTX * p_ctx, uint32 dw)
 {
-	return fwrite(&dw, 4, 1, p_ctx->f);
+	return hfio_write(p_ctx->fio, &dw, 4) == 4;
 }
 
 int avi_write_fourcc_(AVICTX * p_ctx, const char fcc[4])
 {
-	return fwrite(fcc, 4, 1, p_ctx->f);
+	return hfio_write(p_ctx->fio, fcc, 4) == 4;
 }
 
 int avi_write_buffer_(AVICTX * p_ctx, char * p_data, int len)
 {
-	return fwrite(p_data, len, 1, p_ctx->f);
+	return hfio_write(p_ctx->fio, p_data, len) == len;
 }
 
 #define avi_write_uint16(p_ctx, w) do{ if(avi_write_uint16_(p_ctx, w) != 1) goto w_err; }while(0)
@@ -55,6 +55,76 @@ int avi_write_buffer_(AVICTX * p_ctx, char * p_data, int len)
 #define avi_write_fourcc(p_ctx, fcc) do{ if(avi_write_fourcc_(p_ctx, fcc) != 1) goto w_err; }while(0)
 #define avi_write_buffer(p_ctx, p_data, len) do{ if(avi_write_buffer_(p_ctx, p_data, len) != 1) goto w_err; }while(0)
 
+static int      avi_sync_mode = AVI_SYNC_FLUSH;
+static uint32   avi_sync_ms = AVI_SYNC_MS_DEF;
+
+static void avi_write_pad(AVICTX * p_ctx)
+{
+	uint8 pad = 0;
+	
+	hfio_write(p_ctx->fio, &pad, 1);
+}
+
+/**
+ * Apply the durability policy after a chunk is written, 
+ * the index store is mapped, it only needs to be synced with the file
+ */
+static void avi_sync(AVICTX * p_ctx, int b_key)
+{
+	BOOL flush = FALSE;
+
+	if (AVI_SYNC_KEY == p_ctx->sync_mode)
+	{
+		flush = b_key;
+	}
+	else if (AVI_SYNC_FLUSH == p_ctx->sync_mode || AVI_SYNC_FSYNC == p_ctx->sync_mode)
+	{
+		flush = (sys_os_get_ms() - p_ctx->sync_time >= p_ctx->sync_ms);
+	}
+
+	if (!flush)
+	{
+		return;
+	}
+
+	p_ctx->sync_time = sys_os_get_ms();
+
+	hfio_flush(p_ctx->fio);
+
+	if (AVI_SYNC_FSYNC == p_ctx->sync_mode)
+	{
+		hfio_sync(p_ctx->fio);
+
+		if (p_ctx->idx_m)
+		{
+			hmbuf_sync(p_ctx->idx_m, TRUE);
+		}
+	}
+}
+
+void avi_write_set_sync_def(int mode, uint32 ms)
+{
+	if (mode > AVI_SYNC_DEF && mode <= AVI_SYNC_FSYNC)
+	{
+		avi_sync_mode = mode;
+	}
+
+	avi_sync_ms = ms > 0 ? ms : AVI_SYNC_MS_DEF;
+}
+
+void avi_write_set_sync(AVICTX * p_ctx, int mode, uint32 ms)
+{
+	if (mode > AVI_SYNC_DEF && mode <= AVI_SYNC_FSYNC)
+	{
+		p_ctx->sync_mode = mode;
+	}
+
+	if (ms > 0)
+	{
+		p_ctx->sync_ms = ms;
+	}
+}
+
 void avi_free_idx(AVICTX * p_ctx)
 {
 	if (p_ctx->idx)
@@ -63,14 +133,13 @@ void avi_free_idx(AVICTX * p_ctx)
 		p_ctx->idx = NULL;
 	}
 	
-	if (p_ctx->idx_f)
+	if (p_ctx->idx_m)
 	{
-		fclose(p_ctx->idx_f);
-		p_ctx->idx_f = NULL;
+		hmbuf_close(p_ctx->idx_m, FALSE);
+		p_ctx->idx_m = NULL;
 	}
 
 	p_ctx->i_idx = 0;
-	p_ctx->i_idx_max = 0;
 }
 
 int avi_write_idx(AVICTX * p_ctx)
@@ -78,68 +147,265 @@ int avi_write_idx(AVICTX * p_ctx)
 	avi_write_fourcc(p_ctx, "idx1");
 	avi_write_uint32(p_ctx,  p_ctx->i_idx * 16);
 
-	if (p_ctx->ctxf_idx_m == 1)
+	if (p_ctx->idx_m && p_ctx->i_idx > 0)
 	{
-		if (p_ctx->i_idx > 0)
+		int64 len = (int64)p_ctx->i_idx * 16;
+		
+		// the entries are copied from the mapped file in the kernel, without reading them back
+		if (p_ctx->idx_m->fd >= 0)
 		{
-			if (fwrite( p_ctx->idx, p_ctx->i_idx * 16, 1, p_ctx->f) != 1)
+			if (hfio_splice(p_ctx->fio, p_ctx->idx_m->fd, 0, len) < 0)
 			{
+				log_print(HT_LOG_ERR, "%s, splice idx into avi file failed!!!\r\n", __FUNCTION__);
 				return -1;
-			}	
-
-			fflush(p_ctx->f);
+			}
+		}
+		else if (hfio_write(p_ctx->fio, p_ctx->idx_m->data, (int)len) < 0)
+		{
+			return -1;
 		}
 	}
-	else if (p_ctx->idx_f)
+
+	return 0;
+
+w_err:
+
+	return -1;
+}
+
+void avi_set_dw(void * p, uint32 dw)
+{
+	uint8 * ptr = (uint8 *)p;
+
+	ptr[0] = (dw      ) & 0xff;
+	ptr[1] = (dw >> 8 ) & 0xff;
+	ptr[2] = (dw >> 16) & 0xff;
+	ptr[3] = (dw >> 24) & 0xff;
+}
+
+static int avi_odml_init(AVIODML * p_odml, const char fcc[4])
+{
+	memcpy(p_odml->fcc, fcc, 4);
+
+	p_odml->indx = (AVISIDXE *)calloc(AVI_INDX_ENTRIES, sizeof(AVISIDXE));
+	p_odml->ix = (uint32 *)malloc(AVI_IX_ENTRIES * 8);
+
+	if (NULL == p_odml->indx || NULL == p_odml->ix)
 	{
-		// Write index data in a fixed buffer to an index file
-		if (p_ctx->idx_fix_off > 0)
+		return -1;
+	}
+
+	return 0;
+}
+
+static void avi_odml_free(AVIODML * p_odml)
+{
+	if (p_odml->indx)
+	{
+		free(p_odml->indx);
+		p_odml->indx = NULL;
+	}
+
+	if (p_odml->ix)
+	{
+		free(p_odml->ix);
+		p_odml->ix = NULL;
+	}
+
+	p_odml->indx_cnt = 0;
+	p_odml->ix_cnt = 0;
+}
+
+/**
+ * Overwrite a length field written before, then return to the end of the file
+ */
+static int avi_patch_uint32(AVICTX * p_ctx, int64 pos, uint32 dw)
+{
+	if (hfio_seek(p_ctx->fio, pos, SEEK_SET) < 0)
+	{
+		return -1;
+	}
+
+	if (avi_write_uint32_(p_ctx, dw) != 1)
+	{
+		return -1;
+	}
+
+	return hfio_seek(p_ctx->fio, 0, SEEK_END);
+}
+
+/**
+ * Write the pending entries of the stream as an 'ix##' standard index chunk into movi, 
+ * the super index in the header is updated in place, so the data written so far 
+ * can be indexed even if the file is not closed
+ */
+static int avi_write_ix(AVICTX * p_ctx, AVIODML * p_odml)
+{
+	int64 pos;
+	uint32 len;
+	char fcc[4];
+
+	if (p_odml->ix_cnt == 0)
+	{
+		return 0;
+	}
+
+	pos = hfio_tell(p_ctx->fio);
+	len = 24 + p_odml->ix_cnt * 8;
+
+	fcc[0] = 'i';
+	fcc[1] = 'x';
+	fcc[2] = p_odml->fcc[0];
+	fcc[3] = p_odml->fcc[1];
+
+	avi_write_fourcc(p_ctx, fcc);
+	avi_write_uint32(p_ctx, len);
+	avi_write_uint16(p_ctx, 2);								// wLongsPerEntry
+	avi_write_uint16(p_ctx, AVI_INDEX_OF_CHUNKS << 8);		// bIndexSubType, bIndexType
+	avi_write_uint32(p_ctx, p_odml->ix_cnt);				// nEntriesInUse
+	avi_write_fourcc(p_ctx, p_odml->fcc);					// dwChunkId
+	avi_write_uint32(p_ctx, (uint32)p_odml->ix_base);		// qwBaseOffset
+	avi_write_uint32(p_ctx, (uint32)(p_odml->ix_base >> 32));
+	avi_write_uint32(p_ctx, 0);								// dwReserved3
+	avi_write_buffer(p_ctx, (char *)p_odml->ix, p_odml->ix_cnt * 8);
+
+	if (p_odml->indx_cnt < AVI_INDX_ENTRIES)
+	{
+		AVISIDXE * p_entry = &p_odml->indx[p_odml->indx_cnt++];
+		
+		p_entry->qwOffset = pos;
+		p_entry->dwSize = len + 8;
+		p_entry->dwDuration = p_odml->ix_cnt;
+
+		if (p_odml->indx_pos > 0)
 		{
-			if (fwrite(p_ctx->idx_fix, p_ctx->idx_fix_off * 4, 1, p_ctx->idx_f) != 1)
+			if (avi_patch_uint32(p_ctx, p_odml->indx_pos + 12, p_odml->indx_cnt) < 0)
 			{
 				goto w_err;
-            }
-            
-			fflush(p_ctx->idx_f);
+			}
 
-			p_ctx->idx_fix_off = 0;
+			if (hfio_seek(p_ctx->fio, p_odml->indx_pos + 32 + (p_odml->indx_cnt - 1) * sizeof(AVISIDXE), SEEK_SET) < 0)
+			{
+				goto w_err;
+			}
+			
+			avi_write_buffer(p_ctx, (char *)p_entry, sizeof(AVISIDXE));
+
+			if (hfio_seek(p_ctx->fio, 0, SEEK_END) < 0)
+			{
+				goto w_err;
+			}
 		}
+	}
+	else
+	{
+		log_print(HT_LOG_WARN, "%s, %.4s super index is full, %u entries are not indexed\r\n", 
+			__FUNCTION__, p_odml->fcc, p_odml->ix_cnt);
+	}
 
-		// Write index temporary file data to the avi file
-		
-		fseek(p_ctx->idx_f, 0, SEEK_END);
-		
-		int idx_len = ftell(p_ctx->idx_f);
-		
-		if (idx_len != (p_ctx->i_idx * 16))
+	p_odml->ix_cnt = 0;
+
+	return 0;
+
+w_err:
+
+	return -1;
+}
+
+static int avi_write_indx(AVICTX * p_ctx, AVIODML * p_odml)
+{
+	p_odml->indx_pos = hfio_tell(p_ctx->fio);
+
+	avi_write_fourcc(p_ctx, "indx");
+	avi_write_uint32(p_ctx, 24 + AVI_INDX_ENTRIES * sizeof(AVISIDXE));
+	avi_write_uint16(p_ctx, 4);								// wLongsPerEntry
+	avi_write_uint16(p_ctx, AVI_INDEX_OF_INDEXES << 8);		// bIndexSubType, bIndexType
+	avi_write_uint32(p_ctx, p_odml->indx_cnt);				// nEntriesInUse
+	avi_write_fourcc(p_ctx, p_odml->fcc);					// dwChunkId
+	avi_write_uint32(p_ctx, 0);								// dwReserved[3]
+	avi_write_uint32(p_ctx, 0);
+	avi_write_uint32(p_ctx, 0);
+	avi_write_buffer(p_ctx, (char *)p_odml->indx, AVI_INDX_ENTRIES * sizeof(AVISIDXE));
+
+	return 0;
+
+w_err:
+
+	return -1;
+}
+
+/**
+ * Remove the temporary index file, the legacy index has been written into the AVI file
+ */
+static void avi_remove_idx_file(AVICTX * p_ctx)
+{
+	if (p_ctx->idx_m)
+	{
+		hmbuf_close(p_ctx->idx_m, TRUE);
+		p_ctx->idx_m = NULL;
+	}
+}
+
+/**
+ * Close the current RIFF and start a RIFF-AVIX, 
+ * the first RIFF is closed with the legacy 'idx1' index, which only covers it
+ */
+static int avi_riff_next(AVICTX * p_ctx)
+{
+	int64 pos;
+
+	if (avi_write_ix(p_ctx, &p_ctx->odml_v) < 0 || avi_write_ix(p_ctx, &p_ctx->odml_a) < 0)
+	{
+		return -1;
+	}
+
+	pos = hfio_tell(p_ctx->fio);
+
+	if (p_ctx->i_riff_cnt == 1)
+	{
+		p_ctx->i_movi_end = pos;
+
+		if (avi_write_idx(p_ctx) < 0)
 		{
-			log_print(HT_LOG_ERR, "%s, idx real len[%d] != idx file len[%d],idx_fix_off[%d]!!!\r\n", 
-			    __FUNCTION__, p_ctx->i_idx * 16, idx_len, p_ctx->idx_fix_off * 4);
 			return -1;
 		}
 
-		fseek(p_ctx->f, 0, SEEK_END);
-		fseek(p_ctx->idx_f, 0, SEEK_SET);
-		
-		int rlen;
-		
-		do
+		p_ctx->i_riff = hfio_tell(p_ctx->fio);
+		p_ctx->i_frame_first = p_ctx->i_frame_video;
+
+		if (avi_write_header(p_ctx) < 0)
 		{
-			rlen = fread(p_ctx->idx_fix, 1, sizeof(p_ctx->idx_fix), p_ctx->idx_f);
-			if (rlen <= 0)
-			{
-				break;
-			}
-			
-			if (fwrite(p_ctx->idx_fix, rlen, 1, p_ctx->f) != 1)
-			{
-				log_print(HT_LOG_ERR, "%s, write idx into avi file failed!!!\r\n", __FUNCTION__);
-				return -1;
-			}
-		} while(rlen > 0);
-		
-		fflush(p_ctx->f);
+			return -1;
+		}
+
+		if (hfio_seek(p_ctx->fio, 0, SEEK_END) < 0)
+		{
+			return -1;
+		}
+
+		avi_remove_idx_file(p_ctx);
+		avi_free_idx(p_ctx);
+
+		pos = p_ctx->i_riff;
 	}
+	else
+	{
+		if (avi_patch_uint32(p_ctx, p_ctx->i_riff_pos + 4, (uint32)(pos - p_ctx->i_riff_pos - 8)) < 0 ||
+			avi_patch_uint32(p_ctx, p_ctx->i_riff_pos + 16, (uint32)(pos - p_ctx->i_riff_pos - 20)) < 0)
+		{
+			return -1;
+		}
+	}
+
+	p_ctx->i_riff_pos = pos;
+	p_ctx->i_riff_cnt++;
+
+	avi_write_fourcc(p_ctx, "RIFF");
+	avi_write_uint32(p_ctx, 0xFFFFFFFF);
+	avi_write_fourcc(p_ctx, "AVIX");
+	avi_write_fourcc(p_ctx, "LIST");
+	avi_write_uint32(p_ctx, 0xFFFFFFFF);
+	avi_write_fourcc(p_ctx, "movi");
 
 	return 0;
 
@@ -148,31 +414,102 @@ w_err:
 	return -1;
 }
 
-void avi_set_dw(void * p, uint32 dw)
+/**
+ * Called before a chunk of len is written, 
+ * write the full standard index and start a RIFF-AVIX when the current RIFF would exceed AVI_RIFF_MAX
+ */
+static int avi_riff_check(AVICTX * p_ctx, AVIODML * p_odml, uint32 len)
 {
-	uint8 * ptr = (uint8 *)p;
+	if (p_odml->ix_cnt >= AVI_IX_ENTRIES)
+	{
+		if (avi_write_ix(p_ctx, p_odml) < 0)
+		{
+			return -1;
+		}
+	}
 
-	ptr[0] = (dw      ) & 0xff;
-	ptr[1] = (dw >> 8 ) & 0xff;
-	ptr[2] = (dw >> 16) & 0xff;
-	ptr[3] = (dw >> 24) & 0xff;
+	int64 pos = hfio_tell(p_ctx->fio);
+
+	if (pos - p_ctx->i_riff_pos + 8 + len > AVI_RIFF_MAX && pos > p_ctx->i_movi && pos > p_ctx->i_riff_pos + 24)
+	{
+		return avi_riff_next(p_ctx);
+	}
+
+	return 0;
+}
+
+/**
+ * Add the chunk to the standard index of the stream, 
+ * and to the legacy index while writing the first RIFF
+ */
+static int avi_add_idx(AVICTX * p_ctx, AVIODML * p_odml, int64 i_pos, uint32 len, int b_key)
+{
+	if (p_odml->ix_cnt == 0)
+	{
+		p_odml->ix_base = i_pos;
+	}
+
+	p_odml->ix[2*p_odml->ix_cnt+0] = (uint32)(i_pos + 8 - p_odml->ix_base);	// offset of the chunk data
+	p_odml->ix[2*p_odml->ix_cnt+1] = b_key ? len : (len | 0x80000000);		// bit 31 is set for the delta frame
+	p_odml->ix_cnt++;
+
+	if (p_ctx->i_riff_cnt > 1 || NULL == p_ctx->idx_m)
+	{
+		return 0;
+	}
+
+	int * p_entry = (int *)hmbuf_append(p_ctx->idx_m, 16);
+	if (NULL == p_entry)
+	{
+		return -1;
+	}
+
+	memcpy(&p_entry[0], p_odml->fcc, 4);
+	avi_set_dw(&p_entry[1], b_key ? AVIIF_KEYFRAME : 0);
+	avi_set_dw(&p_entry[2], (uint32)i_pos);
+	avi_set_dw(&p_entry[3], len);
+
+	p_ctx->i_idx++;
+
+	return 0;
 }
 
 int avi_end(AVICTX * p_ctx)
 {
-	if (p_ctx->f == NULL)
+	int64 pos;
+
+	if (p_ctx->fio == NULL)
 	{
 		return -1;
     }
-    
-	p_ctx->i_movi_end = ftell(p_ctx->f);
 
-	if (avi_write_idx(p_ctx) < 0)
+	if (avi_write_ix(p_ctx, &p_ctx->odml_v) < 0 || avi_write_ix(p_ctx, &p_ctx->odml_a) < 0)
 	{
 		goto end_err;
-    }
-    
-	p_ctx->i_riff = ftell(p_ctx->f);
+	}
+
+	pos = hfio_tell(p_ctx->fio);
+
+	if (p_ctx->i_riff_cnt == 1)
+	{
+		p_ctx->i_movi_end = pos;
+
+		if (avi_write_idx(p_ctx) < 0)
+		{
+			goto end_err;
+		}
+
+		p_ctx->i_riff = hfio_tell(p_ctx->fio);
+	}
+	else
+	{
+		// the last RIFF-AVIX is ended with movi
+		if (avi_patch_uint32(p_ctx, p_ctx->i_riff_pos + 4, (uint32)(pos - p_ctx->i_riff_pos - 8)) < 0 ||
+			avi_patch_uint32(p_ctx, p_ctx->i_riff_pos + 16, (uint32)(pos - p_ctx->i_riff_pos - 20)) < 0)
+		{
+			goto end_err;
+		}
+	}
 
 	if (avi_write_header(p_ctx) < 0)
 	{
@@ -180,29 +517,19 @@ int avi_end(AVICTX * p_ctx)
     }
     
 	// AVI file has been completed, delete the temporary index file
-	if (p_ctx->idx_f)
-	{
-		fclose(p_ctx->idx_f);
-		p_ctx->idx_f = NULL;
-		
-#if __WINDOWS_OS__
-        char filename[256];
-        sprintf(filename, "%s.idx", p_ctx->filename);
-        remove(filename);
-#else
-
-		char cmds[256];
-		sprintf(cmds, "rm -f %s.idx", p_ctx->filename);
-		system(cmds);
-#endif		
-	}
+	avi_remove_idx_file(p_ctx);
 
 end_err:
 
-	if (p_ctx->f)
+	if (p_ctx->fio)
 	{
-		fclose(p_ctx->f);
-		p_ctx->f = NULL;
+		if (AVI_SYNC_FSYNC == p_ctx->sync_mode)
+		{
+			hfio_sync(p_ctx->fio);
+		}
+		
+		hfio_close(p_ctx->fio);
+		p_ctx->fio = NULL;
 	}
 
 	avi_free_idx(p_ctx);
@@ -224,25 +551,38 @@ AVICTX * avi_write_open(const char * filename)
 
 	p_ctx->ctxf_write = 1;
 
-	p_ctx->f = fopen(filename, "wb+");
-	if (p_ctx->f == NULL)
+	// the chunks are coalesced in the aligned buffer (blocks), flushed by the durability policy
+	p_ctx->fio = hfio_open(filename);
+	if (p_ctx->fio == NULL)
 	{
-		log_print(HT_LOG_ERR, "%s, fopen [%s] failed!!!\r\n", __FUNCTION__, filename);
+		log_print(HT_LOG_ERR, "%s, hfio_open [%s] failed!!!\r\n", __FUNCTION__, filename);
 		goto write_err;
 	}
 
+	p_ctx->sync_mode = avi_sync_mode;
+	p_ctx->sync_ms = avi_sync_ms;
+	p_ctx->sync_time = sys_os_get_ms();
+
 	strncpy(p_ctx->filename, filename, sizeof(p_ctx->filename));
 
 	char idx_path[256];
 	sprintf(idx_path, "%s.idx", filename);
 	
-	p_ctx->idx_f = fopen(idx_path, "wb+");
-	if (p_ctx->idx_f == NULL)
+	p_ctx->idx_m = hmbuf_open(idx_path, AVI_IDX_SIZE);
+	if (p_ctx->idx_m == NULL)
 	{
-		log_print(HT_LOG_ERR, "%s, fopen [%s] failed!!!\r\n", __FUNCTION__, idx_path);
+		log_print(HT_LOG_ERR, "%s, hmbuf_open [%s] failed!!!\r\n", __FUNCTION__, idx_path);
 		goto write_err;
 	}
 
+	if (avi_odml_init(&p_ctx->odml_v, "00dc") < 0 || avi_odml_init(&p_ctx->odml_a, "01wb") < 0)
+	{
+		log_print(HT_LOG_ERR, "%s, malloc odml index failed!!!\r\n", __FUNCTION__);
+		goto write_err;
+	}
+
+	p_ctx->i_riff_cnt = 1;
+	
 	p_ctx->mutex = sys_os_create_mutex();
 
 	return p_ctx;
@@ -252,15 +592,18 @@ write_err:
 	if (p_ctx)
 	{
 		// An error has been written in the front, and it needs to be judged whether it can be closed.
-		if (p_ctx->f)
+		if (p_ctx->fio)
 		{
-			fclose(p_ctx->f);
+			hfio_close(p_ctx->fio);
 		}
 		
-		if (p_ctx->idx_f)
+		if (p_ctx->idx_m)
 		{
-			fclose(p_ctx->idx_f);
-		}	
+			hmbuf_close(p_ctx->idx_m, TRUE);
+		}
+
+		avi_odml_free(&p_ctx->odml_v);
+		avi_odml_free(&p_ctx->odml_a);
 	}
 	
 	if (p_ctx)
@@ -274,6 +617,7 @@ write_err:
 int avi_write_video_start(AVICTX * p_ctx, uint32 len, int b_key)
 {
 	int ret = -1;
+	int64 i_pos;
 
     if (NULL == p_ctx)
 	{
@@ -282,64 +626,28 @@ int avi_write_video_start(AVICTX * p_ctx, uint32 len, int b_key)
     
     sys_os_mutex_enter(p_ctx->mutex);
     
-	if (NULL == p_ctx || NULL == p_ctx->f)
+	if (NULL == p_ctx || NULL == p_ctx->fio)
 	{
 		return -1;
     }
 
-	int i_pos = ftell(p_ctx->f);
-
-	avi_write_fourcc(p_ctx, "00dc");
-	avi_write_uint32(p_ctx, len);
-
-	// Write index, memory mode and temporary file
-	if (p_ctx->ctxf_idx_m == 1)
+	if (avi_riff_check(p_ctx, &p_ctx->odml_v, len) < 0)
 	{
-		if (p_ctx->i_idx_max <= p_ctx->i_idx)
-		{
-			p_ctx->i_idx_max += 1000;
-			p_ctx->idx = (int *)realloc(p_ctx->idx, p_ctx->i_idx_max * 16);
-			if (p_ctx->idx == NULL)
-			{
-				log_print(HT_LOG_ERR, "%s, realloc ret null!!!\r\n", __FUNCTION__);
-			}
-		}
-
-		if (p_ctx->idx)
-		{
-			memcpy(&p_ctx->idx[4*p_ctx->i_idx+0], "00dc", 4);
-			avi_set_dw(&p_ctx->idx[4*p_ctx->i_idx+1], b_key ? AVIIF_KEYFRAME : 0);
-			avi_set_dw(&p_ctx->idx[4*p_ctx->i_idx+2], i_pos);
-			avi_set_dw(&p_ctx->idx[4*p_ctx->i_idx+3], len);
-		
-			p_ctx->i_idx++;
-		}
+		goto w_err;
 	}
-	else if (p_ctx->idx_f)
-	{
-		memcpy(&p_ctx->idx_fix[p_ctx->idx_fix_off + 0], "00dc", 4);
-		avi_set_dw(&p_ctx->idx_fix[p_ctx->idx_fix_off + 1], b_key ? AVIIF_KEYFRAME : 0);
-		avi_set_dw(&p_ctx->idx_fix[p_ctx->idx_fix_off + 2], i_pos);
-		avi_set_dw(&p_ctx->idx_fix[p_ctx->idx_fix_off + 3], len);
 
-		p_ctx->idx_fix_off += 4;
-		
-		if (p_ctx->idx_fix_off == (sizeof(p_ctx->idx_fix) / sizeof(int)))
-		{
-			if (fwrite(p_ctx->idx_fix, sizeof(p_ctx->idx_fix), 1, p_ctx->idx_f) != 1)
-			{
-				goto w_err;
-			}
-			
-			fflush(p_ctx->idx_f);
+	i_pos = hfio_tell(p_ctx->fio);
 
-			p_ctx->idx_fix_off = 0;
-		}
+	avi_write_fourcc(p_ctx, "00dc");
+	avi_write_uint32(p_ctx, len);
 
-		p_ctx->i_idx++;
+	if (avi_add_idx(p_ctx, &p_ctx->odml_v, i_pos, len, b_key) < 0)
+	{
+		goto w_err;
 	}
 
 	p_ctx->i_frame_video++;
+	p_ctx->ctxf_key = b_key ? 1 : 0;
 	
 	return 0;
 
@@ -347,16 +655,10 @@ w_err:
 
 	log_print(HT_LOG_ERR, "%s, ret[%d] err[%d] [%s]!!!\r\n", __FUNCTION__, ret, errno, strerror(errno));
 
-	if (p_ctx->f)
-	{
-		fclose(p_ctx->f);
-		p_ctx->f = NULL;
-	}
-	
-	if (p_ctx->idx_f)
+	if (p_ctx->fio)
 	{
-		fclose(p_ctx->idx_f);
-		p_ctx->idx_f = NULL;
+		hfio_close(p_ctx->fio);
+		p_ctx->fio = NULL;
 	}
 
 	sys_os_mutex_leave(p_ctx->mutex);
@@ -366,30 +668,22 @@ w_err:
 
 int avi_write_video_data(AVICTX * p_ctx, void * p_data, uint32 len)
 {
-	int ret = fwrite(p_data, len, 1, p_ctx->f);
-	if (ret != 1)
+	int ret = hfio_write(p_ctx->fio, p_data, len);
+	if (ret < 0)
 	{
 		goto w_err;
     }
     
-	fflush(p_ctx->f);
-
 	return len;
 
 w_err:
 
 	log_print(HT_LOG_ERR, "%s, ret[%d]err[%d][%s]!!!\r\n", __FUNCTION__, ret, errno, strerror(errno));
 
-	if (p_ctx->f)
-	{
-		fclose(p_ctx->f);
-		p_ctx->f = NULL;
-	}
-	
-	if (p_ctx->idx_f)
+	if (p_ctx->fio)
 	{
-		fclose(p_ctx->idx_f);
-		p_ctx->idx_f = NULL;
+		hfio_close(p_ctx->fio);
+		p_ctx->fio = NULL;
 	}
 
 	sys_os_mutex_leave(p_ctx->mutex);
@@ -399,26 +693,27 @@ w_err:
 
 int avi_write_video_end(AVICTX * p_ctx, int wlen)
 {
-	if (p_ctx->f == NULL)
+	if (p_ctx->fio == NULL)
 	{
 		return -1;
     }
     
 	if (wlen & 0x01)	/* pad */
 	{
-		fputc(0, p_ctx->f);
+		avi_write_pad(p_ctx);
     }
-    
-	int ret = ftell(p_ctx->f);
 
+    avi_sync(p_ctx, p_ctx->ctxf_key);
+    
 	sys_os_mutex_leave(p_ctx->mutex);
 	
-	return ret;
+	return wlen;
 }
 
 int avi_write_video(AVICTX * p_ctx, void * p_data, uint32 len, int b_key)
 {
 	int ret = -1;
+	int64 i_pos;
 
     if (NULL == p_ctx)
     {
@@ -427,77 +722,145 @@ int avi_write_video(AVICTX * p_ctx, void * p_data, uint32 len, int b_key)
     
     sys_os_mutex_enter(p_ctx->mutex);
     
-	if (NULL == p_ctx || NULL == p_ctx->f)
+	if (NULL == p_ctx || NULL == p_ctx->fio)
 	{
 		return -1;
     }
 
-	int i_pos = ftell(p_ctx->f);
+	if (avi_riff_check(p_ctx, &p_ctx->odml_v, len) < 0)
+	{
+		goto w_err;
+	}
+
+	i_pos = hfio_tell(p_ctx->fio);
 
 	avi_write_fourcc(p_ctx, "00dc");
 	avi_write_uint32(p_ctx, len);
 
-	if (fwrite(p_data, len, 1, p_ctx->f) != 1)
+	if (hfio_write(p_ctx->fio, p_data, len) < 0)
 	{
 		goto w_err;
 	}
 	
-	fflush(p_ctx->f);
-
 	if (len & 0x01)	/* pad */
 	{
-		fputc(0, p_ctx->f);
+		avi_write_pad(p_ctx);
     }
     
-	if (p_ctx->ctxf_idx_m == 1)
+	if (avi_add_idx(p_ctx, &p_ctx->odml_v, i_pos, len, b_key) < 0)
 	{
-		if (p_ctx->i_idx_max <= p_ctx->i_idx)
-		{
-			p_ctx->i_idx_max += 1000;
-			p_ctx->idx = (int *)realloc(p_ctx->idx, p_ctx->i_idx_max * 16);
-			if (p_ctx->idx == NULL)
-			{
-				log_print(HT_LOG_ERR, "%s, realloc ret null!!!\r\n", __FUNCTION__);
-			}
-		}
+		goto w_err;
+	}
+
+	p_ctx->i_frame_video++;
+
+	avi_sync(p_ctx, b_key);
+
+	ret = (int)len;
+
+	if (p_ctx->s_time == 0)
+	{
+		p_ctx->s_time = sys_os_get_ms();
+		p_ctx->e_time = p_ctx->s_time;
+	}
+	else
+	{
+		p_ctx->e_time = sys_os_get_ms();
+	}
+
+w_err:
 
-		if (p_ctx->idx)
+	if (ret < 0)
+	{
+		log_print(HT_LOG_ERR, "%s, ret[%d] err[%d] [%s]!!!\r\n", __FUNCTION__, ret, errno, strerror(errno));
+
+		if (p_ctx->fio)
 		{
-			memcpy(&p_ctx->idx[4*p_ctx->i_idx+0], "00dc", 4);
-			avi_set_dw(&p_ctx->idx[4*p_ctx->i_idx+1], b_key ? AVIIF_KEYFRAME : 0);
-			avi_set_dw(&p_ctx->idx[4*p_ctx->i_idx+2], i_pos);
-			avi_set_dw(&p_ctx->idx[4*p_ctx->i_idx+3], len);
-		
-			p_ctx->i_idx++;
+			hfio_close(p_ctx->fio);
+			p_ctx->fio = NULL;
 		}
 	}
-	else if (p_ctx->idx_f)
+
+	sys_os_mutex_leave(p_ctx->mutex);
+	
+	return ret;
+}
+
+int avi_write_video_iov(AVICTX * p_ctx, RTPIOV * p_iov, int cnt, uint32 len, int b_key)
+{
+	int ret = -1;
+	int64 i_pos;
+	int n = 0;
+	uint32 hdr[2];
+	uint8  pad = 0;
+	RTPIOV iov[RTP_FRM_IOV_MAX + 2];
+
+    if (NULL == p_ctx)
+    {
+        return -1;
+    }
+    
+    sys_os_mutex_enter(p_ctx->mutex);
+    
+	if (NULL == p_ctx->fio)
 	{
-		memcpy(&p_ctx->idx_fix[p_ctx->idx_fix_off + 0], "00dc", 4);
-		avi_set_dw(&p_ctx->idx_fix[p_ctx->idx_fix_off + 1], b_key ? AVIIF_KEYFRAME : 0);
-		avi_set_dw(&p_ctx->idx_fix[p_ctx->idx_fix_off + 2], i_pos);
-		avi_set_dw(&p_ctx->idx_fix[p_ctx->idx_fix_off + 3], len);
+		sys_os_mutex_leave(p_ctx->mutex);
+		return -1;
+    }
 
-		p_ctx->idx_fix_off += 4;
-		
-		if (p_ctx->idx_fix_off == (sizeof(p_ctx->idx_fix) / sizeof(int)))
-		{
-			if (fwrite(p_ctx->idx_fix, sizeof(p_ctx->idx_fix), 1, p_ctx->idx_f) != 1)
-			{
-				goto w_err;
-            }
-            
-			fflush(p_ctx->idx_f);
+	if (avi_riff_check(p_ctx, &p_ctx->odml_v, len) < 0)
+	{
+		goto w_err;
+	}
+
+	i_pos = hfio_tell(p_ctx->fio);
 
-			p_ctx->idx_fix_off = 0;
+	memcpy(&hdr[0], "00dc", 4);
+	hdr[1] = len;
+
+	iov[n].iov_base = hdr;
+	iov[n].iov_len = 8;
+	n++;
+
+	if (cnt <= RTP_FRM_IOV_MAX)
+	{
+		memcpy(&iov[n], p_iov, cnt * sizeof(RTPIOV));
+		n += cnt;
+	}
+	else
+	{
+		// a grown frame chain, the slices are written on their own
+		if (hfio_writev(p_ctx->fio, iov, n) < 0 || hfio_writev(p_ctx->fio, p_iov, cnt) < 0)
+		{
+			goto w_err;
 		}
 
-		p_ctx->i_idx++;
+		n = 0;
+	}
+
+	if (len & 0x01)	/* pad */
+	{
+		iov[n].iov_base = &pad;
+		iov[n].iov_len = 1;
+		n++;
+	}
+
+	// the chunk header, data and pad are written together
+	if (n > 0 && hfio_writev(p_ctx->fio, iov, n) < 0)
+	{
+		goto w_err;
+	}
+
+	if (avi_add_idx(p_ctx, &p_ctx->odml_v, i_pos, len, b_key) < 0)
+	{
+		goto w_err;
 	}
 
 	p_ctx->i_frame_video++;
 
-	ret = ftell(p_ctx->f);
+	avi_sync(p_ctx, b_key);
+
+	ret = (int)len;
 
 	if (p_ctx->s_time == 0)
 	{
@@ -515,16 +878,10 @@ w_err:
 	{
 		log_print(HT_LOG_ERR, "%s, ret[%d] err[%d] [%s]!!!\r\n", __FUNCTION__, ret, errno, strerror(errno));
 
-		if (p_ctx->f)
-		{
-			fclose(p_ctx->f);
-			p_ctx->f = NULL;
-		}
-		
-		if (p_ctx->idx_f)
+		if (p_ctx->fio)
 		{
-			fclose(p_ctx->idx_f);
-			p_ctx->idx_f = NULL;
+			hfio_close(p_ctx->fio);
+			p_ctx->fio = NULL;
 		}
 	}
 
@@ -533,84 +890,67 @@ w_err:
 	return ret;
 }
 
-int avi_write_audio(AVICTX * p_ctx, void * p_data, uint32 len)
+int avi_write_audio_iov(AVICTX * p_ctx, RTPIOV * p_iov, int cnt, uint32 len)
 {
 	int ret = -1;
+	int64 i_pos;
+	int n = 0;
+	uint32 hdr[2];
+	uint8  pad = 0;
+	RTPIOV iov[4];
 
-    if (NULL == p_ctx)
+    if (NULL == p_ctx || cnt > 2)
     {
         return -1;
     }
     
     sys_os_mutex_enter(p_ctx->mutex);
     
-	if (NULL == p_ctx || NULL == p_ctx->f)
+	if (NULL == p_ctx->fio)
 	{
+		sys_os_mutex_leave(p_ctx->mutex);
 		return -1;
     }
 
-	int i_pos = ftell(p_ctx->f);
-
-	/* chunk header */
-	avi_write_fourcc(p_ctx, "01wb");
-	avi_write_uint32(p_ctx, len);
-
-	if (fwrite(p_data, len, 1, p_ctx->f) != 1)
+	if (avi_riff_check(p_ctx, &p_ctx->odml_a, len) < 0)
 	{
 		goto w_err;
-    }
-    
+	}
+
+	i_pos = hfio_tell(p_ctx->fio);
+
+	memcpy(&hdr[0], "01wb", 4);
+	hdr[1] = len;
+
+	iov[n].iov_base = hdr;
+	iov[n].iov_len = 8;
+	n++;
+
+	memcpy(&iov[n], p_iov, cnt * sizeof(RTPIOV));
+	n += cnt;
+
 	if (len & 0x01)	/* pad */
 	{
-		fputc(0, p_ctx->f);
-    }
-    
-	if (p_ctx->ctxf_idx_m == 1)
-	{
-		if (p_ctx->i_idx_max <= p_ctx->i_idx)
-		{
-			p_ctx->i_idx_max += 1000;
-			p_ctx->idx = (int *)realloc(p_ctx->idx, p_ctx->i_idx_max * 16);
-			if (p_ctx->idx == NULL)
-			{
-				log_print(HT_LOG_ERR, "%s, realloc ret null!!!\r\n", __FUNCTION__);
-			}
-		}
+		iov[n].iov_base = &pad;
+		iov[n].iov_len = 1;
+		n++;
+	}
 
-		if (p_ctx->idx)
-		{
-			memcpy(&p_ctx->idx[4*p_ctx->i_idx+0], "01wb", 4);
-			avi_set_dw(&p_ctx->idx[4*p_ctx->i_idx+1], AVIIF_KEYFRAME);
-			avi_set_dw(&p_ctx->idx[4*p_ctx->i_idx+2], i_pos);
-			avi_set_dw(&p_ctx->idx[4*p_ctx->i_idx+3], len);
-		
-			p_ctx->i_idx++;
-		}
+	if (hfio_writev(p_ctx->fio, iov, n) < 0)
+	{
+		goto w_err;
 	}
-	else if (p_ctx->idx_f)
+    
+	if (avi_add_idx(p_ctx, &p_ctx->odml_a, i_pos, len, 1) < 0)
 	{
-		memcpy(&p_ctx->idx_fix[p_ctx->idx_fix_off + 0], "01wb", 4);
-		avi_set_dw(&p_ctx->idx_fix[p_ctx->idx_fix_off + 1], AVIIF_KEYFRAME);
-		avi_set_dw(&p_ctx->idx_fix[p_ctx->idx_fix_off + 2], i_pos);
-		avi_set_dw(&p_ctx->idx_fix[p_ctx->idx_fix_off + 3], len);
-
-		p_ctx->idx_fix_off += 4;
-		
-		if (p_ctx->idx_fix_off == (sizeof(p_ctx->idx_fix) / sizeof(int)))
-		{
-			if (fwrite(p_ctx->idx_fix, sizeof(p_ctx->idx_fix), 1, p_ctx->idx_f) != 1)
-			{
-				goto w_err;
-			}
-			
-			p_ctx->idx_fix_off = 0;
-		}
-
-		p_ctx->i_idx++;
+		goto w_err;
 	}
 
 	p_ctx->i_frame_audio++;
-	ret = ftell(p_ctx->f);
+
+	avi_sync(p_ctx, 0);
+
+	ret = (int)len;
 
 w_err:
 
@@ -618,16 +958,10 @@ w_err:
 	{
 		log_print(HT_LOG_ERR, "%s, ret[%d]!!!\r\n", __FUNCTION__, ret);
 
-		if (p_ctx->f)
+		if (p_ctx->fio)
 		{
-			fclose(p_ctx->f);
-			p_ctx->f = NULL;
-		}
-		
-		if (p_ctx->idx_f)
-		{
-			fclose(p_ctx->idx_f);
-			p_ctx->idx_f = NULL;
+			hfio_close(p_ctx->fio);
+			p_ctx->fio = NULL;
 		}
 	}
 
@@ -636,6 +970,16 @@ w_err:
 	return ret;
 }
 
+int avi_write_audio(AVICTX * p_ctx, void * p_data, uint32 len)
+{
+	RTPIOV iov;
+
+	iov.iov_base = p_data;
+	iov.iov_len = len;
+
+	return avi_write_audio_iov(p_ctx, &iov, 1, len);
+}
+
 void avi_write_close(AVICTX * p_ctx)
 {
 	if (NULL == p_ctx)
@@ -652,6 +996,8 @@ void avi_write_close(AVICTX * p_ctx)
 
 	avi_end(p_ctx);
 	avi_free_idx(p_ctx);
+	avi_odml_free(&p_ctx->odml_v);
+	avi_odml_free(&p_ctx->odml_a);
 
     sys_os_mutex_leave(p_ctx->mutex);
     
@@ -808,7 +1154,7 @@ void avi_build_audio_hdr(AVICTX * p_ctx)
 
 int avi_write_header(AVICTX * p_ctx)
 {
-	if (p_ctx->f == NULL)
+	if (p_ctx->fio == NULL)
 	{
 		return -1;
     }
@@ -818,14 +1164,18 @@ int avi_write_header(AVICTX * p_ctx)
 	avi_build_video_hdr(p_ctx);
 	avi_build_audio_hdr(p_ctx);
 
-	fseek(p_ctx->f, 0, SEEK_SET);
+	hfio_seek(p_ctx->fio, 0, SEEK_SET);
 
 	int avih_len = sizeof(AVIMHDR) + 8;
+	int indx_len = 24 + AVI_INDX_ENTRIES * sizeof(AVISIDXE) + 8;
 
-	int strl_v_len = sizeof(AVISHDR) + 8 + sizeof(BMPHDR) + 8;
-	int strl_a_len = sizeof(AVISHDR) + 8 + sizeof(WAVEFMT) + 8;
+	int strl_v_len = sizeof(AVISHDR) + 8 + sizeof(BMPHDR) + 8 + indx_len;
+	int strl_a_len = sizeof(AVISHDR) + 8 + sizeof(WAVEFMT) + 8 + indx_len;
 	int s_v_ll = strl_v_len + 12;
 	int s_a_ll = strl_a_len + 12;
+	int odml_ll = AVI_DMLH_SIZE + 8 + 12;
+
+	char dmlh[AVI_DMLH_SIZE];
 
 	int extra_len = 0;
 	int pad_len = 0;
@@ -841,18 +1191,18 @@ int avi_write_header(AVICTX * p_ctx)
 	}
 
 	avi_write_fourcc(p_ctx, "RIFF");
-	avi_write_uint32(p_ctx, p_ctx->i_riff > 0 ? p_ctx->i_riff - 8 : 0xFFFFFFFF); // Total file length - ('RIFF') - 4 
+	avi_write_uint32(p_ctx, p_ctx->i_riff > 0 ? (uint32)(p_ctx->i_riff - 8) : 0xFFFFFFFF); // Total file length - ('RIFF') - 4 
 	avi_write_fourcc(p_ctx, "AVI ");
 
 	avi_write_fourcc(p_ctx, "LIST");
 	
 	if (p_ctx->ctxf_audio == 1)
 	{
-		avi_write_uint32(p_ctx,  4 + avih_len + s_v_ll + s_a_ll + extra_len + pad_len);	// List data length + 4("hdrl")
+		avi_write_uint32(p_ctx,  4 + avih_len + s_v_ll + s_a_ll + extra_len + pad_len + odml_ll);	// List data length + 4("hdrl")
 	}	
 	else
 	{
-		avi_write_uint32(p_ctx,  4 + avih_len + s_v_ll);	// List data length + 4("hdrl")
+		avi_write_uint32(p_ctx,  4 + avih_len + s_v_ll + odml_ll);	// List data length + 4("hdrl")
     }
     
 	avi_write_fourcc(p_ctx, "hdrl");
@@ -872,7 +1222,7 @@ int avi_write_header(AVICTX * p_ctx)
 	p_ctx->avi_hdr.dwMaxBytesPerSec		= 0xffffffff;				// The maximum data rate of this AVI file
 	p_ctx->avi_hdr.dwPaddingGranularity	= 0;						// Granularity of data padding
 	p_ctx->avi_hdr.dwFlags				= AVIF_HASINDEX|AVIF_ISINTERLEAVED|AVIF_TRUSTCKTYPE;
-	p_ctx->avi_hdr.dwTotalFrames		= p_ctx->i_frame_video;		// Total number of frames
+	p_ctx->avi_hdr.dwTotalFrames		= p_ctx->i_riff_cnt > 1 ? p_ctx->i_frame_first : p_ctx->i_frame_video;	// Number of frames in the first RIFF
 	p_ctx->avi_hdr.dwInitialFrames		= 0;						// Specify the initial number of frames for the interactive format
 
 	if (p_ctx->ctxf_audio == 1)
@@ -891,7 +1241,7 @@ int avi_write_header(AVICTX * p_ctx)
 	avi_write_buffer(p_ctx, (char*)&p_ctx->avi_hdr, sizeof(AVIMHDR));
 
 	avi_write_fourcc(p_ctx, "LIST");
-	avi_write_uint32(p_ctx,  4 + sizeof(AVISHDR) + 8 + sizeof(BMPHDR) + 8);
+	avi_write_uint32(p_ctx,  4 + strl_v_len);
 	avi_write_fourcc(p_ctx, "strl");						        // How many streams are there in the file, and how many 'strl' sublists there are
 
 	avi_write_fourcc(p_ctx, "strh");
@@ -902,10 +1252,15 @@ int avi_write_header(AVICTX * p_ctx)
 	avi_write_uint32(p_ctx,  sizeof(BMPHDR));
 	avi_write_buffer(p_ctx, (char*)&p_ctx->bmp, sizeof(BMPHDR));
 
+	if (avi_write_indx(p_ctx, &p_ctx->odml_v) < 0)
+	{
+		goto w_err;
+	}
+
 	if (p_ctx->ctxf_audio == 1)
 	{
 		avi_write_fourcc(p_ctx, "LIST");
-		avi_write_uint32(p_ctx,  4 + sizeof(AVISHDR) + 8 + sizeof(WAVEFMT) + 8 + extra_len + pad_len);
+		avi_write_uint32(p_ctx,  4 + strl_a_len + extra_len + pad_len);
 		avi_write_fourcc(p_ctx, "strl");
 
 		avi_write_fourcc(p_ctx, "strh");
@@ -922,18 +1277,34 @@ int avi_write_header(AVICTX * p_ctx)
 
 		    if (p_ctx->a_extra_len & 0x01)	/* pad */
         	{
-        		fputc(0, p_ctx->f);
+        		avi_write_pad(p_ctx);
             }
 		}
+
+		if (avi_write_indx(p_ctx, &p_ctx->odml_a) < 0)
+		{
+			goto w_err;
+		}
 	}
 
+	// OpenDML extended header, the total number of frames of all RIFFs
+	memset(dmlh, 0, sizeof(dmlh));
+	avi_set_dw(dmlh, p_ctx->i_frame_video);
+
+	avi_write_fourcc(p_ctx, "LIST");
+	avi_write_uint32(p_ctx,  4 + 8 + AVI_DMLH_SIZE);
+	avi_write_fourcc(p_ctx, "odml");
+	avi_write_fourcc(p_ctx, "dmlh");
+	avi_write_uint32(p_ctx,  AVI_DMLH_SIZE);
+	avi_write_buffer(p_ctx, dmlh, AVI_DMLH_SIZE);
+
 	avi_write_fourcc(p_ctx, "LIST");
-	avi_write_uint32(p_ctx,  p_ctx->i_movi_end > 0 ? (p_ctx->i_movi_end - p_ctx->i_movi + 4) : 0xFFFFFFFF);
+	avi_write_uint32(p_ctx,  p_ctx->i_movi_end > 0 ? (uint32)(p_ctx->i_movi_end - p_ctx->i_movi + 4) : 0xFFFFFFFF);
 	avi_write_fourcc(p_ctx, "movi");
 
-	fflush(p_ctx->f);
+	hfio_flush(p_ctx->fio);
 
-	p_ctx->i_movi = ftell(p_ctx->f);
+	p_ctx->i_movi = hfio_tell(p_ctx->fio);
 	
 	if (p_ctx->i_movi < 0)
 	{
@@ -944,10 +1315,10 @@ int avi_write_header(AVICTX * p_ctx)
 
 w_err:
 
-	if (p_ctx->f)
+	if (p_ctx->fio)
 	{
-		fclose(p_ctx->f);
-		p_ctx->f = NULL;
+		hfio_close(p_ctx->fio);
+		p_ctx->fio = NULL;
 	}
 
 	return -1;
@@ -964,16 +1335,16 @@ int avi_update_header(AVICTX * p_ctx)
     
     sys_os_mutex_enter(p_ctx->mutex);
 
-    if (NULL == p_ctx || NULL == p_ctx->f)
+    if (NULL == p_ctx || NULL == p_ctx->fio)
 	{
 		return -1;
     }
     
 	if (avi_write_header(p_ctx) == 0)
 	{
-		if (p_ctx->f)
+		if (p_ctx->fio)
 		{
-			fseek(p_ctx->f, 0, SEEK_END);
+			hfio_seek(p_ctx->fio, 0, SEEK_END);
 
 			sys_os_mutex_leave(p_ctx->mutex);
 			return 0;
@@ -1128,7 +1499,7 @@ int avi_parse_video_size(AVICTX * p_ctx, uint8 * p_data, uint32 len)
 				h265_t parse;
 				h265_parser_init(&parse);
 
-				if (h265_parser_parse(&parse, p_cur+4, n_len-s_len) == 0)
+				if (h265_parser_parse(&parse, p_cur+s_len, n_len-s_len) == 0)
 				{
 					log_print(HT_LOG_INFO, "%s, H265 width[%d],height[%d]\r\n", __FUNCTION__, parse.pic_width_in_luma_samples, parse.pic_height_in_luma_samples);
 					p_ctx->v_width = parse.pic_width_in_luma_samples;
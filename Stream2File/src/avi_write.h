@@ -22,6 +22,7 @@
 
 #include "sys_inc.h"
 #include "avi.h"
+#include "rtp_rx.h"
 
 
 #ifdef __cplusplus
@@ -33,11 +34,29 @@ int 	avi_write_idx(AVICTX * p_ctx);
 void 	avi_set_dw(void * p, uint32 dw);
 int 	avi_end(AVICTX * p_ctx);
 AVICTX* avi_write_open(const char * filename);
+
+/**
+ * Set the durability policy of the files opened afterwards, 
+ * the write buffer is set up by hfio_init
+ */
+void	avi_write_set_sync_def(int mode, uint32 ms);
+
+/**
+ * Override the durability policy of one file
+ */
+void	avi_write_set_sync(AVICTX * p_ctx, int mode, uint32 ms);
 int 	avi_write_video_start(AVICTX * p_ctx, uint32 len, int b_key);
 int 	avi_write_video_data(AVICTX * p_ctx, void * p_data, uint32 len);
 int 	avi_write_video_end(AVICTX * p_ctx, int wlen);
 int 	avi_write_video(AVICTX * p_ctx, void * p_data, uint32 len, int b_key);
+int 	avi_write_video_iov(AVICTX * p_ctx, RTPIOV * p_iov, int cnt, uint32 len, int b_key);
 int 	avi_write_audio(AVICTX * p_ctx, void * p_data, uint32 len);
+
+/**
+ * Write one audio chunk gathered from up to two pieces,
+ * e.g. a stack ADTS header and the raw frame
+ */
+int 	avi_write_audio_iov(AVICTX * p_ctx, RTPIOV * p_iov, int cnt, uint32 len);
 void 	avi_write_close(AVICTX * p_ctx);
 void 	avi_set_video_info(AVICTX * p_ctx, int fps, int width, int height, const char fcc[4]);
 void 	avi_set_audio_info(AVICTX * p_ctx, int chns, int rate, uint16 fmt, uint8 * extra, int extra_len);
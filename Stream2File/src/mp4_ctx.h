@@ -21,6 +21,9 @@
 #define MP4_CTX_H
 
 #include "format.h"
+#include "mp4_mux.h"
+
+#define MP4_AU_NAL_MAX      128         // initial nal units of one sample, doubled when full
 
 extern "C"
 {
@@ -38,6 +41,15 @@ typedef struct mp4_pkt
 	uint32		len;					// packet length
 } MP4PKT;
 
+typedef struct mp4_ts
+{
+	uint32      clock;                  // Source timestamp clock rate, 0 - the track timescale
+	uint32      last_ts;                // Last source timestamp
+	int64       pts;                    // Last source timestamp extended to 64 bits, relative to the first one
+	uint64      dts;                    // Decode time of the last sample, the track timescale based
+	uint32      samples;                // Samples written
+} MP4TS;
+
 typedef struct mp4_file_context
 {
     uint32		ctxf_read	: 1;	    // Read mode
@@ -49,16 +61,20 @@ typedef struct mp4_file_context
 	uint32		ctxf_vps_f	: 1;	    // Auxiliary calculation of image size usage, already filled in VPS in avcc
     uint32      ctxf_nalu   : 1;
 	uint32      ctxf_iframe : 1;
-	uint32		ctxf_res	: 23;
+	uint32      ctxf_frag   : 1;        // Fragmented mp4, moof + mdat fragments after the moov
+	uint32		ctxf_res	: 22;
 
     int         v_track_id;             // video track id     
     uint32      v_stream_idx;           // video stream index
-    uint32      v_timestamp;            // video timestamp     
+    MP4TS       v_ts;                   // video timestamp
     int         a_track_id;             // audio track id     
     uint32      a_stream_idx;           // audio stream index
-    uint32      a_timestamp;            // audio timestamp
+    MP4TS       a_ts;                   // audio timestamp
     
-    GF_ISOFile *handler;                // Read and write file handle
+    GF_ISOFile *handler;                // Read file handle
+    MP4MUX *    mux;                    // Write file handle
+    MP4TRK *    v_trk;                  // Video track of the write mode
+    MP4TRK *    a_trk;                  // Audio track of the write mode
 	char		filename[256];		    // File full path
 	void *		mutex;				    // Write, close mutex
 	
@@ -92,6 +108,22 @@ typedef struct mp4_file_context
     // Auxiliary analysis
 	uint32		prev_ts;			    // Last timestamp
 	uint32		delta_ts[20];		    // Calculate fps values
+
+	// Fragmented mp4
+	uint32      frag_ms;                // Fragment duration (ms), 0 - every key frame
+	int64       frag_time;              // Current fragment start time (ms), -1 - no fragment yet
+	int         sync_mode;              // Durability policy of the fragments, AVI_SYNC_NONE ~ AVI_SYNC_FSYNC
+	uint32      sync_ms;                // fdatasync interval (ms)
+	uint32      sync_time;              // Last fdatasync time
+
+	// H264/H265 access unit of the sample being written
+	HFIOV     * au_iov;                 // length prefixes and nal unit payload slices
+	int         au_iov_cnt;
+	int         au_iov_max;
+	uint32    * au_nlen;                // big endian length prefixes
+	int         au_nal_cnt;
+	int         au_nal_max;
+	int         au_key;                 // has a key frame slice
 } MP4CTX;
 
 
@@ -0,0 +1,1356 @@
+/***************************************************************************************
+ *
+ *  IMPORTANT: READ BEFORE DOWNLOADING, COPYING, INSTALLING OR USING.
+ *
+ *  By downloading, copying, installing or using the software you agree to this license.
+ *  If you do not agree to this license, do not download, install, 
+ *  copy or use the software.
+ *
+ *  Copyright (C) 2014-2020, Happytimesoft Corporation, all rights reserved.
+ *
+ *  Redistribution and use in binary forms, with or without modification, are permitted.
+ *
+ *  Unless required by applicable law or agreed to in writing, software distributed 
+ *  under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ *  CONDITIONS OF ANY KIND, either express or implied. See the License for the specific
+ *  language governing permissions and limitations under the License.
+ *
+****************************************************************************************/
+
+#ifdef MP4_FORMAT
+
+#include "sys_inc.h"
+#include "mp4_mux.h"
+#include "media_util.h"
+#include "h265_util.h"
+
+/***********************************************************/
+// seconds from 1904-01-01 to 1970-01-01
+#define MP4_TIME_OFFSET     2082844800U
+
+/***********************************************************/
+static BOOL mp4_buf_reserve(MP4BUF * p_buf, uint32 len)
+{
+    uint8 * p_new;
+    uint32 size;
+
+    if (p_buf->len + len <= p_buf->size)
+    {
+        return TRUE;
+    }
+
+    size = p_buf->size ? p_buf->size : 4096;
+
+    while (size < p_buf->len + len)
+    {
+        size *= 2;
+    }
+
+    p_new = (uint8 *)realloc(p_buf->buf, size);
+    if (NULL == p_new)
+    {
+        log_print(HT_LOG_ERR, "%s, realloc %u failed\r\n", __FUNCTION__, size);
+        return FALSE;
+    }
+
+    p_buf->buf = p_new;
+    p_buf->size = size;
+
+    return TRUE;
+}
+
+static void mp4_buf_free(MP4BUF * p_buf)
+{
+    if (p_buf->buf)
+    {
+        free(p_buf->buf);
+    }
+
+    memset(p_buf, 0, sizeof(MP4BUF));
+}
+
+static void mp4_put_data(MP4BUF * p_buf, const void * p_data, uint32 len)
+{
+    if (mp4_buf_reserve(p_buf, len))
+    {
+        if (p_data)
+        {
+            memcpy(p_buf->buf + p_buf->len, p_data, len);
+        }
+        else
+        {
+            memset(p_buf->buf + p_buf->len, 0, len);
+        }
+
+        p_buf->len += len;
+    }
+}
+
+static void mp4_put8(MP4BUF * p_buf, uint32 v)
+{
+    uint8 b = (uint8)v;
+
+    mp4_put_data(p_buf, &b, 1);
+}
+
+static void mp4_put16(MP4BUF * p_buf, uint32 v)
+{
+    uint8 b[2];
+
+    b[0] = (uint8)(v >> 8);
+    b[1] = (uint8)v;
+
+    mp4_put_data(p_buf, b, 2);
+}
+
+static void mp4_put32(MP4BUF * p_buf, uint32 v)
+{
+    uint8 b[4];
+
+    b[0] = (uint8)(v >> 24);
+    b[1] = (uint8)(v >> 16);
+    b[2] = (uint8)(v >> 8);
+    b[3] = (uint8)v;
+
+    mp4_put_data(p_buf, b, 4);
+}
+
+static void mp4_put64(MP4BUF * p_buf, uint64 v)
+{
+    mp4_put32(p_buf, (uint32)(v >> 32));
+    mp4_put32(p_buf, (uint32)v);
+}
+
+static void mp4_set32(uint8 * p, uint32 v)
+{
+    p[0] = (uint8)(v >> 24);
+    p[1] = (uint8)(v >> 16);
+    p[2] = (uint8)(v >> 8);
+    p[3] = (uint8)v;
+}
+
+static uint32 mp4_box_start(MP4BUF * p_buf, uint32 type)
+{
+    uint32 pos = p_buf->len;
+
+    mp4_put32(p_buf, 0);
+    mp4_put32(p_buf, type);
+
+    return pos;
+}
+
+static uint32 mp4_fullbox_start(MP4BUF * p_buf, uint32 type, uint32 version, uint32 flags)
+{
+    uint32 pos = mp4_box_start(p_buf, type);
+
+    mp4_put32(p_buf, (version << 24) | (flags & 0xFFFFFF));
+
+    return pos;
+}
+
+static void mp4_box_end(MP4BUF * p_buf, uint32 pos)
+{
+    if (pos + 4 <= p_buf->len)
+    {
+        mp4_set32(p_buf->buf + pos, p_buf->len - pos);
+    }
+}
+
+/**
+ * Descriptor of esds, the length is always coded in 4 bytes
+ */
+static void mp4_put_desc(MP4BUF * p_buf, uint32 tag, uint32 len)
+{
+    mp4_put8(p_buf, tag);
+    mp4_put8(p_buf, 0x80 | ((len >> 21) & 0x7F));
+    mp4_put8(p_buf, 0x80 | ((len >> 14) & 0x7F));
+    mp4_put8(p_buf, 0x80 | ((len >> 7) & 0x7F));
+    mp4_put8(p_buf, len & 0x7F);
+}
+
+static void mp4_put_matrix(MP4BUF * p_buf)
+{
+    mp4_put32(p_buf, 0x00010000);
+    mp4_put32(p_buf, 0);
+    mp4_put32(p_buf, 0);
+    mp4_put32(p_buf, 0);
+    mp4_put32(p_buf, 0x00010000);
+    mp4_put32(p_buf, 0);
+    mp4_put32(p_buf, 0);
+    mp4_put32(p_buf, 0);
+    mp4_put32(p_buf, 0x40000000);
+}
+
+static BOOL mp4_grow(void ** pp, uint32 * p_max, uint32 cnt, uint32 unit)
+{
+    void * p_new;
+    uint32 max;
+
+    if (cnt < *p_max)
+    {
+        return TRUE;
+    }
+
+    max = *p_max ? *p_max * 2 : 256;
+
+    p_new = realloc(*pp, max * unit);
+    if (NULL == p_new)
+    {
+        log_print(HT_LOG_ERR, "%s, realloc %u failed\r\n", __FUNCTION__, max * unit);
+        return FALSE;
+    }
+
+    *pp = p_new;
+    *p_max = max;
+
+    return TRUE;
+}
+
+/***********************************************************/
+static uint64 mp4_trk_duration(MP4TRK * p_trk)
+{
+    if (0 == p_trk->samples)
+    {
+        return 0;
+    }
+
+    return p_trk->last_dts - p_trk->first_dts + (p_trk->last_delta ? p_trk->last_delta : 1);
+}
+
+/**
+ * Close the current chunk of the track, a stsc entry is added
+ * only when the samples per chunk changes
+ */
+static void mp4_chunk_end(MP4TRK * p_trk)
+{
+    if (0 == p_trk->chunk_samples)
+    {
+        return;
+    }
+
+    if (0 == p_trk->stsc_cnt || p_trk->stsc[p_trk->stsc_cnt-1].value != p_trk->chunk_samples)
+    {
+        if (mp4_grow((void **)&p_trk->stsc, &p_trk->stsc_max, p_trk->stsc_cnt, sizeof(MP4RUN)))
+        {
+            p_trk->stsc[p_trk->stsc_cnt].count = p_trk->stco_cnt;
+            p_trk->stsc[p_trk->stsc_cnt].value = p_trk->chunk_samples;
+            p_trk->stsc_cnt++;
+        }
+    }
+
+    p_trk->chunk_samples = 0;
+}
+
+/**
+ * Append count samples of the value to the run length encoded table
+ */
+static BOOL mp4_run_add(MP4RUN ** pp_run, uint32 * p_cnt, uint32 * p_max, uint32 value, uint32 count)
+{
+    if (*p_cnt > 0 && (*pp_run)[*p_cnt-1].value == value)
+    {
+        (*pp_run)[*p_cnt-1].count += count;
+    }
+    else if (mp4_grow((void **)pp_run, p_max, *p_cnt, sizeof(MP4RUN)))
+    {
+        (*pp_run)[*p_cnt].count = count;
+        (*pp_run)[*p_cnt].value = value;
+        (*p_cnt)++;
+    }
+    else
+    {
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+/**
+ * The upper bound of the moov size, so it is serialized without reallocation
+ */
+static uint32 mp4_moov_size(MP4MUX * p_mux)
+{
+    int i;
+    uint32 size = 1024;
+
+    for (i = 0; i < p_mux->trk_cnt; i++)
+    {
+        MP4TRK * p_trk = &p_mux->trks[i];
+
+        size += 1024 + p_trk->config_len;
+        size += (p_trk->stts_cnt + 1) * 8;
+        size += p_trk->ctts_cnt * 8;
+        size += p_trk->stss_cnt * 4;
+        size += p_trk->stsc_cnt * 12;
+        size += p_trk->samples * 4;
+        size += p_trk->stco_cnt * 8;
+    }
+
+    return size;
+}
+
+static void mp4_write_esds(MP4BUF * p_buf, MP4TRK * p_trk)
+{
+    uint32 pos;
+    uint32 dsi_len = p_trk->config_len > 0 ? 5 + p_trk->config_len : 0;
+
+    pos = mp4_fullbox_start(p_buf, MP4_4CC('e','s','d','s'), 0, 0);
+
+    mp4_put_desc(p_buf, 0x03, 3 + 5 + 13 + dsi_len + 5 + 1);    // ES_Descriptor
+    mp4_put16(p_buf, p_trk->track_id);
+    mp4_put8(p_buf, 0);
+
+    mp4_put_desc(p_buf, 0x04, 13 + dsi_len);                    // DecoderConfigDescriptor
+    mp4_put8(p_buf, p_trk->oti);
+    mp4_put8(p_buf, (MP4_TRK_VIDEO == p_trk->type) ? 0x11 : 0x15); // stream type, upstream 0, reserved 1
+    mp4_put8(p_buf, 0);                                         // buffer size db
+    mp4_put16(p_buf, 0);
+    mp4_put32(p_buf, 0);                                        // max bitrate
+    mp4_put32(p_buf, 0);                                        // avg bitrate
+
+    if (dsi_len > 0)
+    {
+        mp4_put_desc(p_buf, 0x05, p_trk->config_len);           // DecoderSpecificInfo
+        mp4_put_data(p_buf, p_trk->config, p_trk->config_len);
+    }
+
+    mp4_put_desc(p_buf, 0x06, 1);                               // SLConfigDescriptor
+    mp4_put8(p_buf, 0x02);
+
+    mp4_box_end(p_buf, pos);
+}
+
+static void mp4_write_stsd(MP4BUF * p_buf, MP4TRK * p_trk)
+{
+    uint32 pos, entry;
+
+    pos = mp4_fullbox_start(p_buf, MP4_4CC('s','t','s','d'), 0, 0);
+    mp4_put32(p_buf, 1);
+
+    entry = mp4_box_start(p_buf, p_trk->fourcc);
+    mp4_put_data(p_buf, NULL, 6);
+    mp4_put16(p_buf, 1);                                        // data reference index
+
+    if (MP4_TRK_VIDEO == p_trk->type)
+    {
+        uint32 cfg;
+
+        mp4_put_data(p_buf, NULL, 16);
+        mp4_put16(p_buf, p_trk->width);
+        mp4_put16(p_buf, p_trk->height);
+        mp4_put32(p_buf, 0x00480000);                           // 72 dpi
+        mp4_put32(p_buf, 0x00480000);
+        mp4_put32(p_buf, 0);
+        mp4_put16(p_buf, 1);                                    // frame count
+        mp4_put_data(p_buf, NULL, 32);                          // compressor name
+        mp4_put16(p_buf, 0x0018);                               // depth
+        mp4_put16(p_buf, 0xFFFF);
+
+        if (MP4_4CC('a','v','c','1') == p_trk->fourcc)
+        {
+            cfg = mp4_box_start(p_buf, MP4_4CC('a','v','c','C'));
+            mp4_put_data(p_buf, p_trk->config, p_trk->config_len);
+            mp4_box_end(p_buf, cfg);
+        }
+        else if (MP4_4CC('h','v','c','1') == p_trk->fourcc)
+        {
+            cfg = mp4_box_start(p_buf, MP4_4CC('h','v','c','C'));
+            mp4_put_data(p_buf, p_trk->config, p_trk->config_len);
+            mp4_box_end(p_buf, cfg);
+        }
+        else
+        {
+            mp4_write_esds(p_buf, p_trk);
+        }
+    }
+    else
+    {
+        mp4_put_data(p_buf, NULL, 8);
+        mp4_put16(p_buf, p_trk->chns);
+        mp4_put16(p_buf, 16);                                   // sample size
+        mp4_put32(p_buf, 0);
+        mp4_put32(p_buf, p_trk->rate < 65536 ? (p_trk->rate << 16) : 0);
+
+        mp4_write_esds(p_buf, p_trk);
+    }
+
+    mp4_box_end(p_buf, entry);
+    mp4_box_end(p_buf, pos);
+}
+
+static void mp4_write_stbl(MP4BUF * p_buf, MP4TRK * p_trk)
+{
+    uint32 i, pos, stbl, delta;
+
+    stbl = mp4_box_start(p_buf, MP4_4CC('s','t','b','l'));
+
+    mp4_write_stsd(p_buf, p_trk);
+
+    // stts, the last sample lasts as long as the previous one
+    pos = mp4_fullbox_start(p_buf, MP4_4CC('s','t','t','s'), 0, 0);
+
+    delta = p_trk->last_delta ? p_trk->last_delta : 1;
+
+    if (0 == p_trk->samples)
+    {
+        mp4_put32(p_buf, 0);
+    }
+    else if (p_trk->stts_cnt > 0 && p_trk->stts[p_trk->stts_cnt-1].value == delta)
+    {
+        mp4_put32(p_buf, p_trk->stts_cnt);
+
+        for (i = 0; i < p_trk->stts_cnt; i++)
+        {
+            mp4_put32(p_buf, p_trk->stts[i].count + (i == p_trk->stts_cnt - 1));
+            mp4_put32(p_buf, p_trk->stts[i].value);
+        }
+    }
+    else
+    {
+        mp4_put32(p_buf, p_trk->stts_cnt + 1);
+
+        for (i = 0; i < p_trk->stts_cnt; i++)
+        {
+            mp4_put32(p_buf, p_trk->stts[i].count);
+            mp4_put32(p_buf, p_trk->stts[i].value);
+        }
+
+        mp4_put32(p_buf, 1);
+        mp4_put32(p_buf, delta);
+    }
+
+    mp4_box_end(p_buf, pos);
+
+    // ctts, version 1 for the negative offsets
+    if (p_trk->ctts_cnt > 0)
+    {
+        pos = mp4_fullbox_start(p_buf, MP4_4CC('c','t','t','s'), 1, 0);
+        mp4_put32(p_buf, p_trk->ctts_cnt);
+
+        for (i = 0; i < p_trk->ctts_cnt; i++)
+        {
+            mp4_put32(p_buf, p_trk->ctts[i].count);
+            mp4_put32(p_buf, p_trk->ctts[i].value);
+        }
+
+        mp4_box_end(p_buf, pos);
+    }
+
+    // stss, absent if all samples are key samples
+    if (MP4_TRK_VIDEO == p_trk->type && p_trk->stss_cnt < p_trk->samples)
+    {
+        pos = mp4_fullbox_start(p_buf, MP4_4CC('s','t','s','s'), 0, 0);
+        mp4_put32(p_buf, p_trk->stss_cnt);
+
+        for (i = 0; i < p_trk->stss_cnt; i++)
+        {
+            mp4_put32(p_buf, p_trk->stss[i]);
+        }
+
+        mp4_box_end(p_buf, pos);
+    }
+
+    pos = mp4_fullbox_start(p_buf, MP4_4CC('s','t','s','c'), 0, 0);
+    mp4_put32(p_buf, p_trk->stsc_cnt);
+
+    for (i = 0; i < p_trk->stsc_cnt; i++)
+    {
+        mp4_put32(p_buf, p_trk->stsc[i].count);
+        mp4_put32(p_buf, p_trk->stsc[i].value);
+        mp4_put32(p_buf, 1);
+    }
+
+    mp4_box_end(p_buf, pos);
+
+    pos = mp4_fullbox_start(p_buf, MP4_4CC('s','t','s','z'), 0, 0);
+    mp4_put32(p_buf, 0);
+    mp4_put32(p_buf, p_trk->samples);
+
+    if (mp4_buf_reserve(p_buf, p_trk->samples * 4))
+    {
+        for (i = 0; i < p_trk->samples; i++)
+        {
+            mp4_set32(p_buf->buf + p_buf->len, p_trk->stsz[i]);
+            p_buf->len += 4;
+        }
+    }
+
+    mp4_box_end(p_buf, pos);
+
+    // the chunk offsets only grow, the last one tells if co64 is needed
+    if (p_trk->stco_cnt > 0 && p_trk->stco[p_trk->stco_cnt-1] > 0xFFFFFFFF)
+    {
+        pos = mp4_fullbox_start(p_buf, MP4_4CC('c','o','6','4'), 0, 0);
+        mp4_put32(p_buf, p_trk->stco_cnt);
+
+        for (i = 0; i < p_trk->stco_cnt; i++)
+        {
+            mp4_put64(p_buf, p_trk->stco[i]);
+        }
+    }
+    else
+    {
+        pos = mp4_fullbox_start(p_buf, MP4_4CC('s','t','c','o'), 0, 0);
+        mp4_put32(p_buf, p_trk->stco_cnt);
+
+        for (i = 0; i < p_trk->stco_cnt; i++)
+        {
+            mp4_put32(p_buf, (uint32)p_trk->stco[i]);
+        }
+    }
+
+    mp4_box_end(p_buf, pos);
+
+    mp4_box_end(p_buf, stbl);
+}
+
+static void mp4_write_trak(MP4BUF * p_buf, MP4TRK * p_trk, uint64 ctime)
+{
+    uint32 trak, mdia, minf, pos, dref;
+    uint64 duration = mp4_trk_duration(p_trk);
+    BOOL   video = (MP4_TRK_VIDEO == p_trk->type);
+
+    trak = mp4_box_start(p_buf, MP4_4CC('t','r','a','k'));
+
+    pos = mp4_fullbox_start(p_buf, MP4_4CC('t','k','h','d'), 1, 3);    // enabled, in movie
+    mp4_put64(p_buf, ctime);
+    mp4_put64(p_buf, ctime);
+    mp4_put32(p_buf, p_trk->track_id);
+    mp4_put32(p_buf, 0);
+    mp4_put64(p_buf, p_trk->timescale ? duration * MP4_MOVIE_TIMESCALE / p_trk->timescale : 0);
+    mp4_put_data(p_buf, NULL, 8);
+    mp4_put16(p_buf, 0);                                        // layer
+    mp4_put16(p_buf, 0);                                        // alternate group
+    mp4_put16(p_buf, video ? 0 : 0x0100);                       // volume
+    mp4_put16(p_buf, 0);
+    mp4_put_matrix(p_buf);
+    mp4_put32(p_buf, video ? (p_trk->width << 16) : 0);
+    mp4_put32(p_buf, video ? (p_trk->height << 16) : 0);
+    mp4_box_end(p_buf, pos);
+
+    mdia = mp4_box_start(p_buf, MP4_4CC('m','d','i','a'));
+
+    pos = mp4_fullbox_start(p_buf, MP4_4CC('m','d','h','d'), 1, 0);
+    mp4_put64(p_buf, ctime);
+    mp4_put64(p_buf, ctime);
+    mp4_put32(p_buf, p_trk->timescale);
+    mp4_put64(p_buf, duration);
+    mp4_put16(p_buf, 0x55C4);                                   // "und"
+    mp4_put16(p_buf, 0);
+    mp4_box_end(p_buf, pos);
+
+    pos = mp4_fullbox_start(p_buf, MP4_4CC('h','d','l','r'), 0, 0);
+    mp4_put32(p_buf, 0);
+    mp4_put32(p_buf, video ? MP4_4CC('v','i','d','e') : MP4_4CC('s','o','u','n'));
+    mp4_put_data(p_buf, NULL, 12);
+    mp4_put_data(p_buf, video ? "VideoHandler" : "SoundHandler", 13);
+    mp4_box_end(p_buf, pos);
+
+    minf = mp4_box_start(p_buf, MP4_4CC('m','i','n','f'));
+
+    if (video)
+    {
+        pos = mp4_fullbox_start(p_buf, MP4_4CC('v','m','h','d'), 0, 1);
+        mp4_put_data(p_buf, NULL, 8);
+    }
+    else
+    {
+        pos = mp4_fullbox_start(p_buf, MP4_4CC('s','m','h','d'), 0, 0);
+        mp4_put32(p_buf, 0);
+    }
+
+    mp4_box_end(p_buf, pos);
+
+    pos = mp4_box_start(p_buf, MP4_4CC('d','i','n','f'));
+    dref = mp4_fullbox_start(p_buf, MP4_4CC('d','r','e','f'), 0, 0);
+    mp4_put32(p_buf, 1);
+    mp4_box_end(p_buf, mp4_fullbox_start(p_buf, MP4_4CC('u','r','l',' '), 0, 1)); // self contained
+    mp4_box_end(p_buf, dref);
+    mp4_box_end(p_buf, pos);
+
+    mp4_write_stbl(p_buf, p_trk);
+
+    mp4_box_end(p_buf, minf);
+    mp4_box_end(p_buf, mdia);
+    mp4_box_end(p_buf, trak);
+}
+
+/**
+ * Serialize the moov to the box buffer
+ */
+static void mp4_build_moov(MP4MUX * p_mux)
+{
+    int i;
+    uint32 moov, pos;
+    uint64 duration = 0;
+    uint64 ctime = (uint64)time(NULL) + MP4_TIME_OFFSET;
+    MP4BUF * p_buf = &p_mux->box;
+
+    p_buf->len = 0;
+
+    mp4_buf_reserve(p_buf, mp4_moov_size(p_mux));
+
+    for (i = 0; i < p_mux->trk_cnt; i++)
+    {
+        MP4TRK * p_trk = &p_mux->trks[i];
+        uint64 d = p_trk->timescale ? mp4_trk_duration(p_trk) * MP4_MOVIE_TIMESCALE / p_trk->timescale : 0;
+
+        if (d > duration)
+        {
+            duration = d;
+        }
+    }
+
+    moov = mp4_box_start(p_buf, MP4_4CC('m','o','o','v'));
+
+    pos = mp4_fullbox_start(p_buf, MP4_4CC('m','v','h','d'), 1, 0);
+    mp4_put64(p_buf, ctime);
+    mp4_put64(p_buf, ctime);
+    mp4_put32(p_buf, MP4_MOVIE_TIMESCALE);
+    mp4_put64(p_buf, duration);
+    mp4_put32(p_buf, 0x00010000);                               // rate
+    mp4_put16(p_buf, 0x0100);                                   // volume
+    mp4_put_data(p_buf, NULL, 10);
+    mp4_put_matrix(p_buf);
+    mp4_put_data(p_buf, NULL, 24);
+    mp4_put32(p_buf, p_mux->trk_cnt + 1);                       // next track id
+    mp4_box_end(p_buf, pos);
+
+    for (i = 0; i < p_mux->trk_cnt; i++)
+    {
+        mp4_write_trak(p_buf, &p_mux->trks[i], ctime);
+    }
+
+    if (p_mux->frag_flag)
+    {
+        uint32 mvex = mp4_box_start(p_buf, MP4_4CC('m','v','e','x'));
+
+        for (i = 0; i < p_mux->trk_cnt; i++)
+        {
+            pos = mp4_fullbox_start(p_buf, MP4_4CC('t','r','e','x'), 0, 0);
+            mp4_put32(p_buf, p_mux->trks[i].track_id);
+            mp4_put32(p_buf, 1);                                // sample description index
+            mp4_put32(p_buf, 0);
+            mp4_put32(p_buf, 0);
+            mp4_put32(p_buf, 0);
+            mp4_box_end(p_buf, pos);
+        }
+
+        mp4_box_end(p_buf, mvex);
+    }
+
+    mp4_box_end(p_buf, moov);
+}
+
+static int mp4_mux_write(MP4MUX * p_mux, const void * p_data, uint32 len)
+{
+    if (hfio_write(p_mux->fio, p_data, len) != (int)len)
+    {
+        log_print(HT_LOG_ERR, "%s, hfio_write failed\r\n", __FUNCTION__);
+        return -1;
+    }
+
+    p_mux->pos += len;
+
+    return 0;
+}
+
+/**
+ * Regular mp4, write the moov to the reserved space if it fits, otherwise at the end
+ */
+static int mp4_mux_finish(MP4MUX * p_mux)
+{
+    int i;
+    uint8 b[8];
+    uint64 mdat_size = p_mux->pos - p_mux->mdat_pos;
+
+    for (i = 0; i < p_mux->trk_cnt; i++)
+    {
+        mp4_chunk_end(&p_mux->trks[i]);
+    }
+
+    // mdat 64 bits size
+    mp4_set32(b, (uint32)(mdat_size >> 32));
+    mp4_set32(b+4, (uint32)mdat_size);
+
+    hfio_seek(p_mux->fio, p_mux->mdat_pos + 8, SEEK_SET);
+    hfio_write(p_mux->fio, b, 8);
+    hfio_seek(p_mux->fio, p_mux->pos, SEEK_SET);
+
+    mp4_build_moov(p_mux);
+
+    if (p_mux->free_size > 0)
+    {
+        uint32 left = p_mux->free_size - p_mux->box.len;
+
+        if (p_mux->box.len == p_mux->free_size || (p_mux->box.len < p_mux->free_size && left >= 8))
+        {
+            hfio_seek(p_mux->fio, p_mux->free_pos, SEEK_SET);
+            hfio_write(p_mux->fio, p_mux->box.buf, p_mux->box.len);
+
+            if (left > 0)
+            {
+                mp4_set32(b, left);
+                mp4_set32(b+4, MP4_4CC('f','r','e','e'));
+                hfio_write(p_mux->fio, b, 8);
+            }
+
+            hfio_seek(p_mux->fio, p_mux->pos, SEEK_SET);
+
+            return 0;
+        }
+
+        log_print(HT_LOG_WARN, "%s, moov size %u exceeds the reserved %u, written at the end\r\n", 
+            __FUNCTION__, p_mux->box.len, p_mux->free_size);
+    }
+
+    return mp4_mux_write(p_mux, p_mux->box.buf, p_mux->box.len);
+}
+
+static void mp4_trk_free(MP4TRK * p_trk)
+{
+    if (p_trk->config)
+    {
+        free(p_trk->config);
+    }
+
+    if (p_trk->stsz)
+    {
+        free(p_trk->stsz);
+    }
+
+    if (p_trk->stts)
+    {
+        free(p_trk->stts);
+    }
+
+    if (p_trk->ctts)
+    {
+        free(p_trk->ctts);
+    }
+
+    if (p_trk->stss)
+    {
+        free(p_trk->stss);
+    }
+
+    if (p_trk->stsc)
+    {
+        free(p_trk->stsc);
+    }
+
+    if (p_trk->stco)
+    {
+        free(p_trk->stco);
+    }
+
+    if (p_trk->frag)
+    {
+        free(p_trk->frag);
+    }
+
+    mp4_buf_free(&p_trk->frag_data);
+}
+
+/**
+ * Write the ftyp, and the fast start space and the mdat header of the regular mp4
+ */
+static int mp4_mux_write_head(MP4MUX * p_mux)
+{
+    uint32 pos;
+    MP4BUF * p_buf = &p_mux->box;
+
+    if (p_mux->head_flag)
+    {
+        return 0;
+    }
+
+    p_buf->len = 0;
+
+    pos = mp4_box_start(p_buf, MP4_4CC('f','t','y','p'));
+
+    if (p_mux->frag_flag)
+    {
+        mp4_put32(p_buf, MP4_4CC('i','s','o','5'));
+        mp4_put32(p_buf, 512);
+        mp4_put32(p_buf, MP4_4CC('i','s','o','5'));
+        mp4_put32(p_buf, MP4_4CC('i','s','o','6'));
+        mp4_put32(p_buf, MP4_4CC('m','p','4','1'));
+    }
+    else
+    {
+        mp4_put32(p_buf, MP4_4CC('m','p','4','2'));
+        mp4_put32(p_buf, 0);
+        mp4_put32(p_buf, MP4_4CC('m','p','4','2'));
+        mp4_put32(p_buf, MP4_4CC('i','s','o','m'));
+    }
+
+    mp4_box_end(p_buf, pos);
+
+    if (!p_mux->frag_flag)
+    {
+        // fast start, a free box is reserved for the moov
+        if (p_mux->free_size > 0)
+        {
+            p_mux->free_pos = p_buf->len;
+
+            pos = mp4_box_start(p_buf, MP4_4CC('f','r','e','e'));
+            mp4_put_data(p_buf, NULL, p_mux->free_size - 8);
+            mp4_box_end(p_buf, pos);
+        }
+
+        // mdat with 64 bits size, it is set at the close
+        p_mux->mdat_pos = p_buf->len;
+
+        mp4_put32(p_buf, 1);
+        mp4_put32(p_buf, MP4_4CC('m','d','a','t'));
+        mp4_put64(p_buf, 0);
+    }
+
+    p_mux->head_flag = 1;
+
+    return mp4_mux_write(p_mux, p_buf->buf, p_buf->len);
+}
+
+/***********************************************************/
+MP4MUX * mp4_mux_open(const char * filename, uint32 reserve)
+{
+    MP4MUX * p_mux = (MP4MUX *)malloc(sizeof(MP4MUX));
+    if (NULL == p_mux)
+    {
+        log_print(HT_LOG_ERR, "%s, malloc failed\r\n", __FUNCTION__);
+        return NULL;
+    }
+
+    memset(p_mux, 0, sizeof(MP4MUX));
+
+    p_mux->fio = hfio_open(filename);
+    if (NULL == p_mux->fio)
+    {
+        free(p_mux);
+
+        log_print(HT_LOG_ERR, "%s, hfio_open failed. %s\r\n", __FUNCTION__, filename);
+        return NULL;
+    }
+
+    p_mux->free_size = (reserve >= 8) ? reserve : 0;
+
+    return p_mux;
+}
+
+int mp4_mux_set_frag(MP4MUX * p_mux)
+{
+    if (p_mux->head_flag)
+    {
+        return -1;
+    }
+
+    p_mux->frag_flag = 1;
+
+    return 0;
+}
+
+void mp4_mux_close(MP4MUX * p_mux)
+{
+    int i;
+
+    if (NULL == p_mux)
+    {
+        return;
+    }
+
+    mp4_mux_write_head(p_mux);
+
+    if (p_mux->frag_flag)
+    {
+        if (!p_mux->moov_flag)
+        {
+            mp4_mux_write_moov(p_mux);
+        }
+        else
+        {
+            mp4_mux_frag_start(p_mux);
+        }
+    }
+    else
+    {
+        mp4_mux_finish(p_mux);
+    }
+
+    if (p_mux->sync_flag)
+    {
+        hfio_sync(p_mux->fio);
+    }
+    
+    hfio_close(p_mux->fio);
+
+    for (i = 0; i < p_mux->trk_cnt; i++)
+    {
+        mp4_trk_free(&p_mux->trks[i]);
+    }
+
+    mp4_buf_free(&p_mux->box);
+
+    free(p_mux);
+}
+
+MP4TRK * mp4_mux_add_track(MP4MUX * p_mux, uint32 type, uint32 fourcc, uint32 timescale)
+{
+    MP4TRK * p_trk;
+
+    if (p_mux->trk_cnt >= MP4_MUX_MAX_TRKS || p_mux->moov_flag)
+    {
+        log_print(HT_LOG_ERR, "%s, no more track can be added\r\n", __FUNCTION__);
+        return NULL;
+    }
+
+    p_trk = &p_mux->trks[p_mux->trk_cnt++];
+
+    p_trk->type = type;
+    p_trk->track_id = p_mux->trk_cnt;
+    p_trk->fourcc = fourcc;
+    p_trk->timescale = timescale;
+
+    return p_trk;
+}
+
+int mp4_mux_set_config(MP4TRK * p_trk, uint8 * p_cfg, int len)
+{
+    uint8 * p_new = NULL;
+
+    if (len > 0)
+    {
+        p_new = (uint8 *)malloc(len);
+        if (NULL == p_new)
+        {
+            log_print(HT_LOG_ERR, "%s, malloc failed\r\n", __FUNCTION__);
+            return -1;
+        }
+
+        memcpy(p_new, p_cfg, len);
+    }
+
+    if (p_trk->config)
+    {
+        free(p_trk->config);
+    }
+
+    p_trk->config = p_new;
+    p_trk->config_len = len;
+
+    return 0;
+}
+
+int mp4_mux_avcc(MP4TRK * p_trk, uint8 * sps, int sps_len, uint8 * pps, int pps_len)
+{
+    uint8 cfg[1100];
+    int len = 0;
+
+    if (sps_len < 4 || sps_len + pps_len + 11 > (int)sizeof(cfg))
+    {
+        return -1;
+    }
+
+    cfg[len++] = 1;                                     // configuration version
+    cfg[len++] = sps[1];                                // profile
+    cfg[len++] = sps[2];                                // profile compatibility
+    cfg[len++] = sps[3];                                // level
+    cfg[len++] = 0xFF;                                  // 4 bytes nal unit length
+    cfg[len++] = 0xE1;                                  // 1 sps
+    cfg[len++] = (uint8)(sps_len >> 8);
+    cfg[len++] = (uint8)sps_len;
+    memcpy(cfg+len, sps, sps_len);
+    len += sps_len;
+    cfg[len++] = 1;                                     // 1 pps
+    cfg[len++] = (uint8)(pps_len >> 8);
+    cfg[len++] = (uint8)pps_len;
+    memcpy(cfg+len, pps, pps_len);
+    len += pps_len;
+
+    return mp4_mux_set_config(p_trk, cfg, len);
+}
+
+int mp4_mux_hvcc(MP4TRK * p_trk, uint8 * vps, int vps_len, uint8 * sps, int sps_len, uint8 * pps, int pps_len)
+{
+    int i, len = 0;
+    uint8 cfg[1600];
+    uint8 rbsp[32];
+    h265_t parse;
+    uint8 * nals[3] = {vps, sps, pps};
+    int lens[3] = {vps_len, sps_len, pps_len};
+    uint8 types[3] = {32, 33, 34};                      // VPS, SPS, PPS
+
+    if (sps_len < 16 || vps_len + sps_len + pps_len + 38 > (int)sizeof(cfg))
+    {
+        return -1;
+    }
+
+    // the general profile_tier_level follows the first byte of the sps payload
+    remove_emulation_bytes(rbsp, sizeof(rbsp), sps+2, sps_len-2 > (int)sizeof(rbsp) ? sizeof(rbsp) : sps_len-2);
+
+    h265_parser_init(&parse);
+    parse.chroma_format_idc = 1;
+
+    h265_parser_parse(&parse, sps+2, sps_len-2);
+
+    cfg[len++] = 1;                                     // configuration version
+    memcpy(cfg+len, rbsp+1, 12);                        // profile space, tier, profile, compatibility, constraint, level
+    len += 12;
+    cfg[len++] = 0xF0;                                  // min spatial segmentation
+    cfg[len++] = 0x00;
+    cfg[len++] = 0xFC;                                  // parallelism type
+    cfg[len++] = 0xFC | (parse.chroma_format_idc & 0x03);
+    cfg[len++] = 0xF8 | (parse.bit_depth_luma_minus8 & 0x07);
+    cfg[len++] = 0xF8 | (parse.bit_depth_chroma_minus8 & 0x07);
+    cfg[len++] = 0;                                     // avg frame rate
+    cfg[len++] = 0;
+    cfg[len++] = (uint8)((((rbsp[0] >> 1) & 0x07) + 1) << 3 | (rbsp[0] & 0x01) << 2 | 0x03);
+    cfg[len++] = 3;                                     // arrays
+
+    for (i = 0; i < 3; i++)
+    {
+        cfg[len++] = 0x80 | types[i];                   // array completeness
+        cfg[len++] = 0;
+        cfg[len++] = 1;
+        cfg[len++] = (uint8)(lens[i] >> 8);
+        cfg[len++] = (uint8)lens[i];
+        memcpy(cfg+len, nals[i], lens[i]);
+        len += lens[i];
+    }
+
+    return mp4_mux_set_config(p_trk, cfg, len);
+}
+
+int mp4_mux_write_moov(MP4MUX * p_mux)
+{
+    if (p_mux->moov_flag)
+    {
+        return 0;
+    }
+
+    if (mp4_mux_write_head(p_mux) < 0)
+    {
+        return -1;
+    }
+
+    mp4_build_moov(p_mux);
+
+    if (mp4_mux_write(p_mux, p_mux->box.buf, p_mux->box.len) < 0)
+    {
+        return -1;
+    }
+
+    p_mux->moov_flag = 1;
+
+    return 0;
+}
+
+static int mp4_mux_frag_sample(MP4MUX * p_mux, MP4TRK * p_trk, uint64 dts, int32 cts, HFIOV * p_iov, int cnt, uint32 len, BOOL b_key)
+{
+    int i;
+
+    if (!p_mux->moov_flag)
+    {
+        return -1;
+    }
+
+    if (!mp4_grow((void **)&p_trk->frag, &p_trk->frag_max, p_trk->frag_cnt, sizeof(MP4FSMP)) ||
+        !mp4_buf_reserve(&p_trk->frag_data, len))
+    {
+        return -1;
+    }
+
+    if (0 == p_trk->frag_cnt)
+    {
+        p_trk->frag_dts = dts - p_trk->first_dts;
+    }
+
+    p_trk->frag[p_trk->frag_cnt].size = len;
+    p_trk->frag[p_trk->frag_cnt].key = b_key;
+    p_trk->frag[p_trk->frag_cnt].cts = cts;
+    p_trk->frag[p_trk->frag_cnt].dts = dts;
+    p_trk->frag_cnt++;
+
+    for (i = 0; i < cnt; i++)
+    {
+        mp4_put_data(&p_trk->frag_data, p_iov[i].iov_base, p_iov[i].iov_len);
+    }
+
+    return 0;
+}
+
+int mp4_mux_write_sample(MP4MUX * p_mux, MP4TRK * p_trk, uint64 dts, int32 cts, HFIOV * p_iov, int cnt, BOOL b_key)
+{
+    int i;
+    uint32 len = 0;
+
+    for (i = 0; i < cnt; i++)
+    {
+        len += p_iov[i].iov_len;
+    }
+
+    if (mp4_mux_write_head(p_mux) < 0)
+    {
+        return -1;
+    }
+
+    if (p_trk->samples > 0)
+    {
+        p_trk->last_delta = (dts > p_trk->last_dts) ? (uint32)(dts - p_trk->last_dts) : 0;
+    }
+    else
+    {
+        p_trk->first_dts = dts;
+    }
+
+    if (p_mux->frag_flag)
+    {
+        if (mp4_mux_frag_sample(p_mux, p_trk, dts, cts, p_iov, cnt, len, b_key) < 0)
+        {
+            return -1;
+        }
+
+        p_trk->samples++;
+        p_trk->last_dts = dts;
+
+        return 0;
+    }
+
+    if (!mp4_grow((void **)&p_trk->stsz, &p_trk->stsz_max, p_trk->samples, sizeof(uint32)) ||
+        !mp4_grow((void **)&p_trk->stss, &p_trk->stss_max, p_trk->stss_cnt, sizeof(uint32)) ||
+        !mp4_grow((void **)&p_trk->stco, &p_trk->stco_max, p_trk->stco_cnt, sizeof(uint64)))
+    {
+        return -1;
+    }
+
+    // a new chunk starts when the samples of the other track are interleaved
+    if (p_mux->last_trk != p_trk || p_trk->chunk_samples >= MP4_CHUNK_SAMPLES)
+    {
+        mp4_chunk_end(p_trk);
+
+        p_trk->stco[p_trk->stco_cnt++] = p_mux->pos;
+        p_mux->last_trk = p_trk;
+    }
+
+    if (hfio_writev(p_mux->fio, p_iov, cnt) != (int)len)
+    {
+        log_print(HT_LOG_ERR, "%s, hfio_writev failed\r\n", __FUNCTION__);
+        return -1;
+    }
+
+    p_mux->pos += len;
+
+    if (p_trk->samples > 0)
+    {
+        mp4_run_add(&p_trk->stts, &p_trk->stts_cnt, &p_trk->stts_max, p_trk->last_delta, 1);
+    }
+
+    // the samples before the first composition offset are 0
+    if (cts != 0 && 0 == p_trk->ctts_cnt && p_trk->samples > 0)
+    {
+        mp4_run_add(&p_trk->ctts, &p_trk->ctts_cnt, &p_trk->ctts_max, 0, p_trk->samples);
+    }
+
+    if (cts != 0 || p_trk->ctts_cnt > 0)
+    {
+        mp4_run_add(&p_trk->ctts, &p_trk->ctts_cnt, &p_trk->ctts_max, (uint32)cts, 1);
+    }
+
+    if (b_key && MP4_TRK_VIDEO == p_trk->type)
+    {
+        p_trk->stss[p_trk->stss_cnt++] = p_trk->samples + 1;
+    }
+
+    p_trk->stsz[p_trk->samples++] = len;
+    p_trk->chunk_samples++;
+    p_trk->last_dts = dts;
+
+    return 0;
+}
+
+int mp4_mux_append_sample(MP4MUX * p_mux, MP4TRK * p_trk, HFIOV * p_iov, int cnt)
+{
+    int i;
+    uint32 len = 0;
+
+    for (i = 0; i < cnt; i++)
+    {
+        len += p_iov[i].iov_len;
+    }
+
+    if (p_mux->frag_flag)
+    {
+        if (0 == p_trk->frag_cnt || !mp4_buf_reserve(&p_trk->frag_data, len))
+        {
+            return -1;
+        }
+
+        for (i = 0; i < cnt; i++)
+        {
+            mp4_put_data(&p_trk->frag_data, p_iov[i].iov_base, p_iov[i].iov_len);
+        }
+
+        p_trk->frag[p_trk->frag_cnt-1].size += len;
+
+        return 0;
+    }
+
+    // the last sample of the mdat should be the one of the track
+    if (0 == p_trk->samples || p_mux->last_trk != p_trk)
+    {
+        return -1;
+    }
+
+    if (hfio_writev(p_mux->fio, p_iov, cnt) != (int)len)
+    {
+        log_print(HT_LOG_ERR, "%s, hfio_writev failed\r\n", __FUNCTION__);
+        return -1;
+    }
+
+    p_mux->pos += len;
+    p_trk->stsz[p_trk->samples-1] += len;
+
+    return 0;
+}
+
+int mp4_mux_frag_start(MP4MUX * p_mux)
+{
+    int i, n = 0;
+    uint32 j, moof, traf, pos, delta, flags, data_len = 0;
+    uint32 offset_pos[MP4_MUX_MAX_TRKS];
+    uint8 mdat[8];
+    HFIOV iov[MP4_MUX_MAX_TRKS + 2];
+    MP4BUF * p_buf = &p_mux->box;
+
+    for (i = 0; i < p_mux->trk_cnt; i++)
+    {
+        data_len += p_mux->trks[i].frag_data.len;
+        n += p_mux->trks[i].frag_cnt;
+    }
+
+    if (0 == n)
+    {
+        return 0;
+    }
+
+    p_buf->len = 0;
+
+    moof = mp4_box_start(p_buf, MP4_4CC('m','o','o','f'));
+
+    pos = mp4_fullbox_start(p_buf, MP4_4CC('m','f','h','d'), 0, 0);
+    mp4_put32(p_buf, ++p_mux->frag_seq);
+    mp4_box_end(p_buf, pos);
+
+    for (i = 0; i < p_mux->trk_cnt; i++)
+    {
+        MP4TRK * p_trk = &p_mux->trks[i];
+
+        offset_pos[i] = 0;
+
+        if (0 == p_trk->frag_cnt)
+        {
+            continue;
+        }
+
+        traf = mp4_box_start(p_buf, MP4_4CC('t','r','a','f'));
+
+        pos = mp4_fullbox_start(p_buf, MP4_4CC('t','f','h','d'), 0, 0x020000);   // default base is moof
+        mp4_put32(p_buf, p_trk->track_id);
+        mp4_box_end(p_buf, pos);
+
+        pos = mp4_fullbox_start(p_buf, MP4_4CC('t','f','d','t'), 1, 0);
+        mp4_put64(p_buf, p_trk->frag_dts);
+        mp4_box_end(p_buf, pos);
+
+        // data offset, sample duration, size and flags, and the composition offsets if any
+        flags = 0x000701;
+
+        for (j = 0; j < p_trk->frag_cnt; j++)
+        {
+            if (p_trk->frag[j].cts != 0)
+            {
+                flags |= 0x000800;
+                break;
+            }
+        }
+
+        pos = mp4_fullbox_start(p_buf, MP4_4CC('t','r','u','n'), (flags & 0x000800) ? 1 : 0, flags);
+        mp4_put32(p_buf, p_trk->frag_cnt);
+        offset_pos[i] = p_buf->len;
+        mp4_put32(p_buf, 0);
+
+        for (j = 0; j < p_trk->frag_cnt; j++)
+        {
+            if (j + 1 < p_trk->frag_cnt)
+            {
+                delta = (uint32)(p_trk->frag[j+1].dts - p_trk->frag[j].dts);
+            }
+            else
+            {
+                delta = p_trk->last_delta;
+            }
+
+            mp4_put32(p_buf, delta);
+            mp4_put32(p_buf, p_trk->frag[j].size);
+            mp4_put32(p_buf, p_trk->frag[j].key ? 0x02000000 : 0x01010000);
+
+            if (flags & 0x000800)
+            {
+                mp4_put32(p_buf, (uint32)p_trk->frag[j].cts);
+            }
+        }
+
+        mp4_box_end(p_buf, pos);
+        mp4_box_end(p_buf, traf);
+    }
+
+    mp4_box_end(p_buf, moof);
+
+    // the track data follow each other in the mdat
+    n = 0;
+    delta = p_buf->len + 8;
+
+    iov[n].iov_base = p_buf->buf;
+    iov[n++].iov_len = p_buf->len;
+
+    mp4_set32(mdat, data_len + 8);
+    mp4_set32(mdat+4, MP4_4CC('m','d','a','t'));
+
+    iov[n].iov_base = mdat;
+    iov[n++].iov_len = 8;
+
+    for (i = 0; i < p_mux->trk_cnt; i++)
+    {
+        MP4TRK * p_trk = &p_mux->trks[i];
+
+        if (0 == p_trk->frag_cnt)
+        {
+            continue;
+        }
+
+        mp4_set32(p_buf->buf + offset_pos[i], delta);
+        delta += p_trk->frag_data.len;
+
+        iov[n].iov_base = p_trk->frag_data.buf;
+        iov[n++].iov_len = p_trk->frag_data.len;
+    }
+
+    if (hfio_writev(p_mux->fio, iov, n) != (int)(p_buf->len + 8 + data_len))
+    {
+        log_print(HT_LOG_ERR, "%s, hfio_writev failed\r\n", __FUNCTION__);
+        return -1;
+    }
+
+    p_mux->pos += p_buf->len + 8 + data_len;
+
+    for (i = 0; i < p_mux->trk_cnt; i++)
+    {
+        p_mux->trks[i].frag_cnt = 0;
+        p_mux->trks[i].frag_data.len = 0;
+    }
+
+    return 0;
+}
+
+#endif // MP4_FORMAT
+
+
@@ -0,0 +1,187 @@
+/***************************************************************************************
+ *
+ *  IMPORTANT: READ BEFORE DOWNLOADING, COPYING, INSTALLING OR USING.
+ *
+ *  By downloading, copying, installing or using the software you agree to this license.
+ *  If you do not agree to this license, do not download, install, 
+ *  copy or use the software.
+ *
+ *  Copyright (C) 2014-2020, Happytimesoft Corporation, all rights reserved.
+ *
+ *  Redistribution and use in binary forms, with or without modification, are permitted.
+ *
+ *  Unless required by applicable law or agreed to in writing, software distributed 
+ *  under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ *  CONDITIONS OF ANY KIND, either express or implied. See the License for the specific
+ *  language governing permissions and limitations under the License.
+ *
+****************************************************************************************/
+
+#ifndef MP4_MUX_H
+#define MP4_MUX_H
+
+#include "sys_inc.h"
+
+/***********************************************************/
+#define MP4_TRK_VIDEO       1
+#define MP4_TRK_AUDIO       2
+
+#define MP4_MUX_MAX_TRKS    2
+#define MP4_CHUNK_SAMPLES   64          // max samples per chunk
+#define MP4_MOVIE_TIMESCALE 1000
+
+#define MP4_4CC(a,b,c,d)    (((uint32)(a)<<24) | ((uint32)(b)<<16) | ((uint32)(c)<<8) | (uint32)(d))
+
+#define MP4_OTI_MPEG4V      0x20        // esds object type, MPEG-4 visual
+#define MP4_OTI_AAC         0x40        // esds object type, MPEG-4 audio
+#define MP4_OTI_JPEG        0x6C        // esds object type, JPEG
+
+/***********************************************************/
+typedef struct
+{
+    uint8     * buf;
+    uint32      len;
+    uint32      size;
+} MP4BUF;
+
+typedef struct
+{
+    uint32      count;                  // stts / ctts sample count, stsc first chunk
+    uint32      value;                  // stts sample delta, ctts composition offset, stsc samples per chunk
+} MP4RUN;
+
+typedef struct
+{
+    uint32      size;
+    uint32      key;
+    int32       cts;                    // composition offset
+    uint64      dts;
+} MP4FSMP;
+
+typedef struct
+{
+    uint32      type;                   // MP4_TRK_VIDEO, MP4_TRK_AUDIO
+    uint32      track_id;               // 1 based
+    uint32      fourcc;                 // sample entry, avc1, hvc1, mp4v, mp4a
+    uint8       oti;                    // esds object type of mp4v, mp4a
+    uint32      timescale;              // media timescale, can be changed until the moov is written
+
+    int         width;                  // video width
+    int         height;                 // video height
+    int         chns;                   // audio channels
+    int         rate;                   // audio sampling frequency
+
+    uint8     * config;                 // avcC / hvcC payload, decoder specific info of esds
+    int         config_len;
+
+    // Sample tables, appended in the packed form as the samples come
+    uint32      samples;                // samples written
+    uint32    * stsz;
+    uint32      stsz_max;
+    MP4RUN    * stts;                   // run length encoded sample deltas
+    uint32      stts_cnt;
+    uint32      stts_max;
+    MP4RUN    * ctts;                   // run length encoded composition offsets, NULL until one is not 0
+    uint32      ctts_cnt;
+    uint32      ctts_max;
+    uint32    * stss;                   // key sample numbers
+    uint32      stss_cnt;
+    uint32      stss_max;
+    MP4RUN    * stsc;                   // run length encoded samples per chunk
+    uint32      stsc_cnt;
+    uint32      stsc_max;
+    uint64    * stco;                   // chunk offsets
+    uint32      stco_cnt;
+    uint32      stco_max;
+    uint32      chunk_samples;          // samples of the current chunk
+
+    uint64      first_dts;
+    uint64      last_dts;
+    uint32      last_delta;
+
+    // Fragmented mp4, samples of the current fragment
+    MP4FSMP   * frag;
+    uint32      frag_cnt;
+    uint32      frag_max;
+    MP4BUF      frag_data;
+    uint64      frag_dts;               // tfdt of the current fragment
+} MP4TRK;
+
+typedef struct
+{
+    uint32      frag_flag   : 1;        // fragmented mp4
+    uint32      head_flag   : 1;        // ftyp (and the regular mp4 mdat header) has been written
+    uint32      moov_flag   : 1;        // the moov has been written
+    uint32      sync_flag   : 1;        // fdatasync the file before it is closed
+    uint32      reserved    : 28;
+
+    HFIO      * fio;                    // file handle
+    uint64      pos;                    // file write position
+    uint64      mdat_pos;               // regular mp4, mdat box position
+    uint64      free_pos;               // regular mp4, fast start reserved space position
+    uint32      free_size;              // regular mp4, fast start reserved space size, 0 - moov at the end
+    uint32      frag_seq;               // moof sequence number
+
+    MP4TRK      trks[MP4_MUX_MAX_TRKS];
+    int         trk_cnt;
+    MP4TRK    * last_trk;               // track of the last written sample, a new chunk starts on change
+
+    MP4BUF      box;                    // moov / moof serialization buffer
+} MP4MUX;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Open the file, reserve - the space reserved before mdat for a fast start moov, 0 - moov at the end
+ */
+MP4MUX * mp4_mux_open(const char * filename, uint32 reserve);
+void     mp4_mux_close(MP4MUX * p_mux);
+
+/**
+ * Write a fragmented mp4, it should be called before anything is written
+ */
+int      mp4_mux_set_frag(MP4MUX * p_mux);
+
+/**
+ * Add a track, all the tracks should be added before the moov is written
+ */
+MP4TRK * mp4_mux_add_track(MP4MUX * p_mux, uint32 type, uint32 fourcc, uint32 timescale);
+int      mp4_mux_set_config(MP4TRK * p_trk, uint8 * p_cfg, int len);
+
+/**
+ * Build the avcC / hvcC payload of the parameter sets
+ */
+int      mp4_mux_avcc(MP4TRK * p_trk, uint8 * sps, int sps_len, uint8 * pps, int pps_len);
+int      mp4_mux_hvcc(MP4TRK * p_trk, uint8 * vps, int vps_len, uint8 * sps, int sps_len, uint8 * pps, int pps_len);
+
+/**
+ * Fragmented mp4, write the moov, the samples are written to fragments after it
+ */
+int      mp4_mux_write_moov(MP4MUX * p_mux);
+
+/**
+ * Write a sample made of the slices, dts is in the track timescale and increases,
+ * cts is the composition time offset, it is negative for the reordered frames
+ */
+int      mp4_mux_write_sample(MP4MUX * p_mux, MP4TRK * p_trk, uint64 dts, int32 cts, HFIOV * p_iov, int cnt, BOOL b_key);
+
+/**
+ * Append the data to the last sample of the track, it fails if the sample is not
+ * the last data written (regular mp4) or is already in a written fragment
+ */
+int      mp4_mux_append_sample(MP4MUX * p_mux, MP4TRK * p_trk, HFIOV * p_iov, int cnt);
+
+/**
+ * Fragmented mp4, write the pending fragment out, the next samples go to a new fragment
+ */
+int      mp4_mux_frag_start(MP4MUX * p_mux);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // MP4_MUX_H
+
+
@@ -32,6 +32,47 @@
 #include <math.h>
 #include "rtsp_util.h"
 #include "format.h"
+#include "mp4_mux.h"
+#include "avi.h"
+
+static uint32 mp4_moov_reserve = 0;
+static int    mp4_sync_mode = AVI_SYNC_FLUSH;
+static uint32 mp4_sync_ms = AVI_SYNC_MS_DEF;
+
+/**
+ * Set the space reserved at the file start for the moov of the regular mp4 (fast start),
+ * the moov is written at the end if it does not fit, 0 - always at the end
+ */
+void mp4_write_set_faststart_def(uint32 reserve)
+{
+    mp4_moov_reserve = reserve;
+}
+
+/**
+ * The fragmented mp4 follows the avi durability policy, a fragment is the chunk
+ */
+void mp4_write_set_sync_def(int mode, uint32 ms)
+{
+    if (mode > AVI_SYNC_DEF && mode <= AVI_SYNC_FSYNC)
+    {
+        mp4_sync_mode = mode;
+    }
+
+    mp4_sync_ms = ms > 0 ? ms : AVI_SYNC_MS_DEF;
+}
+
+void mp4_write_set_sync(MP4CTX * p_ctx, int mode, uint32 ms)
+{
+    if (mode > AVI_SYNC_DEF && mode <= AVI_SYNC_FSYNC)
+    {
+        p_ctx->sync_mode = mode;
+    }
+
+    if (ms > 0)
+    {
+        p_ctx->sync_ms = ms;
+    }
+}
 
 MP4CTX * mp4_write_open(char * filename)
 {
@@ -48,22 +89,174 @@ MP4CTX * mp4_write_open(char * filename)
 
     strncpy(p_ctx->filename, filename, sizeof(p_ctx->filename));
 
-    p_ctx->handler = gf_isom_open(filename, GF_ISOM_OPEN_WRITE, NULL);
-    if (NULL == p_ctx->handler)
+    p_ctx->mux = mp4_mux_open(filename, mp4_moov_reserve);
+    if (NULL == p_ctx->mux)
     {
         free(p_ctx);
         
-        log_print(HT_LOG_ERR, "%s, MP4Create failed!!! %s\r\n", __FUNCTION__, filename);
+        log_print(HT_LOG_ERR, "%s, mp4_mux_open failed!!! %s\r\n", __FUNCTION__, filename);
         return NULL;
     }
 
-    gf_isom_set_brand_info(p_ctx->handler, GF_ISOM_BRAND_MP42, 0);
-    
+	p_ctx->sync_mode = mp4_sync_mode;
+	p_ctx->sync_ms = mp4_sync_ms;
+	
 	p_ctx->mutex = sys_os_create_mutex();
     
 	return p_ctx;
 }
 
+/**
+ * Write a fragmented mp4, it should be called right after mp4_write_open.
+ * The moov is written once the tracks are created, then the samples go to
+ * moof + mdat fragments, so the memory of a stream is bounded by one fragment
+ * and the file is playable up to the last fragment if the recording is interrupted.
+ * frag_ms : fragment duration, 0 - every key frame, -1 - MP4_FRAG_MS_DEF
+ */
+void mp4_write_set_fragment(MP4CTX * p_ctx, int frag_ms)
+{
+    if (NULL == p_ctx || NULL == p_ctx->mux)
+    {
+        return;
+    }
+
+    sys_os_mutex_enter(p_ctx->mutex);
+
+    if (mp4_mux_set_frag(p_ctx->mux) == 0)
+    {
+        p_ctx->ctxf_frag = 1;
+        p_ctx->frag_ms = (frag_ms < 0) ? MP4_FRAG_MS_DEF : frag_ms;
+        p_ctx->frag_time = -1;
+    }
+
+    sys_os_mutex_leave(p_ctx->mutex);
+}
+
+/**
+ * Fragmented mp4, write the moov once the tracks of the configured streams are created,
+ * return FALSE if the samples should be dropped until then
+ */
+static BOOL mp4_frag_ready(MP4CTX * p_ctx)
+{
+    if (!p_ctx->ctxf_frag || p_ctx->mux->moov_flag)
+    {
+        return TRUE;
+    }
+
+    if (p_ctx->ctxf_video && NULL == p_ctx->v_trk)
+    {
+        return FALSE;
+    }
+
+    if (p_ctx->ctxf_audio && NULL == p_ctx->a_trk && AUDIO_FORMAT_AAC == p_ctx->a_fmt)
+    {
+        return FALSE;
+    }
+
+    if (mp4_mux_write_moov(p_ctx->mux) < 0)
+    {
+        log_print(HT_LOG_ERR, "%s, mp4_mux_write_moov failed\r\n", __FUNCTION__);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+/**
+ * Fragmented mp4, apply the durability policy after a fragment is written, 
+ * the file is playable up to the last flushed fragment
+ */
+static void mp4_frag_sync(MP4CTX * p_ctx)
+{
+    if (AVI_SYNC_NONE == p_ctx->sync_mode)
+    {
+        return;
+    }
+
+    hfio_flush(p_ctx->mux->fio);
+
+    if (AVI_SYNC_FSYNC == p_ctx->sync_mode && sys_os_get_ms() - p_ctx->sync_time >= p_ctx->sync_ms)
+    {
+        p_ctx->sync_time = sys_os_get_ms();
+        
+        hfio_sync(p_ctx->mux->fio);
+    }
+}
+
+/**
+ * Fragmented mp4, start a new fragment at a key frame once the fragment duration is reached,
+ * or after MP4_FRAG_MAX_MS whatever the frame is. The previous fragment is written out.
+ * ms : decode time of the sample to be written
+ */
+static int mp4_frag_start(MP4CTX * p_ctx, int b_key, int64 ms)
+{
+    int64 frag_ms = p_ctx->frag_ms;
+
+    // audio only, every frame is a key frame
+    if (NULL == p_ctx->v_trk && 0 == frag_ms)
+    {
+        frag_ms = MP4_FRAG_MS_DEF;
+    }
+
+    if (p_ctx->frag_time >= 0 && ms - p_ctx->frag_time < MP4_FRAG_MAX_MS && 
+        (!b_key || ms - p_ctx->frag_time < frag_ms))
+    {
+        return 0;
+    }
+
+    p_ctx->frag_time = ms;
+
+    if (mp4_mux_frag_start(p_ctx->mux) < 0)
+    {
+        log_print(HT_LOG_ERR, "%s, mp4_mux_frag_start failed\r\n", __FUNCTION__);
+        return -1;
+    }
+
+    mp4_frag_sync(p_ctx);
+    
+    return 0;
+}
+
+/**
+ * Convert the source timestamp to the presentation time in the track timescale.
+ * The 32 bits timestamp is extended by its signed difference to the last one,
+ * so the time goes on across the wrap around. A jump over MP4_TS_GAP_MS either way
+ * is taken as a discontinuity of the source, the time goes on by dur then.
+ */
+static uint64 mp4_ts_pts(MP4TS * p_ts, uint32 ts, uint32 timescale, uint32 dur)
+{
+    uint32 clock = p_ts->clock ? p_ts->clock : timescale;
+    int64 gap = (int64)clock * MP4_TS_GAP_MS / 1000;
+    int64 delta;
+
+    if (0 == p_ts->samples)
+    {
+        p_ts->pts = 0;
+    }
+    else
+    {
+        delta = (int32)(ts - p_ts->last_ts);
+
+        if (delta > gap || delta < -gap)
+        {
+            log_print(HT_LOG_WARN, "%s, timestamp jump %d, clock %u\r\n", __FUNCTION__, (int)delta, clock);
+
+            delta = (int64)dur * clock / timescale;
+        }
+
+        p_ts->pts += delta;
+    }
+
+    p_ts->last_ts = ts;
+
+    if (p_ts->pts <= 0)
+    {
+        return 0;
+    }
+
+    return (uint64)p_ts->pts * timescale / clock;
+}
+
 void mp4_write_close(MP4CTX * p_ctx)
 {
     if (p_ctx == NULL)
@@ -73,35 +266,21 @@ void mp4_write_close(MP4CTX * p_ctx)
     
 	sys_os_mutex_enter(p_ctx->mutex);
 
-    if (p_ctx->handler)
+    if (p_ctx->mux)
     {
-        if (p_ctx->s_time < p_ctx->e_time && p_ctx->i_frame_video > 1)
-        {
-            // Final correction to the actual frame rate
-            float fps = (float)(p_ctx->i_frame_video * 1000.0) / (p_ctx->e_time - p_ctx->s_time);
-            p_ctx->v_fps = (uint32)(fps + 0.5);
-
-            log_print(HT_LOG_DBG, "%s, stime=%u, etime=%u, frames=%d, fps=%d\r\n",
-                __FUNCTION__, p_ctx->s_time, p_ctx->e_time, p_ctx->i_frame_video, p_ctx->v_fps);
-
-            printf( "%s, stime=%u, etime=%u, frames=%d, fps=%d\r\n",
-                __FUNCTION__, p_ctx->s_time, p_ctx->e_time, p_ctx->i_frame_video, p_ctx->v_fps);
-
-            log_print(HT_LOG_DBG, "%s, file=%s,stime=%u, etime=%u, frames=%d, fps=%d\r\n",
-                __FUNCTION__, p_ctx->filename, p_ctx->s_time, p_ctx->e_time, p_ctx->i_frame_video, p_ctx->v_fps);
-        }
+        p_ctx->mux->sync_flag = (AVI_SYNC_FSYNC == p_ctx->sync_mode);
+        
+	    mp4_mux_close(p_ctx->mux);
+	}
 
-        if (p_ctx->v_fps > 0)
-        {
-            gf_isom_set_timescale(p_ctx->handler, p_ctx->v_fps);
-            gf_isom_set_media_timescale(p_ctx->handler, p_ctx->v_track_id, p_ctx->v_fps, GF_TRUE);
-        }
-        else
-        {
-            gf_isom_set_timescale(p_ctx->handler, 25);
-        }
+	if (p_ctx->au_iov)
+	{
+	    free(p_ctx->au_iov);
+	}
 
-	    gf_isom_close(p_ctx->handler);
+	if (p_ctx->au_nlen)
+	{
+	    free(p_ctx->au_nlen);
 	}
 
 	sys_os_mutex_leave(p_ctx->mutex);
@@ -133,103 +312,59 @@ void mp4_set_audio_info(MP4CTX * p_ctx, int chns, int rate, uint16 fmt, uint8 *
 	p_ctx->ctxf_audio = 1;
 }
 
-int mp4_init_jpeg(MP4CTX * p_ctx)
+/**
+ * Set the clock rate of the source timestamps, the rtp video clock is 90000 and the audio
+ * one is the sampling frequency, the rtmp timestamps are in milliseconds.
+ * 0 - the track timescale, MP4_VIDEO_TIMESCALE and the audio sampling frequency
+ */
+void mp4_set_timestamp_clock(MP4CTX * p_ctx, uint32 v_clock, uint32 a_clock)
 {
-    GF_Err err;
-    uint32 fps = (p_ctx->v_fps > 0) ? p_ctx->v_fps : 25;
-    
-    p_ctx->v_track_id = gf_isom_new_track(p_ctx->handler, 0, GF_ISOM_MEDIA_VISUAL, fps);
-    if (0 == p_ctx->v_track_id)
-    {
-        log_print(HT_LOG_ERR, "%s, gf_isom_new_track failed\r\n", __FUNCTION__);
-        return -1;
-    }
-    
-    err = gf_isom_set_track_enabled(p_ctx->handler, p_ctx->v_track_id, 1);
-    if (GF_OK != err)
-    {
-        log_print(HT_LOG_ERR, "%s, gf_isom_set_track_enabled failed\r\n", __FUNCTION__);
-        return -1;
-    }
+    p_ctx->v_ts.clock = v_clock;
+    p_ctx->a_ts.clock = a_clock;
+}
 
-    err = gf_isom_set_visual_info(p_ctx->handler, p_ctx->v_track_id, p_ctx->v_stream_idx, p_ctx->v_width, p_ctx->v_height);
-    if (GF_OK != err)
+static int mp4_new_video_track(MP4CTX * p_ctx, uint32 fourcc, uint8 oti)
+{
+    p_ctx->v_trk = mp4_mux_add_track(p_ctx->mux, MP4_TRK_VIDEO, fourcc, MP4_VIDEO_TIMESCALE);
+    if (NULL == p_ctx->v_trk)
     {
-        log_print(HT_LOG_ERR, "%s, gf_isom_set_visual_info failed\r\n", __FUNCTION__);
+        log_print(HT_LOG_ERR, "%s, mp4_mux_add_track failed\r\n", __FUNCTION__);
         return -1;
     }
 
+    p_ctx->v_trk->oti = oti;
+    p_ctx->v_trk->width = p_ctx->v_width;
+    p_ctx->v_trk->height = p_ctx->v_height;
+
     return 0;
 }
 
 int mp4_write_aac_info(MP4CTX * p_ctx)
 {
-    GF_Err err;
-
-    if (p_ctx->a_track_id > 0)
+    // no track can be added after the moov of a fragmented mp4
+    if (p_ctx->a_trk || p_ctx->mux->moov_flag)
     {
         return 0;
     }
     
-    p_ctx->a_track_id = gf_isom_new_track(p_ctx->handler, 0, GF_ISOM_MEDIA_AUDIO, p_ctx->a_rate);
-    if (0 == p_ctx->a_track_id)
-    {
-        log_print(HT_LOG_ERR, "%s, gf_isom_new_track failed\r\n", __FUNCTION__);
-        return -1;
-    }
-    
-	err = gf_isom_set_track_enabled(p_ctx->handler, p_ctx->a_track_id, 1);
-    if (GF_OK != err)
-    {
-        log_print(HT_LOG_ERR, "%s, gf_isom_set_track_enabled failed\r\n", __FUNCTION__);
-        return -1;
-    }
-    
-	GF_ESD * p_esd = gf_odf_desc_esd_new(0);
-	if (NULL == p_esd)
-    {
-        log_print(HT_LOG_ERR, "%s, gf_odf_desc_esd_new failed\r\n", __FUNCTION__);
-        return -1;
-    }
-	
-	p_esd->ESID = gf_isom_get_track_id(p_ctx->handler, p_ctx->a_track_id);
-	p_esd->OCRESID = gf_isom_get_track_id(p_ctx->handler, p_ctx->a_track_id);
-	p_esd->decoderConfig->streamType = GF_STREAM_AUDIO;
-	p_esd->decoderConfig->objectTypeIndication = GPAC_OTI_AUDIO_AAC_MPEG4;
-	p_esd->slConfig->timestampResolution = p_ctx->a_rate;
-	p_esd->decoderConfig->decoderSpecificInfo = (GF_DefaultDescriptor *)gf_odf_desc_new(GF_ODF_DSI_TAG);
-	p_esd->decoderConfig->decoderSpecificInfo->data = (char *)p_ctx->a_extra;
-	p_esd->decoderConfig->decoderSpecificInfo->dataLength = p_ctx->a_extra_len;
-	
-	err = gf_isom_new_mpeg4_description(p_ctx->handler, p_ctx->a_track_id, p_esd, NULL, NULL, &p_ctx->a_stream_idx);
-    if (GF_OK != err)
-    {
-        log_print(HT_LOG_ERR, "%s, gf_isom_new_mpeg4_description failed\r\n", __FUNCTION__);
-        return -1;
-    }
-    
-	err = gf_isom_set_audio_info(p_ctx->handler, p_ctx->a_track_id, p_ctx->a_stream_idx, p_ctx->a_rate, p_ctx->a_chns, 16, GF_IMPORT_AUDIO_SAMPLE_ENTRY_NOT_SET);
-    if (GF_OK != err)
+    p_ctx->a_trk = mp4_mux_add_track(p_ctx->mux, MP4_TRK_AUDIO, MP4_4CC('m','p','4','a'), p_ctx->a_rate);
+    if (NULL == p_ctx->a_trk)
     {
-        log_print(HT_LOG_ERR, "%s, gf_isom_set_audio_info failed\r\n", __FUNCTION__);
+        log_print(HT_LOG_ERR, "%s, mp4_mux_add_track failed\r\n", __FUNCTION__);
         return -1;
     }
     
-	return 0;
+    p_ctx->a_trk->oti = MP4_OTI_AAC;
+    p_ctx->a_trk->chns = p_ctx->a_chns;
+    p_ctx->a_trk->rate = p_ctx->a_rate;
+
+    return mp4_mux_set_config(p_ctx->a_trk, p_ctx->a_extra, p_ctx->a_extra_len);
 }
 
 int mp4_write_header(MP4CTX * p_ctx)
 {
     int ret = 0;
 
-    if (p_ctx->ctxf_video)
-    {
-        if (memcmp(p_ctx->v_fcc, "JPEG", 4) == 0)
-        {
-            // ret = mp4_init_jpeg(p_ctx);
-        }
-    }
-
     if (p_ctx->ctxf_audio)
     {
         if (p_ctx->a_fmt == AUDIO_FORMAT_AAC) // AAC
@@ -243,7 +378,7 @@ int mp4_write_header(MP4CTX * p_ctx)
 
 int mp4_update_header(MP4CTX * p_ctx)
 {
-    if (NULL == p_ctx || NULL == p_ctx->handler)
+    if (NULL == p_ctx || NULL == p_ctx->mux)
 	{
 		return -1;
     }
@@ -252,9 +387,10 @@ int mp4_update_header(MP4CTX * p_ctx)
     
     mp4_write_header(p_ctx);
 
-    if (p_ctx->v_track_id > 0)
+    if (p_ctx->v_trk)
     {
-        gf_isom_set_timescale(p_ctx->handler, p_ctx->v_fps > 0 ? p_ctx->v_fps : 25);
+        p_ctx->v_trk->width = p_ctx->v_width;
+        p_ctx->v_trk->height = p_ctx->v_height;
     }
 
     sys_os_mutex_leave(p_ctx->mutex);
@@ -262,47 +398,53 @@ int mp4_update_header(MP4CTX * p_ctx)
     return 0;
 }
 
-int mp4_write_aac_frame(MP4CTX * p_ctx, void * p_data, uint32 len)
+int mp4_write_aac_frame(MP4CTX * p_ctx, void * p_data, uint32 len, uint32 ts)
 {
     int ret = 0;
-    GF_Err err;
-    uint32 ts = rtsp_get_timestamp(p_ctx->a_rate);
+    uint64 dts;
+    HFIOV iov;
+    MP4TS * p_ts = &p_ctx->a_ts;
     
-    if (p_ctx->a_track_id == 0)
+    if (NULL == p_ctx->a_trk || p_ctx->a_rate <= 0)
     {
         return -1;
     }
 
-    if (p_ctx->a_timestamp == 0)
+    if (!mp4_frag_ready(p_ctx))
     {
-        p_ctx->a_timestamp = ts;
+        return 0;
     }
     
-    GF_ISOSample * p_sample = gf_isom_sample_new();
-    
-    p_sample->IsRAP = (SAPType)1;
-    p_sample->dataLength = len;
-    p_sample->data = (char *)p_data;
-    p_sample->DTS = ts - p_ctx->a_timestamp;
-    p_sample->CTS_Offset = 0;
+    // an aac frame is 1024 samples, the frames follow each other
+    // unless the source timestamp tells some were lost
+    dts = mp4_ts_pts(p_ts, ts, p_ctx->a_rate, 1024);
 
-    err = gf_isom_add_sample(p_ctx->handler, p_ctx->a_track_id, p_ctx->a_stream_idx, p_sample);			
-    if (GF_OK != err)
+    if (p_ts->samples > 0 && dts < p_ts->dts + 2048)
     {
-        ret = -1;
+        dts = p_ts->dts + 1024;
     }
 
-    p_sample->data = NULL;
-    p_sample->dataLength = 0;
+    if (p_ctx->ctxf_frag && NULL == p_ctx->v_trk)
+    {
+        mp4_frag_start(p_ctx, 1, dts * 1000 / p_ctx->a_rate);
+    }
     
-    gf_isom_sample_del(&p_sample);
+    iov.iov_base = p_data;
+    iov.iov_len = len;
 
+    if (mp4_mux_write_sample(p_ctx->mux, p_ctx->a_trk, dts, 0, &iov, 1, TRUE) < 0)
+    {
+        ret = -1;
+    }
+
+    p_ts->dts = dts;
+    p_ts->samples++;
     p_ctx->i_frame_audio++;
     
     return ret;
 }
 
-int mp4_write_audio(MP4CTX * p_ctx, void * p_data, uint32 len)
+int mp4_write_audio(MP4CTX * p_ctx, void * p_data, uint32 len, uint32 ts)
 {
     int ret = 0;
     
@@ -314,11 +456,11 @@ int mp4_write_audio(MP4CTX * p_ctx, void * p_data, uint32 len)
 
         if (p_buf[0] == 0xFF && (p_buf[1] & 0xF0) == 0xF0)
         {
-            ret = mp4_write_aac_frame(p_ctx, p_buf + 7, len - 7);
+            ret = mp4_write_aac_frame(p_ctx, p_buf + 7, len - 7, ts);
         }    
         else
         {
-            ret = mp4_write_aac_frame(p_ctx, p_buf, len);
+            ret = mp4_write_aac_frame(p_ctx, p_buf, len, ts);
 		}
     }
 
@@ -329,461 +471,472 @@ int mp4_write_audio(MP4CTX * p_ctx, void * p_data, uint32 len)
 
 int mp4_write_h264_nalu(MP4CTX * p_ctx)
 {
-    GF_Err err;
-    uint32 fps = (p_ctx->v_fps > 0) ? p_ctx->v_fps : 25;
-    
-    p_ctx->v_track_id = gf_isom_new_track(p_ctx->handler, 0, GF_ISOM_MEDIA_VISUAL, fps);
-    if (0 == p_ctx->v_track_id)
+    if (NULL == p_ctx->v_trk && mp4_new_video_track(p_ctx, MP4_4CC('a','v','c','1'), 0) < 0)
     {
-        log_print(HT_LOG_ERR, "%s, gf_isom_new_track failed\r\n", __FUNCTION__);
-        return -1;
-    }
-    
-    err = gf_isom_set_track_enabled(p_ctx->handler, p_ctx->v_track_id, 1);
-    if (GF_OK != err)
-    {
-        log_print(HT_LOG_ERR, "%s, gf_isom_set_track_enabled failed\r\n", __FUNCTION__);
         return -1;
     }
 
-    GF_AVCConfig * p_avc_cfg = gf_odf_avc_cfg_new();
-    if (NULL == p_avc_cfg)
+    if (mp4_mux_avcc(p_ctx->v_trk, p_ctx->sps, p_ctx->sps_len, p_ctx->pps, p_ctx->pps_len) < 0)
     {
-        log_print(HT_LOG_ERR, "%s, gf_odf_avc_cfg_new failed\r\n", __FUNCTION__);
+        log_print(HT_LOG_ERR, "%s, mp4_mux_avcc failed\r\n", __FUNCTION__);
         return -1;
     }
-    
-	err = gf_isom_avc_config_new(p_ctx->handler, p_ctx->v_track_id, p_avc_cfg, NULL, NULL, &p_ctx->v_stream_idx);
-	if (GF_OK != err)
+
+	p_ctx->ctxf_nalu = 1;
+
+	return 0;
+}
+
+int mp4_write_h265_nalu(MP4CTX * p_ctx)
+{
+    if (NULL == p_ctx->v_trk && mp4_new_video_track(p_ctx, MP4_4CC('h','v','c','1'), 0) < 0)
     {
-        log_print(HT_LOG_ERR, "%s, gf_isom_avc_config_new failed\r\n", __FUNCTION__);
         return -1;
     }
-    
-	err = gf_isom_set_visual_info(p_ctx->handler, p_ctx->v_track_id, p_ctx->v_stream_idx, p_ctx->v_width, p_ctx->v_height);
-    if (GF_OK != err)
+
+    if (mp4_mux_hvcc(p_ctx->v_trk, p_ctx->vps, p_ctx->vps_len, p_ctx->sps, p_ctx->sps_len, p_ctx->pps, p_ctx->pps_len) < 0)
     {
-        log_print(HT_LOG_ERR, "%s, gf_isom_set_visual_info failed\r\n", __FUNCTION__);
+        log_print(HT_LOG_ERR, "%s, mp4_mux_hvcc failed\r\n", __FUNCTION__);
         return -1;
     }
-    
-	p_avc_cfg->configurationVersion = 1;
-	p_avc_cfg->AVCProfileIndication = p_ctx->sps[1];
-	p_avc_cfg->profile_compatibility = p_ctx->sps[2];
-	p_avc_cfg->AVCLevelIndication = p_ctx->sps[3];
 
-	GF_AVCConfigSlot sps;
-	memset(&sps, 0, sizeof(sps));
+    p_ctx->ctxf_nalu = 1;
+    
+	return 0;
+}
 
-	sps.size = p_ctx->sps_len;
-	sps.data = (char *)p_ctx->sps;
+/**
+ * Write a video sample made of the slices, the source timestamp is the presentation time.
+ * The decode time increases, a frame presented before the last one (B frame) is decoded
+ * one tick after it and gets a negative composition offset, the samples of the same picture
+ * are one tick apart.
+ */
+static int mp4_write_video_sample(MP4CTX * p_ctx, HFIOV * p_iov, int cnt, int b_key, uint32 ts)
+{
+    int ret = 0;
+    int32 cts = 0;
+    uint64 pts, dts;
+    MP4TS * p_ts = &p_ctx->v_ts;
+    BOOL same = (p_ts->samples > 0 && ts == p_ts->last_ts);
+    uint32 fps = (p_ctx->v_fps > 0) ? p_ctx->v_fps : 25;
 
-    gf_list_add(p_avc_cfg->sequenceParameterSets, &sps);
+    pts = dts = mp4_ts_pts(p_ts, ts, MP4_VIDEO_TIMESCALE, MP4_VIDEO_TIMESCALE / fps);
 
-    GF_AVCConfigSlot pps;
-	memset(&pps, 0, sizeof(pps));
-	
-    pps.size = p_ctx->pps_len;
-	pps.data = (char *)p_ctx->pps;
+    if (p_ts->samples > 0 && dts <= p_ts->dts)
+    {
+        dts = p_ts->dts + 1;
 
-	gf_list_add(p_avc_cfg->pictureParameterSets, &pps);
+        if (!same)
+        {
+            cts = (int32)((int64)pts - (int64)dts);
+        }
+    }
 
-	err = gf_isom_avc_config_update(p_ctx->handler, p_ctx->v_track_id, p_ctx->v_stream_idx, p_avc_cfg);
-    if (GF_OK != err)
+	if (p_ctx->ctxf_frag)
+	{
+	    mp4_frag_start(p_ctx, b_key, dts * 1000 / MP4_VIDEO_TIMESCALE);
+	}
+	
+    if (mp4_mux_write_sample(p_ctx->mux, p_ctx->v_trk, dts, cts, p_iov, cnt, b_key) < 0)
     {
-        log_print(HT_LOG_ERR, "%s, gf_isom_avc_config_update failed\r\n", __FUNCTION__);
-        return -1;
+        ret = -1;
+		log_print(HT_LOG_ERR, "%s, mp4_mux_write_sample failed\r\n", __FUNCTION__);
     }
-    
-    p_avc_cfg->pictureParameterSets = NULL;
-	p_avc_cfg->sequenceParameterSets = NULL;
-
-	gf_odf_avc_cfg_del(p_avc_cfg);
 
-	p_ctx->ctxf_nalu = 1;
-
-	return 0;
+    p_ts->dts = dts;
+    p_ts->samples++;
+    p_ctx->i_frame_video++;
+    
+	if (p_ctx->s_time == 0)
+	{
+		p_ctx->s_time = sys_os_get_ms();
+		p_ctx->e_time = p_ctx->s_time;
+	}
+	else
+	{
+		p_ctx->e_time = sys_os_get_ms();
+	}
+	
+    return ret;
 }
 
-int mp4_write_h265_nalu(MP4CTX * p_ctx)
+/**
+ * Keep the parameter set for the sample description, the track is created once all of them
+ * are known. The description is updated until the first video sample is written (or the moov
+ * of the fragmented mp4). A later change switches the segment in front of the next key frame
+ * (r2f_pset_check), so the new sets are described by the next file; until then they are kept 
+ * in band. Return TRUE if the nal unit should go in the sample
+ */
+static BOOL mp4_write_param_set(MP4CTX * p_ctx, int type, uint8 * p_nal, int len)
 {
-    int idx;
-    GF_Err err;
-    uint32 fps = (p_ctx->v_fps > 0) ? p_ctx->v_fps : 25;
-    
-    p_ctx->v_track_id = gf_isom_new_track(p_ctx->handler, 0, GF_ISOM_MEDIA_VISUAL, fps);
-    if (0 == p_ctx->v_track_id)
+    int ret = 0;
+    int * p_len;
+    uint8 * p_set;
+    BOOL h265 = (memcmp(p_ctx->v_fcc, "H265", 4) == 0);
+
+    if ((h265 && HEVC_NAL_VPS == type))
     {
-        log_print(HT_LOG_ERR, "%s, gf_isom_new_track failed\r\n", __FUNCTION__);
-        return -1;
+        p_set = p_ctx->vps;
+        p_len = &p_ctx->vps_len;
     }
-    
-    err = gf_isom_set_track_enabled(p_ctx->handler, p_ctx->v_track_id, 1);
-    if (GF_OK != err)
+    else if ((h265 && HEVC_NAL_SPS == type) || (!h265 && H264_NAL_SPS == type))
     {
-        log_print(HT_LOG_ERR, "%s, gf_isom_set_track_enabled failed\r\n", __FUNCTION__);
-        return -1;
+        p_set = p_ctx->sps;
+        p_len = &p_ctx->sps_len;
+    }
+    else
+    {
+        p_set = p_ctx->pps;
+        p_len = &p_ctx->pps_len;
     }
 
-    GF_HEVCConfig * p_hevc_cfg = gf_odf_hevc_cfg_new();
-    if (NULL == p_hevc_cfg)
+    if (*p_len == len && memcmp(p_set, p_nal, len) == 0)
     {
-        log_print(HT_LOG_ERR, "%s, gf_odf_hevc_cfg_new failed\r\n", __FUNCTION__);
-        return -1;
+        return FALSE;
     }
-    
-	p_hevc_cfg->nal_unit_size = 4;
 
-	err = gf_isom_hevc_config_new(p_ctx->handler, p_ctx->v_track_id, p_hevc_cfg, NULL, NULL, &p_ctx->v_stream_idx);
-	if (GF_OK != err)
+    if (p_ctx->v_ts.samples > 0 || p_ctx->mux->moov_flag)
     {
-        log_print(HT_LOG_ERR, "%s, gf_isom_hevc_config_new failed\r\n", __FUNCTION__);
-        return -1;
+        return TRUE;
     }
-    
-	err = gf_isom_set_nalu_extract_mode(p_ctx->handler, p_ctx->v_track_id, GF_ISOM_NALU_EXTRACT_INSPECT);
-	if (GF_OK != err)
+
+    if (*p_len > 0)
     {
-        log_print(HT_LOG_ERR, "%s, gf_isom_set_nalu_extract_mode failed\r\n", __FUNCTION__);
-        return -1;
+        log_print(HT_LOG_DBG, "%s, parameter set %d changed\r\n", __FUNCTION__, type);
     }
-    
-	err = gf_isom_set_cts_packing(p_ctx->handler, p_ctx->v_track_id, GF_TRUE);
-    if (GF_OK != err)
+
+    memcpy(p_set, p_nal, len);
+    *p_len = len;
+
+    if (!h265 && p_ctx->sps_len > 0 && p_ctx->pps_len > 0)
     {
-        log_print(HT_LOG_ERR, "%s, gf_isom_set_cts_packing failed\r\n", __FUNCTION__);
-        return -1;
+        ret = mp4_write_h264_nalu(p_ctx);
+    }
+    else if (h265 && p_ctx->sps_len > 0 && p_ctx->pps_len > 0 && p_ctx->vps_len > 0)
+    {
+        ret = mp4_write_h265_nalu(p_ctx);
     }
 
-	p_hevc_cfg->configurationVersion = 1;
+    if (ret < 0)
+    {
+        log_print(HT_LOG_ERR, "%s, sample description of the parameter sets failed\r\n", __FUNCTION__);
+    }
 
-	HEVCState hevc;
-	memset(&hevc, 0 ,sizeof(HEVCState));
+    return FALSE;
+}
 
-    idx = gf_media_hevc_read_vps((char*)p_ctx->vps, p_ctx->vps_len, &hevc);
-    hevc.vps[idx].crc = gf_crc_32((char*)p_ctx->vps, p_ctx->vps_len);
-    p_hevc_cfg->avgFrameRate = hevc.vps[idx].rates[0].avg_pic_rate;
-    p_hevc_cfg->constantFrameRate = hevc.vps[idx].rates[0].constand_pic_rate_idc;
-    p_hevc_cfg->numTemporalLayers = hevc.vps[idx].max_sub_layers;
-    p_hevc_cfg->temporalIdNested = hevc.vps[idx].temporal_id_nesting;
+/**
+ * Double the length prefix array, the prefix slices already in the access unit are moved along
+ */
+static BOOL mp4_au_grow_nal(MP4CTX * p_ctx)
+{
+    int i;
+    int max = p_ctx->au_nal_max > 0 ? p_ctx->au_nal_max * 2 : MP4_AU_NAL_MAX;
+    uint32 * p_old = p_ctx->au_nlen;
+    uint32 * p_new = (uint32 *)malloc(max * sizeof(uint32));
+    if (NULL == p_new)
+    {
+        log_print(HT_LOG_ERR, "%s, malloc failed\r\n", __FUNCTION__);
+        return FALSE;
+    }
 
-    GF_AVCConfigSlot vps;
-	memset(&vps, 0, sizeof(vps));
-	
-	GF_HEVCParamArray vps_param;
-	memset(&vps_param, 0, sizeof(vps_param));
-	
-	vps_param.nalus = gf_list_new();
-    gf_list_add(p_hevc_cfg->param_array, &vps_param);
-    vps_param.array_completeness = 1;
-    vps_param.type = GF_HEVC_NALU_VID_PARAM;
-    vps.id = idx;
-    vps.size = p_ctx->vps_len;
-    vps.data = (char *)p_ctx->vps;
-    gf_list_add(vps_param.nalus, &vps);
-    
-    idx = gf_media_hevc_read_sps((char*)p_ctx->sps, p_ctx->sps_len, &hevc);
-    hevc.sps[idx].crc = gf_crc_32((char*)p_ctx->sps, p_ctx->sps_len);
-    p_hevc_cfg->profile_space = hevc.sps[idx].ptl.profile_space;
-    p_hevc_cfg->tier_flag = hevc.sps[idx].ptl.tier_flag;
-    p_hevc_cfg->profile_idc = hevc.sps[idx].ptl.profile_idc;
-
-    GF_AVCConfigSlot sps;
-	memset(&sps, 0, sizeof(sps));
-	
-	GF_HEVCParamArray sps_param;
-	memset(&sps_param, 0, sizeof(sps_param));
-	
-	sps_param.nalus = gf_list_new();
-    gf_list_add(p_hevc_cfg->param_array, &sps_param);
-    sps_param.array_completeness = 1;
-    sps_param.type = GF_HEVC_NALU_SEQ_PARAM;
-    sps.id = idx;
-    sps.size = p_ctx->sps_len;
-    sps.data = (char *)p_ctx->sps;
-    gf_list_add(sps_param.nalus, &sps);
-
-    idx = gf_media_hevc_read_pps((char*)p_ctx->pps, p_ctx->pps_len, &hevc);
-    hevc.pps[idx].crc = gf_crc_32((char*)p_ctx->pps, p_ctx->pps_len);
-
-    GF_AVCConfigSlot pps;
-	memset(&pps, 0, sizeof(pps));
-	
-	GF_HEVCParamArray pps_param;
-	memset(&pps_param, 0, sizeof(pps_param));
-	
-	pps_param.nalus = gf_list_new();
-    gf_list_add(p_hevc_cfg->param_array, &pps_param);
-    pps_param.array_completeness = 1;
-    pps_param.type = GF_HEVC_NALU_PIC_PARAM;
-    pps.id = idx;
-    pps.size = p_ctx->pps_len;
-    pps.data = (char *)p_ctx->pps;
-    gf_list_add(pps_param.nalus, &pps);
-
-    err = gf_isom_set_visual_info(p_ctx->handler, p_ctx->v_track_id, p_ctx->v_stream_idx, p_ctx->v_width, p_ctx->v_height);
-    if (GF_OK != err)
-    {
-        log_print(HT_LOG_ERR, "%s, gf_isom_set_visual_info failed\r\n", __FUNCTION__);
-        return -1;
+    if (p_old)
+    {
+        memcpy(p_new, p_old, p_ctx->au_nal_cnt * sizeof(uint32));
+        
+        for (i = 0; i < p_ctx->au_iov_cnt; i++)
+        {
+            uint32 * p_base = (uint32 *)p_ctx->au_iov[i].iov_base;
+            
+            if (p_base >= p_old && p_base < p_old + p_ctx->au_nal_max)
+            {
+                p_ctx->au_iov[i].iov_base = p_new + (p_base - p_old);
+            }
+        }
+
+        free(p_old);
+
+        log_print(HT_LOG_INFO, "%s, %d nal units in one sample\r\n", __FUNCTION__, max);
     }
     
-	err = gf_isom_hevc_config_update(p_ctx->handler, p_ctx->v_track_id, p_ctx->v_stream_idx, p_hevc_cfg);
-	if (GF_OK != err)
+    p_ctx->au_nlen = p_new;
+    p_ctx->au_nal_max = max;
+
+    return TRUE;
+}
+
+/**
+ * Add a nal unit to the access unit, p_iov are the payload slices after the start code
+ */
+static void mp4_au_nal(MP4CTX * p_ctx, HFIOV * p_iov, int cnt, uint32 len)
+{
+    int i, type, ps, key;
+    uint8 * p_hdr = (uint8 *)p_iov[0].iov_base;
+
+    if (memcmp(p_ctx->v_fcc, "H265", 4) == 0)
     {
-        log_print(HT_LOG_ERR, "%s, gf_isom_hevc_config_update failed\r\n", __FUNCTION__);
-        return -1;
+        type = (p_hdr[0] >> 1) & 0x3F;
+        ps = (HEVC_NAL_VPS == type || HEVC_NAL_SPS == type || HEVC_NAL_PPS == type);
+        key = (type >= 16 && type <= 21);
     }
-
-    if (sps_param.nalus)
+    else
     {
-        gf_list_del(sps_param.nalus);
+        type = p_hdr[0] & 0x1F;
+        ps = (H264_NAL_SPS == type || H264_NAL_PPS == type);
+        key = (H264_NAL_IDR == type);
     }
 
-    if (pps_param.nalus)
+    if (ps && len <= sizeof(p_ctx->sps))
     {
-        gf_list_del(pps_param.nalus);
+        uint8 set[sizeof(p_ctx->sps)];
+        uint32 pos = 0;
+
+        for (i = 0; i < cnt; i++)
+        {
+            memcpy(set + pos, p_iov[i].iov_base, p_iov[i].iov_len);
+            pos += p_iov[i].iov_len;
+        }
+
+        if (!mp4_write_param_set(p_ctx, type, set, len))
+        {
+            return;
+        }
     }
 
-    if (vps_param.nalus)
+    if (p_ctx->au_nal_cnt >= p_ctx->au_nal_max && !mp4_au_grow_nal(p_ctx))
     {
-        gf_list_del(vps_param.nalus);
+        // the sample would miss a slice, the access unit is dropped
+        log_print(HT_LOG_ERR, "%s, drop the access unit of %d nal units\r\n", __FUNCTION__, p_ctx->au_nal_cnt);
+        
+        p_ctx->au_iov_cnt = 0;
+        p_ctx->au_nal_cnt = 0;
+        p_ctx->au_key = 0;
+        return;
     }
 
-    p_hevc_cfg->param_array = NULL;
-    
-	gf_odf_hevc_cfg_del(p_hevc_cfg);
+    if (p_ctx->au_iov_cnt + cnt + 1 > p_ctx->au_iov_max)
+    {
+        int max = (p_ctx->au_iov_cnt + cnt + 1) * 2;
+        HFIOV * p_new = (HFIOV *)realloc(p_ctx->au_iov, max * sizeof(HFIOV));
+        if (NULL == p_new)
+        {
+            log_print(HT_LOG_ERR, "%s, realloc failed\r\n", __FUNCTION__);
+            return;
+        }
 
-    p_ctx->ctxf_nalu = 1;
-    
-	return 0;
-}
+        p_ctx->au_iov = p_new;
+        p_ctx->au_iov_max = max;
+    }
 
-int mp4_write_video_frame(MP4CTX * p_ctx, void * p_data, uint32 len, int b_key)
-{
-    int ret = 0;
-    uint32 nlen;
-    GF_Err err;
-    
-	GF_ISOSample * p_sample = gf_isom_sample_new();
-	if (NULL == p_sample)
-	{
-	    log_print(HT_LOG_ERR, "%s, gf_isom_sample_new failed\r\n", __FUNCTION__);
-        return -1;
-	}
-	
-	memset(p_sample, 0, sizeof(GF_ISOSample));
+    // length prefix, then the payload slices
+    p_ctx->au_nlen[p_ctx->au_nal_cnt] = htonl(len);
 
-    nlen = htonl(len - 4);
-    memcpy(p_data, &nlen, 4);
-	
-	p_sample->IsRAP = (SAPType)b_key;
-	p_sample->dataLength = len;
-	p_sample->data = (char *)p_data;
-	p_sample->DTS = p_ctx->v_timestamp;
-	p_sample->CTS_Offset = 0;
-	
-	err = gf_isom_add_sample(p_ctx->handler, p_ctx->v_track_id, p_ctx->v_stream_idx, p_sample);			
-	if (GF_OK != err)
-	{
-	    ret = -1;
-		log_print(HT_LOG_ERR, "%s, gf_isom_add_sample failed\r\n", __FUNCTION__);
-	}
+    p_ctx->au_iov[p_ctx->au_iov_cnt].iov_base = &p_ctx->au_nlen[p_ctx->au_nal_cnt];
+    p_ctx->au_iov[p_ctx->au_iov_cnt].iov_len = 4;
+    p_ctx->au_iov_cnt++;
+    p_ctx->au_nal_cnt++;
 
-    p_ctx->v_timestamp += 1;
-    
-	p_sample->data = NULL;
-	p_sample->dataLength = 0;
-	
-	gf_isom_sample_del(&p_sample);
+    memcpy(&p_ctx->au_iov[p_ctx->au_iov_cnt], p_iov, cnt * sizeof(HFIOV));
+    p_ctx->au_iov_cnt += cnt;
 
-    p_ctx->i_frame_video++;
-    
-	if (p_ctx->s_time == 0)
-	{
-		p_ctx->s_time = sys_os_get_ms();
-		p_ctx->e_time = p_ctx->s_time;
-	}
-	else
-	{
-		p_ctx->e_time = sys_os_get_ms();
-	}
-	
-    return 0;
+    if (key)
+    {
+        p_ctx->au_key = 1;
+    }
+}
+
+static void mp4_au_reset(MP4CTX * p_ctx)
+{
+    p_ctx->au_iov_cnt = 0;
+    p_ctx->au_nal_cnt = 0;
+    p_ctx->au_key = 0;
 }
 
-int mp4_write_h264(MP4CTX * p_ctx, void * p_data, uint32 len, int b_key)
+/**
+ * Write the access unit as one sample, the recording starts at the first key frame.
+ * The slices of a picture delivered apart (the marker is set on every slice) join the last sample
+ */
+static int mp4_au_write(MP4CTX * p_ctx, uint32 ts)
 {
-    uint8 nalu = (((uint8 *)p_data)[4] & 0x1f);
+    int ret;
 
-    if (H264_NAL_SPS == nalu)
+    if (0 == p_ctx->au_nal_cnt || !p_ctx->ctxf_nalu || !mp4_frag_ready(p_ctx))
     {
-        if (0 == p_ctx->sps_len)
-        {
-            memcpy(p_ctx->sps, (uint8 *)p_data+4, len-4);
-            p_ctx->sps_len = len-4;
+        return 0;
+    }
 
-            if (p_ctx->sps_len > 0 && p_ctx->pps_len > 0)
-            {
-                if (mp4_write_h264_nalu(p_ctx) < 0)
-                {
-                    log_print(HT_LOG_ERR, "%s, mp4_write_h264_nalu failed\r\n", __FUNCTION__);
-                    return -1;
-                }
-            }
-        }
+    if (!p_ctx->ctxf_iframe && !p_ctx->au_key)
+    {
+        return 0;
     }
-    else if (H264_NAL_PPS == nalu)
+
+    if (p_ctx->v_ts.samples > 0 && ts == p_ctx->v_ts.last_ts &&
+        mp4_mux_append_sample(p_ctx->mux, p_ctx->v_trk, p_ctx->au_iov, p_ctx->au_iov_cnt) == 0)
     {
-        if (0 == p_ctx->pps_len)
-        {
-            memcpy(p_ctx->pps, (uint8 *)p_data+4, len-4);
-            p_ctx->pps_len = len-4;
+        return 0;
+    }
 
-            if (p_ctx->sps_len > 0 && p_ctx->pps_len > 0)
-            {
-                if (mp4_write_h264_nalu(p_ctx) < 0)
-                {
-                    log_print(HT_LOG_ERR, "%s, mp4_write_h264_nalu failed\r\n", __FUNCTION__);
-                    return -1;
-                }
-            }
-        }
+    ret = mp4_write_video_sample(p_ctx, p_ctx->au_iov, p_ctx->au_iov_cnt, p_ctx->au_key, ts);
+    if (ret < 0)
+    {
+        log_print(HT_LOG_ERR, "%s, mp4_write_video_sample failed\r\n", __FUNCTION__);
     }
-    else if (H264_NAL_SEI == nalu)
+    else if (p_ctx->au_key)
     {
+        p_ctx->ctxf_iframe = 1;
     }
-    else if (p_ctx->ctxf_nalu)
+
+    return ret;
+}
+
+/**
+ * H264/H265 access unit, the nal units of the frame are written as one length prefixed sample
+ */
+int mp4_write_nalu_au(MP4CTX * p_ctx, uint8 * p_data, uint32 len, uint32 ts)
+{
+    int s_len = 0, n_len = 0, parse_len = len;
+    uint8 * p_cur = p_data;
+    HFIOV iov;
+
+    mp4_au_reset(p_ctx);
+
+    while (p_cur)
     {
-        if (!p_ctx->ctxf_iframe)
+        uint8 * p_next = avc_split_nalu(p_cur, parse_len, &s_len, &n_len);
+        if (n_len <= s_len)
         {
-            if (H264_NAL_IDR == nalu)
-            {
-                if (mp4_write_video_frame(p_ctx, p_data, len, b_key) < 0)
-                {
-                    log_print(HT_LOG_ERR, "%s, mp4_write_frame failed\r\n", __FUNCTION__);
-                    return -1;
-                }
-                else
-                {
-                    p_ctx->ctxf_iframe = 1;
-                }
-            }
-        }
-        else
-        {
-            if (mp4_write_video_frame(p_ctx, p_data, len, b_key) < 0)
-            {
-                log_print(HT_LOG_ERR, "%s, mp4_write_frame failed\r\n", __FUNCTION__);
-                return -1;
-            }
+            break;
         }
+
+        iov.iov_base = p_cur + s_len;
+        iov.iov_len = n_len - s_len;
+
+        mp4_au_nal(p_ctx, &iov, 1, n_len - s_len);
+
+        parse_len -= n_len;
+        p_cur = p_next;
     }
 
-    return 0;
+    return mp4_au_write(p_ctx, ts);
 }
 
-int mp4_write_h265(MP4CTX * p_ctx, void * p_data, uint32 len, int b_key)
+/**
+ * MJPEG, every frame is a key sample of a mp4v track with the JPEG object type
+ */
+int mp4_write_jpeg(MP4CTX * p_ctx, void * p_data, uint32 len, uint32 ts)
 {
-    uint8 nalu = ((((uint8 *)p_data)[4] >> 1) & 0x3F);
+    HFIOV iov;
 
-    if (HEVC_NAL_SPS == nalu)
+    if (NULL == p_ctx->v_trk)
     {
-        if (0 == p_ctx->sps_len)
+        if (0 == p_ctx->v_width || 0 == p_ctx->v_height)
         {
-            memcpy(p_ctx->sps, (uint8 *)p_data+4, len-4);
-            p_ctx->sps_len = len-4;
+            return 0;
+        }
 
-            if (p_ctx->sps_len > 0 && p_ctx->pps_len > 0 && p_ctx->vps_len > 0)
-            {
-                if (mp4_write_h265_nalu(p_ctx) < 0)
-                {
-                    log_print(HT_LOG_ERR, "%s, mp4_write_h264_nalu failed\r\n", __FUNCTION__);
-                    return -1;
-                }
-            }
+        if (mp4_new_video_track(p_ctx, MP4_4CC('m','p','4','v'), MP4_OTI_JPEG) < 0)
+        {
+            return -1;
         }
     }
-    else if (HEVC_NAL_PPS == nalu)
-    {
-        if (0 == p_ctx->pps_len)
-        {
-            memcpy(p_ctx->pps, (uint8 *)p_data+4, len-4);
-            p_ctx->pps_len = len-4;
 
-            if (p_ctx->sps_len > 0 && p_ctx->pps_len > 0 && p_ctx->vps_len > 0)
-            {
-                if (mp4_write_h265_nalu(p_ctx) < 0)
-                {
-                    log_print(HT_LOG_ERR, "%s, mp4_write_h264_nalu failed\r\n", __FUNCTION__);
-                    return -1;
-                }
-            }
-        }
+    if (!mp4_frag_ready(p_ctx))
+    {
+        return 0;
     }
-    else if (HEVC_NAL_VPS == nalu)
+
+    iov.iov_base = p_data;
+    iov.iov_len = len;
+
+    return mp4_write_video_sample(p_ctx, &iov, 1, 1, ts);
+}
+
+/**
+ * MPEG-4 visual, the headers before the first VOP are the decoder specific info,
+ * the recording starts at the first I-VOP
+ */
+int mp4_write_mp4v(MP4CTX * p_ctx, void * p_data, uint32 len, uint32 ts)
+{
+    uint32 pos = 0;
+    int vol_f = 0, vop = -1;
+    uint8 * p_buf = (uint8 *)p_data;
+    HFIOV iov;
+
+    while (pos + 4 < len)
     {
-        if (0 == p_ctx->vps_len)
+        if (p_buf[pos] == 0 && p_buf[pos+1] == 0 && p_buf[pos+2] == 1)
         {
-            memcpy(p_ctx->vps, (uint8 *)p_data+4, len-4);
-            p_ctx->vps_len = len-4;
-
-            if (p_ctx->sps_len > 0 && p_ctx->pps_len > 0 && p_ctx->vps_len > 0)
+            if (p_buf[pos+3] >= 0x20 && p_buf[pos+3] <= 0x2F)
             {
-                if (mp4_write_h265_nalu(p_ctx) < 0)
-                {
-                    log_print(HT_LOG_ERR, "%s, mp4_write_h264_nalu failed\r\n", __FUNCTION__);
-                    return -1;
-                }
+                vol_f = 1;
+            }
+            else if (p_buf[pos+3] == 0xB6)
+            {
+                vop = pos;
+                break;
             }
         }
+
+        pos++;
     }
-    else if (HEVC_NAL_SEI_PREFIX == nalu || HEVC_NAL_SEI_SUFFIX == nalu)
+
+    if (vop < 0)
     {
+        return 0;
     }
-    else if (p_ctx->ctxf_nalu)
+
+    if (NULL == p_ctx->v_trk)
     {
-        if (!p_ctx->ctxf_iframe)
+        if (!vol_f)
         {
-            if (b_key)
-            {
-                if (mp4_write_video_frame(p_ctx, p_data, len, b_key) < 0)
-                {
-                    log_print(HT_LOG_ERR, "%s, mp4_write_frame failed\r\n", __FUNCTION__);
-                    return -1;
-                }
-                else
-                {
-                    p_ctx->ctxf_iframe = 1;
-                }
-            }
+            return 0;
         }
-        else
+
+        if (mp4_new_video_track(p_ctx, MP4_4CC('m','p','4','v'), MP4_OTI_MPEG4V) < 0 ||
+            mp4_mux_set_config(p_ctx->v_trk, p_buf, vop) < 0)
         {
-            if (mp4_write_video_frame(p_ctx, p_data, len, b_key) < 0)
-            {
-                log_print(HT_LOG_ERR, "%s, mp4_write_frame failed\r\n", __FUNCTION__);
-                return -1;
-            }
+            return -1;
         }
     }
 
-    return 0;
+    // vop_coding_type, 0 - I-VOP
+    int b_key = ((p_buf[vop+4] >> 6) == 0);
+
+    if (!p_ctx->ctxf_iframe && !b_key)
+    {
+        return 0;
+    }
+
+    if (!mp4_frag_ready(p_ctx))
+    {
+        return 0;
+    }
+
+    p_ctx->ctxf_iframe = 1;
+
+    iov.iov_base = p_data;
+    iov.iov_len = len;
+
+    return mp4_write_video_sample(p_ctx, &iov, 1, b_key, ts);
 }
 
-int mp4_write_video(MP4CTX * p_ctx, void * p_data, uint32 len, int b_key)
+int mp4_write_video(MP4CTX * p_ctx, void * p_data, uint32 len, int b_key, uint32 ts)
 {
     int ret = 0;
     
     sys_os_mutex_enter(p_ctx->mutex);
     
-    if (memcmp(p_ctx->v_fcc, "H264", 4) == 0)
+    if (memcmp(p_ctx->v_fcc, "H264", 4) == 0 || memcmp(p_ctx->v_fcc, "H265", 4) == 0)
+    {
+        ret = mp4_write_nalu_au(p_ctx, (uint8 *)p_data, len, ts);
+    }
+    else if (memcmp(p_ctx->v_fcc, "JPEG", 4) == 0)
     {
-        ret = mp4_write_h264(p_ctx, p_data, len, b_key);
+        ret = mp4_write_jpeg(p_ctx, p_data, len, ts);
     }
-    else if (memcmp(p_ctx->v_fcc, "H265", 4) == 0)
+    else if (memcmp(p_ctx->v_fcc, "MP4V", 4) == 0)
     {
-        ret = mp4_write_h265(p_ctx, p_data, len, b_key);
+        ret = mp4_write_mp4v(p_ctx, p_data, len, ts);
     }
 
     sys_os_mutex_leave(p_ctx->mutex);
@@ -791,6 +944,36 @@ int mp4_write_video(MP4CTX * p_ctx, void * p_data, uint32 len, int b_key)
     return ret;
 }
 
+/**
+ * Write the H264/H265 frame chain as one sample, the payload slices are written
+ * as they are, the start code slices are replaced by the length prefixes
+ */
+int mp4_write_video_frm(MP4CTX * p_ctx, RTPFRMIOV * p_frm, uint32 ts)
+{
+    int i, first, cnt, len, ret;
+    
+    sys_os_mutex_enter(p_ctx->mutex);
+
+    mp4_au_reset(p_ctx);
+
+    for (i = 0; i < p_frm->nal_cnt; i++)
+    {
+        len = rtp_frm_iov_nal_range(p_frm, i, &first, &cnt);
+        if (len < 5 || cnt < 2)
+        {
+            continue;
+        }
+
+        mp4_au_nal(p_ctx, &p_frm->iov[first+1], cnt-1, len-4);
+    }
+
+    ret = mp4_au_write(p_ctx, ts);
+    
+    sys_os_mutex_leave(p_ctx->mutex);
+    
+    return ret;
+}
+
 int mp4_calc_fps(MP4CTX * p_ctx, uint8 * p_data, uint32 len, uint32 ts)
 {
     int i;
@@ -842,7 +1025,7 @@ int mp4_calc_fps(MP4CTX * p_ctx, uint8 * p_data, uint32 len, uint32 ts)
 	    
 		delta_ts /= count;
 		
-		float fps = (float) 90000.0 / delta_ts;
+		float fps = (float) (p_ctx->v_ts.clock ? p_ctx->v_ts.clock : MP4_VIDEO_TIMESCALE) / delta_ts;
 		
 		p_ctx->v_fps = (uint32)(fps + 0.5);
 
@@ -854,10 +1037,6 @@ int mp4_calc_fps(MP4CTX * p_ctx, uint8 * p_data, uint32 len, uint32 ts)
             p_ctx->prev_ts = 0;
             memset(p_ctx->delta_ts, 0, sizeof(uint32)*count);
         }
-        else
-        {
-            gf_isom_set_media_timescale(p_ctx->handler, p_ctx->v_track_id, p_ctx->v_fps, GF_TRUE);
-        }
         
 		return (int)fps;
 	}
@@ -883,13 +1062,6 @@ int mp4_parse_video_size(MP4CTX * p_ctx, uint8 * p_data, uint32 len)
 
 	if (memcmp(p_ctx->v_fcc, "H264", 4) == 0)
 	{
-		nalu_t = p_data[4] & 0x1F;
-		
-		if (nalu_t != H264_NAL_SPS)
-		{
-			return 0;
-        }
-        
 		int s_len = 0, n_len = 0, parse_len = len;
 		uint8 * p_cur = p_data;
 
@@ -947,7 +1119,7 @@ int mp4_parse_video_size(MP4CTX * p_ctx, uint8 * p_data, uint32 len)
 				h265_t parse;
 				h265_parser_init(&parse);
 
-				if (h265_parser_parse(&parse, p_cur+4, n_len-s_len) == 0)
+				if (h265_parser_parse(&parse, p_cur+s_len, n_len-s_len) == 0)
 				{
 					log_print(HT_LOG_INFO, "%s, H265 width[%d],height[%d]\r\n", __FUNCTION__, parse.pic_width_in_luma_samples, parse.pic_height_in_luma_samples);
 					p_ctx->v_width = parse.pic_width_in_luma_samples;
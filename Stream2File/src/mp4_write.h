@@ -21,19 +21,31 @@
 #define MP4_WRITE_H
 
 #include "mp4_ctx.h"
+#include "rtp_rx.h"
+
+#define MP4_FRAG_MS_DEF     1000        // default fragment duration (ms)
+#define MP4_FRAG_MAX_MS     10000       // start a fragment without waiting for a key frame
+#define MP4_VIDEO_TIMESCALE 90000       // video track timescale, the rtp video clock rate
+#define MP4_TS_GAP_MS       5000        // a larger source timestamp jump is a discontinuity
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+void     mp4_write_set_faststart_def(uint32 reserve);
+void     mp4_write_set_sync_def(int mode, uint32 ms);
+void     mp4_write_set_sync(MP4CTX * p_ctx, int mode, uint32 ms);
 MP4CTX * mp4_write_open(char * filename);
 void     mp4_write_close(MP4CTX * p_ctx);
+void     mp4_write_set_fragment(MP4CTX * p_ctx, int frag_ms);
 void     mp4_set_video_info(MP4CTX * p_ctx, int fps, int width, int height, const char fcc[4]);
 void     mp4_set_audio_info(MP4CTX * p_ctx, int chns, int rate, uint16 fmt, uint8 * extra, int extra_len);
+void     mp4_set_timestamp_clock(MP4CTX * p_ctx, uint32 v_clock, uint32 a_clock);
 int      mp4_write_header(MP4CTX * p_ctx);
 int      mp4_update_header(MP4CTX * p_ctx);
-int      mp4_write_audio(MP4CTX * p_ctx, void * p_data, uint32 len);
-int      mp4_write_video(MP4CTX * p_ctx, void * p_data, uint32 len, int b_key);
+int      mp4_write_audio(MP4CTX * p_ctx, void * p_data, uint32 len, uint32 ts);
+int      mp4_write_video(MP4CTX * p_ctx, void * p_data, uint32 len, int b_key, uint32 ts);
+int      mp4_write_video_frm(MP4CTX * p_ctx, RTPFRMIOV * p_frm, uint32 ts);
 int      mp4_calc_fps(MP4CTX * p_ctx, uint8 * p_data, uint32 len, uint32 ts);
 int      mp4_parse_video_size(MP4CTX * p_ctx, uint8 * p_data, uint32 len);
 
@@ -21,6 +21,11 @@
 #include "r2f.h"
 #include "r2f_cfg.h"
 #include "r2f_rua.h"
+#include "r2f_writer.h"
+#include "r2f_final.h"
+#include "r2f_cmd.h"
+#include "r2f_api.h"
+#include "r2f_cmdq.h"
 #include "avi_write.h"
 #include "media_util.h"
 #ifdef MP4_FORMAT
@@ -31,12 +36,10 @@
 #include "rtmp_cln.h"
 #endif
 
-#include "mysql.h"
 #include <cstring>
 #include <thread>
 using namespace std;
 
-#pragma comment(lib,"libmysql.lib")
 /***************************************************************************************/
 #define R2F_MAJOR_VERSION   2
 #define R2F_MINOR_VERSION   1
@@ -62,7 +65,9 @@ void r2f_audio_encode_cb(uint8 *data, int size, int nbsamples, void *pUserdata)
 {
 	RUA * p_rua = (RUA *)pUserdata;
 
-	r2f_record_aac(p_rua, data, size);
+	r2f_record_aac(p_rua, data, size, p_rua->aenc_ts);
+
+	p_rua->aenc_ts += nbsamples;
 }
 
 BOOL r2f_init_audio_recodec(RUA * p_rua, int codec, int sr, int chs)
@@ -113,6 +118,10 @@ BOOL r2f_init_audio_recodec(RUA * p_rua, int codec, int sr, int chs)
             p_rua->aencoder->getExtraData(&extradata, &extralen);
 
             mp4_set_audio_info(p_rua->mp4ctx, chs, sr, AUDIO_FORMAT_AAC, extradata, extralen);
+
+            // the recoded frames are timed by the encoded samples
+            p_rua->aenc_ts = 0;
+            mp4_set_timestamp_clock(p_rua->mp4ctx, p_rua->mp4ctx->v_ts.clock, 0);
         }
         else
         {
@@ -273,7 +282,7 @@ int rtmp_notify_callback(int event, void * puser)
     	    avi_update_header(p_avictx);
 	    }
 #ifdef MP4_FORMAT	    
-        else if (R2F_FMT_MP4 == p_rua->filefmt)
+        else if (R2F_FMT_IS_MP4(p_rua->filefmt))
 	    {
 	        MP4CTX * p_mp4ctx = p_rua->mp4ctx;    	    
     	    	    
@@ -301,6 +310,7 @@ int rtmp_notify_callback(int event, void * puser)
 	    if (0 == p_rua->starttime)
         {
 	        p_rua->starttime = time(NULL);
+	        r2f_policy_start(&p_rua->pol_st, &p_rua->policy);
 	    }
 	}
     else if (RTMP_EVE_AUDIOREADY == event)
@@ -347,7 +357,7 @@ int rtmp_notify_callback(int event, void * puser)
     	    avi_update_header(p_avictx);
     	} 
 #ifdef MP4_FORMAT	    
-        else if (R2F_FMT_MP4 == p_rua->filefmt)
+        else if (R2F_FMT_IS_MP4(p_rua->filefmt))
         {
             MP4CTX * p_mp4ctx = p_rua->mp4ctx;  
             
@@ -373,6 +383,7 @@ int rtmp_notify_callback(int event, void * puser)
         if (0 == p_rua->starttime)
         {
 	        p_rua->starttime = time(NULL);
+	        r2f_policy_start(&p_rua->pol_st, &p_rua->policy);
 	    }
 	}
 	
@@ -383,13 +394,23 @@ int rtmp_audio_callback(uint8 * pdata, int len, uint32 ts, void *puser)
 {
     // log_print(HT_LOG_DBG, "%s, len = %d, ts = %u, seq = %d\r\n", __FUNCTION__, len, ts, seq);
 
-    return r2f_record_audio((RUA *)puser, pdata, len);
+    if (r2f_writer_put_audio((RUA *)puser, pdata, len, ts))
+    {
+        return 0;
+    }
+
+    return r2f_record_audio((RUA *)puser, pdata, len, ts);
 }
 
 int rtmp_video_callback(uint8 * pdata, int len, uint32 ts, void *puser)
 {
     // log_print(HT_LOG_DBG, "%s, len = %d, ts = %u, seq = %d\r\n", __FUNCTION__, len, ts, seq);
 
+    if (r2f_writer_put_video((RUA *)puser, pdata, len, ts))
+    {
+        return 0;
+    }
+
     return r2f_record_video((RUA *)puser, pdata, len, ts);
 }
 
@@ -493,7 +514,7 @@ int rtsp_notify_callback(int event, void * puser)
     	    avi_update_header(p_avictx);
 	    }
 #ifdef MP4_FORMAT	    
-        else if (R2F_FMT_MP4 == p_rua->filefmt)
+        else if (R2F_FMT_IS_MP4(p_rua->filefmt))
 	    {
 	        MP4CTX * p_mp4ctx = p_rua->mp4ctx;    	    
     	    	    
@@ -534,6 +555,7 @@ int rtsp_notify_callback(int event, void * puser)
 #endif // MP4_FORMAT
 
 	    p_rua->starttime = time(NULL);
+	    r2f_policy_start(&p_rua->pol_st, &p_rua->policy);
 	}
     
     return 0;
@@ -543,16 +565,45 @@ int rtsp_audio_callback(uint8 * pdata, int len, uint32 ts, uint16 seq, void * pu
 {
     // log_print(HT_LOG_DBG, "%s, len = %d, ts = %u, seq = %d\r\n", __FUNCTION__, len, ts, seq);
 
-    return r2f_record_audio((RUA *)puser, pdata, len);
+    if (r2f_writer_put_audio((RUA *)puser, pdata, len, ts))
+    {
+        return 0;
+    }
+
+    return r2f_record_audio((RUA *)puser, pdata, len, ts);
 }
 
 int rtsp_video_callback(uint8 * pdata, int len, uint32 ts, uint16 seq, void * puser)
 {
     // log_print(HT_LOG_DBG, "%s, len = %d, ts = %u, seq = %d\r\n", __FUNCTION__, len, ts, seq);
 
+    if (r2f_writer_put_video((RUA *)puser, pdata, len, ts))
+    {
+        return 0;
+    }
+
     return r2f_record_video((RUA *)puser, pdata, len, ts);
 }
 
+int rtsp_video_iov_callback(RTPFRMIOV * p_frm, uint32 ts, uint16 seq, void * puser)
+{
+    if (r2f_writer_put_video_iov((RUA *)puser, p_frm, ts))
+    {
+        return 0;
+    }
+
+    return r2f_record_video_iov((RUA *)puser, p_frm, ts);
+}
+
+#ifdef METADATA
+int rtsp_metadata_callback(uint8 * pdata, int len, uint32 ts, uint16 seq, void * puser)
+{
+    r2f_event_meta(&((RUA *)puser)->event, pdata, len);
+
+    return 0;
+}
+#endif
+
 /***************************************************************/
 void rtsp_reconn(RUA * p_rua)
 {
@@ -573,13 +624,18 @@ void rtsp_reconn(RUA * p_rua)
     p_rtsp->set_audio_cb(rtsp_audio_callback);
     p_rtsp->set_video_cb(rtsp_video_callback);
 
+    if (g_r2f_cfg.zero_copy)
+    {
+        p_rtsp->set_video_iov_cb(rtsp_video_iov_callback);
+    }
+
 	if (!p_rtsp->rtsp_start(url, user, pass))
 	{
 	    log_print(HT_LOG_ERR, "%s, rtsp_start failed. %s\r\n", __FUNCTION__, url);
 	}
 }
 
-int r2f_record_aac(RUA * p_rua, uint8 * pdata, int len)
+int r2f_record_aac(RUA * p_rua, uint8 * pdata, int len, uint32 ts)
 {
     int ret = -1;
     int chs = 1;
@@ -587,6 +643,20 @@ int r2f_record_aac(RUA * p_rua, uint8 * pdata, int len)
     int rate_idx = 0;
     uint16 frame_len = len + 7;
     uint8 adts[7];
+    RTPIOV iov[2];
+
+#ifdef MP4_FORMAT
+    // mp4 stores the raw access unit, no ADTS header to build and strip again
+    if (R2F_FMT_IS_MP4(p_rua->filefmt))
+    {
+        return mp4_write_audio(p_rua->mp4ctx, pdata, len, ts);
+    }
+#endif
+
+    if (R2F_FMT_AVI != p_rua->filefmt)
+    {
+        return -1;
+    }
 
     if (p_rua->rtsp_flag)
     {
@@ -678,31 +748,29 @@ int r2f_record_aac(RUA * p_rua, uint8 * pdata, int len)
     adts[6] = 0xFC;
     adts[6] |= (len / 1024) & 0x03; // set raw data blocks. 
 
-    int size = len + 7;
-    char * buff = (char *) malloc(size);
-    if (buff)
-    {
-        memcpy(buff, adts, 7);
-        memcpy(buff+7, pdata, len);
-
-        if (R2F_FMT_AVI == p_rua->filefmt)
-        {
-            ret = avi_write_audio(p_rua->avictx, buff, size);
-        }
-#ifdef MP4_FORMAT        
-        else if (R2F_FMT_MP4 == p_rua->filefmt)
-        {
-            ret = mp4_write_audio(p_rua->mp4ctx, buff, size);
-        }
-#endif
+    // the header and frame are gathered into one chunk, no copy
+    iov[0].iov_base = adts;
+    iov[0].iov_len = 7;
+    iov[1].iov_base = pdata;
+    iov[1].iov_len = len;
 
-        free(buff);
-    }
+    ret = avi_write_audio_iov(p_rua->avictx, iov, 2, frame_len);
     
     return ret;
 }
 
-int r2f_record_audio(RUA * p_rua, uint8 * pdata, int len)
+int r2f_record_audio(RUA * p_rua, uint8 * pdata, int len, uint32 ts)
+{
+    if (r2f_record_hold(p_rua, R2F_EF_AUDIO, FALSE))
+    {
+        r2f_event_hold(&p_rua->event, R2F_EF_AUDIO, pdata, len, ts, FALSE);
+        return 0;
+    }
+
+    return r2f_write_audio(p_rua, pdata, len, ts);
+}
+
+int r2f_write_audio(RUA * p_rua, uint8 * pdata, int len, uint32 ts)
 {
     int ret = -1, codec;
 
@@ -720,10 +788,10 @@ int r2f_record_audio(RUA * p_rua, uint8 * pdata, int len)
     {
         return -1;
     }
-        
+
     if (codec == AUDIO_CODEC_AAC)
     {
-        r2f_record_aac(p_rua, pdata, len);
+        r2f_record_aac(p_rua, pdata, len, ts);
     }
     else
     {
@@ -732,7 +800,7 @@ int r2f_record_audio(RUA * p_rua, uint8 * pdata, int len)
             ret = avi_write_audio(p_rua->avictx, pdata, len);
         }
 #ifdef MP4_FORMAT        
-        else if (R2F_FMT_MP4 == p_rua->filefmt)
+        else if (R2F_FMT_IS_MP4(p_rua->filefmt))
         {
 #ifdef AUDIO_CONV        
             if (p_rua->adecoder)
@@ -744,17 +812,38 @@ int r2f_record_audio(RUA * p_rua, uint8 * pdata, int len)
 #endif
     }
 
-    if (r2f_switch_check(p_rua))
+    r2f_switch_mark(p_rua, len, FALSE);
+
+    return ret;
+}
+
+/**
+ * A picture size change of the sps ends the segment in front of the next key frame,
+ * the next segment is opened with the new size. The mp4 sample description is fixed 
+ * once written, any parameter set change ends the mp4 segment as well
+ */
+static void r2f_pset_check(RUA * p_rua, int flags)
+{
+    if (flags & R2F_PS_RESIZE)
     {
-        r2f_file_switch(p_rua);
+        log_print(HT_LOG_INFO, "%s, %s, picture size changed to %ux%u, switch the segment\r\n", 
+            __FUNCTION__, p_rua->url, p_rua->pset.width, p_rua->pset.height);
+
+        p_rua->pol_st.due = 1;
     }
+    else if ((flags & R2F_PS_CHANGED) && R2F_FMT_IS_MP4(p_rua->filefmt))
+    {
+        log_print(HT_LOG_INFO, "%s, %s, parameter set changed, switch the segment\r\n", 
+            __FUNCTION__, p_rua->url);
 
-    return ret;
+        p_rua->pol_st.due = 1;
+    }
 }
 
 int r2f_record_video_ex(RUA * p_rua, uint8 * pdata, int len, uint32 ts)
 {
     int codec;
+    int hdr = (len > 3 && pdata[2] == 1) ? 3 : 4;     // nal header behind the 3 or 4 byte start code
     
     if (p_rua->rtsp_flag)
     {
@@ -782,7 +871,17 @@ int r2f_record_video_ex(RUA * p_rua, uint8 * pdata, int len, uint32 ts)
 
         if (p_avictx->v_width == 0 || p_avictx->v_height == 0)
         {
-            avi_parse_video_size(p_avictx, pdata, len);
+            if (VIDEO_CODEC_H264 == codec || VIDEO_CODEC_H265 == codec)
+            {
+                // parsed once per sps by the parameter set cache
+                p_avictx->v_width = p_rua->pset.width;
+                p_avictx->v_height = p_rua->pset.height;
+                p_avictx->ctxf_sps_f = (p_rua->pset.width > 0);
+            }
+            else
+            {
+                avi_parse_video_size(p_avictx, pdata, len);
+            }
             
             if (p_avictx->v_width && p_avictx->v_height)
             {
@@ -794,12 +893,12 @@ int r2f_record_video_ex(RUA * p_rua, uint8 * pdata, int len, uint32 ts)
         
         if (VIDEO_CODEC_H264 == codec)
         {
-            uint8 nalu_t = (pdata[4] & 0x1F);
+            uint8 nalu_t = (pdata[hdr] & 0x1F);
             key = (nalu_t == 5);
         }
         else if (VIDEO_CODEC_H265 == codec)
         {
-            uint8 nalu_t = (pdata[4] >> 1) & 0x3F;
+            uint8 nalu_t = (pdata[hdr] >> 1) & 0x3F;
             key = (nalu_t >= 16 && nalu_t <= 21);
         }  
         else if (VIDEO_CODEC_JPEG == codec)
@@ -812,7 +911,7 @@ int r2f_record_video_ex(RUA * p_rua, uint8 * pdata, int len, uint32 ts)
         p_avictx->prev_ts = ts;
     }
 #ifdef MP4_FORMAT
-    else if (R2F_FMT_MP4 == p_rua->filefmt)
+    else if (R2F_FMT_IS_MP4(p_rua->filefmt))
     {
         MP4CTX * p_mp4ctx = p_rua->mp4ctx;
         
@@ -823,7 +922,16 @@ int r2f_record_video_ex(RUA * p_rua, uint8 * pdata, int len, uint32 ts)
 
         if (p_mp4ctx->v_width == 0 || p_mp4ctx->v_height == 0)
         {
-            mp4_parse_video_size(p_mp4ctx, pdata, len);
+            if (VIDEO_CODEC_H264 == codec || VIDEO_CODEC_H265 == codec)
+            {
+                p_mp4ctx->v_width = p_rua->pset.width;
+                p_mp4ctx->v_height = p_rua->pset.height;
+                p_mp4ctx->ctxf_sps_f = (p_rua->pset.width > 0);
+            }
+            else
+            {
+                mp4_parse_video_size(p_mp4ctx, pdata, len);
+            }
             
             if (p_mp4ctx->v_width && p_mp4ctx->v_height)
             {
@@ -835,12 +943,12 @@ int r2f_record_video_ex(RUA * p_rua, uint8 * pdata, int len, uint32 ts)
         
         if (VIDEO_CODEC_H264 == codec)
         {
-            uint8 nalu_t = (pdata[4] & 0x1F);
+            uint8 nalu_t = (pdata[hdr] & 0x1F);
             key = (nalu_t == 5);
         }
         else if (VIDEO_CODEC_H265 == codec)
         {
-            uint8 nalu_t = (pdata[4] >> 1) & 0x3F;
+            uint8 nalu_t = (pdata[hdr] >> 1) & 0x3F;
             key = (nalu_t >= 16 && nalu_t <= 21);
         }  
         else if (VIDEO_CODEC_JPEG == codec)
@@ -848,7 +956,7 @@ int r2f_record_video_ex(RUA * p_rua, uint8 * pdata, int len, uint32 ts)
             key = 1;
         }
         
-        mp4_write_video(p_mp4ctx, pdata, len, key);
+        mp4_write_video(p_mp4ctx, pdata, len, key, ts);
 
         p_mp4ctx->prev_ts = ts;
 	}
@@ -858,34 +966,66 @@ int r2f_record_video_ex(RUA * p_rua, uint8 * pdata, int len, uint32 ts)
 	    return -1;
 	}
 	
-    if (r2f_switch_check(p_rua))
-    {
-        r2f_file_switch(p_rua);
-    }
-    
 	return 0;
 }
 
-int r2f_record_video(RUA * p_rua, uint8 * pdata, int len, uint32 ts)
+static int r2f_stream_video_codec(RUA * p_rua)
 {
-    int codec;
-    
     if (p_rua->rtsp_flag)
     {
-        codec = p_rua->rtsp->video_codec();
+        return p_rua->rtsp->video_codec();
     }
 #ifdef RTMP_STREAM    
     else if (p_rua->rtmp_flag)
     {
-        codec = p_rua->rtmp->video_codec();
+        return p_rua->rtmp->video_codec();
     }
-#endif    
-    else 
+#endif
+
+    return VIDEO_CODEC_NONE;
+}
+
+int r2f_record_video(RUA * p_rua, uint8 * pdata, int len, uint32 ts)
+{
+    BOOL key;
+    
+    if (!p_rua->rtsp_flag && !p_rua->rtmp_flag)
     {
         return -1;
     }
 
-    if (VIDEO_CODEC_H264 == codec || VIDEO_CODEC_H265 == codec)
+    key = r2f_video_key(r2f_stream_video_codec(p_rua), pdata, len);
+
+    if (r2f_record_hold(p_rua, R2F_EF_VIDEO, key))
+    {
+        r2f_event_hold(&p_rua->event, R2F_EF_VIDEO, pdata, len, ts, key);
+        return 0;
+    }
+
+    return r2f_write_video(p_rua, pdata, len, ts, key);
+}
+
+int r2f_write_video(RUA * p_rua, uint8 * pdata, int len, uint32 ts, BOOL key)
+{
+    int codec;
+    
+    if (!p_rua->rtsp_flag && !p_rua->rtmp_flag)
+    {
+        return -1;
+    }
+
+    codec = r2f_stream_video_codec(p_rua);
+
+    r2f_pset_check(p_rua, r2f_pset_frame(&p_rua->pset, codec, pdata, len));
+
+    // the segment ends in front of a key frame
+    if (key && r2f_policy_key(&p_rua->pol_st))
+    {
+        r2f_file_switch(p_rua);
+    }
+
+    // the mp4 writer takes the whole access unit as one sample
+    if ((VIDEO_CODEC_H264 == codec || VIDEO_CODEC_H265 == codec) && R2F_FMT_AVI == p_rua->filefmt)
     {
         int s_len = 0, n_len = 0, parse_len = len;
     	uint8 * p_cur = pdata;
@@ -895,7 +1035,7 @@ int r2f_record_video(RUA * p_rua, uint8 * pdata, int len, uint32 ts)
     		uint8 * p_next = avc_split_nalu(p_cur, parse_len, &s_len, &n_len);
     		if (n_len < 5)
     		{
-    			return 0;
+    			break;
             }
 
     		r2f_record_video_ex(p_rua, p_cur, n_len, ts);
@@ -909,9 +1049,144 @@ int r2f_record_video(RUA * p_rua, uint8 * pdata, int len, uint32 ts)
 	    r2f_record_video_ex(p_rua, pdata, len, ts);
 	}
 
+    r2f_switch_mark(p_rua, len, key);
+
 	return 0;
 }
 
+/**
+ * Record the H264/H265 frame chain, the slice nal units are written
+ * from the packet buffers, the others are assembled and recorded as before.
+ * The mp4 writer takes the whole chain as one sample
+ */
+int r2f_record_video_iov(RUA * p_rua, RTPFRMIOV * p_frm, uint32 ts)
+{
+    int size;
+    BOOL f_key;
+    
+    if (!p_rua->rtsp_flag)
+    {
+        return -1;
+    }
+
+    f_key = r2f_video_iov_key(p_rua->rtsp->video_codec(), p_frm);
+
+    if (r2f_record_hold(p_rua, R2F_EF_VIDEO, f_key))
+    {
+        // assembled once, the ring does not keep the packet buffers
+        uint8 * p_buf = frm_buf_get(p_frm->len, &size);
+        if (p_buf)
+        {
+            rtp_frm_iov_copy(p_frm, 0, p_frm->iov_cnt, p_buf);
+            r2f_event_put(&p_rua->event, R2F_EF_VIDEO, p_buf, p_frm->len, size, ts, f_key);
+        }
+        return 0;
+    }
+
+    return r2f_write_video_iov(p_rua, p_frm, ts, f_key);
+}
+
+int r2f_write_video_iov(RUA * p_rua, RTPFRMIOV * p_frm, uint32 ts, BOOL f_key)
+{
+    int i, first, cnt, len, codec, size;
+    
+    if (!p_rua->rtsp_flag)
+    {
+        return -1;
+    }
+
+    codec = p_rua->rtsp->video_codec();
+
+    r2f_pset_check(p_rua, r2f_pset_iov(&p_rua->pset, codec, p_frm));
+
+    if (f_key && r2f_policy_key(&p_rua->pol_st))
+    {
+        r2f_file_switch(p_rua);
+    }
+
+#ifdef MP4_FORMAT
+    if (R2F_FMT_IS_MP4(p_rua->filefmt))
+    {
+        MP4CTX * p_mp4ctx = p_rua->mp4ctx;
+
+        if (p_mp4ctx->v_fps && p_mp4ctx->v_width && p_mp4ctx->v_height)
+        {
+            mp4_write_video_frm(p_mp4ctx, p_frm, ts);
+            p_mp4ctx->prev_ts = ts;
+        }
+        else
+        {
+            // the frames before the stream is analyzed
+            uint8 * p_buf = frm_buf_get(p_frm->len, &size);
+            if (p_buf)
+            {
+                rtp_frm_iov_copy(p_frm, 0, p_frm->iov_cnt, p_buf);
+                r2f_record_video_ex(p_rua, p_buf, p_frm->len, ts);
+                frm_buf_free(p_buf, size);
+            }
+        }
+
+        r2f_switch_mark(p_rua, p_frm->len, f_key);
+
+        return 0;
+    }
+#endif
+
+    for (i = 0; i < p_frm->nal_cnt; i++)
+    {
+        len = rtp_frm_iov_nal_range(p_frm, i, &first, &cnt);
+        if (len < 5 || cnt < 2)
+        {
+            continue;
+        }
+
+        int key = 0, slice = 0, ready = 0;
+        uint8 nal_hdr = ((uint8 *)p_frm->iov[first+1].iov_base)[0];
+        
+        if (VIDEO_CODEC_H264 == codec)
+        {
+            uint8 nalu_t = (nal_hdr & 0x1F);
+            key = (nalu_t == 5);
+            slice = (nalu_t >= 1 && nalu_t <= 5);
+        }
+        else if (VIDEO_CODEC_H265 == codec)
+        {
+            uint8 nalu_t = (nal_hdr >> 1) & 0x3F;
+            key = (nalu_t >= 16 && nalu_t <= 21);
+            slice = (nalu_t <= 21);
+        }
+
+        if (R2F_FMT_AVI == p_rua->filefmt)
+        {
+            AVICTX * p_avictx = p_rua->avictx;
+            ready = (p_avictx->v_fps && p_avictx->v_width && p_avictx->v_height);
+        }
+
+        if (!slice || !ready)
+        {
+            // parameter sets, sei and the frames before the stream is analyzed
+            uint8 * p_buf = frm_buf_get(len, &size);
+            if (p_buf)
+            {
+                rtp_frm_iov_copy(p_frm, first, cnt, p_buf);
+                r2f_record_video_ex(p_rua, p_buf, len, ts);
+                frm_buf_free(p_buf, size);
+            }
+            continue;
+        }
+
+        if (R2F_FMT_AVI == p_rua->filefmt)
+        {
+            avi_write_video_iov(p_rua->avictx, &p_frm->iov[first], cnt, len, key);
+            p_rua->avictx->prev_ts = ts;
+        }
+    }
+
+    r2f_switch_mark(p_rua, p_frm->len, f_key);
+
+    return 0;
+}
+
 void r2f_notify_handler(RUA * p_rua, uint32 evt)
 {
     if (RTSP_EVE_STOPPED == evt || RTSP_EVE_CONNFAIL == evt || 
@@ -965,6 +1240,9 @@ exit_flag:
 BOOL r2f_rua_start(RUA * p_rua)
 {
     BOOL ret = FALSE;
+
+    // without a writer the frames are recorded on the receive thread
+    r2f_writer_attach(p_rua);
     
     if (p_rua->rtsp_flag)
     {
@@ -974,6 +1252,36 @@ BOOL r2f_rua_start(RUA * p_rua)
         p_rtsp->set_audio_cb(rtsp_audio_callback);
         p_rtsp->set_video_cb(rtsp_video_callback);
 
+        if (g_r2f_cfg.zero_copy)
+        {
+            p_rtsp->set_video_iov_cb(rtsp_video_iov_callback);
+        }
+
+#ifdef METADATA
+        if (p_rua->event.meta[0] != '\0')
+        {
+            p_rtsp->set_metadata_cb(rtsp_metadata_callback);
+        }
+#endif
+
+        if (g_r2f_cfg.rx_buf_size > 0)
+        {
+            p_rtsp->set_rx_buf_size(g_r2f_cfg.rx_buf_size * 1024);
+        }
+
+        if (g_r2f_cfg.udp_rcvbuf > 0)
+        {
+            p_rtsp->set_udp_rcvbuf(g_r2f_cfg.udp_rcvbuf * 1024);
+        }
+
+        p_rtsp->set_udp_timestamp(g_r2f_cfg.udp_timestamp);
+
+        if (g_r2f_cfg.reorder_depth >= 0)
+        {
+            p_rtsp->set_reorder_depth(g_r2f_cfg.reorder_depth, 
+                g_r2f_cfg.reorder_time > 0 ? g_r2f_cfg.reorder_time : RTSP_REORDER_TIME);
+        }
+
         ret = p_rtsp->rtsp_start(p_rua->url, p_rua->user, p_rua->pass);
     }
 #ifdef RTMP_STREAM    
@@ -1006,7 +1314,7 @@ const char * r2f_fmt_str(int fmt)
         return "avi";
     }
 #ifdef MP4_FORMAT    
-    else if (R2F_FMT_MP4 == fmt)
+    else if (R2F_FMT_IS_MP4(fmt))
     {
         return "mp4";
     }
@@ -1139,72 +1447,210 @@ BOOL r2f_filepath(const char * url, const char * cfgpath, int fmt, char * filepa
     return TRUE;
 }
 
+/**
+ * Return TRUE if a limit of the segment policy is reached, the counters are
+ * maintained by r2f_switch_mark from the recorded frames
+ */
 BOOL r2f_switch_check(RUA * p_rua)
 {
-    uint64 tlen = 0;
+    return p_rua->pol_st.due;
+}
 
-    if (p_rua->filefmt == R2F_FMT_AVI)
+/**
+ * Snapshot the stream parameters of the current segment, the next segment
+ * is opened with them
+ */
+static void r2f_seg_get(RUA * p_rua, R2FSEG * p_seg)
+{
+    memset(p_seg, 0, sizeof(R2FSEG));
+
+    p_seg->filefmt = p_rua->filefmt;
+
+    if (R2F_FMT_AVI == p_rua->filefmt)
     {
         AVICTX * p_ctx = p_rua->avictx;
-        tlen = ftell(p_ctx->f);
+
+        p_seg->sync_mode = p_rua->sync_mode;
+        p_seg->sync_ms = p_rua->sync_ms;
+        p_seg->ctxf_video = p_ctx->ctxf_video;
+        p_seg->ctxf_audio = p_ctx->ctxf_audio;
+
+        if (p_ctx->ctxf_video)
+        {
+            p_seg->ctxf_sps_f = p_ctx->ctxf_sps_f;
+            p_seg->v_fps = p_ctx->v_fps;
+            p_seg->v_width = p_ctx->v_width;
+            p_seg->v_height = p_ctx->v_height;
+            memcpy(p_seg->v_fcc, p_ctx->v_fcc, 4);
+        }
+
+        if (p_ctx->ctxf_audio)
+        {
+            p_seg->a_chns = p_ctx->a_chns;
+            p_seg->a_rate = p_ctx->a_rate;
+            p_seg->a_fmt = p_ctx->a_fmt;
+            p_seg->a_extra = p_ctx->a_extra;
+            p_seg->a_extra_len = p_ctx->a_extra_len;
+        }
     }
-#ifdef MP4_FORMAT    
-    else if (p_rua->filefmt == R2F_FMT_MP4)
+#ifdef MP4_FORMAT
+    else if (R2F_FMT_IS_MP4(p_rua->filefmt))
     {
         MP4CTX * p_ctx = p_rua->mp4ctx;
-        tlen = gf_isom_get_file_size(p_ctx->handler);
+
+        p_seg->frag_ms = g_r2f_cfg.mp4_frag_ms;
+        p_seg->sync_mode = p_rua->sync_mode;
+        p_seg->sync_ms = p_rua->sync_ms;
+        p_seg->ctxf_video = p_ctx->ctxf_video;
+        p_seg->ctxf_audio = p_ctx->ctxf_audio;
+        p_seg->v_clock = p_ctx->v_ts.clock;
+        p_seg->a_clock = p_ctx->a_ts.clock;
+
+        if (p_ctx->ctxf_video)
+        {
+            p_seg->ctxf_sps_f = p_ctx->ctxf_sps_f;
+            p_seg->v_fps = p_ctx->v_fps;
+            p_seg->v_width = p_ctx->v_width;
+            p_seg->v_height = p_ctx->v_height;
+            memcpy(p_seg->v_fcc, p_ctx->v_fcc, 4);
+        }
+
+        if (p_ctx->ctxf_audio)
+        {
+            p_seg->a_chns = p_ctx->a_chns;
+            p_seg->a_rate = p_ctx->a_rate;
+            p_seg->a_fmt = p_ctx->a_fmt;
+            p_seg->a_extra = p_ctx->a_extra;
+            p_seg->a_extra_len = p_ctx->a_extra_len;
+        }
     }
 #endif
 
-    // Switch according to the recording size
-    if (p_rua->recordsize > 0 && tlen > (long)p_rua->recordsize * 1024)
+    // the size of the current sps, it changes at a segment switch
+    if (p_seg->ctxf_video && p_rua->pset.width && p_rua->pset.height)
     {
-        return TRUE;
+        p_seg->v_width = p_rua->pset.width;
+        p_seg->v_height = p_rua->pset.height;
     }
+}
+
+/**
+ * Open the next segment in the background once the stream is analyzed,
+ * so the switch does not wait for the file creation and the header
+ */
+static void r2f_switch_prepare(RUA * p_rua)
+{
+    int len;
 
-    // Switch according to the recording duration
-    if (p_rua->recordtime > 0 && time(NULL) - p_rua->starttime > p_rua->recordtime)
+    if (R2F_NEXT_NONE != p_rua->next.state)
     {
-        return TRUE;
+        return;
     }
- 
-    return FALSE;
-}
 
-void r2f_file_switch(RUA * p_rua)
-{
-    if (p_rua->filefmt == R2F_FMT_AVI)
+    if (R2F_FMT_AVI == p_rua->filefmt)
     {
-        AVICTX * p_ctx;
-        AVICTX * p_oldctx = p_rua->avictx;
-        
-        r2f_filepath(p_rua->url, p_rua->cfgpath, p_rua->filefmt, p_rua->savepath, sizeof(p_rua->savepath)-1);
+        AVICTX * p_ctx = p_rua->avictx;
 
-        log_print(HT_LOG_DBG, "%s, filepath\r\n", __FUNCTION__, p_rua->savepath);
-        
-        p_ctx = avi_write_open(p_rua->savepath);
-        if (NULL == p_ctx)
+        if (p_ctx->ctxf_video && (p_ctx->v_fps == 0 || p_ctx->v_width == 0 || p_ctx->v_height == 0))
         {
             return;
         }
-     
-        p_ctx->ctxf_video = p_oldctx->ctxf_video;
-        p_ctx->ctxf_audio = p_oldctx->ctxf_audio;
-     
-        if (p_ctx->ctxf_video)
+    }
+#ifdef MP4_FORMAT
+    else if (R2F_FMT_IS_MP4(p_rua->filefmt))
+    {
+        MP4CTX * p_ctx = p_rua->mp4ctx;
+
+        if (p_ctx->ctxf_video && (p_ctx->v_fps == 0 || p_ctx->v_width == 0 || p_ctx->v_height == 0))
         {
-            p_ctx->ctxf_sps_f = p_oldctx->ctxf_sps_f;
-            avi_set_video_info(p_ctx, p_oldctx->v_fps, p_oldctx->v_width, p_oldctx->v_height, p_oldctx->v_fcc);
+            return;
         }
-     
-        if (p_ctx->ctxf_audio)
+    }
+#endif
+
+    r2f_seg_get(p_rua, &p_rua->next.seg);
+
+    r2f_filepath(p_rua->url, p_rua->cfgpath, p_rua->filefmt, p_rua->next.path, sizeof(p_rua->next.path)-8);
+
+    // renamed to the segment name at the switch
+    len = strlen(p_rua->next.path);
+    snprintf(p_rua->next.path + len, sizeof(p_rua->next.path) - len, ".next");
+
+    r2f_final_open(&p_rua->next);
+}
+
+/**
+ * Called after every frame with its length. Once a limit of the policy is reached
+ * the switch is taken in front of the next video key frame, so every segment starts
+ * decodable and no frame is lost in between. Audio only streams switch right away
+ */
+void r2f_switch_mark(RUA * p_rua, uint32 len, BOOL key)
+{
+    BOOL video = FALSE;
+
+    if (!r2f_policy_frame(&p_rua->pol_st, len, key))
+    {
+        r2f_switch_prepare(p_rua);
+        return;
+    }
+
+    if (R2F_FMT_AVI == p_rua->filefmt)
+    {
+        video = p_rua->avictx->ctxf_video;
+    }
+#ifdef MP4_FORMAT
+    else if (R2F_FMT_IS_MP4(p_rua->filefmt))
+    {
+        video = p_rua->mp4ctx->ctxf_video;
+    }
+#endif
+
+    if (!video)
+    {
+        r2f_file_switch(p_rua);
+    }
+}
+
+void r2f_file_switch(RUA * p_rua)
+{
+    R2FSEG seg;
+    void * p_newctx;
+
+    r2f_seg_get(p_rua, &seg);
+
+    r2f_filepath(p_rua->url, p_rua->cfgpath, p_rua->filefmt, p_rua->savepath, sizeof(p_rua->savepath)-1);
+
+    log_print(HT_LOG_DBG, "%s, filepath %s\r\n", __FUNCTION__, p_rua->savepath);
+
+    p_newctx = r2f_final_take(&p_rua->next, &seg);
+    if (p_newctx)
+    {
+        // opened ahead under the temporary name
+        if (rename(p_rua->next.path, p_rua->savepath) != 0)
         {
-            avi_set_audio_info(p_ctx, p_oldctx->a_chns, p_oldctx->a_rate, p_oldctx->a_fmt, p_oldctx->a_extra, p_oldctx->a_extra_len);
+            log_print(HT_LOG_WARN, "%s, rename %s failed\r\n", __FUNCTION__, p_rua->next.path);
+            strncpy(p_rua->savepath, p_rua->next.path, sizeof(p_rua->savepath)-1);
         }
-        
-        avi_write_close(p_oldctx);
-     
-        avi_update_header(p_ctx);
+    }
+    else
+    {
+        p_newctx = r2f_seg_open(&seg, p_rua->savepath);
+        if (NULL == p_newctx)
+        {
+            return;
+        }
+    }
+
+    r2f_policy_start(&p_rua->pol_st, &p_rua->policy);
+
+    if (p_rua->filefmt == R2F_FMT_AVI)
+    {
+        AVICTX * p_ctx = (AVICTX *)p_newctx;
+
+        strncpy(p_ctx->filename, p_rua->savepath, sizeof(p_ctx->filename)-1);
+
+        // the index is written in the background, the new segment starts now
+        r2f_final_avi(p_rua->avictx);
 
         if (p_ctx->ctxf_video)
         {
@@ -1264,38 +1710,14 @@ void r2f_file_switch(RUA * p_rua)
         p_rua->avictx = p_ctx;
     }
 #ifdef MP4_FORMAT    
-    else if (p_rua->filefmt == R2F_FMT_MP4)
+    else if (R2F_FMT_IS_MP4(p_rua->filefmt))
     {
-        MP4CTX * p_ctx;
-        MP4CTX * p_oldctx = p_rua->mp4ctx;
-        
-        r2f_filepath(p_rua->url, p_rua->cfgpath, p_rua->filefmt, p_rua->savepath, sizeof(p_rua->savepath)-1);
+        MP4CTX * p_ctx = (MP4CTX *)p_newctx;
 
-        log_print(HT_LOG_DBG, "%s, filepath\r\n", __FUNCTION__, p_rua->savepath);
-        
-        p_ctx = mp4_write_open(p_rua->savepath);
-        if (NULL == p_ctx)
-        {
-            return;
-        }
-     
-        p_ctx->ctxf_video = p_oldctx->ctxf_video;
-        p_ctx->ctxf_audio = p_oldctx->ctxf_audio;
-     
-        if (p_ctx->ctxf_video)
-        {
-            p_ctx->ctxf_sps_f = p_oldctx->ctxf_sps_f;
-            mp4_set_video_info(p_ctx, p_oldctx->v_fps, p_oldctx->v_width, p_oldctx->v_height, p_oldctx->v_fcc);
-        }
-     
-        if (p_ctx->ctxf_audio)
-        {
-            mp4_set_audio_info(p_ctx, p_oldctx->a_chns, p_oldctx->a_rate, p_oldctx->a_fmt, p_oldctx->a_extra, p_oldctx->a_extra_len);
-        }
-        
-        mp4_write_close(p_oldctx);
-     
-        mp4_update_header(p_ctx);
+        strncpy(p_ctx->filename, p_rua->savepath, sizeof(p_ctx->filename)-1);
+
+        // the moov is written in the background, the new segment starts now
+        r2f_final_mp4(p_rua->mp4ctx);
 
         if (p_ctx->ctxf_video)
         {
@@ -1312,8 +1734,8 @@ void r2f_file_switch(RUA * p_rua)
                     
                     if (p_rtsp->get_h264_params(sps, &sps_len, pps, &pps_len))
                     {
-                        mp4_write_video(p_ctx, sps, sps_len, 0);
-                        mp4_write_video(p_ctx, pps, pps_len, 0);
+                        mp4_write_video(p_ctx, sps, sps_len, 0, 0);
+                        mp4_write_video(p_ctx, pps, pps_len, 0, 0);
                     }
                 }
 #ifdef RTMP_STREAM                
@@ -1323,8 +1745,8 @@ void r2f_file_switch(RUA * p_rua)
                     
                     if (p_rtmp->get_h264_params(sps, &sps_len, pps, &pps_len))
                     {
-                        mp4_write_video(p_ctx, sps, sps_len, 0);
-                        mp4_write_video(p_ctx, pps, pps_len, 0);
+                        mp4_write_video(p_ctx, sps, sps_len, 0, 0);
+                        mp4_write_video(p_ctx, pps, pps_len, 0, 0);
                     }
                 }
 #endif                
@@ -1344,9 +1766,9 @@ void r2f_file_switch(RUA * p_rua)
                     
                     if (p_rtsp->get_h265_params(sps, &sps_len, pps, &pps_len, vps, &vps_len))
                     {
-                        mp4_write_video(p_ctx, sps, sps_len, 0);
-                        mp4_write_video(p_ctx, pps, pps_len, 0);
-                        mp4_write_video(p_ctx, vps, vps_len, 0);
+                        mp4_write_video(p_ctx, sps, sps_len, 0, 0);
+                        mp4_write_video(p_ctx, pps, pps_len, 0, 0);
+                        mp4_write_video(p_ctx, vps, vps_len, 0, 0);
                     }
                 }
             }
@@ -1364,6 +1786,51 @@ void r2f_file_switch(RUA * p_rua)
     log_print(HT_LOG_DBG, "%s, exit\r\n", __FUNCTION__);
 }
 
+/**
+ * Apply the event recording state to the frame, return TRUE if the frame 
+ * is held for the next event instead of being written. An event writes
+ * the held frames first, its end switches the segment at the key frame
+ */
+BOOL r2f_record_hold(RUA * p_rua, int type, BOOL key)
+{
+    int act;
+    R2FEFRM frm;
+
+    act = r2f_event_frame(&p_rua->event, type, key);
+    if (R2F_EVT_WRITE == act)
+    {
+        return FALSE;
+    }
+    else if (R2F_EVT_FLUSH == act)
+    {
+        // the segment starts with the event
+        r2f_policy_start(&p_rua->pol_st, &p_rua->policy);
+
+        // the held frames have been through the event state already
+        while (r2f_event_get(&p_rua->event, &frm))
+        {
+            if (R2F_EF_VIDEO == frm.type)
+            {
+                r2f_write_video(p_rua, frm.p_buf, frm.len, frm.ts, frm.key);
+            }
+            else
+            {
+                r2f_write_audio(p_rua, frm.p_buf, frm.len, frm.ts);
+            }
+
+            r2f_event_free(&frm);
+        }
+
+        return FALSE;
+    }
+    else if (R2F_EVT_END == act)
+    {
+        r2f_file_switch(p_rua);
+    }
+
+    return TRUE;
+}
+
 BOOL r2f_init(STREAM2FILE * p_r2f)
 {
     BOOL ret = FALSE;
@@ -1382,6 +1849,13 @@ BOOL r2f_init(STREAM2FILE * p_r2f)
     p_rua->framerate = p_r2f->framerate;
     p_rua->recordsize = p_r2f->recordsize;
     p_rua->recordtime = p_r2f->recordtime;
+    r2f_policy_set(&p_rua->policy, p_r2f->recordsize, p_r2f->recordtime, 
+        p_r2f->recordwall, p_r2f->recordgops, p_r2f->recordpredict);
+    r2f_policy_start(&p_rua->pol_st, &p_rua->policy);
+    r2f_event_set(&p_rua->event, p_r2f->recordmode, p_r2f->preroll, p_r2f->postroll, p_r2f->eventmeta);
+    r2f_pset_init(&p_rua->pset);
+    p_rua->sync_mode = p_r2f->sync_mode;
+    p_rua->sync_ms = p_r2f->sync_ms;
 
     if (memcmp(p_rua->url, "rtsp://", 7) == 0)
     {
@@ -1425,9 +1899,11 @@ BOOL r2f_init(STREAM2FILE * p_r2f)
             log_print(HT_LOG_ERR, "%s, avi_write_open failed. %s\r\n", __FUNCTION__, p_rua->savepath);
             return FALSE;
         }
+
+        avi_write_set_sync(p_rua->avictx, p_rua->sync_mode, p_rua->sync_ms);
     }
 #ifdef MP4_FORMAT    
-    else if (R2F_FMT_MP4 == p_rua->filefmt)
+    else if (R2F_FMT_IS_MP4(p_rua->filefmt))
     {
         p_rua->mp4ctx = mp4_write_open(p_rua->savepath);
         if (NULL == p_rua->mp4ctx)
@@ -1437,6 +1913,18 @@ BOOL r2f_init(STREAM2FILE * p_r2f)
             log_print(HT_LOG_ERR, "%s, mp4_write_open failed. %s\r\n", __FUNCTION__, p_rua->savepath);
             return FALSE;
         }
+
+        if (R2F_FMT_FMP4 == p_rua->filefmt)
+        {
+            mp4_write_set_fragment(p_rua->mp4ctx, g_r2f_cfg.mp4_frag_ms);
+            mp4_write_set_sync(p_rua->mp4ctx, p_rua->sync_mode, p_rua->sync_ms);
+        }
+
+        if (p_rua->rtmp_flag)
+        {
+            // the rtmp timestamps are in milliseconds
+            mp4_set_timestamp_clock(p_rua->mp4ctx, 1000, 1000);
+        }
     }
 #endif    
     else
@@ -1469,7 +1957,7 @@ BOOL r2f_init(STREAM2FILE * p_r2f)
             avi_write_close(p_rua->avictx);
         }
 #ifdef MP4_FORMAT        
-        else if (R2F_FMT_MP4 == p_rua->filefmt)
+        else if (R2F_FMT_IS_MP4(p_rua->filefmt))
         {
             mp4_write_close(p_rua->mp4ctx);
         }
@@ -1503,6 +1991,13 @@ BOOL r2f_init_ex(STREAM2FILE* p_r2f,char * strfilename, int pnum)
     p_rua->framerate = p_r2f->framerate;
     p_rua->recordsize = p_r2f->recordsize;
     p_rua->recordtime = p_r2f->recordtime;
+    r2f_policy_set(&p_rua->policy, p_r2f->recordsize, p_r2f->recordtime, 
+        p_r2f->recordwall, p_r2f->recordgops, p_r2f->recordpredict);
+    r2f_policy_start(&p_rua->pol_st, &p_rua->policy);
+    r2f_event_set(&p_rua->event, p_r2f->recordmode, p_r2f->preroll, p_r2f->postroll, p_r2f->eventmeta);
+    r2f_pset_init(&p_rua->pset);
+    p_rua->sync_mode = p_r2f->sync_mode;
+    p_rua->sync_ms = p_r2f->sync_ms;
     p_rua->pnum = pnum;
 
     if (memcmp(p_rua->url, "rtsp://", 7) == 0)
@@ -1536,7 +2031,13 @@ BOOL r2f_init_ex(STREAM2FILE* p_r2f,char * strfilename, int pnum)
         log_print(HT_LOG_ERR, "%s, r2f_filepath failed\r\n", __FUNCTION__);
         return FALSE;
     }
-    strcpy(p_rua->savepath, strfilename);
+
+    // the caller names the file, otherwise the generated path
+    if (strfilename && strfilename[0] != '\0')
+    {
+        strncpy(p_rua->savepath, strfilename, sizeof(p_rua->savepath) - 1);
+    }
+
     if (R2F_FMT_AVI == p_rua->filefmt)
     {
         p_rua->avictx = avi_write_open(p_rua->savepath);
@@ -1547,9 +2048,11 @@ BOOL r2f_init_ex(STREAM2FILE* p_r2f,char * strfilename, int pnum)
             log_print(HT_LOG_ERR, "%s, avi_write_open failed. %s\r\n", __FUNCTION__, p_rua->savepath);
             return FALSE;
         }
+
+        avi_write_set_sync(p_rua->avictx, p_rua->sync_mode, p_rua->sync_ms);
     }
 #ifdef MP4_FORMAT    
-    else if (R2F_FMT_MP4 == p_rua->filefmt)
+    else if (R2F_FMT_IS_MP4(p_rua->filefmt))
     {
         p_rua->mp4ctx = mp4_write_open(p_rua->savepath);
         if (NULL == p_rua->mp4ctx)
@@ -1559,6 +2062,18 @@ BOOL r2f_init_ex(STREAM2FILE* p_r2f,char * strfilename, int pnum)
             log_print(HT_LOG_ERR, "%s, mp4_write_open failed. %s\r\n", __FUNCTION__, p_rua->savepath);
             return FALSE;
         }
+
+        if (R2F_FMT_FMP4 == p_rua->filefmt)
+        {
+            mp4_write_set_fragment(p_rua->mp4ctx, g_r2f_cfg.mp4_frag_ms);
+            mp4_write_set_sync(p_rua->mp4ctx, p_rua->sync_mode, p_rua->sync_ms);
+        }
+
+        if (p_rua->rtmp_flag)
+        {
+            // the rtmp timestamps are in milliseconds
+            mp4_set_timestamp_clock(p_rua->mp4ctx, 1000, 1000);
+        }
     }
 #endif    
     else
@@ -1591,7 +2106,7 @@ BOOL r2f_init_ex(STREAM2FILE* p_r2f,char * strfilename, int pnum)
             avi_write_close(p_rua->avictx);
         }
 #ifdef MP4_FORMAT        
-        else if (R2F_FMT_MP4 == p_rua->filefmt)
+        else if (R2F_FMT_IS_MP4(p_rua->filefmt))
         {
             mp4_write_close(p_rua->mp4ctx);
         }
@@ -1607,13 +2122,173 @@ BOOL r2f_init_ex(STREAM2FILE* p_r2f,char * strfilename, int pnum)
 
     return r2f_rua_start(p_rua);
 }
-#define DB_ADDRESS "127.0.0.1"
 
-#define DB_ID "root"
+/**
+ * Stop the stream, close the files and free the RUA
+ */
+static void r2f_rua_close(RUA * p_rua)
+{
+    if (p_rua->rtsp)
+    {
+        p_rua->rtsp->rtsp_close();
+
+        // the queued frames are written before the client goes away
+        r2f_writer_detach(p_rua);
+        
+        delete p_rua->rtsp;
+        p_rua->rtsp = NULL;
+    }
+
+#ifdef RTMP_STREAM
+    if (p_rua->rtmp)
+    {
+        p_rua->rtmp->rtmp_close();
+        r2f_writer_detach(p_rua);
+        delete p_rua->rtmp;
+        p_rua->rtmp = NULL;
+    }
+#endif
+
+    if (p_rua->avictx)
+    {
+        avi_write_close(p_rua->avictx);
+        p_rua->avictx = NULL;
+    }
+
+#ifdef MP4_FORMAT
+    if (p_rua->mp4ctx)
+    {
+        mp4_write_close(p_rua->mp4ctx);
+        p_rua->mp4ctx = NULL;
+    }
+#endif
+
+    r2f_final_drop(&p_rua->next);
+
+    // no event was recorded since the last switch
+    if (r2f_event_stop(&p_rua->event))
+    {
+        remove(p_rua->savepath);
+    }
+
+    rua_set_idle(p_rua);
+}
+
+static RUA * r2f_rua_by_pnum(int pnum)
+{
+    uint32 i;
+
+    for (i = 0; i < MAX_NUM_RUA; i++)
+    {
+        RUA * p_rua = rua_get_by_index(i);
+
+        if (NULL != p_rua && p_rua->used_flag && p_rua->pnum == pnum)
+        {
+            return p_rua;
+        }
+    }
+
+    return NULL;
+}
+
+static int r2f_cmd_record(R2FCMD * p_cmd)
+{
+    STREAM2FILE r2f;
+
+    if (r2f_rua_by_pnum(p_cmd->pnum))
+    {
+        log_print(HT_LOG_WARN, "%s, %d is already recording\r\n", __FUNCTION__, p_cmd->pnum);
+        return R2F_CMD_EXISTS;
+    }
+
+    memset(&r2f, 0, sizeof(r2f));
+
+    strncpy(r2f.url, p_cmd->url, sizeof(r2f.url) - 1);
+    strncpy(r2f.user, p_cmd->user, sizeof(r2f.user) - 1);
+    strncpy(r2f.pass, p_cmd->pass, sizeof(r2f.pass) - 1);
+    r2f.filefmt = p_cmd->filefmt;
+
+    if (!r2f_init_ex(&r2f, p_cmd->file, p_cmd->pnum))
+    {
+        log_print(HT_LOG_ERR, "%s, r2f_init failed, %s\r\n", __FUNCTION__, r2f.url);
+        return R2F_CMD_ERR;
+    }
+
+    log_print(HT_LOG_INFO, "%s, %d record process is started\r\n", __FUNCTION__, p_cmd->pnum);
+    printf("[%s],%d record process is started \n", __FUNCTION__, p_cmd->pnum);
+
+    return R2F_CMD_OK;
+}
+
+static int r2f_cmd_stop(RUA * p_rua, R2FCMD * p_cmd)
+{
+    time_t rawtime;
+    struct tm * dt;
+    uint32 s_time = 0;
+
+    if (p_rua->avictx)
+    {
+        s_time = p_rua->avictx->s_time;
+    }
+#ifdef MP4_FORMAT
+    else if (p_rua->mp4ctx)
+    {
+        s_time = p_rua->mp4ctx->s_time;
+    }
+#endif
+
+    log_print(HT_LOG_INFO, "%s, %s\r\n", __FUNCTION__, p_rua->savepath);
+
+    r2f_rua_close(p_rua);
+
+    rawtime = (time_t)s_time;
+    dt = localtime(&rawtime);
+    if (dt)
+    {
+        log_print(HT_LOG_INFO, "%s, %d record process is terminated, start time is [%d:%d:%d]\r\n",
+            __FUNCTION__, p_cmd->pnum, dt->tm_hour, dt->tm_min, dt->tm_sec);
+        printf("[%s],%d record process is terminated, start time is [%d:%d:%d]\n",
+            __FUNCTION__, p_cmd->pnum, dt->tm_hour, dt->tm_min, dt->tm_sec);
+    }
+
+    p_cmd->s_time = s_time;
+
+    return R2F_CMD_OK;
+}
+
+int r2f_cmd_exec(R2FCMD * p_cmd)
+{
+    RUA * p_rua;
+
+    if (R2F_CMD_RECORD == p_cmd->cmd)
+    {
+        return r2f_cmd_record(p_cmd);
+    }
+
+    p_rua = r2f_rua_by_pnum(p_cmd->pnum);
+    if (NULL == p_rua)
+    {
+        log_print(HT_LOG_WARN, "%s, %d is not recording\r\n", __FUNCTION__, p_cmd->pnum);
+        return R2F_CMD_NOTFOUND;
+    }
+
+    if (R2F_CMD_EVENT == p_cmd->cmd)
+    {
+        if (!r2f_event_trigger(&p_rua->event, p_cmd->post))
+        {
+            log_print(HT_LOG_WARN, "%s, %d is not in event recording mode\r\n", __FUNCTION__, p_rua->pnum);
+            return R2F_CMD_ERR;
+        }
 
-#define DB_PASS "apmsetup"
+        return R2F_CMD_OK;
+    }
+    else if (R2F_CMD_STOP == p_cmd->cmd)
+    {
+        return r2f_cmd_stop(p_rua, p_cmd);
+    }
 
-#define DB_NAME "simprec_use"
+    return R2F_CMD_ERR;
+}
 
 BOOL r2f_start()
 {
@@ -1628,6 +2303,7 @@ BOOL r2f_start()
 	{
 		log_init("stream2file.log");
 		log_set_level(g_r2f_cfg.log_level);
+		log_set_rotate((uint32)g_r2f_cfg.log_rotate_size * 1024 * 1024, (uint32)g_r2f_cfg.log_rotate_time * 60);
 	}
 
 	g_r2f_cls.msg_queue = hqCreate(10, sizeof(RIMG), HQ_GET_WAIT | HQ_PUT_WAIT);
@@ -1641,229 +2317,43 @@ BOOL r2f_start()
 	g_r2f_cls.tid_task = sys_os_create_thread((void *)r2f_task_thread, NULL);
 
     sys_buf_init(4 * MAX_NUM_RUA);
+    frm_buf_init(g_r2f_cfg.frame_buf_max * 1024);
+    hfio_init(g_r2f_cfg.fio_backend, g_r2f_cfg.fio_direct, g_r2f_cfg.avi_buf_size * 1024, 
+        g_r2f_cfg.fio_blocks > 0 ? g_r2f_cfg.fio_blocks : HFIO_BLKS_DEF);
+    avi_write_set_sync_def(g_r2f_cfg.avi_sync, g_r2f_cfg.avi_sync_ms);
+#ifdef MP4_FORMAT
+    mp4_write_set_faststart_def(g_r2f_cfg.mp4_moov_reserve * 1024);
+    mp4_write_set_sync_def(g_r2f_cfg.avi_sync, g_r2f_cfg.avi_sync_ms);
+#endif
+    rtp_pkt_buf_init(64 * MAX_NUM_RUA);
+    r2f_writer_init(g_r2f_cfg.writer_threads, g_r2f_cfg.write_queue_depth);
+    r2f_final_init(g_r2f_cfg.final_threads, g_r2f_cfg.final_queue_depth);
     rtsp_msg_buf_init(4 * MAX_NUM_RUA);
 	rua_proxy_init();
 
+    if (!hreactor_init(g_r2f_cfg.rx_threads))
+    {
+        log_print(HT_LOG_INFO, "%s, event loop not available, use rx threads\r\n", __FUNCTION__);
+    }
+
 #ifdef RTMP_STREAM
     rtmp_set_rtmp_log();
 #endif
-    // TEST CODE for record Server
-    MYSQL mysql;
-    MYSQL_RES* m_Res;
-    MYSQL_ROW row;
-    char daytime[100];
-    char dbip[20];
-    char start[3];
-    char end[3];
-    char fps[3];
-    char fname[256];
-    TCHAR DBIP[20] = { 0 };
-    TCHAR START[3] = { 0 };
-    TCHAR END[3] = { 0 };
-    TCHAR BACKUP[3] = { 0 };
-    TCHAR FPS[3] = { 0 };
-    char query[256];
-    int backup = 0;
-    int len = 20;
-    int m_num, m_process[1024], m_pnum;
-    int m_fps;
-    m_num = 0;
-    m_pnum = 0;
-    TCHAR strPathIni[100] = TEXT(".\\simprec.ini");
-
-    ::GetPrivateProfileString(_T("SectionA"), _T("Server"), _T("127.0.0.1"), DBIP, 20, strPathIni);
-    ::GetPrivateProfileString(_T("SectionA"), _T("Start"), _T("1"), START, 3, strPathIni);
-    ::GetPrivateProfileString(_T("SectionA"), _T("End"), _T("6"), END, 3, strPathIni);
-    ::GetPrivateProfileString(_T("SectionA"), _T("Backup"), _T("0"), BACKUP, 3, strPathIni);
-    ::GetPrivateProfileString(_T("SectionA"), _T("FPS"), _T("25"), FPS, 3, strPathIni);
-    printf("Server IP [%S] ROOM[%S-%S] BACKUP[%S] FPS[%S] \n", DBIP, START, END, BACKUP, FPS);
-    mysql_init(&mysql);
-    WideCharToMultiByte(CP_ACP, 0, DBIP, 20, dbip, len, NULL, NULL);
-    WideCharToMultiByte(CP_ACP, 0, START, 3, start, len, NULL, NULL);
-    WideCharToMultiByte(CP_ACP, 0, END, 3, end, len, NULL, NULL);
-    WideCharToMultiByte(CP_ACP, 0, FPS, 3, fps, len, NULL, NULL);
-    m_fps = atoi(fps);
-    if (!mysql_real_connect(&mysql, dbip, DB_ID, DB_PASS, DB_NAME, 3306, 0, 0))
-    {
-        log_print(HT_LOG_ERR, "%s, mysql connect  failed,\r\n", __FUNCTION__);
-
-    }
-    if (_tcscmp(BACKUP, _T("1")) == 0)
-    {
-        sprintf_s(query, "select SEQ,CMD,ARG,NO,STATUS from cmdq where STATUS='B' AND room >=%s AND room <=%s ORDER BY SEQ", start, end);
-        backup = 1;
-    }
-    else
-        sprintf_s(query, "select SEQ,CMD,ARG,NO,STATUS,ARG2 from cmdq where STATUS='Y' AND room >=%s AND room <=%s ORDER BY SEQ", start, end);
-    while (1)
+    // the streams are started and stopped by the command sources
+    if (g_r2f_cfg.api_port > 0 || g_r2f_cfg.api_unix[0] != '\0')
     {
-        if (mysql_query(&mysql, query))
-        {	//  û
-            // return;
-        }
-        m_Res = mysql_store_result(&mysql);
-        if (m_Res != NULL)
-            while ((row = mysql_fetch_row(m_Res)) != NULL)
-            {
-                try
-                {
-                    if (strcmp(row[1], "RECORD") == 0)
-                    {
-                        char rtspcmd[512];// = TEXT(row[2]);
-                        char filename[256];
-                        sprintf(rtspcmd, "%s", row[2]);
-                        // char* address[, adress2[256], user[256], passwdip[256], fileparam[256], file, filename;
-                        char* cmd, * cmd2, * cmd3, * address, user[50], passwordip[256], password2[256], * pass, * password, * add, address2[512], * fname, fname2[256];
-                        // cmd = strtok(rtspcmd, " ");
-                        address = rtspcmd;
-                        /*                   address = strtok(NULL, " ");
-                                           address = strtok(NULL, " ");
-                                           filename = strtok(NULL, " ");
-                                           filename = strtok(NULL, " ");
-                                           filename = strtok(NULL, " ");
-                                           filename = strtok(NULL, " ");
-                                           filename = strtok(NULL, " ");
-                                           filename = strtok(NULL, " ");
-                                           filename = strtok(NULL, " ");
-                                           filename = strtok(NULL, " ");*/
-                        sprintf_s(filename, "%s", row[5]);
-                        //   filename = strtok(NULL, " ");
-                       //    address = strtok(NULL, " ");
-                        sprintf(passwordip, "%s", address);
-                        password = strtok(passwordip, ":");
-                        password = strtok(NULL, ":");
-                        sprintf(user, "%s", password);
-                        password = strtok(NULL, ":");
-                        sprintf(password2, "%s", password);
-                        sprintf(passwordip, "%s", address);
-                        pass = strtok(password2, "@");
-                        add = strtok(passwordip, "@");
-                        add = strtok(NULL, " ");
-                        // opt = strtok(NULL, " ");
-                        sprintf(address2, "rtsp://%s", add);
-                        //  m_process[m_num] = atoi(row[3]);
-                        STREAM2FILE* testr2f;
-                        testr2f = (STREAM2FILE*)malloc(sizeof(STREAM2FILE));
-                        memset(testr2f, 0, sizeof(STREAM2FILE));
-                        strncpy(testr2f->url, address2, sizeof(testr2f->url) - 1);
-                        strncpy(testr2f->user, user + 2, sizeof(testr2f->user) - 1);
-                        strncpy(testr2f->pass, pass, sizeof(testr2f->pass) - 1);
-                        strncpy(testr2f->savepath, "", sizeof(testr2f->savepath) - 1);
-                        testr2f->filefmt = R2F_FMT_MP4;
-                        testr2f->framerate = 0;
-                        testr2f->recordsize = 0;
-                        testr2f->recordtime = 0;
-                        uint32 i = 0;
-                        for (int i = 0; i < strlen(filename); i++)
-                        {
-                            if (filename[i] == '/')
-                                filename[i] = '\\';
-                        }
-                        // fname = strtok(filename, ".");
-                        sprintf(fname2, "%s", filename);
-                        if (!r2f_init_ex(testr2f, fname2, atoi(row[3])))
-                        {
-                            log_print(HT_LOG_ERR, "%s, r2f_init failed, %s\r\n", __FUNCTION__, testr2f->url);
-                        }
-                        log_print(HT_LOG_INFO, "[%s],%d record process is started \n", __FUNCTION__, atoi(row[3]));
-                        printf("[%s],%d record process is started \n", __FUNCTION__, atoi(row[3]));
-                        char sqlcmd[256];
-                        sprintf_s(sqlcmd, "UPDATE cmdq SET STATUS = 'N' where seq=%s", row[0]);
-                        mysql_query(&mysql, sqlcmd);
-                    }
-                    else
-                    {
-                        int fnum = -1;
-                        uint32 i = 0;
-                        for (i = 0; i < MAX_NUM_RUA; i++)
-                        {
-                            RUA* p_rua = rua_get_by_index(i);
-                            time_t rawtime;
-                            long mov_no;
-
-
-                            if (NULL != p_rua && p_rua->pnum == atoi(row[3]))
-                            {
-                                fnum = i;
-                                rawtime = (const time_t)p_rua->mp4ctx->s_time;
-                                mov_no = p_rua->mp4ctx->s_time;
-
-                                if (p_rua->rtsp)
-                                {
-                                    p_rua->rtsp->rtsp_close();
-                                    delete p_rua->rtsp;
-                                    p_rua->rtsp = NULL;
-                                }
-                                if (p_rua->avictx)
-                                {
-                                    avi_write_close(p_rua->avictx);
-                                    p_rua->avictx = NULL;
-                                }
-                                if (p_rua->mp4ctx)
-                                {
-                                    mp4_write_close(p_rua->mp4ctx);
-
-                                }
-
-                                struct tm* dt;
-                                char timestr[30];
-                                char buffer[30];
-
-                                p_rua->mp4ctx = NULL;
-                                dt = localtime(&rawtime);
-                                // use any strftime format spec here
-                               // strftime(timestr, sizeof(timestr), "%m%d%H%M%y", dt);
-                               // sprintf(buffer, "%s", timestr);
-                                sprintf_s(fname, "%s start time is [%d:%d:%d]", p_rua->savepath, dt->tm_hour, dt->tm_min, dt->tm_sec);
-                                //cthread[threadcnt] = new thread(ConvertThread, fname);
-                               // threadcnt++;
-                                //if (threadcnt > 255) threadcnt = 0;
-                                time_t time_now;
-                                struct tm* tm;
-
-                                time(&time_now);
-                                tm = localtime(&time_now);
-
-
-                                // ConvertThread(p_rua->savepath);
-                                log_print(HT_LOG_INFO, "[%s]", fname);
-                                printf("[%s]\n", fname);
-                                log_print(HT_LOG_INFO, "[%s],[%d:%d:%d] %d record process is terminated \n", __FUNCTION__, tm->tm_hour, tm->tm_min, tm->tm_sec, p_rua->pnum);
-                                printf("[%s],[%d:%d:%d] %d record process is terminated \n", __FUNCTION__, tm->tm_hour, tm->tm_min, tm->tm_sec, p_rua->pnum);
-
-
-                                char sqlcmd[256];
-                                sprintf_s(sqlcmd, "UPDATE kn_simprec_mov SET rtsp_start=%d where no=%d", mov_no, p_rua->pnum);
-                                log_print(HT_LOG_INFO, "%s\n", sqlcmd);
-                                printf("%s\n", sqlcmd);
-                                mysql_query(&mysql, sqlcmd);
-                                rua_set_idle(p_rua);
-                                break;
-                            }
-                        }
-                        //if (fnum != -1)
-                        {
-
-                            char sqlcmd[256];
-                            sprintf_s(sqlcmd, "UPDATE cmdq SET STATUS = 'N' where seq=%s", row[0]);
-                            mysql_query(&mysql, sqlcmd);
-
-                        }
-                    }
-                }
-                catch (int exceptionCode)
-                {
-                    log_print(HT_LOG_ERR, "Error %d in command proccesing\n", exceptionCode);
-                    printf( "Error %d in command proccesing\n", exceptionCode);
-                }
-            }
-        if (m_Res)
-        {
-            mysql_free_result(m_Res);
-        }
-        Sleep(100);
-        }
+        r2f_cmd_register(r2f_api_src());
+    }
 
+#ifdef CMDQ_MYSQL
+    r2f_cmd_register(r2f_cmdq_src());
+#endif
+
+    if (!r2f_cmd_init(0))
+    {
+        log_print(HT_LOG_ERR, "%s, r2f_cmd_init failed\r\n", __FUNCTION__);
+        return FALSE;
+    }
 
     /*STREAM2FILE * p_r2f = g_r2f_cfg.r2f;
 	while (p_r2f)
@@ -1883,6 +2373,9 @@ void r2f_stop()
 {
     uint32 i = 0;
 
+    // no command may start a stream from now on
+    r2f_cmd_deinit();
+
     for (i = 0; i < MAX_NUM_RUA; i++)
     {
         RUA * p_rua = rua_get_by_index(i);
@@ -1892,37 +2385,7 @@ void r2f_stop()
             continue;
         }
 
-        if (p_rua->rtsp)
-        {
-            p_rua->rtsp->rtsp_close();
-            delete p_rua->rtsp;
-            p_rua->rtsp = NULL;
-        }
-
-#ifdef RTMP_STREAM
-        if (p_rua->rtmp)
-        {
-            p_rua->rtmp->rtmp_close();
-            delete p_rua->rtmp;
-            p_rua->rtmp = NULL;
-        }
-#endif
-
-        if (p_rua->avictx)
-        {
-            avi_write_close(p_rua->avictx);
-            p_rua->avictx = NULL;
-        }
-
-#ifdef MP4_FORMAT
-        if (p_rua->mp4ctx)
-        {
-            mp4_write_close(p_rua->mp4ctx);
-            p_rua->mp4ctx = NULL;
-        }
-#endif
-
-        rua_set_idle(p_rua);
+        r2f_rua_close(p_rua);
     }
 
     g_r2f_cls.task_flag = 0;
@@ -1944,13 +2407,19 @@ void r2f_stop()
 
     hqDelete(g_r2f_cls.msg_queue);
 
+    r2f_writer_deinit();
+    r2f_final_deinit();
+    hfio_deinit();
+    hreactor_deinit();
     rua_proxy_deinit();
+    frm_buf_deinit();
+    rtp_pkt_buf_deinit();
     sys_buf_deinit();
 	rtsp_msg_buf_deinit();
 
     r2f_free_r2fs(&g_r2f_cfg.r2f);    
 
-    log_print(HT_LOG_DBG, "r2f_stop finished\r\n");
+    log_print(HT_LOG_INFO, "r2f_stop finished, log messages dropped %u\r\n", log_get_dropped());
 
     log_close();
 }
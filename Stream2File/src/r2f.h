@@ -51,11 +51,22 @@ extern "C" {
 
 BOOL r2f_start();
 void r2f_stop();
-int  r2f_record_aac(RUA * p_rua, uint8 * pdata, int len);
-int  r2f_record_audio(RUA * p_rua, uint8 * pdata, int len);
+int  r2f_record_aac(RUA * p_rua, uint8 * pdata, int len, uint32 ts);
+int  r2f_record_audio(RUA * p_rua, uint8 * pdata, int len, uint32 ts);
 int  r2f_record_video(RUA * p_rua, uint8 * pdata, int len, uint32 ts);
+int  r2f_record_video_iov(RUA * p_rua, RTPFRMIOV * p_frm, uint32 ts);
+
+/**
+ * Write the frame past the event recording state, the caller has applied r2f_record_hold,
+ * key - the video frame starts a GOP
+ */
+int  r2f_write_audio(RUA * p_rua, uint8 * pdata, int len, uint32 ts);
+int  r2f_write_video(RUA * p_rua, uint8 * pdata, int len, uint32 ts, BOOL key);
+int  r2f_write_video_iov(RUA * p_rua, RTPFRMIOV * p_frm, uint32 ts, BOOL key);
 BOOL r2f_switch_check(RUA * p_rua); 
+void r2f_switch_mark(RUA * p_rua, uint32 len, BOOL key);
 void r2f_file_switch(RUA * p_rua);
+BOOL r2f_record_hold(RUA * p_rua, int type, BOOL key);
 
 
 #ifdef __cplusplus
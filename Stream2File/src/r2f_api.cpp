@@ -0,0 +1,970 @@
+/***************************************************************************************
+ *
+ *  IMPORTANT: READ BEFORE DOWNLOADING, COPYING, INSTALLING OR USING.
+ *
+ *  By downloading, copying, installing or using the software you agree to this license.
+ *  If you do not agree to this license, do not download, install, 
+ *  copy or use the software.
+ *
+ *  Copyright (C) 2014-2020, Happytimesoft Corporation, all rights reserved.
+ *
+ *  Redistribution and use in binary forms, with or without modification, are permitted.
+ *
+ *  Unless required by applicable law or agreed to in writing, software distributed 
+ *  under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ *  CONDITIONS OF ANY KIND, either express or implied. See the License for the specific
+ *  language governing permissions and limitations under the License.
+ *
+****************************************************************************************/
+
+
+#include "sys_inc.h"
+#include "r2f_api.h"
+#include "r2f_cfg.h"
+#include "r2f_rua.h"
+#if __LINUX_OS__
+#include <sys/un.h>
+#endif
+
+typedef struct
+{
+    uint32      run_flag    : 1;
+    uint32      reserved    : 31;
+
+    SOCKET      tcp_fd;                 // loopback listener, 0 - none
+    SOCKET      unix_fd;                // unix socket listener, 0 - none
+    pthread_t   tid;
+
+    char        req[R2F_API_REQ_MAX+1];
+    char        body[R2F_API_RSP_MAX];
+    char        rsp[R2F_API_RSP_MAX+256];   // the headers and the body
+} R2FAPI;
+
+/***********************************************************/
+
+static R2FAPI       r2f_api;
+
+/***********************************************************/
+
+static const char * r2f_json_ws(const char * p)
+{
+    while (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n')
+    {
+        p++;
+    }
+
+    return p;
+}
+
+/**
+ * Decode the json string at p (the opening quote) into out, p_long is set if it
+ * does not fit. Return the position after the closing quote, NULL on error
+ */
+static const char * r2f_json_str(const char * p, char * out, int len, BOOL * p_long)
+{
+    int off = 0;
+
+    if (*p++ != '"')
+    {
+        return NULL;
+    }
+
+    while (*p && *p != '"')
+    {
+        char c = *p++;
+
+        if (c == '\\')
+        {
+            c = *p++;
+
+            switch (c)
+            {
+            case 'b': c = '\b'; break;
+            case 'f': c = '\f'; break;
+            case 'n': c = '\n'; break;
+            case 'r': c = '\r'; break;
+            case 't': c = '\t'; break;
+            case 'u':
+                {
+                    char hex[5];
+                    uint32 u;
+
+                    if (strlen(p) < 4)
+                    {
+                        return NULL;
+                    }
+
+                    memcpy(hex, p, 4);
+                    hex[4] = '\0';
+                    u = (uint32)strtoul(hex, NULL, 16);
+                    p += 4;
+
+                    // the paths and urls are ascii
+                    c = (u > 0 && u < 0x80) ? (char)u : '?';
+                }
+                break;
+            case '"':
+            case '\\':
+            case '/':
+                break;
+            default:
+                return NULL;
+            }
+        }
+
+        if (out && off < len - 1)
+        {
+            out[off++] = c;
+        }
+        else if (out && p_long)
+        {
+            *p_long = TRUE;
+        }
+    }
+
+    if (*p != '"')
+    {
+        return NULL;
+    }
+
+    if (out)
+    {
+        out[off] = '\0';
+    }
+
+    return p + 1;
+}
+
+/**
+ * Skip the json value at p, return the position after it, NULL on error
+ */
+static const char * r2f_json_skip(const char * p)
+{
+    int depth = 0;
+
+    do
+    {
+        p = r2f_json_ws(p);
+
+        if (*p == '"')
+        {
+            p = r2f_json_str(p, NULL, 0, NULL);
+            if (NULL == p)
+            {
+                return NULL;
+            }
+        }
+        else if (*p == '{' || *p == '[')
+        {
+            depth++;
+            p++;
+        }
+        else if (*p == '}' || *p == ']')
+        {
+            if (depth == 0)
+            {
+                return NULL;
+            }
+
+            depth--;
+            p++;
+        }
+        else if (*p == ',' || *p == ':')
+        {
+            if (depth == 0)
+            {
+                return NULL;
+            }
+
+            p++;
+        }
+        else if (*p == '\0')
+        {
+            return NULL;
+        }
+        else
+        {
+            // number, true, false or null
+            while (*p && *p != ',' && *p != '}' && *p != ']' && *p != ' ' && 
+                *p != '\t' && *p != '\r' && *p != '\n')
+            {
+                p++;
+            }
+        }
+    } while (depth > 0);
+
+    return p;
+}
+
+#define R2F_JSON_NONE           0           // no such member
+#define R2F_JSON_OK             1
+#define R2F_JSON_LONG           2           // the value does not fit the buffer
+
+/**
+ * Get the member of the top level json object, a string is decoded, 
+ * a number or literal is copied as is. Return R2F_JSON_NONE ~ R2F_JSON_LONG
+ */
+static int r2f_json_get(const char * json, const char * key, char * out, int len)
+{
+    char name[32];
+    const char * p = r2f_json_ws(json);
+
+    if (*p++ != '{')
+    {
+        return R2F_JSON_NONE;
+    }
+
+    p = r2f_json_ws(p);
+    if (*p == '}')
+    {
+        return R2F_JSON_NONE;
+    }
+
+    while (p)
+    {
+        // a longer name is not one of the keys
+        p = r2f_json_str(r2f_json_ws(p), name, sizeof(name), NULL);
+        if (NULL == p)
+        {
+            return R2F_JSON_NONE;
+        }
+
+        p = r2f_json_ws(p);
+        if (*p++ != ':')
+        {
+            return R2F_JSON_NONE;
+        }
+
+        p = r2f_json_ws(p);
+
+        if (strcmp(name, key) == 0)
+        {
+            if (*p == '"')
+            {
+                BOOL b_long = FALSE;
+
+                if (NULL == r2f_json_str(p, out, len, &b_long))
+                {
+                    return R2F_JSON_NONE;
+                }
+
+                return b_long ? R2F_JSON_LONG : R2F_JSON_OK;
+            }
+            else
+            {
+                const char * e = r2f_json_skip(p);
+                int n;
+
+                if (NULL == e || *p == '{' || *p == '[')
+                {
+                    return R2F_JSON_NONE;
+                }
+
+                n = (int)(e - p);
+                if (n <= 0)
+                {
+                    return R2F_JSON_NONE;
+                }
+                else if (n >= len)
+                {
+                    return R2F_JSON_LONG;
+                }
+
+                memcpy(out, p, n);
+                out[n] = '\0';
+                return R2F_JSON_OK;
+            }
+        }
+
+        p = r2f_json_skip(p);
+        if (NULL == p)
+        {
+            return R2F_JSON_NONE;
+        }
+
+        p = r2f_json_ws(p);
+        if (*p != ',')
+        {
+            break;
+        }
+
+        p++;
+    }
+
+    return R2F_JSON_NONE;
+}
+
+static BOOL r2f_json_get_int(const char * json, const char * key, int * p_val)
+{
+    char buf[32];
+    char * end;
+
+    if (r2f_json_get(json, key, buf, sizeof(buf)) != R2F_JSON_OK)
+    {
+        return FALSE;
+    }
+
+    *p_val = (int)strtol(buf, &end, 10);
+
+    return (end != buf && *end == '\0');
+}
+
+/***********************************************************/
+
+static void r2f_api_send(SOCKET fd, int code, const char * body)
+{
+    int len, off = 0;
+    const char * reason;
+
+    switch (code)
+    {
+    case 200: reason = "OK"; break;
+    case 400: reason = "Bad Request"; break;
+    case 404: reason = "Not Found"; break;
+    case 403: reason = "Forbidden"; break;
+    case 405: reason = "Method Not Allowed"; break;
+    case 409: reason = "Conflict"; break;
+    case 413: reason = "Payload Too Large"; break;
+    case 415: reason = "Unsupported Media Type"; break;
+    default:  reason = "Internal Server Error"; break;
+    }
+
+    len = snprintf(r2f_api.rsp, sizeof(r2f_api.rsp), 
+        "HTTP/1.1 %d %s\r\n"
+        "Content-Type: application/json\r\n"
+        "Content-Length: %d\r\n"
+        "Connection: close\r\n\r\n%s", 
+        code, reason, (int)strlen(body), body);
+    if (len < 0 || len >= (int)sizeof(r2f_api.rsp))
+    {
+        return;
+    }
+
+    while (off < len)
+    {
+        int slen = send(fd, r2f_api.rsp + off, len - off, 0);
+        if (slen <= 0)
+        {
+            log_print(HT_LOG_WARN, "%s, send failed, %s\r\n", __FUNCTION__, sys_os_get_socket_error());
+            break;
+        }
+
+        off += slen;
+    }
+}
+
+static void r2f_api_error(SOCKET fd, int code, const char * error)
+{
+    snprintf(r2f_api.body, sizeof(r2f_api.body), "{\"result\":\"error\",\"error\":\"%s\"}", error);
+
+    r2f_api_send(fd, code, r2f_api.body);
+}
+
+/**
+ * Put the requested file under the api record directory, the name must be 
+ * a relative path without any ".." component
+ */
+static BOOL r2f_api_file(char * file, int len)
+{
+    char   path[256];
+    char * p = file;
+    int    n;
+
+    if (file[0] == '\0')
+    {
+        return TRUE;    // the generated name
+    }
+    
+    if (file[0] == '/' || file[0] == '\\' || file[1] == ':')
+    {
+        return FALSE;
+    }
+
+    while (*p != '\0')
+    {
+        n = (int)strcspn(p, "/\\");
+        if (n == 2 && p[0] == '.' && p[1] == '.')
+        {
+            return FALSE;
+        }
+
+        p += n;
+        if (*p != '\0')
+        {
+            p++;
+        }
+    }
+
+    if (g_r2f_cfg.api_path[0] == '\0')
+    {
+        return TRUE;
+    }
+
+    n = snprintf(path, sizeof(path), "%s/%s", g_r2f_cfg.api_path, file);
+    if (n < 0 || n >= len || n >= (int)sizeof(path))
+    {
+        return FALSE;
+    }
+
+    strcpy(file, path);
+
+    return TRUE;
+}
+
+/**
+ * Build the command from the request body and run it
+ */
+static void r2f_api_command(SOCKET fd, int cmd, const char * json)
+{
+    R2FCMD r2fcmd;
+    char   fmt[16];
+    int    val;
+    const char * p_end;
+
+    memset(&r2fcmd, 0, sizeof(r2fcmd));
+    r2fcmd.cmd = cmd;
+
+    // a truncated body must not run a command
+    p_end = r2f_json_skip(json);
+    if (NULL == p_end || *r2f_json_ws(json) != '{' || *r2f_json_ws(p_end) != '\0')
+    {
+        r2f_api_error(fd, 400, "invalid json");
+        return;
+    }
+
+    if (!r2f_json_get_int(json, "pnum", &r2fcmd.pnum))
+    {
+        r2f_api_error(fd, 400, "pnum required");
+        return;
+    }
+
+    if (R2F_CMD_RECORD == cmd)
+    {
+        val = r2f_json_get(json, "url", r2fcmd.url, sizeof(r2fcmd.url));
+
+        // a truncated value would record another stream or path
+        if (R2F_JSON_LONG == val)
+        {
+            r2f_api_error(fd, 400, "url too long");
+            return;
+        }
+        else if (R2F_JSON_NONE == val || r2fcmd.url[0] == '\0')
+        {
+            r2f_api_error(fd, 400, "url required");
+            return;
+        }
+        else if (r2f_json_get(json, "user", r2fcmd.user, sizeof(r2fcmd.user)) == R2F_JSON_LONG)
+        {
+            r2f_api_error(fd, 400, "user too long");
+            return;
+        }
+        else if (r2f_json_get(json, "pass", r2fcmd.pass, sizeof(r2fcmd.pass)) == R2F_JSON_LONG)
+        {
+            r2f_api_error(fd, 400, "pass too long");
+            return;
+        }
+        else if (r2f_json_get(json, "file", r2fcmd.file, sizeof(r2fcmd.file)) == R2F_JSON_LONG)
+        {
+            r2f_api_error(fd, 400, "file too long");
+            return;
+        }
+        else if (!r2f_api_file(r2fcmd.file, sizeof(r2fcmd.file)))
+        {
+            r2f_api_error(fd, 400, "file must be a relative path under the record directory");
+            return;
+        }
+
+#ifdef MP4_FORMAT
+        r2fcmd.filefmt = R2F_FMT_MP4;
+#else
+        r2fcmd.filefmt = R2F_FMT_AVI;
+#endif
+        if (r2f_json_get(json, "format", fmt, sizeof(fmt)) == R2F_JSON_OK)
+        {
+            r2fcmd.filefmt = r2f_to_filefmt(fmt);
+        }
+    }
+    else if (R2F_CMD_EVENT == cmd)
+    {
+        if (r2f_json_get_int(json, "post", &val) && val > 0)
+        {
+            r2fcmd.post = val;
+        }
+    }
+
+    switch (r2f_cmd_run(&r2fcmd))
+    {
+    case R2F_CMD_OK:
+        if (R2F_CMD_STOP == cmd)
+        {
+            snprintf(r2f_api.body, sizeof(r2f_api.body), "{\"result\":\"ok\",\"start\":%u}", r2fcmd.s_time);
+            r2f_api_send(fd, 200, r2f_api.body);
+        }
+        else
+        {
+            r2f_api_send(fd, 200, "{\"result\":\"ok\"}");
+        }
+        break;
+
+    case R2F_CMD_NOTFOUND:
+        r2f_api_error(fd, 404, "not recording");
+        break;
+
+    case R2F_CMD_EXISTS:
+        r2f_api_error(fd, 409, "already recording");
+        break;
+
+    default:
+        r2f_api_error(fd, 500, "failed");
+        break;
+    }
+}
+
+/**
+ * Receive the request, the headers and the Content-Length body. 
+ * Return the body, NULL on error, *p_code is the error response
+ */
+static char * r2f_api_recv(SOCKET fd, int * p_code)
+{
+    int rlen = 0, hdr_len = 0, ctt_len = 0;
+    char * p_body = NULL;
+
+    *p_code = 400;
+
+    for (;;)
+    {
+        int len = recv(fd, r2f_api.req + rlen, R2F_API_REQ_MAX - rlen, 0);
+        if (len <= 0)
+        {
+            return NULL;
+        }
+
+        rlen += len;
+        r2f_api.req[rlen] = '\0';
+
+        if (0 == hdr_len)
+        {
+            char * p_end = strstr(r2f_api.req, "\r\n\r\n");
+            char * p_line;
+
+            if (NULL == p_end)
+            {
+                if (rlen >= R2F_API_REQ_MAX)
+                {
+                    *p_code = 413;
+                    return NULL;
+                }
+
+                continue;
+            }
+
+            hdr_len = (int)(p_end - r2f_api.req) + 4;
+            p_body = p_end + 4;
+
+            for (p_line = strstr(r2f_api.req, "\r\n"); p_line && p_line < p_end; p_line = strstr(p_line + 2, "\r\n"))
+            {
+                if (strncasecmp(p_line + 2, "Content-Length:", 15) == 0)
+                {
+                    ctt_len = atoi(p_line + 17);
+                    break;
+                }
+            }
+
+            if (ctt_len < 0 || hdr_len + ctt_len > R2F_API_REQ_MAX)
+            {
+                *p_code = 413;
+                return NULL;
+            }
+        }
+
+        if (rlen >= hdr_len + ctt_len)
+        {
+            p_body[ctt_len] = '\0';
+            return p_body;
+        }
+
+        if (rlen >= R2F_API_REQ_MAX)
+        {
+            *p_code = 413;
+            return NULL;
+        }
+    }
+}
+
+/**
+ * Get the value of the request header, FALSE if it is not present
+ */
+static BOOL r2f_api_header(const char * name, char * out, int len)
+{
+    int    nlen = (int)strlen(name);
+    char * p_end = strstr(r2f_api.req, "\r\n\r\n");
+    char * p_line;
+
+    for (p_line = strstr(r2f_api.req, "\r\n"); p_line && p_line < p_end; p_line = strstr(p_line + 2, "\r\n"))
+    {
+        char * p = p_line + 2;
+        int    vlen;
+
+        if (strncasecmp(p, name, nlen) != 0 || p[nlen] != ':')
+        {
+            continue;
+        }
+
+        p += nlen + 1;
+        while (*p == ' ' || *p == '\t')
+        {
+            p++;
+        }
+
+        vlen = (int)strcspn(p, "\r");
+        while (vlen > 0 && (p[vlen-1] == ' ' || p[vlen-1] == '\t'))
+        {
+            vlen--;
+        }
+
+        if (vlen >= len)
+        {
+            vlen = len - 1;
+        }
+
+        memcpy(out, p, vlen);
+        out[vlen] = '\0';
+
+        return TRUE;
+    }
+
+    return FALSE;
+}
+
+/**
+ * The api listens on the loopback only, a web page may still reach it 
+ * through the browser, so the requests from a page are rejected: any Origin,
+ * a Host other than the loopback (DNS rebinding), a body other than json
+ */
+static int r2f_api_check(BOOL post, const char ** pp_err)
+{
+    char value[128];
+
+    if (r2f_api_header("Origin", value, sizeof(value)))
+    {
+        *pp_err = "origin not allowed";
+        return 403;
+    }
+
+    // HTTP/1.0 clients may not send it
+    if (r2f_api_header("Host", value, sizeof(value)))
+    {
+        char * p = value;
+
+        // strip the port
+        if (*p == '[')
+        {
+            p = strchr(value, ']');
+            p = p ? p + 1 : value + strlen(value);
+        }
+        else
+        {
+            p = value + strcspn(value, ":");
+        }
+
+        *p = '\0';
+
+        if (strcasecmp(value, "127.0.0.1") != 0 && strcasecmp(value, "localhost") != 0 && strcmp(value, "[::1]") != 0)
+        {
+            *pp_err = "host not allowed";
+            return 403;
+        }
+    }
+
+    if (post)
+    {
+        if (!r2f_api_header("Content-Type", value, sizeof(value)) ||
+            strncasecmp(value, "application/json", 16) != 0 ||
+            (value[16] != '\0' && value[16] != ';' && value[16] != ' '))
+        {
+            *pp_err = "content type must be application/json";
+            return 415;
+        }
+    }
+
+    return 200;
+}
+
+static void r2f_api_request(SOCKET fd)
+{
+    int   code;
+    int   cmd;
+    char  method[8];
+    char  path[64];
+    char * p_body;
+    const char * p_err;
+
+#if __LINUX_OS__
+    struct timeval tv;
+
+    tv.tv_sec = R2F_API_TIMEOUT / 1000;
+    tv.tv_usec = (R2F_API_TIMEOUT % 1000) * 1000;
+#elif __WINDOWS_OS__
+    DWORD tv = R2F_API_TIMEOUT;
+#endif
+
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, (char *)&tv, sizeof(tv));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, (char *)&tv, sizeof(tv));
+
+    p_body = r2f_api_recv(fd, &code);
+    if (NULL == p_body)
+    {
+        r2f_api_error(fd, code, 413 == code ? "request too large" : "bad request");
+        return;
+    }
+
+    if (sscanf(r2f_api.req, "%7s %63[^ ?\r\n]", method, path) != 2)
+    {
+        r2f_api_error(fd, 400, "bad request");
+        return;
+    }
+
+    log_print(HT_LOG_DBG, "%s, %s %s\r\n", __FUNCTION__, method, path);
+
+    code = r2f_api_check(strcmp(method, "POST") == 0, &p_err);
+    if (code != 200)
+    {
+        log_print(HT_LOG_WARN, "%s, %s %s rejected, %s\r\n", __FUNCTION__, method, path, p_err);
+
+        r2f_api_error(fd, code, p_err);
+        return;
+    }
+
+    if (strcmp(path, "/status") == 0)
+    {
+        if (strcmp(method, "GET") != 0)
+        {
+            r2f_api_error(fd, 405, "method not allowed");
+        }
+        else if (r2f_cmd_status(r2f_api.body, sizeof(r2f_api.body)) < 0)
+        {
+            r2f_api_error(fd, 500, "failed");
+        }
+        else
+        {
+            r2f_api_send(fd, 200, r2f_api.body);
+        }
+        return;
+    }
+
+    if (strcmp(path, "/record") == 0)
+    {
+        cmd = R2F_CMD_RECORD;
+    }
+    else if (strcmp(path, "/stop") == 0)
+    {
+        cmd = R2F_CMD_STOP;
+    }
+    else if (strcmp(path, "/event") == 0)
+    {
+        cmd = R2F_CMD_EVENT;
+    }
+    else
+    {
+        r2f_api_error(fd, 404, "not found");
+        return;
+    }
+
+    if (strcmp(method, "POST") != 0)
+    {
+        r2f_api_error(fd, 405, "method not allowed");
+        return;
+    }
+
+    r2f_api_command(fd, cmd, p_body);
+}
+
+static void * r2f_api_thread(void * argv)
+{
+    while (r2f_api.run_flag)
+    {
+        int    i, ret;
+        SOCKET max_fd = 0;
+        SOCKET fds[2] = {r2f_api.tcp_fd, r2f_api.unix_fd};
+        fd_set rset;
+        struct timeval tv;
+
+        FD_ZERO(&rset);
+
+        for (i = 0; i < 2; i++)
+        {
+            if (fds[i] > 0)
+            {
+                FD_SET(fds[i], &rset);
+
+                if (fds[i] > max_fd)
+                {
+                    max_fd = fds[i];
+                }
+            }
+        }
+
+        // the timeout only bounds the stop latency, the requests wake the thread
+        tv.tv_sec = 1;
+        tv.tv_usec = 0;
+
+        ret = select((int)(max_fd + 1), &rset, NULL, NULL, &tv);
+        if (ret <= 0)
+        {
+            continue;
+        }
+
+        for (i = 0; i < 2; i++)
+        {
+            SOCKET cfd;
+
+            if (fds[i] <= 0 || !FD_ISSET(fds[i], &rset))
+            {
+                continue;
+            }
+
+            cfd = accept(fds[i], NULL, NULL);
+            if (cfd <= 0)
+            {
+                continue;
+            }
+
+            r2f_api_request(cfd);
+
+            closesocket(cfd);
+        }
+    }
+
+    r2f_api.tid = 0;
+
+    log_print(HT_LOG_INFO, "%s, exit\r\n", __FUNCTION__);
+
+    return NULL;
+}
+
+static SOCKET r2f_api_listen_tcp(int port)
+{
+    int opt = 1;
+    SOCKET fd;
+    struct sockaddr_in addr;
+
+    fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd <= 0)
+    {
+        log_print(HT_LOG_ERR, "%s, socket failed\r\n", __FUNCTION__);
+        return 0;
+    }
+
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, (char *)&opt, sizeof(opt));
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons((uint16)port);
+
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1 || listen(fd, 8) == -1)
+    {
+        log_print(HT_LOG_ERR, "%s, bind 127.0.0.1:%d failed, %s\r\n", __FUNCTION__, port, sys_os_get_socket_error());
+        closesocket(fd);
+        return 0;
+    }
+
+    return fd;
+}
+
+#if __LINUX_OS__
+static SOCKET r2f_api_listen_unix(const char * path)
+{
+    SOCKET fd;
+    struct sockaddr_un addr;
+
+    if (strlen(path) >= sizeof(addr.sun_path))
+    {
+        log_print(HT_LOG_ERR, "%s, path too long, %s\r\n", __FUNCTION__, path);
+        return 0;
+    }
+
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd <= 0)
+    {
+        log_print(HT_LOG_ERR, "%s, socket failed\r\n", __FUNCTION__);
+        return 0;
+    }
+
+    // a stale socket of the last run
+    unlink(path);
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1 || listen(fd, 8) == -1)
+    {
+        log_print(HT_LOG_ERR, "%s, bind %s failed, %s\r\n", __FUNCTION__, path, sys_os_get_socket_error());
+        closesocket(fd);
+        return 0;
+    }
+
+    return fd;
+}
+#endif
+
+static BOOL r2f_api_start(R2FCMDSRC * p_src)
+{
+    if (g_r2f_cfg.api_port > 0)
+    {
+        r2f_api.tcp_fd = r2f_api_listen_tcp(g_r2f_cfg.api_port);
+    }
+
+#if __LINUX_OS__
+    if (g_r2f_cfg.api_unix[0] != '\0')
+    {
+        r2f_api.unix_fd = r2f_api_listen_unix(g_r2f_cfg.api_unix);
+    }
+#endif
+
+    if (r2f_api.tcp_fd <= 0 && r2f_api.unix_fd <= 0)
+    {
+        return FALSE;
+    }
+
+    r2f_api.run_flag = 1;
+    r2f_api.tid = sys_os_create_thread((void *)r2f_api_thread, NULL);
+
+    return TRUE;
+}
+
+static void r2f_api_stop(R2FCMDSRC * p_src)
+{
+    r2f_api.run_flag = 0;
+
+    while (r2f_api.tid)
+    {
+        usleep(10*1000);
+    }
+
+    if (r2f_api.tcp_fd > 0)
+    {
+        closesocket(r2f_api.tcp_fd);
+        r2f_api.tcp_fd = 0;
+    }
+
+#if __LINUX_OS__
+    if (r2f_api.unix_fd > 0)
+    {
+        closesocket(r2f_api.unix_fd);
+        r2f_api.unix_fd = 0;
+
+        unlink(g_r2f_cfg.api_unix);
+    }
+#endif
+}
+
+static R2FCMDSRC r2f_api_cmdsrc = {"api", r2f_api_start, r2f_api_stop, NULL, NULL, NULL};
+
+R2FCMDSRC * r2f_api_src()
+{
+    return &r2f_api_cmdsrc;
+}
+
+
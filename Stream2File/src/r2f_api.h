@@ -0,0 +1,59 @@
+/***************************************************************************************
+ *
+ *  IMPORTANT: READ BEFORE DOWNLOADING, COPYING, INSTALLING OR USING.
+ *
+ *  By downloading, copying, installing or using the software you agree to this license.
+ *  If you do not agree to this license, do not download, install, 
+ *  copy or use the software.
+ *
+ *  Copyright (C) 2014-2020, Happytimesoft Corporation, all rights reserved.
+ *
+ *  Redistribution and use in binary forms, with or without modification, are permitted.
+ *
+ *  Unless required by applicable law or agreed to in writing, software distributed 
+ *  under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ *  CONDITIONS OF ANY KIND, either express or implied. See the License for the specific
+ *  language governing permissions and limitations under the License.
+ *
+****************************************************************************************/
+
+
+#ifndef R2F_API_H
+#define R2F_API_H
+
+#include "r2f_cmd.h"
+
+
+#define R2F_API_REQ_MAX         8192        // max request size, the headers and the body
+#define R2F_API_RSP_MAX         65536       // max response size
+#define R2F_API_TIMEOUT         2000        // request receive timeout (ms)
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Local control api, json over http on the loopback (g_r2f_cfg.api_port) 
+ * and / or a unix socket (g_r2f_cfg.api_unix):
+ *
+ *  GET  /status                                    the recording streams
+ *  POST /record {"pnum":1,"url":"rtsp://..","user":"..","pass":"..","file":"..","format":"mp4"}
+ *  POST /stop   {"pnum":1}
+ *  POST /event  {"pnum":1,"post":30}
+ *
+ * The commands are executed before the response, the result is
+ * {"result":"ok"} or {"result":"error","error":".."}
+ *
+ * The POST body must be sent as application/json. Requests with an Origin 
+ * header or a Host other than the loopback are rejected. The "file" is a 
+ * relative path under g_r2f_cfg.api_path
+ */
+R2FCMDSRC * r2f_api_src();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // R2F_API_H
+
+
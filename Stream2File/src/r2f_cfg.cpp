@@ -86,11 +86,61 @@ int r2f_to_filefmt(const char * fmt)
     {
         return R2F_FMT_MP4;
     }
+    else if (strcasecmp(fmt, "fmp4") == 0)
+    {
+        return R2F_FMT_FMP4;
+    }
 #endif
 
     return R2F_FMT_AVI;
 }
 
+int r2f_to_sync(const char * sync)
+{
+    if (strcasecmp(sync, "none") == 0)
+    {
+        return AVI_SYNC_NONE;
+    }
+    else if (strcasecmp(sync, "flush") == 0)
+    {
+        return AVI_SYNC_FLUSH;
+    }
+    else if (strcasecmp(sync, "key") == 0)
+    {
+        return AVI_SYNC_KEY;
+    }
+    else if (strcasecmp(sync, "fsync") == 0)
+    {
+        return AVI_SYNC_FSYNC;
+    }
+
+    return AVI_SYNC_DEF;
+}
+
+int r2f_to_recordmode(const char * mode)
+{
+    if (strcasecmp(mode, "event") == 0)
+    {
+        return R2F_REC_EVENT;
+    }
+
+    return R2F_REC_CONT;
+}
+
+int r2f_to_fio(const char * fio)
+{
+    if (strcasecmp(fio, "pwrite") == 0)
+    {
+        return HFIO_PWRITE;
+    }
+    else if (strcasecmp(fio, "uring") == 0)
+    {
+        return HFIO_URING;
+    }
+
+    return HFIO_STDIO;
+}
+
 BOOL r2f_parse_r2f(XMLN * p_node, STREAM2FILE * p_r2f)
 {
     XMLN * p_url;	
@@ -101,6 +151,15 @@ BOOL r2f_parse_r2f(XMLN * p_node, STREAM2FILE * p_r2f)
 	XMLN * p_framerate;
 	XMLN * p_recordsize;
 	XMLN * p_recordtime;
+	XMLN * p_recordwall;
+	XMLN * p_recordgops;
+	XMLN * p_recordpredict;
+	XMLN * p_sync;
+	XMLN * p_sync_ms;
+	XMLN * p_recordmode;
+	XMLN * p_preroll;
+	XMLN * p_postroll;
+	XMLN * p_eventmeta;
 
 	p_url = xml_node_get(p_node, "url");
 	if (p_url && p_url->data)
@@ -154,6 +213,60 @@ BOOL r2f_parse_r2f(XMLN * p_node, STREAM2FILE * p_r2f)
 		p_r2f->recordtime = atoi(p_recordtime->data);
 	}
 
+	p_recordwall = xml_node_get(p_node, "recordwall");
+	if (p_recordwall && p_recordwall->data)
+	{
+		p_r2f->recordwall = atoi(p_recordwall->data);
+	}
+
+	p_recordgops = xml_node_get(p_node, "recordgops");
+	if (p_recordgops && p_recordgops->data)
+	{
+		p_r2f->recordgops = atoi(p_recordgops->data);
+	}
+
+	p_recordpredict = xml_node_get(p_node, "recordpredict");
+	if (p_recordpredict && p_recordpredict->data)
+	{
+		p_r2f->recordpredict = atoi(p_recordpredict->data);
+	}
+
+	p_sync = xml_node_get(p_node, "sync");
+	if (p_sync && p_sync->data)
+	{
+		p_r2f->sync_mode = r2f_to_sync(p_sync->data);
+	}
+
+	p_sync_ms = xml_node_get(p_node, "sync_ms");
+	if (p_sync_ms && p_sync_ms->data)
+	{
+		p_r2f->sync_ms = atoi(p_sync_ms->data);
+	}
+
+	p_recordmode = xml_node_get(p_node, "recordmode");
+	if (p_recordmode && p_recordmode->data)
+	{
+		p_r2f->recordmode = r2f_to_recordmode(p_recordmode->data);
+	}
+
+	p_preroll = xml_node_get(p_node, "preroll");
+	if (p_preroll && p_preroll->data)
+	{
+		p_r2f->preroll = atoi(p_preroll->data);
+	}
+
+	p_postroll = xml_node_get(p_node, "postroll");
+	if (p_postroll && p_postroll->data)
+	{
+		p_r2f->postroll = atoi(p_postroll->data);
+	}
+
+	p_eventmeta = xml_node_get(p_node, "eventmeta");
+	if (p_eventmeta && p_eventmeta->data)
+	{
+		strncpy(p_r2f->eventmeta, p_eventmeta->data, sizeof(p_r2f->eventmeta)-1);
+	}
+
 	return TRUE;
 }
 
@@ -162,6 +275,31 @@ BOOL r2f_parse_config(char * xml_buff, int rlen)
 	XMLN * p_node;	
 	XMLN * p_log_enable;
 	XMLN * p_log_level;
+	XMLN * p_log_rotate_size;
+	XMLN * p_log_rotate_time;
+	XMLN * p_rx_threads;
+	XMLN * p_rx_buf_size;
+	XMLN * p_udp_rcvbuf;
+	XMLN * p_udp_timestamp;
+	XMLN * p_reorder_depth;
+	XMLN * p_reorder_time;
+	XMLN * p_frame_buf_max;
+	XMLN * p_zero_copy;
+	XMLN * p_writer_threads;
+	XMLN * p_write_queue_depth;
+	XMLN * p_final_threads;
+	XMLN * p_final_queue_depth;
+	XMLN * p_avi_sync;
+	XMLN * p_avi_sync_ms;
+	XMLN * p_avi_buf_size;
+	XMLN * p_fio_backend;
+	XMLN * p_fio_direct;
+	XMLN * p_fio_blocks;
+	XMLN * p_mp4_frag_ms;
+	XMLN * p_mp4_moov_reserve;
+	XMLN * p_api_port;
+	XMLN * p_api_unix;
+	XMLN * p_api_path;
 	XMLN * p_stream2file;
 
 	p_node = xxx_hxml_parse(xml_buff, rlen);
@@ -181,6 +319,162 @@ BOOL r2f_parse_config(char * xml_buff, int rlen)
 	{
 		g_r2f_cfg.log_level = atoi(p_log_level->data);
 	}
+
+	p_log_rotate_size = xml_node_get(p_node, "log_rotate_size");
+	if (p_log_rotate_size && p_log_rotate_size->data)
+	{
+		g_r2f_cfg.log_rotate_size = atoi(p_log_rotate_size->data);
+	}
+
+	p_log_rotate_time = xml_node_get(p_node, "log_rotate_time");
+	if (p_log_rotate_time && p_log_rotate_time->data)
+	{
+		g_r2f_cfg.log_rotate_time = atoi(p_log_rotate_time->data);
+	}
+
+	p_rx_threads = xml_node_get(p_node, "rx_threads");
+	if (p_rx_threads && p_rx_threads->data)
+	{
+		g_r2f_cfg.rx_threads = atoi(p_rx_threads->data);
+	}
+
+	p_rx_buf_size = xml_node_get(p_node, "rx_buf_size");
+	if (p_rx_buf_size && p_rx_buf_size->data)
+	{
+		g_r2f_cfg.rx_buf_size = atoi(p_rx_buf_size->data);
+	}
+
+	p_udp_rcvbuf = xml_node_get(p_node, "udp_rcvbuf");
+	if (p_udp_rcvbuf && p_udp_rcvbuf->data)
+	{
+		g_r2f_cfg.udp_rcvbuf = atoi(p_udp_rcvbuf->data);
+	}
+
+	p_udp_timestamp = xml_node_get(p_node, "udp_timestamp");
+	if (p_udp_timestamp && p_udp_timestamp->data)
+	{
+		g_r2f_cfg.udp_timestamp = atoi(p_udp_timestamp->data);
+	}
+
+	g_r2f_cfg.reorder_depth = -1;
+	
+	p_reorder_depth = xml_node_get(p_node, "reorder_depth");
+	if (p_reorder_depth && p_reorder_depth->data)
+	{
+		g_r2f_cfg.reorder_depth = atoi(p_reorder_depth->data);
+	}
+
+	p_reorder_time = xml_node_get(p_node, "reorder_time");
+	if (p_reorder_time && p_reorder_time->data)
+	{
+		g_r2f_cfg.reorder_time = atoi(p_reorder_time->data);
+	}
+
+	p_frame_buf_max = xml_node_get(p_node, "frame_buf_max");
+	if (p_frame_buf_max && p_frame_buf_max->data)
+	{
+		g_r2f_cfg.frame_buf_max = atoi(p_frame_buf_max->data);
+	}
+
+	p_zero_copy = xml_node_get(p_node, "zero_copy");
+	if (p_zero_copy && p_zero_copy->data)
+	{
+		g_r2f_cfg.zero_copy = atoi(p_zero_copy->data);
+	}
+
+	p_writer_threads = xml_node_get(p_node, "writer_threads");
+	if (p_writer_threads && p_writer_threads->data)
+	{
+		g_r2f_cfg.writer_threads = atoi(p_writer_threads->data);
+	}
+
+	p_write_queue_depth = xml_node_get(p_node, "write_queue_depth");
+	if (p_write_queue_depth && p_write_queue_depth->data)
+	{
+		g_r2f_cfg.write_queue_depth = atoi(p_write_queue_depth->data);
+	}
+
+	g_r2f_cfg.final_threads = -1;
+
+	p_final_threads = xml_node_get(p_node, "final_threads");
+	if (p_final_threads && p_final_threads->data)
+	{
+		g_r2f_cfg.final_threads = atoi(p_final_threads->data);
+	}
+
+	p_final_queue_depth = xml_node_get(p_node, "final_queue_depth");
+	if (p_final_queue_depth && p_final_queue_depth->data)
+	{
+		g_r2f_cfg.final_queue_depth = atoi(p_final_queue_depth->data);
+	}
+
+	p_avi_sync = xml_node_get(p_node, "avi_sync");
+	if (p_avi_sync && p_avi_sync->data)
+	{
+		g_r2f_cfg.avi_sync = r2f_to_sync(p_avi_sync->data);
+	}
+
+	p_avi_sync_ms = xml_node_get(p_node, "avi_sync_ms");
+	if (p_avi_sync_ms && p_avi_sync_ms->data)
+	{
+		g_r2f_cfg.avi_sync_ms = atoi(p_avi_sync_ms->data);
+	}
+
+	p_avi_buf_size = xml_node_get(p_node, "avi_buf_size");
+	if (p_avi_buf_size && p_avi_buf_size->data)
+	{
+		g_r2f_cfg.avi_buf_size = atoi(p_avi_buf_size->data);
+	}
+
+	p_fio_backend = xml_node_get(p_node, "fio_backend");
+	if (p_fio_backend && p_fio_backend->data)
+	{
+		g_r2f_cfg.fio_backend = r2f_to_fio(p_fio_backend->data);
+	}
+
+	p_fio_direct = xml_node_get(p_node, "fio_direct");
+	if (p_fio_direct && p_fio_direct->data)
+	{
+		g_r2f_cfg.fio_direct = atoi(p_fio_direct->data);
+	}
+
+	p_fio_blocks = xml_node_get(p_node, "fio_blocks");
+	if (p_fio_blocks && p_fio_blocks->data)
+	{
+		g_r2f_cfg.fio_blocks = atoi(p_fio_blocks->data);
+	}
+
+	g_r2f_cfg.mp4_frag_ms = -1;
+
+	p_mp4_frag_ms = xml_node_get(p_node, "mp4_frag_ms");
+	if (p_mp4_frag_ms && p_mp4_frag_ms->data)
+	{
+		g_r2f_cfg.mp4_frag_ms = atoi(p_mp4_frag_ms->data);
+	}
+
+	p_mp4_moov_reserve = xml_node_get(p_node, "mp4_moov_reserve");
+	if (p_mp4_moov_reserve && p_mp4_moov_reserve->data)
+	{
+		g_r2f_cfg.mp4_moov_reserve = atoi(p_mp4_moov_reserve->data);
+	}
+
+	p_api_port = xml_node_get(p_node, "api_port");
+	if (p_api_port && p_api_port->data)
+	{
+		g_r2f_cfg.api_port = atoi(p_api_port->data);
+	}
+
+	p_api_unix = xml_node_get(p_node, "api_unix");
+	if (p_api_unix && p_api_unix->data)
+	{
+		strncpy(g_r2f_cfg.api_unix, p_api_unix->data, sizeof(g_r2f_cfg.api_unix)-1);
+	}
+
+	p_api_path = xml_node_get(p_node, "api_path");
+	if (p_api_path && p_api_path->data)
+	{
+		strncpy(g_r2f_cfg.api_path, p_api_path->data, sizeof(g_r2f_cfg.api_path)-1);
+	}
 	
 	int cnt = 0;
 	
@@ -32,12 +32,46 @@ typedef struct _STREAM2FILE
     uint32  framerate;
     uint32  recordsize;
     uint32  recordtime;
+    uint32  recordwall;         // switch at the wall clock boundaries of this period (s), aligned to the midnight
+    uint32  recordgops;         // switch after this many GOPs
+    BOOL    recordpredict;      // switch at the key frame where the next GOP is predicted to exceed recordsize
+    int     sync_mode;          // avi / fmp4 durability policy, AVI_SYNC_DEF - the global setting
+    uint32  sync_ms;            // avi / fmp4 flush / fdatasync interval (ms), 0 - the global setting
+    int     recordmode;         // R2F_REC_CONT or R2F_REC_EVENT
+    uint32  preroll;            // event recording, seconds kept before the trigger, 0 - default
+    uint32  postroll;           // event recording, seconds recorded after the trigger, 0 - default
+    char    eventmeta[64];      // event recording, the rtsp metadata containing it triggers an event
 } STREAM2FILE;
 
 typedef struct
 {
     BOOL    log_enable;         // log enable 
     int     log_level;          // log level
+    int     log_rotate_size;    // rotate the log file at this size (MB), 0 - disable
+    int     log_rotate_time;    // rotate the log file after this time (minutes), 0 - disable
+    int     rx_threads;         // rtsp event loop threads, 0 - one per core
+    int     rx_buf_size;        // rtsp receive ring buffer size (KB), 0 - default
+    int     udp_rcvbuf;         // rtp udp socket receive buffer size (KB), 0 - default
+    BOOL    udp_timestamp;      // enable udp arrival timestamp (SO_TIMESTAMPNS)
+    int     reorder_depth;      // udp rtp reorder depth (packets), 0 - disable, -1 - default
+    int     reorder_time;       // udp rtp reorder depth (ms)
+    int     frame_buf_max;      // max video frame size (KB), 0 - default
+    BOOL    zero_copy;          // record H264/H265 frames from the packet buffers
+    int     writer_threads;     // file writer threads, 0 - write on the receive threads
+    int     write_queue_depth;  // frames queued per stream for the writer, 0 - default
+    int     final_threads;      // segment finalizer threads, 0 - close on the switching thread, -1 - default
+    int     final_queue_depth;  // segments waiting for a finalizer, 0 - default
+    int     avi_sync;           // avi / fmp4 durability policy, AVI_SYNC_NONE ~ AVI_SYNC_FSYNC
+    uint32  avi_sync_ms;        // avi / fmp4 flush / fdatasync interval (ms)
+    int     avi_buf_size;       // avi write buffer / block size (KB), 0 - default
+    int     fio_backend;        // file write backend, HFIO_STDIO, HFIO_PWRITE or HFIO_URING
+    BOOL    fio_direct;         // open the files with O_DIRECT, the block backends only
+    int     fio_blocks;         // shared block pool size, 0 - default
+    int     mp4_frag_ms;        // fmp4 fragment duration (ms), 0 - every key frame, -1 - default
+    int     mp4_moov_reserve;   // mp4 fast start, space reserved for the moov (KB), 0 - moov at the end
+    int     api_port;           // local control api port on the loopback, 0 - disable
+    char    api_unix[108];      // local control api unix socket path, empty - disable
+    char    api_path[128];      // local control api record directory, the "file" names are relative to it
 
     STREAM2FILE * r2f;
 } R2F_CFG;
@@ -49,6 +83,7 @@ extern "C"{
 extern R2F_CFG g_r2f_cfg;
 
 void r2f_free_r2fs(STREAM2FILE ** p_r2f);
+int  r2f_to_filefmt(const char * fmt);
 BOOL r2f_read_config();
 
 #ifdef __cplusplus
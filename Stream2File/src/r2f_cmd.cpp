@@ -0,0 +1,374 @@
+/***************************************************************************************
+ *
+ *  IMPORTANT: READ BEFORE DOWNLOADING, COPYING, INSTALLING OR USING.
+ *
+ *  By downloading, copying, installing or using the software you agree to this license.
+ *  If you do not agree to this license, do not download, install, 
+ *  copy or use the software.
+ *
+ *  Copyright (C) 2014-2020, Happytimesoft Corporation, all rights reserved.
+ *
+ *  Redistribution and use in binary forms, with or without modification, are permitted.
+ *
+ *  Unless required by applicable law or agreed to in writing, software distributed 
+ *  under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ *  CONDITIONS OF ANY KIND, either express or implied. See the License for the specific
+ *  language governing permissions and limitations under the License.
+ *
+****************************************************************************************/
+
+
+#include "sys_inc.h"
+#include "hqueue.h"
+#include "r2f_cmd.h"
+#include "r2f_rua.h"
+
+typedef struct
+{
+    uint32      run_flag    : 1;
+    uint32      drain_flag  : 1;        // the sources are stopping, no more done callbacks
+    uint32      reserved    : 30;
+
+    pthread_t   tid;
+    HQUEUE    * queue;                  // R2FCMD
+    void      * mutex;                  // serializes the execution and the status
+    R2FCMDSRC * srcs;                   // registered sources
+
+    time_t      start;                  // init time
+    uint32      executed;               // executed commands
+    uint32      failed;                 // commands not returning R2F_CMD_OK
+} R2FCMDEX;
+
+/***********************************************************/
+
+static R2FCMDEX     r2f_cmd;
+
+/***********************************************************/
+
+static void r2f_cmd_exec_locked(R2FCMD * p_cmd, BOOL done)
+{
+    sys_os_mutex_enter(r2f_cmd.mutex);
+
+    p_cmd->result = r2f_cmd_exec(p_cmd);
+
+    r2f_cmd.executed++;
+    if (R2F_CMD_OK != p_cmd->result)
+    {
+        r2f_cmd.failed++;
+    }
+
+    // under the lock, a stopped source is never called back
+    if (done && !r2f_cmd.drain_flag && p_cmd->p_src && p_cmd->p_src->done)
+    {
+        p_cmd->p_src->done(p_cmd->p_src, p_cmd);
+    }
+
+    sys_os_mutex_leave(r2f_cmd.mutex);
+}
+
+static void * r2f_cmd_thread(void * argv)
+{
+    R2FCMD cmd;
+
+    while (r2f_cmd.run_flag)
+    {
+        if (!hqBufGet(r2f_cmd.queue, (char *)&cmd))
+        {
+            continue;
+        }
+
+        if (R2F_CMD_EXIT == cmd.cmd)
+        {
+            break;
+        }
+
+        r2f_cmd_exec_locked(&cmd, TRUE);
+    }
+
+    r2f_cmd.tid = 0;
+
+    log_print(HT_LOG_INFO, "%s, exit\r\n", __FUNCTION__);
+
+    return NULL;
+}
+
+void r2f_cmd_register(R2FCMDSRC * p_src)
+{
+    R2FCMDSRC ** pp_src = &r2f_cmd.srcs;
+
+    while (*pp_src)
+    {
+        pp_src = &(*pp_src)->next;
+    }
+
+    p_src->next = NULL;
+    *pp_src = p_src;
+}
+
+BOOL r2f_cmd_init(int depth)
+{
+    R2FCMDSRC * p_src;
+
+    if (r2f_cmd.run_flag)
+    {
+        return TRUE;
+    }
+
+    if (depth <= 0)
+    {
+        depth = R2F_CMD_QUEUE_DEF;
+    }
+
+    r2f_cmd.queue = hqCreate(depth, sizeof(R2FCMD), HQ_GET_WAIT | HQ_PUT_WAIT);
+    if (NULL == r2f_cmd.queue)
+    {
+        log_print(HT_LOG_ERR, "%s, create queue failed\r\n", __FUNCTION__);
+        return FALSE;
+    }
+
+    r2f_cmd.mutex = sys_os_create_mutex();
+    r2f_cmd.start = time(NULL);
+    r2f_cmd.run_flag = 1;
+
+    r2f_cmd.tid = sys_os_create_thread((void *)r2f_cmd_thread, NULL);
+    if (0 == r2f_cmd.tid)
+    {
+        log_print(HT_LOG_ERR, "%s, create thread failed\r\n", __FUNCTION__);
+
+        r2f_cmd.run_flag = 0;
+        hqDelete(r2f_cmd.queue);
+        r2f_cmd.queue = NULL;
+        sys_os_destroy_sig_mutex(r2f_cmd.mutex);
+        r2f_cmd.mutex = NULL;
+        return FALSE;
+    }
+
+    for (p_src = r2f_cmd.srcs; p_src; p_src = p_src->next)
+    {
+        if (p_src->start && !p_src->start(p_src))
+        {
+            log_print(HT_LOG_ERR, "%s, start command source %s failed\r\n", __FUNCTION__, p_src->name);
+        }
+        else
+        {
+            log_print(HT_LOG_INFO, "%s, command source %s started\r\n", __FUNCTION__, p_src->name);
+        }
+    }
+
+    return TRUE;
+}
+
+void r2f_cmd_deinit()
+{
+    R2FCMD cmd;
+    R2FCMDSRC * p_src;
+
+    if (!r2f_cmd.run_flag)
+    {
+        return;
+    }
+
+    // the commands already queued are still executed, without the done callbacks
+    sys_os_mutex_enter(r2f_cmd.mutex);
+    r2f_cmd.drain_flag = 1;
+    sys_os_mutex_leave(r2f_cmd.mutex);
+
+    for (p_src = r2f_cmd.srcs; p_src; p_src = p_src->next)
+    {
+        if (p_src->stop)
+        {
+            p_src->stop(p_src);
+        }
+    }
+
+    memset(&cmd, 0, sizeof(cmd));
+    cmd.cmd = R2F_CMD_EXIT;
+
+    if (!hqBufPut(r2f_cmd.queue, (char *)&cmd))
+    {
+        log_print(HT_LOG_ERR, "%s, hqBufPut failed\r\n", __FUNCTION__);
+    }
+
+    while (r2f_cmd.tid)
+    {
+        usleep(10*1000);
+    }
+
+    r2f_cmd.run_flag = 0;
+    r2f_cmd.drain_flag = 0;
+
+    hqDelete(r2f_cmd.queue);
+    r2f_cmd.queue = NULL;
+
+    sys_os_destroy_sig_mutex(r2f_cmd.mutex);
+    r2f_cmd.mutex = NULL;
+
+    r2f_cmd.srcs = NULL;
+}
+
+BOOL r2f_cmd_put(R2FCMD * p_cmd)
+{
+    if (!r2f_cmd.run_flag || R2F_CMD_EXIT == p_cmd->cmd)
+    {
+        return FALSE;
+    }
+
+    if (!hqBufPut(r2f_cmd.queue, (char *)p_cmd))
+    {
+        log_print(HT_LOG_ERR, "%s, hqBufPut failed\r\n", __FUNCTION__);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+int r2f_cmd_run(R2FCMD * p_cmd)
+{
+    if (!r2f_cmd.run_flag || R2F_CMD_EXIT == p_cmd->cmd)
+    {
+        p_cmd->result = R2F_CMD_ERR;
+        return p_cmd->result;
+    }
+
+    r2f_cmd_exec_locked(p_cmd, FALSE);
+
+    return p_cmd->result;
+}
+
+/**
+ * Append the string to the json buffer, quoted and escaped.
+ * Return the written length, -1 if it does not fit
+ */
+static int r2f_json_str(char * buf, int len, const char * str)
+{
+    int off = 0;
+
+    if (len < 2)
+    {
+        return -1;
+    }
+
+    buf[off++] = '"';
+
+    for (; *str; str++)
+    {
+        uint8 c = (uint8)*str;
+
+        if (c == '"' || c == '\\')
+        {
+            if (off + 2 >= len)
+            {
+                return -1;
+            }
+
+            buf[off++] = '\\';
+            buf[off++] = c;
+        }
+        else if (c < 0x20)
+        {
+            if (off + 6 >= len)
+            {
+                return -1;
+            }
+
+            off += snprintf(buf+off, len-off, "\\u%04x", c);
+        }
+        else
+        {
+            if (off + 1 >= len)
+            {
+                return -1;
+            }
+
+            buf[off++] = c;
+        }
+    }
+
+    if (off + 1 >= len)
+    {
+        return -1;
+    }
+
+    buf[off++] = '"';
+    buf[off] = '\0';
+
+    return off;
+}
+
+static const char * r2f_fmt_str(int filefmt)
+{
+    if (R2F_FMT_MP4 == filefmt)
+    {
+        return "mp4";
+    }
+    else if (R2F_FMT_FMP4 == filefmt)
+    {
+        return "fmp4";
+    }
+
+    return "avi";
+}
+
+int r2f_cmd_status(char * buf, int len)
+{
+    int off, n;
+    uint32 i, cnt = 0;
+
+#define R2F_JSON_PUT(...)   do { n = snprintf(buf+off, len-off, __VA_ARGS__); \
+                                 if (n < 0 || n >= len-off) { goto FAILED; } \
+                                 off += n; } while (0)
+#define R2F_JSON_STR(s)     do { n = r2f_json_str(buf+off, len-off, s); \
+                                 if (n < 0) { goto FAILED; } \
+                                 off += n; } while (0)
+
+    if (!r2f_cmd.run_flag)
+    {
+        return -1;
+    }
+
+    sys_os_mutex_enter(r2f_cmd.mutex);
+
+    off = 0;
+
+    R2F_JSON_PUT("{\"uptime\":%u,\"executed\":%u,\"failed\":%u,\"streams\":[",
+        (uint32)(time(NULL) - r2f_cmd.start), r2f_cmd.executed, r2f_cmd.failed);
+
+    for (i = 0; i < MAX_NUM_RUA; i++)
+    {
+        RUA * p_rua = rua_get_by_index(i);
+
+        if (NULL == p_rua || !p_rua->used_flag)
+        {
+            continue;
+        }
+
+        R2F_JSON_PUT("%s{\"pnum\":%d,\"url\":", cnt > 0 ? "," : "", p_rua->pnum);
+        R2F_JSON_STR(p_rua->url);
+        R2F_JSON_PUT(",\"file\":");
+        R2F_JSON_STR(p_rua->savepath);
+        R2F_JSON_PUT(",\"format\":\"%s\",\"mode\":\"%s\",\"start\":%u}",
+            r2f_fmt_str(p_rua->filefmt),
+            R2F_REC_EVENT != p_rua->event.mode ? "continuous" : 
+                (R2F_EVT_REC == p_rua->event.state ? "event-recording" : "event-idle"),
+            (uint32)p_rua->starttime);
+
+        cnt++;
+    }
+
+    R2F_JSON_PUT("],\"count\":%u}", cnt);
+
+#undef R2F_JSON_PUT
+#undef R2F_JSON_STR
+
+    sys_os_mutex_leave(r2f_cmd.mutex);
+
+    return off;
+
+FAILED:
+
+    sys_os_mutex_leave(r2f_cmd.mutex);
+
+    return -1;
+}
+
+
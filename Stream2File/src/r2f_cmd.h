@@ -0,0 +1,131 @@
+/***************************************************************************************
+ *
+ *  IMPORTANT: READ BEFORE DOWNLOADING, COPYING, INSTALLING OR USING.
+ *
+ *  By downloading, copying, installing or using the software you agree to this license.
+ *  If you do not agree to this license, do not download, install, 
+ *  copy or use the software.
+ *
+ *  Copyright (C) 2014-2020, Happytimesoft Corporation, all rights reserved.
+ *
+ *  Redistribution and use in binary forms, with or without modification, are permitted.
+ *
+ *  Unless required by applicable law or agreed to in writing, software distributed 
+ *  under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ *  CONDITIONS OF ANY KIND, either express or implied. See the License for the specific
+ *  language governing permissions and limitations under the License.
+ *
+****************************************************************************************/
+
+
+#ifndef R2F_CMD_H
+#define R2F_CMD_H
+
+
+#define R2F_CMD_EXIT            0           // stop the executor
+#define R2F_CMD_RECORD          1           // start recording a stream
+#define R2F_CMD_STOP            2           // stop recording a stream
+#define R2F_CMD_EVENT           3           // trigger an event of an event recording stream
+
+#define R2F_CMD_OK              0
+#define R2F_CMD_ERR             -1          // the command failed
+#define R2F_CMD_NOTFOUND        -2          // no stream with the process number
+#define R2F_CMD_EXISTS          -3          // the process number is already recording
+#define R2F_CMD_BUSY            -4          // the command queue is full
+
+#define R2F_CMD_QUEUE_DEF       64          // default queued commands
+
+typedef struct _R2FCMDSRC R2FCMDSRC;
+
+/**
+ * Control command, the same for every source
+ */
+typedef struct
+{
+    int         cmd;                    // R2F_CMD_RECORD ~ R2F_CMD_EVENT
+    int         pnum;                   // process number of the stream
+
+    char        url[256];               // R2F_CMD_RECORD, stream url
+    char        user[32];
+    char        pass[32];
+    char        file[256];              // R2F_CMD_RECORD, save path, empty - the generated one
+    int         filefmt;                // R2F_CMD_RECORD, R2F_FMT_AVI, R2F_FMT_MP4 or R2F_FMT_FMP4
+    uint32      post;                   // R2F_CMD_EVENT, post-roll (s), 0 - the configured one
+
+    R2FCMDSRC * p_src;                  // the source, its done callback is called after the execution
+    int64       tag;                    // the source's own id of the command
+
+    int         result;                 // R2F_CMD_OK ~ R2F_CMD_BUSY, set by the executor
+    uint32      s_time;                 // R2F_CMD_STOP, start time of the stopped recording
+} R2FCMD;
+
+/**
+ * Command source. start and stop are called by r2f_cmd_init and r2f_cmd_deinit,
+ * the source puts the commands with r2f_cmd_put or runs them with r2f_cmd_run.
+ * done is called on the executor thread for the commands put, it may be NULL.
+ * It is not called after r2f_cmd_deinit begins, before the stop of the source
+ */
+struct _R2FCMDSRC
+{
+    const char * name;
+
+    BOOL     (* start)(R2FCMDSRC * p_src);
+    void     (* stop)(R2FCMDSRC * p_src);
+    void     (* done)(R2FCMDSRC * p_src, R2FCMD * p_cmd);
+
+    void      * priv;
+    R2FCMDSRC * next;
+};
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Add a command source, before r2f_cmd_init
+ */
+void r2f_cmd_register(R2FCMDSRC * p_src);
+
+/**
+ * Start the executor thread and the registered sources, depth 0 - R2F_CMD_QUEUE_DEF
+ */
+BOOL r2f_cmd_init(int depth);
+
+/**
+ * Stop the sources, then the executor, the queued commands are executed first
+ * without their done callbacks
+ */
+void r2f_cmd_deinit();
+
+/**
+ * Queue the command for the executor thread, the command is copied.
+ * Blocks while the queue is full
+ */
+BOOL r2f_cmd_put(R2FCMD * p_cmd);
+
+/**
+ * Execute the command on the calling thread, serialized with the executor.
+ * Return p_cmd->result
+ */
+int  r2f_cmd_run(R2FCMD * p_cmd);
+
+/**
+ * Write the recording streams as a json object into buf, return the length, 
+ * -1 if buf is too small
+ */
+int  r2f_cmd_status(char * buf, int len);
+
+/**
+ * Execute the command, implemented by the recorder (r2f.cpp).
+ * Called with the executor lock held, the done callback too
+ */
+int  r2f_cmd_exec(R2FCMD * p_cmd);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // R2F_CMD_H
+
+
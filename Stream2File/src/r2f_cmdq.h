@@ -0,0 +1,51 @@
+/***************************************************************************************
+ *
+ *  IMPORTANT: READ BEFORE DOWNLOADING, COPYING, INSTALLING OR USING.
+ *
+ *  By downloading, copying, installing or using the software you agree to this license.
+ *  If you do not agree to this license, do not download, install, 
+ *  copy or use the software.
+ *
+ *  Copyright (C) 2014-2020, Happytimesoft Corporation, all rights reserved.
+ *
+ *  Redistribution and use in binary forms, with or without modification, are permitted.
+ *
+ *  Unless required by applicable law or agreed to in writing, software distributed 
+ *  under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ *  CONDITIONS OF ANY KIND, either express or implied. See the License for the specific
+ *  language governing permissions and limitations under the License.
+ *
+****************************************************************************************/
+
+
+#ifndef R2F_CMDQ_H
+#define R2F_CMDQ_H
+
+#include "r2f_cmd.h"
+
+
+#define R2F_CMDQ_INI            "simprec.ini"
+#define R2F_CMDQ_POLL_DEF       100         // default poll interval (ms)
+#define R2F_CMDQ_INFLIGHT       256         // max commands queued and not yet marked done
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifdef CMDQ_MYSQL
+
+/**
+ * MySQL cmdq adapter, the commands of the rooms configured in simprec.ini 
+ * are fetched on its own thread and the status updates are written back in batches
+ */
+R2FCMDSRC * r2f_cmdq_src();
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // R2F_CMDQ_H
+
+
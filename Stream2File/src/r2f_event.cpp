@@ -0,0 +1,378 @@
+/***************************************************************************************
+ *
+ *  IMPORTANT: READ BEFORE DOWNLOADING, COPYING, INSTALLING OR USING.
+ *
+ *  By downloading, copying, installing or using the software you agree to this license.
+ *  If you do not agree to this license, do not download, install, 
+ *  copy or use the software.
+ *
+ *  Copyright (C) 2014-2020, Happytimesoft Corporation, all rights reserved.
+ *
+ *  Redistribution and use in binary forms, with or without modification, are permitted.
+ *
+ *  Unless required by applicable law or agreed to in writing, software distributed 
+ *  under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ *  CONDITIONS OF ANY KIND, either express or implied. See the License for the specific
+ *  language governing permissions and limitations under the License.
+ *
+****************************************************************************************/
+
+
+#include "sys_inc.h"
+#include "r2f_event.h"
+
+#if __WINDOWS_OS__
+#define r2f_event_mb()          MemoryBarrier()
+#else
+#define r2f_event_mb()          __sync_synchronize()
+#endif
+
+/***********************************************************/
+
+/**
+ * Audio frames start a GOP only in the audio only streams
+ */
+static BOOL r2f_event_key(R2FEVT * p_ev, int type, BOOL key)
+{
+    if (R2F_EF_AUDIO == type)
+    {
+        return !p_ev->video;
+    }
+
+    return key;
+}
+
+/**
+ * Release the oldest held frame
+ */
+static void r2f_event_pop(R2FEVT * p_ev)
+{
+    R2FEFRM * p_frm = &p_ev->frms[p_ev->tail & p_ev->mask];
+
+    p_ev->bytes -= p_frm->size;
+    p_ev->tail++;
+    p_ev->stat.evicted++;
+
+    r2f_event_free(p_frm);
+}
+
+/**
+ * Drop the oldest GOP, the ring starts at the next key frame or is empty
+ */
+static void r2f_event_drop_gop(R2FEVT * p_ev)
+{
+    do
+    {
+        r2f_event_pop(p_ev);
+    } while (p_ev->tail != p_ev->head && !p_ev->frms[p_ev->tail & p_ev->mask].key);
+}
+
+static void r2f_event_clear(R2FEVT * p_ev)
+{
+    while (p_ev->tail != p_ev->head)
+    {
+        r2f_event_pop(p_ev);
+    }
+}
+
+/**
+ * Drop the oldest GOPs while the GOP after it still starts in the pre-roll,
+ * the ring covers at least the pre-roll and starts at a key frame
+ */
+static void r2f_event_trim(R2FEVT * p_ev, uint32 now)
+{
+    uint32 i;
+
+    while (p_ev->tail != p_ev->head)
+    {
+        for (i = p_ev->tail + 1; i != p_ev->head; i++)
+        {
+            if (p_ev->frms[i & p_ev->mask].key)
+            {
+                break;
+            }
+        }
+
+        if (i == p_ev->head || (int32)(now - p_ev->frms[i & p_ev->mask].ms) < (int32)p_ev->pre_ms)
+        {
+            break;
+        }
+
+        r2f_event_drop_gop(p_ev);
+    }
+}
+
+static BOOL r2f_event_alloc(R2FEVT * p_ev)
+{
+    uint32 depth = 64, need;
+
+    // the pre-roll plus a GOP of margin, about 64 video and audio frames per second
+    need = (p_ev->pre_ms / 1000 * 2 + 10) * 64;
+    while (depth < need && depth < R2F_EVT_FRAMES_MAX)
+    {
+        depth <<= 1;
+    }
+
+    p_ev->frms = (R2FEFRM *)malloc(depth * sizeof(R2FEFRM));
+    if (NULL == p_ev->frms)
+    {
+        log_print(HT_LOG_ERR, "%s, malloc failed\r\n", __FUNCTION__);
+        return FALSE;
+    }
+
+    memset(p_ev->frms, 0, depth * sizeof(R2FEFRM));
+
+    p_ev->mask = depth - 1;
+    p_ev->head = p_ev->tail = 0;
+    p_ev->bytes = 0;
+
+    return TRUE;
+}
+
+/***********************************************************/
+
+void r2f_event_set(R2FEVT * p_ev, int mode, uint32 pre_sec, uint32 post_sec, const char * meta)
+{
+    memset(p_ev, 0, sizeof(R2FEVT));
+
+    p_ev->mode = (R2F_REC_EVENT == mode) ? R2F_REC_EVENT : R2F_REC_CONT;
+    p_ev->state = R2F_EVT_IDLE;
+    p_ev->pre_ms = (pre_sec > 0 ? pre_sec : R2F_EVT_PRE_DEF) * 1000;
+    p_ev->post_ms = (post_sec > 0 ? post_sec : R2F_EVT_POST_DEF) * 1000;
+
+    if (meta)
+    {
+        strncpy(p_ev->meta, meta, sizeof(p_ev->meta)-1);
+    }
+}
+
+BOOL r2f_event_trigger(R2FEVT * p_ev, uint32 post_sec)
+{
+    if (R2F_REC_EVENT != p_ev->mode)
+    {
+        return FALSE;
+    }
+
+    p_ev->trig_post = post_sec > 0 ? post_sec * 1000 : p_ev->post_ms;
+    p_ev->stat.triggers++;
+
+    // the post-roll must be visible before the sequence, concurrent 
+    // triggers may lose an increment, but the sequence still changes
+    r2f_event_mb();
+    p_ev->trig_seq++;
+
+    return TRUE;
+}
+
+BOOL r2f_event_meta(R2FEVT * p_ev, uint8 * p_data, int len)
+{
+    int i, plen = strlen(p_ev->meta);
+
+    if (R2F_REC_EVENT != p_ev->mode || plen == 0)
+    {
+        return FALSE;
+    }
+
+    for (i = 0; i + plen <= len; i++)
+    {
+        if (p_data[i] == (uint8)p_ev->meta[0] && memcmp(p_data + i, p_ev->meta, plen) == 0)
+        {
+            return r2f_event_trigger(p_ev, 0);
+        }
+    }
+
+    return FALSE;
+}
+
+int r2f_event_frame(R2FEVT * p_ev, int type, BOOL key)
+{
+    uint32 now, post;
+    
+    if (R2F_REC_EVENT != p_ev->mode)
+    {
+        return R2F_EVT_WRITE;
+    }
+    else if (p_ev->flush)
+    {
+        return R2F_EVT_WRITE;
+    }
+
+    if (R2F_EF_VIDEO == type && !p_ev->video)
+    {
+        // the audio held so far is not aligned to the video key frames
+        p_ev->video = 1;
+        r2f_event_clear(p_ev);
+    }
+
+    key = r2f_event_key(p_ev, type, key);
+    now = sys_os_get_coarse_ms();
+
+    if (p_ev->seen_seq != p_ev->trig_seq)
+    {
+        p_ev->seen_seq = p_ev->trig_seq;
+
+        // read the post-roll after the sequence
+        r2f_event_mb();
+        post = p_ev->trig_post;
+
+        if (R2F_EVT_IDLE == p_ev->state)
+        {
+            p_ev->state = R2F_EVT_REC;
+            p_ev->written = 1;
+            p_ev->flush = (p_ev->tail != p_ev->head);
+            p_ev->rec_end = now + post;
+            p_ev->stat.events++;
+
+            log_print(HT_LOG_INFO, "%s, event %u start, pre-roll %u frames, post-roll %u ms\r\n", 
+                __FUNCTION__, p_ev->stat.events, p_ev->head - p_ev->tail, post);
+
+            return R2F_EVT_FLUSH;
+        }
+        else if ((int32)(now + post - p_ev->rec_end) > 0)
+        {
+            p_ev->rec_end = now + post;
+        }
+
+        return R2F_EVT_WRITE;
+    }
+
+    if (R2F_EVT_REC == p_ev->state)
+    {
+        if (key && (int32)(now - p_ev->rec_end) >= 0)
+        {
+            p_ev->state = R2F_EVT_IDLE;
+            p_ev->written = 0;
+
+            log_print(HT_LOG_INFO, "%s, event %u end\r\n", __FUNCTION__, p_ev->stat.events);
+
+            return R2F_EVT_END;
+        }
+
+        return R2F_EVT_WRITE;
+    }
+
+    return R2F_EVT_HOLD;
+}
+
+void r2f_event_put(R2FEVT * p_ev, int type, uint8 * p_buf, int len, int size, uint32 ts, BOOL key)
+{
+    uint32 now;
+    R2FEFRM * p_frm;
+
+    key = r2f_event_key(p_ev, type, key);
+
+    if (NULL == p_ev->frms && !r2f_event_alloc(p_ev))
+    {
+        // released below, as in front of the first key frame
+        key = FALSE;
+    }
+
+    if (key)
+    {
+        now = sys_os_get_coarse_ms();
+        r2f_event_trim(p_ev, now);
+    }
+
+    // GOPs too long for the ring lose their oldest GOP
+    while (p_ev->tail != p_ev->head && 
+        (p_ev->head - p_ev->tail > p_ev->mask || p_ev->bytes + size > R2F_EVT_BYTES_MAX))
+    {
+        r2f_event_drop_gop(p_ev);
+    }
+
+    // the ring starts at a key frame
+    if (p_ev->tail == p_ev->head && !key)
+    {
+        R2FEFRM frm;
+
+        frm.type = type;
+        frm.size = size;
+        frm.p_buf = p_buf;
+
+        r2f_event_free(&frm);
+        return;
+    }
+
+    p_frm = &p_ev->frms[p_ev->head & p_ev->mask];
+    p_frm->type = type;
+    p_frm->key = key;
+    p_frm->ts = ts;
+    p_frm->ms = sys_os_get_coarse_ms();
+    p_frm->len = len;
+    p_frm->size = size;
+    p_frm->p_buf = p_buf;
+
+    p_ev->head++;
+    p_ev->bytes += size;
+    p_ev->stat.held++;
+}
+
+void r2f_event_hold(R2FEVT * p_ev, int type, uint8 * p_data, int len, uint32 ts, BOOL key)
+{
+    int size = len;
+    uint8 * p_buf;
+
+    // nothing to copy in front of the first key frame
+    if (p_ev->tail == p_ev->head && !r2f_event_key(p_ev, type, key))
+    {
+        return;
+    }
+
+    p_buf = frm_buf_get(len, &size);
+    if (NULL == p_buf)
+    {
+        log_print(HT_LOG_ERR, "%s, alloc %d failed\r\n", __FUNCTION__, len);
+        return;
+    }
+
+    memcpy(p_buf, p_data, len);
+
+    r2f_event_put(p_ev, type, p_buf, len, size, ts, key);
+}
+
+BOOL r2f_event_get(R2FEVT * p_ev, R2FEFRM * p_frm)
+{
+    if (p_ev->tail == p_ev->head)
+    {
+        p_ev->flush = 0;
+        return FALSE;
+    }
+
+    memcpy(p_frm, &p_ev->frms[p_ev->tail & p_ev->mask], sizeof(R2FEFRM));
+
+    p_ev->bytes -= p_frm->size;
+    p_ev->tail++;
+    p_ev->stat.flushed++;
+
+    return TRUE;
+}
+
+void r2f_event_free(R2FEFRM * p_frm)
+{
+    frm_buf_free(p_frm->p_buf, p_frm->size);
+
+    p_frm->p_buf = NULL;
+}
+
+BOOL r2f_event_stop(R2FEVT * p_ev)
+{
+    if (R2F_REC_EVENT != p_ev->mode)
+    {
+        return FALSE;
+    }
+
+    if (p_ev->frms)
+    {
+        r2f_event_clear(p_ev);
+        
+        free(p_ev->frms);
+        p_ev->frms = NULL;
+    }
+
+    log_print(HT_LOG_INFO, "%s, events %u, triggers %u, held %u, evicted %u, flushed %u\r\n", 
+        __FUNCTION__, p_ev->stat.events, p_ev->stat.triggers, p_ev->stat.held, 
+        p_ev->stat.evicted, p_ev->stat.flushed);
+
+    return !p_ev->written;
+}
+
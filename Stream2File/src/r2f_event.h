@@ -0,0 +1,161 @@
+/***************************************************************************************
+ *
+ *  IMPORTANT: READ BEFORE DOWNLOADING, COPYING, INSTALLING OR USING.
+ *
+ *  By downloading, copying, installing or using the software you agree to this license.
+ *  If you do not agree to this license, do not download, install, 
+ *  copy or use the software.
+ *
+ *  Copyright (C) 2014-2020, Happytimesoft Corporation, all rights reserved.
+ *
+ *  Redistribution and use in binary forms, with or without modification, are permitted.
+ *
+ *  Unless required by applicable law or agreed to in writing, software distributed 
+ *  under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ *  CONDITIONS OF ANY KIND, either express or implied. See the License for the specific
+ *  language governing permissions and limitations under the License.
+ *
+****************************************************************************************/
+
+
+#ifndef R2F_EVENT_H
+#define R2F_EVENT_H
+
+
+#define R2F_REC_CONT            0           // continuous recording
+#define R2F_REC_EVENT           1           // event triggered recording
+
+#define R2F_EVT_IDLE            0           // holding the pre-event frames
+#define R2F_EVT_REC             1           // recording an event
+
+#define R2F_EVT_HOLD            0           // hold the frame in the ring
+#define R2F_EVT_WRITE           1           // write the frame
+#define R2F_EVT_FLUSH           2           // an event starts, write the held frames, then the frame
+#define R2F_EVT_END             3           // the post-roll ended in front of this key frame, 
+                                            // switch the segment and hold the frame
+
+#define R2F_EF_VIDEO            0           // contiguous video frame
+#define R2F_EF_AUDIO            1           // audio frame
+
+#define R2F_EVT_PRE_DEF         10          // default pre-roll (s)
+#define R2F_EVT_POST_DEF        30          // default post-roll (s)
+#define R2F_EVT_FRAMES_MAX      4096        // max frames held per stream
+#define R2F_EVT_BYTES_MAX       (32*1024*1024)  // max bytes held per stream
+#define R2F_EVT_META_LEN        64          // max length of the metadata trigger pattern
+
+/**
+ * Held frame, the ring owns the frame buffer
+ */
+typedef struct
+{
+    uint32      type        : 1;        // R2F_EF_VIDEO or R2F_EF_AUDIO
+    uint32      key         : 1;        // the frame starts a GOP
+    uint32      reserved    : 30;
+
+    uint32      ts;                     // rtp timestamp
+    uint32      ms;                     // arrival time, coarse clock
+    int         len;                    // p_buf data length
+    int         size;                   // p_buf allocated size
+    uint8     * p_buf;
+} R2FEFRM;
+
+typedef struct
+{
+    uint32      events;                 // recorded events
+    uint32      triggers;               // received triggers, the ones extending an event included
+    uint32      held;                   // frames put into the ring
+    uint32      evicted;                // frames dropped out of the ring
+    uint32      flushed;                // pre-event frames written
+} R2FESTAT;
+
+/**
+ * Event recording state of a stream. The frames are held in a GOP aligned ring 
+ * covering at least the pre-roll, a trigger flushes the ring into the open segment
+ * and the frames are recorded until the post-roll ends, then the segment is
+ * switched at the next key frame and the stream holds the frames again.
+ * The ring is used by the recording thread of the stream only, the triggers
+ * are passed to it through trig_seq
+ */
+typedef struct
+{
+    uint32      mode        : 1;        // R2F_REC_CONT or R2F_REC_EVENT
+    uint32      state       : 1;        // R2F_EVT_IDLE or R2F_EVT_REC
+    uint32      video       : 1;        // the stream has video, the ring is cut at the video key frames
+    uint32      written     : 1;        // the current segment holds an event
+    uint32      flush       : 1;        // the held frames are being written
+    uint32      reserved    : 27;
+
+    uint32      pre_ms;                 // pre-roll (ms)
+    uint32      post_ms;                // default post-roll (ms)
+    char        meta[R2F_EVT_META_LEN]; // the rtsp metadata containing it triggers an event, empty - disable
+
+    volatile uint32 trig_seq;           // increased by every trigger
+    volatile uint32 trig_post;          // post-roll of the last trigger (ms)
+    uint32      seen_seq;               // last trigger handled by the recording thread
+    uint32      rec_end;                // end of the post-roll, coarse clock
+
+    R2FEFRM   * frms;                   // frame ring, allocated at the first held frame
+    uint32      mask;                   // depth - 1, depth is a power of 2
+    uint32      head;                   // next put position
+    uint32      tail;                   // oldest held frame
+    uint32      bytes;                  // held bytes
+
+    R2FESTAT    stat;
+} R2FEVT;
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Set the recording mode of the stream, pre_sec and post_sec are seconds,
+ * 0 means the default. meta may be NULL
+ */
+void r2f_event_set(R2FEVT * p_ev, int mode, uint32 pre_sec, uint32 post_sec, const char * meta);
+
+/**
+ * Start or extend an event, post_sec 0 means the configured post-roll. 
+ * Any thread, the event starts at the next frame of the stream.
+ * Return FALSE if the stream records continuously
+ */
+BOOL r2f_event_trigger(R2FEVT * p_ev, uint32 post_sec);
+
+/**
+ * Trigger an event if the rtsp metadata contains the configured pattern
+ */
+BOOL r2f_event_meta(R2FEVT * p_ev, uint8 * p_data, int len);
+
+/**
+ * Called by the recording thread for every frame, type is R2F_EF_VIDEO or R2F_EF_AUDIO.
+ * Return R2F_EVT_HOLD ~ R2F_EVT_END
+ */
+int  r2f_event_frame(R2FEVT * p_ev, int type, BOOL key);
+
+/**
+ * Hold the frame in the ring, r2f_event_put takes the frm_buf_get buffer over,
+ * r2f_event_hold copies the data.
+ * The ring starts at a key frame and is cut by whole GOPs to the pre-roll
+ */
+void r2f_event_put(R2FEVT * p_ev, int type, uint8 * p_buf, int len, int size, uint32 ts, BOOL key);
+void r2f_event_hold(R2FEVT * p_ev, int type, uint8 * p_data, int len, uint32 ts, BOOL key);
+
+/**
+ * Take the oldest held frame, the caller releases it with r2f_event_free.
+ * The frames written meanwhile pass r2f_event_frame until the ring is empty
+ */
+BOOL r2f_event_get(R2FEVT * p_ev, R2FEFRM * p_frm);
+void r2f_event_free(R2FEFRM * p_frm);
+
+/**
+ * Release the ring at the stream stop, return TRUE if the stream records events 
+ * and the current segment holds none, the caller removes the empty segment
+ */
+BOOL r2f_event_stop(R2FEVT * p_ev);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // R2F_EVENT_H
+
@@ -0,0 +1,608 @@
+/***************************************************************************************
+ *
+ *  IMPORTANT: READ BEFORE DOWNLOADING, COPYING, INSTALLING OR USING.
+ *
+ *  By downloading, copying, installing or using the software you agree to this license.
+ *  If you do not agree to this license, do not download, install, 
+ *  copy or use the software.
+ *
+ *  Copyright (C) 2014-2020, Happytimesoft Corporation, all rights reserved.
+ *
+ *  Redistribution and use in binary forms, with or without modification, are permitted.
+ *
+ *  Unless required by applicable law or agreed to in writing, software distributed 
+ *  under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ *  CONDITIONS OF ANY KIND, either express or implied. See the License for the specific
+ *  language governing permissions and limitations under the License.
+ *
+****************************************************************************************/
+
+
+#include "sys_inc.h"
+#include "r2f_final.h"
+#include "r2f_rua.h"
+#include "avi_write.h"
+#ifdef MP4_FORMAT
+#include "mp4_write.h"
+#endif
+
+typedef struct
+{
+    uint32      run_flag    : 1;
+    uint32      reserved    : 31;
+
+    int         threads;
+    pthread_t   tids[R2F_FIN_THREADS_MAX];
+    void      * p_sig;                  // wake up signal
+    void      * mutex;                  // protects the queue and the metrics
+
+    R2FFJOB   * jobs;                   // pending segments ring
+    uint32      depth;
+    uint32      head;                   // next put position
+    uint32      tail;                   // next get position
+
+    R2FFSTAT    stat;
+} R2FFINAL;
+
+/***********************************************************/
+
+static R2FFINAL     r2f_final;
+
+/***********************************************************/
+
+static void r2f_final_lock()
+{
+    if (r2f_final.mutex)
+    {
+        sys_os_mutex_enter(r2f_final.mutex);
+    }
+}
+
+static void r2f_final_unlock()
+{
+    if (r2f_final.mutex)
+    {
+        sys_os_mutex_leave(r2f_final.mutex);
+    }
+}
+
+/**
+ * The job type of a segment opened ahead, only avi segments are opened without MP4_FORMAT
+ */
+static int r2f_final_type(int filefmt)
+{
+#ifdef MP4_FORMAT
+    if (R2F_FMT_IS_MP4(filefmt))
+    {
+        return R2F_FIN_MP4;
+    }
+#endif
+
+    return R2F_FIN_AVI;
+}
+
+/**
+ * Write the trailer of the segment and close it, then account the latency
+ */
+static void r2f_final_close(R2FFJOB * p_job, BOOL direct)
+{
+    char   filename[256] = {'\0'};
+    uint32 now, wait, lat, pending;
+
+    now = sys_os_get_ms();
+    wait = now - p_job->queued;
+
+    if (R2F_FIN_AVI == p_job->type)
+    {
+        AVICTX * p_ctx = (AVICTX *)p_job->p_ctx;
+
+        strncpy(filename, p_ctx->filename, sizeof(filename)-1);
+        avi_write_close(p_ctx);
+    }
+#ifdef MP4_FORMAT
+    else if (R2F_FIN_MP4 == p_job->type)
+    {
+        MP4CTX * p_ctx = (MP4CTX *)p_job->p_ctx;
+
+        strncpy(filename, p_ctx->filename, sizeof(filename)-1);
+        mp4_write_close(p_ctx);
+    }
+#endif
+
+    lat = sys_os_get_ms() - p_job->queued;
+
+    if (p_job->drop)
+    {
+        remove(filename);
+
+        r2f_final_lock();
+        if (!direct)
+        {
+            r2f_final.stat.active--;
+        }
+        r2f_final_unlock();
+
+        log_print(HT_LOG_INFO, "%s, %s dropped\r\n", __FUNCTION__, filename);
+        return;
+    }
+
+    r2f_final_lock();
+
+    if (!direct)
+    {
+        r2f_final.stat.active--;
+    }
+    else
+    {
+        r2f_final.stat.direct++;
+    }
+
+    r2f_final.stat.finalized++;
+    r2f_final.stat.wait_last = wait;
+    r2f_final.stat.lat_last = lat;
+    r2f_final.stat.lat_total += lat;
+
+    if (wait > r2f_final.stat.wait_max)
+    {
+        r2f_final.stat.wait_max = wait;
+    }
+
+    if (lat > r2f_final.stat.lat_max)
+    {
+        r2f_final.stat.lat_max = lat;
+    }
+
+    pending = r2f_final.stat.pending;
+
+    r2f_final_unlock();
+
+    log_print(HT_LOG_INFO, "%s, %s finalized%s, wait %u ms, latency %u ms, pending %u\r\n", 
+        __FUNCTION__, filename, direct ? " directly" : "", wait, lat, pending);
+}
+
+/**
+ * Open the next segment of a stream ahead of the switch
+ */
+static void r2f_final_next(R2FFJOB * p_job)
+{
+    void * p_ctx;
+    uint32 lat;
+    R2FNEXT * p_next = (R2FNEXT *)p_job->p_ctx;
+
+    p_ctx = r2f_seg_open(&p_next->seg, p_next->path);
+
+    lat = sys_os_get_ms() - p_job->queued;
+
+    r2f_final_lock();
+
+    p_next->p_ctx = p_ctx;
+    p_next->state = p_ctx ? R2F_NEXT_READY : R2F_NEXT_FAILED;
+
+    r2f_final.stat.active--;
+    r2f_final.stat.opened++;
+    r2f_final.stat.open_last = lat;
+
+    if (lat > r2f_final.stat.open_max)
+    {
+        r2f_final.stat.open_max = lat;
+    }
+
+    r2f_final_unlock();
+
+    log_print(HT_LOG_DBG, "%s, %s opened ahead, latency %u ms\r\n", __FUNCTION__, p_next->path, lat);
+}
+
+static void * r2f_final_thread(void * argv)
+{
+    BOOL got;
+    R2FFJOB job;
+    int index = (int)(size_t)argv;
+
+    while (1)
+    {
+        got = FALSE;
+
+        sys_os_mutex_enter(r2f_final.mutex);
+
+        if (r2f_final.tail != r2f_final.head)
+        {
+            job = r2f_final.jobs[r2f_final.tail % r2f_final.depth];
+            r2f_final.tail++;
+
+            r2f_final.stat.pending--;
+            r2f_final.stat.active++;
+            got = TRUE;
+        }
+        else if (!r2f_final.run_flag)
+        {
+            // stopped and drained
+            sys_os_mutex_leave(r2f_final.mutex);
+            break;
+        }
+
+        sys_os_mutex_leave(r2f_final.mutex);
+
+        if (!got)
+        {
+            sys_os_sig_wait_timeout(r2f_final.p_sig, 100);
+        }
+        else if (R2F_FIN_OPEN == job.type)
+        {
+            r2f_final_next(&job);
+        }
+        else
+        {
+            r2f_final_close(&job, FALSE);
+        }
+    }
+
+    r2f_final.tids[index] = 0;
+
+    log_print(HT_LOG_INFO, "%s, finalizer %d exit\r\n", __FUNCTION__, index);
+
+    return NULL;
+}
+
+/**
+ * Queue the job, return FALSE if there is no thread or the queue is full
+ */
+static BOOL r2f_final_put(R2FFJOB * p_job)
+{
+    if (r2f_final.threads <= 0)
+    {
+        return FALSE;
+    }
+
+    sys_os_mutex_enter(r2f_final.mutex);
+
+    if (r2f_final.head - r2f_final.tail >= r2f_final.depth)
+    {
+        sys_os_mutex_leave(r2f_final.mutex);
+
+        log_print(HT_LOG_WARN, "%s, finalizer queue full, depth %u\r\n", __FUNCTION__, r2f_final.depth);
+        return FALSE;
+    }
+
+    r2f_final.jobs[r2f_final.head % r2f_final.depth] = *p_job;
+    r2f_final.head++;
+
+    r2f_final.stat.pending++;
+    if (r2f_final.stat.pending > r2f_final.stat.high_water)
+    {
+        r2f_final.stat.high_water = r2f_final.stat.pending;
+    }
+
+    sys_os_mutex_leave(r2f_final.mutex);
+
+    sys_os_sig_sign(r2f_final.p_sig);
+
+    return TRUE;
+}
+
+static void r2f_final_segment(int type, void * p_ctx, BOOL drop)
+{
+    R2FFJOB job;
+
+    memset(&job, 0, sizeof(job));
+
+    job.type = type;
+    job.drop = drop;
+    job.p_ctx = p_ctx;
+    job.queued = sys_os_get_ms();
+
+    if (!r2f_final_put(&job))
+    {
+        // the caller pays for the close, the queue stays bounded
+        r2f_final_close(&job, TRUE);
+    }
+}
+
+/***********************************************************/
+
+BOOL r2f_final_init(int threads, int depth)
+{
+    int i;
+
+    memset(&r2f_final, 0, sizeof(r2f_final));
+
+    if (threads < 0)
+    {
+        threads = R2F_FIN_THREADS_DEF;
+    }
+    else if (threads == 0)
+    {
+        return TRUE;
+    }
+    else if (threads > R2F_FIN_THREADS_MAX)
+    {
+        threads = R2F_FIN_THREADS_MAX;
+    }
+
+    if (depth <= 0)
+    {
+        depth = R2F_FIN_QUEUE_DEF;
+    }
+    else if (depth > R2F_FIN_QUEUE_MAX)
+    {
+        depth = R2F_FIN_QUEUE_MAX;
+    }
+
+    r2f_final.jobs = (R2FFJOB *)malloc(depth * sizeof(R2FFJOB));
+    if (NULL == r2f_final.jobs)
+    {
+        log_print(HT_LOG_ERR, "%s, malloc failed\r\n", __FUNCTION__);
+        return FALSE;
+    }
+
+    r2f_final.depth = depth;
+    r2f_final.p_sig = sys_os_create_sig();
+    r2f_final.mutex = sys_os_create_mutex();
+    r2f_final.run_flag = 1;
+
+    for (i = 0; i < threads; i++)
+    {
+        r2f_final.tids[i] = sys_os_create_thread((void *)r2f_final_thread, (void *)(size_t)i);
+        if (r2f_final.tids[i] == 0)
+        {
+            log_print(HT_LOG_ERR, "%s, create finalizer thread failed\r\n", __FUNCTION__);
+            break;
+        }
+
+        r2f_final.threads++;
+    }
+
+    r2f_final.stat.threads = r2f_final.threads;
+    r2f_final.stat.depth = r2f_final.depth;
+
+    if (r2f_final.threads == 0)
+    {
+        r2f_final_deinit();
+        return FALSE;
+    }
+
+    log_print(HT_LOG_INFO, "%s, finalizer threads %d, queue depth %u\r\n", 
+        __FUNCTION__, r2f_final.threads, r2f_final.depth);
+
+    return TRUE;
+}
+
+void r2f_final_deinit()
+{
+    int i;
+
+    if (r2f_final.mutex)
+    {
+        sys_os_mutex_enter(r2f_final.mutex);
+        r2f_final.run_flag = 0;
+        sys_os_mutex_leave(r2f_final.mutex);
+    }
+
+    // the threads finish the pending segments before exit
+    for (i = 0; i < r2f_final.threads; i++)
+    {
+        sys_os_sig_sign(r2f_final.p_sig);
+    }
+
+    for (i = 0; i < r2f_final.threads; i++)
+    {
+        while (r2f_final.tids[i])
+        {
+            usleep(10*1000);
+        }
+    }
+
+    if (r2f_final.stat.finalized > 0)
+    {
+        log_print(HT_LOG_INFO, "%s, segments %u, direct %u, high water %u, "
+            "latency mean %u ms, max %u ms, wait max %u ms, opened %u, open max %u ms\r\n", 
+            __FUNCTION__, r2f_final.stat.finalized, r2f_final.stat.direct, r2f_final.stat.high_water, 
+            (uint32)(r2f_final.stat.lat_total / r2f_final.stat.finalized), 
+            r2f_final.stat.lat_max, r2f_final.stat.wait_max, 
+            r2f_final.stat.opened, r2f_final.stat.open_max);
+    }
+
+    if (r2f_final.p_sig)
+    {
+        sys_os_destroy_sig_mutex(r2f_final.p_sig);
+        r2f_final.p_sig = NULL;
+    }
+
+    if (r2f_final.mutex)
+    {
+        sys_os_destroy_sig_mutex(r2f_final.mutex);
+        r2f_final.mutex = NULL;
+    }
+
+    if (r2f_final.jobs)
+    {
+        free(r2f_final.jobs);
+        r2f_final.jobs = NULL;
+    }
+
+    r2f_final.threads = 0;
+}
+
+void r2f_final_avi(AVICTX * p_ctx)
+{
+    if (p_ctx)
+    {
+        r2f_final_segment(R2F_FIN_AVI, p_ctx, FALSE);
+    }
+}
+
+#ifdef MP4_FORMAT
+void r2f_final_mp4(MP4CTX * p_ctx)
+{
+    if (p_ctx)
+    {
+        r2f_final_segment(R2F_FIN_MP4, p_ctx, FALSE);
+    }
+}
+#endif
+
+void r2f_final_get_stat(R2FFSTAT * p_stat)
+{
+    r2f_final_lock();
+    memcpy(p_stat, &r2f_final.stat, sizeof(R2FFSTAT));
+    r2f_final_unlock();
+}
+
+void * r2f_seg_open(R2FSEG * p_seg, const char * path)
+{
+    if (R2F_FMT_AVI == p_seg->filefmt)
+    {
+        AVICTX * p_ctx = avi_write_open(path);
+        if (NULL == p_ctx)
+        {
+            return NULL;
+        }
+
+        avi_write_set_sync(p_ctx, p_seg->sync_mode, p_seg->sync_ms);
+
+        if (p_seg->ctxf_video)
+        {
+            p_ctx->ctxf_sps_f = p_seg->ctxf_sps_f;
+            avi_set_video_info(p_ctx, p_seg->v_fps, p_seg->v_width, p_seg->v_height, p_seg->v_fcc);
+        }
+
+        if (p_seg->ctxf_audio)
+        {
+            avi_set_audio_info(p_ctx, p_seg->a_chns, p_seg->a_rate, p_seg->a_fmt, p_seg->a_extra, p_seg->a_extra_len);
+        }
+
+        avi_update_header(p_ctx);
+
+        return p_ctx;
+    }
+#ifdef MP4_FORMAT
+    else if (R2F_FMT_IS_MP4(p_seg->filefmt))
+    {
+        MP4CTX * p_ctx = mp4_write_open((char *)path);
+        if (NULL == p_ctx)
+        {
+            return NULL;
+        }
+
+        if (R2F_FMT_FMP4 == p_seg->filefmt)
+        {
+            mp4_write_set_fragment(p_ctx, p_seg->frag_ms);
+            mp4_write_set_sync(p_ctx, p_seg->sync_mode, p_seg->sync_ms);
+        }
+
+        if (p_seg->ctxf_video)
+        {
+            p_ctx->ctxf_sps_f = p_seg->ctxf_sps_f;
+            mp4_set_video_info(p_ctx, p_seg->v_fps, p_seg->v_width, p_seg->v_height, p_seg->v_fcc);
+        }
+
+        if (p_seg->ctxf_audio)
+        {
+            mp4_set_audio_info(p_ctx, p_seg->a_chns, p_seg->a_rate, p_seg->a_fmt, p_seg->a_extra, p_seg->a_extra_len);
+        }
+
+        mp4_set_timestamp_clock(p_ctx, p_seg->v_clock, p_seg->a_clock);
+
+        mp4_update_header(p_ctx);
+
+        return p_ctx;
+    }
+#endif
+
+    return NULL;
+}
+
+BOOL r2f_final_open(R2FNEXT * p_next)
+{
+    R2FFJOB job;
+
+    memset(&job, 0, sizeof(job));
+
+    job.type = R2F_FIN_OPEN;
+    job.p_ctx = p_next;
+    job.queued = sys_os_get_ms();
+
+    p_next->p_ctx = NULL;
+    p_next->state = R2F_NEXT_OPENING;
+
+    if (!r2f_final_put(&job))
+    {
+        p_next->state = R2F_NEXT_NONE;
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+void * r2f_final_take(R2FNEXT * p_next, R2FSEG * p_seg)
+{
+    void * p_ctx = NULL;
+    void * p_stale = NULL;
+
+    r2f_final_lock();
+
+    if (R2F_NEXT_READY == p_next->state)
+    {
+        if (memcmp(&p_next->seg, p_seg, sizeof(R2FSEG)) == 0)
+        {
+            p_ctx = p_next->p_ctx;
+        }
+        else
+        {
+            // the stream parameters changed since the open
+            p_stale = p_next->p_ctx;
+        }
+
+        p_next->p_ctx = NULL;
+        p_next->state = R2F_NEXT_NONE;
+    }
+    else if (R2F_NEXT_FAILED == p_next->state)
+    {
+        p_next->state = R2F_NEXT_NONE;
+    }
+
+    r2f_final_unlock();
+
+    if (p_stale)
+    {
+        r2f_final_segment(r2f_final_type(p_next->seg.filefmt), p_stale, TRUE);
+    }
+
+    return p_ctx;
+}
+
+void r2f_final_drop(R2FNEXT * p_next)
+{
+    void * p_ctx = NULL;
+
+    while (R2F_NEXT_OPENING == p_next->state)
+    {
+        usleep(10*1000);
+    }
+
+    r2f_final_lock();
+
+    if (R2F_NEXT_READY == p_next->state)
+    {
+        p_ctx = p_next->p_ctx;
+    }
+
+    p_next->p_ctx = NULL;
+    p_next->state = R2F_NEXT_NONE;
+
+    r2f_final_unlock();
+
+    if (p_ctx)
+    {
+        R2FFJOB job;
+
+        memset(&job, 0, sizeof(job));
+
+        job.type = r2f_final_type(p_next->seg.filefmt);
+        job.drop = 1;
+        job.p_ctx = p_ctx;
+
+        r2f_final_close(&job, TRUE);
+    }
+}
+
+
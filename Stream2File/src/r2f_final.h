@@ -0,0 +1,178 @@
+/***************************************************************************************
+ *
+ *  IMPORTANT: READ BEFORE DOWNLOADING, COPYING, INSTALLING OR USING.
+ *
+ *  By downloading, copying, installing or using the software you agree to this license.
+ *  If you do not agree to this license, do not download, install, 
+ *  copy or use the software.
+ *
+ *  Copyright (C) 2014-2020, Happytimesoft Corporation, all rights reserved.
+ *
+ *  Redistribution and use in binary forms, with or without modification, are permitted.
+ *
+ *  Unless required by applicable law or agreed to in writing, software distributed 
+ *  under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ *  CONDITIONS OF ANY KIND, either express or implied. See the License for the specific
+ *  language governing permissions and limitations under the License.
+ *
+****************************************************************************************/
+
+
+#ifndef R2F_FINAL_H
+#define R2F_FINAL_H
+
+#include "avi.h"
+#ifdef MP4_FORMAT
+#include "mp4_ctx.h"
+#endif
+
+
+#define R2F_FIN_THREADS_DEF     2           // default finalizer threads
+#define R2F_FIN_THREADS_MAX     16
+#define R2F_FIN_QUEUE_DEF       16          // default pending segments
+#define R2F_FIN_QUEUE_MAX       1024
+
+#define R2F_FIN_AVI             0           // AVICTX segment
+#define R2F_FIN_MP4             1           // MP4CTX segment
+#define R2F_FIN_OPEN            2           // R2FNEXT, open the next segment ahead
+
+#define R2F_NEXT_NONE           0           // no next segment
+#define R2F_NEXT_OPENING        1           // queued or being opened
+#define R2F_NEXT_READY          2           // opened and headered, waiting for the switch
+#define R2F_NEXT_FAILED         3           // open failed, retried after the next switch
+
+/**
+ * Pending segment, the finalizer owns the context
+ */
+typedef struct
+{
+    uint32      type        : 2;        // R2F_FIN_AVI, R2F_FIN_MP4 or R2F_FIN_OPEN
+    uint32      drop        : 1;        // an unused segment, remove the file after close
+    uint32      reserved    : 29;
+
+    void      * p_ctx;
+    uint32      queued;                 // sys_os_get_ms when queued
+} R2FFJOB;
+
+/**
+ * Stream parameters a segment is opened with
+ */
+typedef struct
+{
+    int         filefmt;                // R2F_FMT_AVI, R2F_FMT_MP4 or R2F_FMT_FMP4
+    uint32      ctxf_video  : 1;
+    uint32      ctxf_audio  : 1;
+    uint32      ctxf_sps_f  : 1;
+    uint32      reserved    : 29;
+
+    int         sync_mode;              // avi / fmp4 durability policy
+    uint32      sync_ms;
+    int         frag_ms;                // fmp4 fragment duration
+
+    uint32      v_fps;
+    char        v_fcc[4];
+    int         v_width;
+    int         v_height;
+    uint32      v_clock;                // mp4 source timestamp clock
+
+    int         a_chns;
+    int         a_rate;
+    uint16      a_fmt;
+    uint8     * a_extra;                // owned by the stream
+    int         a_extra_len;
+    uint32      a_clock;
+} R2FSEG;
+
+/**
+ * The next segment of a stream, opened in the background under a temporary
+ * name while the current one is recorded. The state is changed by the 
+ * finalizer under its mutex
+ */
+typedef struct
+{
+    volatile int state;                 // R2F_NEXT_NONE ~ R2F_NEXT_FAILED
+    R2FSEG      seg;
+    char        path[256];              // temporary file name
+    void      * p_ctx;                  // AVICTX or MP4CTX when ready
+} R2FNEXT;
+
+/**
+ * Finalizer metrics, the times are in ms
+ */
+typedef struct
+{
+    uint32      threads;                // finalizer threads
+    uint32      depth;                  // max pending segments
+    uint32      pending;                // segments waiting in the queue
+    uint32      active;                 // segments being finalized
+    uint32      high_water;             // max pending segments
+    uint32      finalized;              // segments finalized by the threads
+    uint32      direct;                 // segments finalized on the caller, no thread or the queue was full
+    uint32      wait_last;              // queue wait of the last segment
+    uint32      wait_max;
+    uint32      lat_last;               // queued to closed, the last segment
+    uint32      lat_max;
+    uint64      lat_total;              // sum of the latencies, lat_total / finalized is the mean
+    uint32      opened;                 // next segments opened ahead
+    uint32      open_last;              // queued to opened and headered, the last segment
+    uint32      open_max;
+} R2FFSTAT;
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Start the finalizer threads, threads = 0 means the segments are closed on the caller,
+ * threads < 0 - R2F_FIN_THREADS_DEF
+ */
+BOOL r2f_final_init(int threads, int depth);
+
+/**
+ * Finalize the pending segments and stop the threads
+ */
+void r2f_final_deinit();
+
+/**
+ * Hand over a finished segment, the index / moov are written and the file is closed
+ * in the background. If there is no thread or the queue is full the segment is closed
+ * before the call returns. The context must not be used after the call
+ */
+void r2f_final_avi(AVICTX * p_ctx);
+#ifdef MP4_FORMAT
+void r2f_final_mp4(MP4CTX * p_ctx);
+#endif
+
+void r2f_final_get_stat(R2FFSTAT * p_stat);
+
+/**
+ * Open the segment file, apply the stream parameters and write the header,
+ * return the AVICTX or MP4CTX
+ */
+void * r2f_seg_open(R2FSEG * p_seg, const char * path);
+
+/**
+ * Queue the open of the next segment, p_next->seg and p_next->path are set by the caller.
+ * Return FALSE if there is no thread or the queue is full
+ */
+BOOL r2f_final_open(R2FNEXT * p_next);
+
+/**
+ * Take the ready next segment if it was opened with the same parameters, 
+ * a stale one is dropped in the background. Return NULL if no segment is ready
+ */
+void * r2f_final_take(R2FNEXT * p_next, R2FSEG * p_seg);
+
+/**
+ * The stream stops, wait for the open in progress and remove the unused segment
+ */
+void r2f_final_drop(R2FNEXT * p_next);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // R2F_FINAL_H
+
+
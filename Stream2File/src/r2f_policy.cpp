@@ -0,0 +1,162 @@
+/***************************************************************************************
+ *
+ *  IMPORTANT: READ BEFORE DOWNLOADING, COPYING, INSTALLING OR USING.
+ *
+ *  By downloading, copying, installing or using the software you agree to this license.
+ *  If you do not agree to this license, do not download, install, 
+ *  copy or use the software.
+ *
+ *  Copyright (C) 2014-2020, Happytimesoft Corporation, all rights reserved.
+ *
+ *  Redistribution and use in binary forms, with or without modification, are permitted.
+ *
+ *  Unless required by applicable law or agreed to in writing, software distributed 
+ *  under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ *  CONDITIONS OF ANY KIND, either express or implied. See the License for the specific
+ *  language governing permissions and limitations under the License.
+ *
+****************************************************************************************/
+
+
+#include "sys_inc.h"
+#include "r2f_policy.h"
+
+/***********************************************************/
+
+void r2f_policy_set(R2FPOLICY * p_pol, uint32 recordsize, uint32 recordtime, 
+        uint32 recordwall, uint32 recordgops, BOOL predict)
+{
+    memset(p_pol, 0, sizeof(R2FPOLICY));
+
+    if (recordsize > 0)
+    {
+        p_pol->flags |= R2F_POL_SIZE;
+        p_pol->size = (uint64)recordsize * 1024;
+
+        if (predict)
+        {
+            p_pol->flags |= R2F_POL_BITRATE;
+        }
+    }
+
+    if (recordtime > 0)
+    {
+        p_pol->flags |= R2F_POL_TIME;
+        p_pol->time_ms = recordtime * 1000;
+    }
+
+    if (recordwall > 0)
+    {
+        p_pol->flags |= R2F_POL_WALL;
+        p_pol->wall_sec = recordwall;
+    }
+
+    if (recordgops > 0)
+    {
+        p_pol->flags |= R2F_POL_GOP;
+        p_pol->gops = recordgops;
+    }
+}
+
+void r2f_policy_start(R2FPOLSTATE * p_st, R2FPOLICY * p_pol)
+{
+    uint64 gop_est = p_st->gop_est;
+    uint32 bitrate = p_st->bitrate;
+
+    memset(p_st, 0, sizeof(R2FPOLSTATE));
+
+    memcpy(&p_st->pol, p_pol, sizeof(R2FPOLICY));
+
+    p_st->gop_est = gop_est;
+    p_st->bitrate = bitrate;
+    p_st->start_ms = sys_os_get_coarse_ms();
+    p_st->gop_ms = p_st->start_ms;
+
+    if (p_pol->flags & R2F_POL_WALL)
+    {
+        // once per segment, the frames compare the coarse clock only
+        time_t t = time(NULL);
+        struct tm * p_tm = localtime(&t);
+        uint32 sec = p_tm->tm_hour * 3600 + p_tm->tm_min * 60 + p_tm->tm_sec;
+
+        p_st->wall_ms = p_st->start_ms + (p_pol->wall_sec - sec % p_pol->wall_sec) * 1000;
+    }
+}
+
+BOOL r2f_policy_frame(R2FPOLSTATE * p_st, uint32 len, BOOL key)
+{
+    uint32 now, flags = p_st->pol.flags;
+
+    p_st->bytes += len;
+
+    if (key)
+    {
+        if (p_st->gop_bytes > 0)
+        {
+            now = sys_os_get_coarse_ms();
+
+            // the last GOP weighs 1/4
+            p_st->gop_est = p_st->gop_est ? (p_st->gop_est * 3 + p_st->gop_bytes) / 4 : p_st->gop_bytes;
+
+            if (now - p_st->gop_ms > 0)
+            {
+                p_st->bitrate = (uint32)(p_st->gop_bytes * 8000 / (now - p_st->gop_ms));
+            }
+
+            p_st->gop_ms = now;
+        }
+
+        p_st->gop_bytes = 0;
+        p_st->gops++;
+    }
+
+    p_st->gop_bytes += len;
+
+    if (p_st->due || 0 == flags)
+    {
+        return p_st->due;
+    }
+
+    if ((flags & R2F_POL_SIZE) && p_st->bytes >= p_st->pol.size)
+    {
+        p_st->due = 1;
+    }
+    else if ((flags & R2F_POL_GOP) && p_st->gops >= p_st->pol.gops)
+    {
+        p_st->due = 1;
+    }
+    else if (flags & (R2F_POL_TIME | R2F_POL_WALL))
+    {
+        now = sys_os_get_coarse_ms();
+
+        if ((flags & R2F_POL_TIME) && now - p_st->start_ms >= p_st->pol.time_ms)
+        {
+            p_st->due = 1;
+        }
+        else if ((flags & R2F_POL_WALL) && (int32)(now - p_st->wall_ms) >= 0)
+        {
+            p_st->due = 1;
+        }
+    }
+
+    return p_st->due;
+}
+
+BOOL r2f_policy_key(R2FPOLSTATE * p_st)
+{
+    if (p_st->due)
+    {
+        return TRUE;
+    }
+
+    // at least one GOP per segment
+    if ((p_st->pol.flags & R2F_POL_BITRATE) && p_st->gops > 0 && 
+        p_st->bytes + p_st->gop_est > p_st->pol.size)
+    {
+        p_st->due = 1;
+    }
+
+    return p_st->due;
+}
+
+
@@ -0,0 +1,103 @@
+/***************************************************************************************
+ *
+ *  IMPORTANT: READ BEFORE DOWNLOADING, COPYING, INSTALLING OR USING.
+ *
+ *  By downloading, copying, installing or using the software you agree to this license.
+ *  If you do not agree to this license, do not download, install, 
+ *  copy or use the software.
+ *
+ *  Copyright (C) 2014-2020, Happytimesoft Corporation, all rights reserved.
+ *
+ *  Redistribution and use in binary forms, with or without modification, are permitted.
+ *
+ *  Unless required by applicable law or agreed to in writing, software distributed 
+ *  under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ *  CONDITIONS OF ANY KIND, either express or implied. See the License for the specific
+ *  language governing permissions and limitations under the License.
+ *
+****************************************************************************************/
+
+
+#ifndef R2F_POLICY_H
+#define R2F_POLICY_H
+
+
+#define R2F_POL_SIZE            0x01        // segment size
+#define R2F_POL_TIME            0x02        // segment duration
+#define R2F_POL_WALL            0x04        // wall clock boundary
+#define R2F_POL_GOP             0x08        // key frame count
+#define R2F_POL_BITRATE         0x10        // segment size predicted from the estimated bitrate
+
+/**
+ * Segment switch policy of a stream, the enabled limits are combined,
+ * the first one reached closes the segment
+ */
+typedef struct
+{
+    uint32      flags;                  // R2F_POL_SIZE ~ R2F_POL_BITRATE
+    uint64      size;                   // segment size limit (bytes), R2F_POL_SIZE and R2F_POL_BITRATE
+    uint32      time_ms;                // segment duration (ms)
+    uint32      wall_sec;               // wall clock period (s), aligned to the local midnight, 
+                                        // 3600 switches at the top of every hour
+    uint32      gops;                   // key frames per segment
+} R2FPOLICY;
+
+/**
+ * Per stream policy state, maintained from the frames the writer records.
+ * The checks are counter compares, no file or clock system call per frame
+ */
+typedef struct
+{
+    uint32      due         : 1;        // a limit is reached, switch at the next key frame
+    uint32      reserved    : 31;
+
+    R2FPOLICY   pol;
+
+    uint64      bytes;                  // bytes written to the segment
+    uint32      start_ms;               // segment start, coarse clock
+    uint32      wall_ms;                // coarse clock of the next wall clock boundary
+    uint32      gops;                   // key frames in the segment
+
+    uint64      gop_bytes;              // bytes of the current GOP
+    uint32      gop_ms;                 // coarse clock of the current GOP start
+    uint64      gop_est;                // estimated GOP size (bytes)
+    uint32      bitrate;                // estimated bitrate (bits per second)
+} R2FPOLSTATE;
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Build the policy of the stream configuration, recordsize is KB, 
+ * recordtime and recordwall are seconds
+ */
+void r2f_policy_set(R2FPOLICY * p_pol, uint32 recordsize, uint32 recordtime, 
+        uint32 recordwall, uint32 recordgops, BOOL predict);
+
+/**
+ * Start a new segment, the estimated GOP size is kept over the segments
+ */
+void r2f_policy_start(R2FPOLSTATE * p_st, R2FPOLICY * p_pol);
+
+/**
+ * Account a frame written to the segment, return TRUE once a limit is reached
+ */
+BOOL r2f_policy_frame(R2FPOLSTATE * p_st, uint32 len, BOOL key);
+
+/**
+ * Called in front of a video key frame, return TRUE if the segment should 
+ * end before it. With R2F_POL_BITRATE the segment ends when the next GOP 
+ * is predicted to exceed the size limit, so the keyframe aligned segments 
+ * stay below it
+ */
+BOOL r2f_policy_key(R2FPOLSTATE * p_st);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // R2F_POLICY_H
+
+
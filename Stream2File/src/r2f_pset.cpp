@@ -0,0 +1,272 @@
+/***************************************************************************************
+ *
+ *  IMPORTANT: READ BEFORE DOWNLOADING, COPYING, INSTALLING OR USING.
+ *
+ *  By downloading, copying, installing or using the software you agree to this license.
+ *  If you do not agree to this license, do not download, install, 
+ *  copy or use the software.
+ *
+ *  Copyright (C) 2014-2020, Happytimesoft Corporation, all rights reserved.
+ *
+ *  Redistribution and use in binary forms, with or without modification, are permitted.
+ *
+ *  Unless required by applicable law or agreed to in writing, software distributed 
+ *  under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ *  CONDITIONS OF ANY KIND, either express or implied. See the License for the specific
+ *  language governing permissions and limitations under the License.
+ *
+****************************************************************************************/
+
+
+#include "sys_inc.h"
+#include "r2f_pset.h"
+#include "media_format.h"
+#include "media_util.h"
+#include "h264.h"
+#include "h265.h"
+#include "h264_util.h"
+#include "h265_util.h"
+
+/***********************************************************/
+
+static uint32 r2f_pset_hash(uint8 * p_data, int len)
+{
+    int i;
+    uint32 hash = 2166136261u;
+
+    for (i = 0; i < len; i++)
+    {
+        hash ^= p_data[i];
+        hash *= 16777619u;
+    }
+
+    // 0 marks an empty slot
+    return hash ? hash : 1;
+}
+
+/**
+ * Return the cache slot of the nal unit, -1 for the other nal units.
+ * The slices end the parameter sets of the frame, *p_vcl is set
+ */
+static int r2f_pset_slot(int codec, uint8 nal_hdr, BOOL * p_vcl)
+{
+    *p_vcl = FALSE;
+
+    if (VIDEO_CODEC_H264 == codec)
+    {
+        uint8 nalu_t = (nal_hdr & 0x1F);
+
+        if (nalu_t == H264_NAL_SPS)
+        {
+            return R2F_PS_SPS;
+        }
+        else if (nalu_t == H264_NAL_PPS)
+        {
+            return R2F_PS_PPS;
+        }
+
+        *p_vcl = (nalu_t >= 1 && nalu_t <= 5);
+    }
+    else if (VIDEO_CODEC_H265 == codec)
+    {
+        uint8 nalu_t = (nal_hdr >> 1) & 0x3F;
+
+        if (nalu_t == HEVC_NAL_VPS)
+        {
+            return R2F_PS_VPS;
+        }
+        else if (nalu_t == HEVC_NAL_SPS)
+        {
+            return R2F_PS_SPS;
+        }
+        else if (nalu_t == HEVC_NAL_PPS)
+        {
+            return R2F_PS_PPS;
+        }
+
+        *p_vcl = (nalu_t <= 31);
+    }
+
+    return -1;
+}
+
+/**
+ * Parse the picture size of the sps nal unit, return FALSE if it can not be parsed
+ */
+static BOOL r2f_pset_parse_sps(int codec, uint8 * p_nal, int len, uint32 * p_width, uint32 * p_height)
+{
+    if (VIDEO_CODEC_H264 == codec)
+    {
+        int b_start;
+        nal_t nal;
+        h264_t parse;
+        uint8 rbsp[R2F_PS_NAL_MAX];
+
+        nal.i_type = H264_NAL_SPS;
+        nal.i_payload = remove_emulation_bytes(rbsp, sizeof(rbsp), p_nal + 1, len - 1);
+        nal.p_payload = rbsp;
+
+        h264_parser_init(&parse);
+        h264_parser_parse(&parse, &nal, &b_start);
+
+        *p_width = parse.i_width;
+        *p_height = parse.i_height;
+    }
+    else
+    {
+        h265_t parse;
+
+        // the parser removes the emulation prevention bytes itself
+        h265_parser_init(&parse);
+        if (len <= 2 || h265_parser_parse(&parse, p_nal + 2, len - 2) != 0)
+        {
+            return FALSE;
+        }
+
+        *p_width = parse.pic_width_in_luma_samples;
+        *p_height = parse.pic_height_in_luma_samples;
+    }
+
+    return (*p_width > 0 && *p_height > 0);
+}
+
+/***********************************************************/
+
+void r2f_pset_init(R2FPSET * p_ps)
+{
+    memset(p_ps, 0, sizeof(R2FPSET));
+}
+
+int r2f_pset_nal(R2FPSET * p_ps, int codec, uint8 * p_nal, int len)
+{
+    int slot, flags = 0;
+    uint32 hash, width, height;
+    BOOL vcl;
+
+    if (len < 2 || len > R2F_PS_NAL_MAX)
+    {
+        return 0;
+    }
+
+    slot = r2f_pset_slot(codec, p_nal[0], &vcl);
+    if (slot < 0)
+    {
+        return 0;
+    }
+
+    hash = r2f_pset_hash(p_nal, len);
+    if (hash == p_ps->hash[slot])
+    {
+        return 0;
+    }
+
+    if (p_ps->hash[slot])
+    {
+        flags |= R2F_PS_CHANGED;
+        p_ps->changes++;
+    }
+
+    p_ps->hash[slot] = hash;
+
+    if (R2F_PS_SPS == slot)
+    {
+        p_ps->parses++;
+
+        if (r2f_pset_parse_sps(codec, p_nal, len, &width, &height))
+        {
+            log_print(HT_LOG_INFO, "%s, %s width[%u],height[%u]\r\n", __FUNCTION__, 
+                VIDEO_CODEC_H264 == codec ? "H264" : "H265", width, height);
+
+            if (p_ps->width && (width != p_ps->width || height != p_ps->height))
+            {
+                flags |= R2F_PS_RESIZE;
+            }
+
+            p_ps->width = width;
+            p_ps->height = height;
+        }
+    }
+
+    return flags;
+}
+
+int r2f_pset_frame(R2FPSET * p_ps, int codec, uint8 * p_data, int len)
+{
+    int s_len = 0, n_len = 0, flags = 0;
+    uint8 * p_next;
+    BOOL vcl;
+
+    if (VIDEO_CODEC_H264 != codec && VIDEO_CODEC_H265 != codec)
+    {
+        return 0;
+    }
+
+    while (p_data && len > 4)
+    {
+        // the start code length, the nal type is checked before the nal is scanned
+        if (p_data[0] != 0 || p_data[1] != 0)
+        {
+            break;
+        }
+        
+        s_len = (p_data[2] == 1) ? 3 : 4;
+
+        if (r2f_pset_slot(codec, p_data[s_len], &vcl) < 0 && vcl)
+        {
+            break;
+        }
+
+        p_next = avc_split_nalu(p_data, len, &s_len, &n_len);
+        if (n_len <= s_len)
+        {
+            break;
+        }
+
+        flags |= r2f_pset_nal(p_ps, codec, p_data + s_len, n_len - s_len);
+
+        len -= n_len;
+        p_data = p_next;
+    }
+
+    return flags;
+}
+
+int r2f_pset_iov(R2FPSET * p_ps, int codec, RTPFRMIOV * p_frm)
+{
+    int i, first, cnt, len, flags = 0;
+    uint8 buf[R2F_PS_NAL_MAX + 4];
+    BOOL vcl;
+
+    if (VIDEO_CODEC_H264 != codec && VIDEO_CODEC_H265 != codec)
+    {
+        return 0;
+    }
+
+    for (i = 0; i < p_frm->nal_cnt; i++)
+    {
+        len = rtp_frm_iov_nal_range(p_frm, i, &first, &cnt);
+        if (len < 5 || cnt < 2)
+        {
+            continue;
+        }
+
+        if (r2f_pset_slot(codec, ((uint8 *)p_frm->iov[first+1].iov_base)[0], &vcl) < 0)
+        {
+            if (vcl)
+            {
+                break;
+            }
+
+            continue;
+        }
+
+        if (len <= (int)sizeof(buf))
+        {
+            rtp_frm_iov_copy(p_frm, first, cnt, buf);
+            flags |= r2f_pset_frame(p_ps, codec, buf, len);
+        }
+    }
+
+    return flags;
+}
+
@@ -0,0 +1,75 @@
+/***************************************************************************************
+ *
+ *  IMPORTANT: READ BEFORE DOWNLOADING, COPYING, INSTALLING OR USING.
+ *
+ *  By downloading, copying, installing or using the software you agree to this license.
+ *  If you do not agree to this license, do not download, install, 
+ *  copy or use the software.
+ *
+ *  Copyright (C) 2014-2020, Happytimesoft Corporation, all rights reserved.
+ *
+ *  Redistribution and use in binary forms, with or without modification, are permitted.
+ *
+ *  Unless required by applicable law or agreed to in writing, software distributed 
+ *  under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ *  CONDITIONS OF ANY KIND, either express or implied. See the License for the specific
+ *  language governing permissions and limitations under the License.
+ *
+****************************************************************************************/
+
+
+#ifndef R2F_PSET_H
+#define R2F_PSET_H
+
+#include "rtp_rx.h"
+
+
+#define R2F_PS_VPS              0
+#define R2F_PS_SPS              1
+#define R2F_PS_PPS              2
+#define R2F_PS_CNT              3
+
+#define R2F_PS_CHANGED          0x01        // a parameter set differs from the cached one
+#define R2F_PS_RESIZE           0x02        // the changed sps has another picture size
+
+#define R2F_PS_NAL_MAX          512         // larger parameter sets are not parsed
+
+/**
+ * Parameter set cache of a H264/H265 stream, keyed by a hash of the raw 
+ * nal units. A set is parsed only when its bytes change, the repeated sets
+ * in front of every key frame cost a hash
+ */
+typedef struct
+{
+    uint32      hash[R2F_PS_CNT];       // FNV-1a of the nal unit, 0 - not seen yet
+    uint32      width;                  // picture size of the cached sps, 0 - unknown
+    uint32      height;
+    uint32      parses;                 // sps parses
+    uint32      changes;                // parameter set changes after the first ones
+} R2FPSET;
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void r2f_pset_init(R2FPSET * p_ps);
+
+/**
+ * Account one nal unit without the start code, return R2F_PS_CHANGED | R2F_PS_RESIZE
+ */
+int  r2f_pset_nal(R2FPSET * p_ps, int codec, uint8 * p_nal, int len);
+
+/**
+ * Account the parameter sets in front of the first slice of the annex-b frame 
+ * or of the received frame chain, the slices are not scanned
+ */
+int  r2f_pset_frame(R2FPSET * p_ps, int codec, uint8 * p_data, int len);
+int  r2f_pset_iov(R2FPSET * p_ps, int codec, RTPFRMIOV * p_frm);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // R2F_PSET_H
+
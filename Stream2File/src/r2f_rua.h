@@ -22,6 +22,10 @@
 
 #include "rtsp_cln.h"
 #include "avi.h"
+#include "r2f_final.h"
+#include "r2f_policy.h"
+#include "r2f_event.h"
+#include "r2f_pset.h"
 #ifdef MP4_FORMAT
 #include "mp4_ctx.h"
 #ifdef AUDIO_CONV
@@ -41,6 +45,9 @@
 
 #define R2F_FMT_AVI         0
 #define R2F_FMT_MP4         1
+#define R2F_FMT_FMP4        2           // fragmented mp4, written by the mp4 writer
+
+#define R2F_FMT_IS_MP4(fmt) (R2F_FMT_MP4 == (fmt) || R2F_FMT_FMP4 == (fmt))
 
 typedef struct
 {
@@ -54,12 +61,19 @@ typedef struct
     char    pass[32];           // login pass    
     char    cfgpath[256];       // recording configured save path    
     char    savepath[256];      // recording save full path
-    int     filefmt;            // R2F_FMT_AVI or R2F_FMT_MP4
+    int     filefmt;            // R2F_FMT_AVI, R2F_FMT_MP4 or R2F_FMT_FMP4
     int     pnum;               //  Process number For Record Server 
     uint32  framerate;          // video recording frame rate
     time_t  starttime;          // start recording time, unit is second
     uint32  recordsize;         // Recording size configured for each recording, unit is kbyte
     uint32  recordtime;         // Recording time configured for each recording, unit is second
+    R2FPOLICY   policy;         // segment switch policy
+    R2FPOLSTATE pol_st;         // segment switch policy state
+    int     sync_mode;          // avi / fmp4 durability policy, AVI_SYNC_DEF - the global setting
+    uint32  sync_ms;            // avi / fmp4 flush / fdatasync interval (ms), 0 - the global setting
+    R2FNEXT next;               // next segment, opened ahead of the switch
+    R2FEVT  event;              // event recording state
+    R2FPSET pset;               // H264/H265 parameter set cache
 
     CRtspClient * rtsp;         // rtsp client 
 #ifdef RTMP_STREAM
@@ -73,6 +87,7 @@ typedef struct
 #ifdef AUDIO_CONV
     CAudioDecoder * adecoder;   // audio decoder
     CAudioEncoder * aencoder;   // audio encoder
+    uint32          aenc_ts;    // timestamp of the recoded audio, the encoded samples
 #endif
 #endif
 } RUA;
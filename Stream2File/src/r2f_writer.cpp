@@ -0,0 +1,713 @@
+/***************************************************************************************
+ *
+ *  IMPORTANT: READ BEFORE DOWNLOADING, COPYING, INSTALLING OR USING.
+ *
+ *  By downloading, copying, installing or using the software you agree to this license.
+ *  If you do not agree to this license, do not download, install, 
+ *  copy or use the software.
+ *
+ *  Copyright (C) 2014-2020, Happytimesoft Corporation, all rights reserved.
+ *
+ *  Redistribution and use in binary forms, with or without modification, are permitted.
+ *
+ *  Unless required by applicable law or agreed to in writing, software distributed 
+ *  under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ *  CONDITIONS OF ANY KIND, either express or implied. See the License for the specific
+ *  language governing permissions and limitations under the License.
+ *
+****************************************************************************************/
+
+#include "sys_inc.h"
+#include "r2f_writer.h"
+#include "r2f.h"
+#include "media_format.h"
+#include "media_util.h"
+
+#if __WINDOWS_OS__
+#define r2f_wmb()               MemoryBarrier()
+#else
+#define r2f_wmb()               __sync_synchronize()
+#endif
+
+#define R2F_NAL_NONE            0           // no video coding layer nal unit
+#define R2F_NAL_KEY             1           // IDR / IRAP picture
+#define R2F_NAL_REF             2           // reference picture
+#define R2F_NAL_NONREF          3           // non-reference picture
+
+/***********************************************************/
+
+static R2FWQ        r2f_wqs[MAX_NUM_RUA];
+static R2FWRITER    r2f_writers[R2F_WRITER_MAX];
+static int          r2f_writer_cnt = 0;
+static uint32       r2f_wq_depth = R2F_WQ_DEPTH_DEF;
+
+/***********************************************************/
+
+static int r2f_video_codec(RUA * p_rua)
+{
+    if (p_rua->rtsp_flag && p_rua->rtsp)
+    {
+        return p_rua->rtsp->video_codec();
+    }
+#ifdef RTMP_STREAM
+    else if (p_rua->rtmp_flag && p_rua->rtmp)
+    {
+        return p_rua->rtmp->video_codec();
+    }
+#endif
+
+    return VIDEO_CODEC_NONE;
+}
+
+/**
+ * Classify one nal unit by its header byte
+ */
+static int r2f_nal_class(int codec, uint8 nal_hdr)
+{
+    if (VIDEO_CODEC_H264 == codec)
+    {
+        uint8 nalu_t = (nal_hdr & 0x1F);
+
+        if (nalu_t == 5)
+        {
+            return R2F_NAL_KEY;
+        }
+        else if (nalu_t >= 1 && nalu_t <= 4)
+        {
+            // nal_ref_idc
+            return (nal_hdr & 0x60) ? R2F_NAL_REF : R2F_NAL_NONREF;
+        }
+    }
+    else if (VIDEO_CODEC_H265 == codec)
+    {
+        uint8 nalu_t = (nal_hdr >> 1) & 0x3F;
+
+        if (nalu_t >= 16 && nalu_t <= 21)
+        {
+            return R2F_NAL_KEY;
+        }
+        else if (nalu_t <= 14)
+        {
+            // TRAIL_N, TSA_N, STSA_N, RADL_N, RASL_N and RSV_VCL_N are the even types
+            return (nalu_t & 1) ? R2F_NAL_REF : R2F_NAL_NONREF;
+        }
+        else if (nalu_t <= 31)
+        {
+            return R2F_NAL_REF;
+        }
+    }
+
+    return R2F_NAL_NONE;
+}
+
+/**
+ * Classify the frame by its first picture nal unit, the parameter sets 
+ * and SEI in front of it are skipped. Frames of the other codecs are 
+ * independent, they are reported as key frames
+ */
+static int r2f_frame_class(int codec, uint8 * p_data, int len)
+{
+    int cls, s_len = 0, n_len = 0;
+    uint8 * p_next;
+
+    if (VIDEO_CODEC_H264 != codec && VIDEO_CODEC_H265 != codec)
+    {
+        return R2F_NAL_KEY;
+    }
+
+    while (p_data && len > 4)
+    {
+        p_next = avc_split_nalu(p_data, len, &s_len, &n_len);
+        if (n_len <= s_len)
+        {
+            break;
+        }
+
+        cls = r2f_nal_class(codec, p_data[s_len]);
+        if (cls != R2F_NAL_NONE)
+        {
+            return cls;
+        }
+
+        len -= n_len;
+        p_data = p_next;
+    }
+
+    return R2F_NAL_NONE;
+}
+
+static int r2f_frame_iov_class(int codec, RTPFRMIOV * p_frm)
+{
+    int i, cls, first;
+
+    for (i = 0; i < p_frm->nal_cnt; i++)
+    {
+        first = p_frm->nal_idx[i];
+        if (first + 1 >= p_frm->iov_cnt)
+        {
+            break;
+        }
+
+        cls = r2f_nal_class(codec, ((uint8 *)p_frm->iov[first+1].iov_base)[0]);
+        if (cls != R2F_NAL_NONE)
+        {
+            return cls;
+        }
+    }
+
+    return R2F_NAL_NONE;
+}
+
+static void r2f_wfrm_free(R2FWFRM * p_wfrm)
+{
+    if (p_wfrm->p_frm)
+    {
+        rtp_frm_iov_free(p_wfrm->p_frm);
+    }
+    else
+    {
+        frm_buf_free(p_wfrm->p_buf, p_wfrm->size);
+    }
+
+    memset(p_wfrm, 0, sizeof(R2FWFRM));
+}
+
+/**
+ * Apply the drop policy on the producer side, return TRUE if the frame can be queued.
+ * Above 3/4 of the depth the non-reference frames are dropped, when the queue 
+ * is full a reference frame breaks the GOP, the video is dropped until the next key frame
+ */
+static BOOL r2f_wq_admit(R2FWQ * p_wq, int type, int cls)
+{
+    uint32 used = p_wq->head - p_wq->tail;
+    uint32 depth = p_wq->mask + 1;
+
+    if (R2F_WF_AUDIO == type)
+    {
+        if (used >= depth)
+        {
+            p_wq->stat.drop_audio++;
+            return FALSE;
+        }
+
+        return TRUE;
+    }
+
+    if (p_wq->gop_drop)
+    {
+        if (R2F_NAL_KEY != cls && R2F_NAL_NONE != cls)
+        {
+            p_wq->stat.drop_gop++;
+            return FALSE;
+        }
+        else if (R2F_NAL_KEY == cls && used < depth)
+        {
+            log_print(HT_LOG_INFO, "%s, %s, resume at key frame, dropped %u\r\n", 
+                __FUNCTION__, p_wq->p_rua->url, p_wq->stat.drop_gop);
+            
+            p_wq->gop_drop = 0;
+        }
+    }
+
+    if (R2F_NAL_NONREF == cls && used >= depth - depth / 4)
+    {
+        p_wq->stat.drop_nonref++;
+        return FALSE;
+    }
+
+    if (used >= depth)
+    {
+        if (R2F_NAL_NONREF == cls)
+        {
+            p_wq->stat.drop_nonref++;
+        }
+        else
+        {
+            if (!p_wq->gop_drop)
+            {
+                log_print(HT_LOG_WARN, "%s, %s, queue full, drop until the next key frame\r\n", 
+                    __FUNCTION__, p_wq->p_rua->url);
+            }
+            
+            p_wq->gop_drop = 1;
+            p_wq->stat.drop_gop++;
+        }
+
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+static void r2f_wq_push(R2FWQ * p_wq, R2FWFRM * p_wfrm)
+{
+    uint32 used;
+    
+    memcpy(&p_wq->frms[p_wq->head & p_wq->mask], p_wfrm, sizeof(R2FWFRM));
+
+    // the descriptor must be visible before the new head
+    r2f_wmb();
+    p_wq->head++;
+
+    used = p_wq->head - p_wq->tail;
+    if (used > p_wq->stat.high_water)
+    {
+        p_wq->stat.high_water = used;
+    }
+
+    p_wq->stat.frames++;
+
+    sys_os_sig_sign(r2f_writers[p_wq->writer].p_sig);
+}
+
+/**
+ * Event recording, hand the queued frame over to the pre-event ring instead of
+ * copying it again. Return TRUE if the frame is held, the slot is released as usual
+ */
+static BOOL r2f_wq_hold(R2FWQ * p_wq, R2FWFRM * p_wfrm)
+{
+    int size;
+    int type = (R2F_WF_AUDIO == p_wfrm->type) ? R2F_EF_AUDIO : R2F_EF_VIDEO;
+    BOOL key = p_wfrm->key;
+    uint8 * p_buf;
+    RUA * p_rua = p_wq->p_rua;
+
+    if (R2F_REC_EVENT != p_rua->event.mode)
+    {
+        return FALSE;
+    }
+
+    if (!r2f_record_hold(p_rua, type, key))
+    {
+        return FALSE;
+    }
+
+    if (R2F_WF_IOV == p_wfrm->type)
+    {
+        // assembled once, the ring does not keep the packet buffers
+        p_buf = frm_buf_get(p_wfrm->p_frm->len, &size);
+        if (p_buf)
+        {
+            rtp_frm_iov_copy(p_wfrm->p_frm, 0, p_wfrm->p_frm->iov_cnt, p_buf);
+            r2f_event_put(&p_rua->event, type, p_buf, p_wfrm->p_frm->len, size, p_wfrm->ts, key);
+        }
+    }
+    else
+    {
+        r2f_event_put(&p_rua->event, type, p_wfrm->p_buf, p_wfrm->len, p_wfrm->size, p_wfrm->ts, key);
+        p_wfrm->p_buf = NULL;
+    }
+
+    return TRUE;
+}
+
+/**
+ * Write up to max queued frames, called by the writer thread with its mutex held
+ */
+static int r2f_wq_drain(R2FWQ * p_wq, int max)
+{
+    int cnt = 0;
+    R2FWFRM * p_wfrm;
+
+    while (cnt < max && p_wq->tail != p_wq->head)
+    {
+        // read the descriptor after the head
+        r2f_wmb();
+        
+        p_wfrm = &p_wq->frms[p_wq->tail & p_wq->mask];
+
+        if (r2f_wq_hold(p_wq, p_wfrm))
+        {
+            // held for the next event
+        }
+        else if (R2F_WF_VIDEO == p_wfrm->type)
+        {
+            r2f_write_video(p_wq->p_rua, p_wfrm->p_buf, p_wfrm->len, p_wfrm->ts, p_wfrm->key);
+        }
+        else if (R2F_WF_IOV == p_wfrm->type)
+        {
+            r2f_write_video_iov(p_wq->p_rua, p_wfrm->p_frm, p_wfrm->ts, p_wfrm->key);
+        }
+        else
+        {
+            r2f_write_audio(p_wq->p_rua, p_wfrm->p_buf, p_wfrm->len, p_wfrm->ts);
+        }
+
+        r2f_wfrm_free(p_wfrm);
+
+        // the slot is released after it is cleared
+        r2f_wmb();
+        p_wq->tail++;
+        cnt++;
+    }
+
+    return cnt;
+}
+
+static void * r2f_writer_thread(void * argv)
+{
+    int i, cnt;
+    R2FWRITER * p_writer = (R2FWRITER *)argv;
+    int index = (int)(p_writer - r2f_writers);
+
+    while (p_writer->run_flag)
+    {
+        sys_os_sig_wait_timeout(p_writer->p_sig, 100);
+
+        do
+        {
+            cnt = 0;
+
+            sys_os_mutex_enter(p_writer->mutex);
+
+            for (i = 0; i < MAX_NUM_RUA; i++)
+            {
+                R2FWQ * p_wq = &r2f_wqs[i];
+                
+                if (p_wq->used_flag && p_wq->writer == index)
+                {
+                    cnt += r2f_wq_drain(p_wq, R2F_WQ_BATCH);
+                }
+            }
+
+            sys_os_mutex_leave(p_writer->mutex);
+        } while (cnt > 0);
+    }
+
+    p_writer->tid = 0;
+
+    log_print(HT_LOG_INFO, "%s, writer %d exit\r\n", __FUNCTION__, index);
+
+    return NULL;
+}
+
+/***********************************************************/
+
+BOOL r2f_writer_init(int threads, int depth)
+{
+    int i;
+
+    memset(r2f_wqs, 0, sizeof(r2f_wqs));
+    memset(r2f_writers, 0, sizeof(r2f_writers));
+
+    r2f_writer_cnt = 0;
+
+    if (threads <= 0)
+    {
+        return TRUE;
+    }
+    else if (threads > R2F_WRITER_MAX)
+    {
+        threads = R2F_WRITER_MAX;
+    }
+
+    if (depth <= 0)
+    {
+        depth = R2F_WQ_DEPTH_DEF;
+    }
+    else if (depth > R2F_WQ_DEPTH_MAX)
+    {
+        depth = R2F_WQ_DEPTH_MAX;
+    }
+
+    // round up to a power of 2, the ring positions are masked
+    r2f_wq_depth = 4;
+    while (r2f_wq_depth < (uint32)depth)
+    {
+        r2f_wq_depth <<= 1;
+    }
+    
+    for (i = 0; i < threads; i++)
+    {
+        R2FWRITER * p_writer = &r2f_writers[i];
+
+        p_writer->p_sig = sys_os_create_sig();
+        p_writer->mutex = sys_os_create_mutex();
+        p_writer->run_flag = 1;
+        
+        p_writer->tid = sys_os_create_thread((void *)r2f_writer_thread, p_writer);
+        if (p_writer->tid == 0)
+        {
+            log_print(HT_LOG_ERR, "%s, create writer thread failed\r\n", __FUNCTION__);
+
+            p_writer->run_flag = 0;
+            sys_os_destroy_sig_mutex(p_writer->p_sig);
+            sys_os_destroy_sig_mutex(p_writer->mutex);
+            break;
+        }
+
+        r2f_writer_cnt++;
+    }
+
+    log_print(HT_LOG_INFO, "%s, writer threads %d, queue depth %u\r\n", 
+        __FUNCTION__, r2f_writer_cnt, r2f_wq_depth);
+
+    return r2f_writer_cnt > 0;
+}
+
+void r2f_writer_deinit()
+{
+    int i;
+
+    for (i = 0; i < MAX_NUM_RUA; i++)
+    {
+        if (r2f_wqs[i].used_flag)
+        {
+            r2f_writer_detach(r2f_wqs[i].p_rua);
+        }
+    }
+
+    for (i = 0; i < r2f_writer_cnt; i++)
+    {
+        R2FWRITER * p_writer = &r2f_writers[i];
+
+        p_writer->run_flag = 0;
+        sys_os_sig_sign(p_writer->p_sig);
+
+        while (p_writer->tid)
+        {
+            usleep(10*1000);
+        }
+
+        sys_os_destroy_sig_mutex(p_writer->p_sig);
+        sys_os_destroy_sig_mutex(p_writer->mutex);
+    }
+
+    r2f_writer_cnt = 0;
+}
+
+BOOL r2f_writer_attach(RUA * p_rua)
+{
+    int i, writer = 0;
+    R2FWQ * p_wq;
+
+    if (r2f_writer_cnt == 0)
+    {
+        return FALSE;
+    }
+
+    p_wq = &r2f_wqs[rua_get_index(p_rua)];
+    if (p_wq->used_flag)
+    {
+        return TRUE;
+    }
+
+    for (i = 1; i < r2f_writer_cnt; i++)
+    {
+        if (r2f_writers[i].streams < r2f_writers[writer].streams)
+        {
+            writer = i;
+        }
+    }
+
+    p_wq->frms = (R2FWFRM *)malloc(r2f_wq_depth * sizeof(R2FWFRM));
+    if (NULL == p_wq->frms)
+    {
+        log_print(HT_LOG_ERR, "%s, malloc failed\r\n", __FUNCTION__);
+        return FALSE;
+    }
+
+    memset(p_wq->frms, 0, r2f_wq_depth * sizeof(R2FWFRM));
+    memset(&p_wq->stat, 0, sizeof(R2FWSTAT));
+
+    p_wq->head = p_wq->tail = 0;
+    p_wq->mask = r2f_wq_depth - 1;
+    p_wq->gop_drop = 0;
+    p_wq->p_rua = p_rua;
+    p_wq->writer = writer;
+    p_wq->stat.depth = r2f_wq_depth;
+
+    sys_os_mutex_enter(r2f_writers[writer].mutex);
+    r2f_writers[writer].streams++;
+    p_wq->used_flag = 1;
+    sys_os_mutex_leave(r2f_writers[writer].mutex);
+
+    return TRUE;
+}
+
+void r2f_writer_detach(RUA * p_rua)
+{
+    R2FWRITER * p_writer;
+    R2FWQ * p_wq = &r2f_wqs[rua_get_index(p_rua)];
+
+    if (!p_wq->used_flag)
+    {
+        return;
+    }
+
+    p_writer = &r2f_writers[p_wq->writer];
+
+    while (p_writer->run_flag && p_wq->tail != p_wq->head)
+    {
+        sys_os_sig_sign(p_writer->p_sig);
+        usleep(1000);
+    }
+
+    sys_os_mutex_enter(p_writer->mutex);
+
+    // the writer is stopped, discard what is left
+    while (p_wq->tail != p_wq->head)
+    {
+        r2f_wfrm_free(&p_wq->frms[p_wq->tail & p_wq->mask]);
+        p_wq->tail++;
+    }
+
+    p_wq->used_flag = 0;
+    p_writer->streams--;
+    
+    sys_os_mutex_leave(p_writer->mutex);
+
+    log_print(HT_LOG_INFO, "%s, %s, frames %u, depth %u, high water %u, "
+        "drop non-ref %u, drop gop %u, drop audio %u\r\n", __FUNCTION__, p_rua->url, 
+        p_wq->stat.frames, p_wq->stat.depth, p_wq->stat.high_water, 
+        p_wq->stat.drop_nonref, p_wq->stat.drop_gop, p_wq->stat.drop_audio);
+
+    free(p_wq->frms);
+    p_wq->frms = NULL;
+    p_wq->p_rua = NULL;
+}
+
+BOOL r2f_writer_put_video(RUA * p_rua, uint8 * p_data, int len, uint32 ts)
+{
+    int cls;
+    R2FWFRM wfrm;
+    R2FWQ * p_wq = &r2f_wqs[rua_get_index(p_rua)];
+
+    if (!p_wq->used_flag)
+    {
+        return FALSE;
+    }
+
+    cls = r2f_frame_class(r2f_video_codec(p_rua), p_data, len);
+    
+    if (!r2f_wq_admit(p_wq, R2F_WF_VIDEO, cls))
+    {
+        return TRUE;
+    }
+
+    memset(&wfrm, 0, sizeof(wfrm));
+
+    wfrm.p_buf = frm_buf_get(len, &wfrm.size);
+    if (NULL == wfrm.p_buf)
+    {
+        p_wq->stat.drop_gop++;
+        p_wq->gop_drop = 1;
+        return TRUE;
+    }
+
+    memcpy(wfrm.p_buf, p_data, len);
+
+    wfrm.type = R2F_WF_VIDEO;
+    wfrm.key = (R2F_NAL_KEY == cls);
+    wfrm.len = len;
+    wfrm.ts = ts;
+
+    r2f_wq_push(p_wq, &wfrm);
+
+    return TRUE;
+}
+
+BOOL r2f_writer_put_video_iov(RUA * p_rua, RTPFRMIOV * p_frm, uint32 ts)
+{
+    int cls;
+    R2FWFRM wfrm;
+    R2FWQ * p_wq = &r2f_wqs[rua_get_index(p_rua)];
+
+    if (!p_wq->used_flag)
+    {
+        return FALSE;
+    }
+
+    cls = r2f_frame_iov_class(r2f_video_codec(p_rua), p_frm);
+    
+    if (!r2f_wq_admit(p_wq, R2F_WF_IOV, cls))
+    {
+        return TRUE;
+    }
+
+    memset(&wfrm, 0, sizeof(wfrm));
+
+    // the packets are shared with the clone, the payload is not copied
+    wfrm.p_frm = rtp_frm_iov_clone(p_frm);
+    if (NULL == wfrm.p_frm)
+    {
+        p_wq->stat.drop_gop++;
+        p_wq->gop_drop = 1;
+        return TRUE;
+    }
+
+    wfrm.type = R2F_WF_IOV;
+    wfrm.key = (R2F_NAL_KEY == cls);
+    wfrm.len = p_frm->len;
+    wfrm.ts = ts;
+
+    r2f_wq_push(p_wq, &wfrm);
+
+    return TRUE;
+}
+
+BOOL r2f_writer_put_audio(RUA * p_rua, uint8 * p_data, int len, uint32 ts)
+{
+    R2FWFRM wfrm;
+    R2FWQ * p_wq = &r2f_wqs[rua_get_index(p_rua)];
+
+    if (!p_wq->used_flag)
+    {
+        return FALSE;
+    }
+
+    if (!r2f_wq_admit(p_wq, R2F_WF_AUDIO, R2F_NAL_NONE))
+    {
+        return TRUE;
+    }
+
+    memset(&wfrm, 0, sizeof(wfrm));
+
+    wfrm.p_buf = frm_buf_get(len, &wfrm.size);
+    if (NULL == wfrm.p_buf)
+    {
+        p_wq->stat.drop_audio++;
+        return TRUE;
+    }
+
+    memcpy(wfrm.p_buf, p_data, len);
+
+    wfrm.type = R2F_WF_AUDIO;
+    wfrm.len = len;
+    wfrm.ts = ts;
+
+    r2f_wq_push(p_wq, &wfrm);
+
+    return TRUE;
+}
+
+BOOL r2f_writer_get_stat(RUA * p_rua, R2FWSTAT * p_stat)
+{
+    R2FWQ * p_wq = &r2f_wqs[rua_get_index(p_rua)];
+
+    if (!p_wq->used_flag)
+    {
+        return FALSE;
+    }
+
+    memcpy(p_stat, &p_wq->stat, sizeof(R2FWSTAT));
+
+    return TRUE;
+}
+
+BOOL r2f_video_key(int codec, uint8 * p_data, int len)
+{
+    return r2f_frame_class(codec, p_data, len) == R2F_NAL_KEY;
+}
+
+BOOL r2f_video_iov_key(int codec, RTPFRMIOV * p_frm)
+{
+    if (VIDEO_CODEC_H264 != codec && VIDEO_CODEC_H265 != codec)
+    {
+        return TRUE;
+    }
+
+    return r2f_frame_iov_class(codec, p_frm) == R2F_NAL_KEY;
+}
+
+
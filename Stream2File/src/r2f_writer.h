@@ -0,0 +1,138 @@
+/***************************************************************************************
+ *
+ *  IMPORTANT: READ BEFORE DOWNLOADING, COPYING, INSTALLING OR USING.
+ *
+ *  By downloading, copying, installing or using the software you agree to this license.
+ *  If you do not agree to this license, do not download, install, 
+ *  copy or use the software.
+ *
+ *  Copyright (C) 2014-2020, Happytimesoft Corporation, all rights reserved.
+ *
+ *  Redistribution and use in binary forms, with or without modification, are permitted.
+ *
+ *  Unless required by applicable law or agreed to in writing, software distributed 
+ *  under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ *  CONDITIONS OF ANY KIND, either express or implied. See the License for the specific
+ *  language governing permissions and limitations under the License.
+ *
+****************************************************************************************/
+
+#ifndef R2F_WRITER_H
+#define R2F_WRITER_H
+
+#include "r2f_rua.h"
+
+
+#define R2F_WQ_DEPTH_DEF        64          // default frames per stream queue
+#define R2F_WQ_DEPTH_MAX        4096
+#define R2F_WRITER_MAX          32          // max writer threads
+#define R2F_WQ_BATCH            16          // frames written per queue visit
+
+#define R2F_WF_VIDEO            0           // contiguous video frame
+#define R2F_WF_IOV              1           // H264/H265 frame chain
+#define R2F_WF_AUDIO            2           // audio frame
+
+/**
+ * Queued frame descriptor, the queue owns the frame data
+ */
+typedef struct
+{
+    uint32      type        : 2;        // R2F_WF_VIDEO, R2F_WF_IOV or R2F_WF_AUDIO
+    uint32      key         : 1;        // the video frame starts a GOP, classified when queued
+    uint32      reserved    : 29;
+
+    uint32      ts;                     // rtp timestamp
+    int         len;                    // p_buf data length
+    int         size;                   // p_buf allocated size
+    uint8     * p_buf;                  // R2F_WF_VIDEO, R2F_WF_AUDIO
+    RTPFRMIOV * p_frm;                  // R2F_WF_IOV, a clone of the received chain
+} R2FWFRM;
+
+typedef struct
+{
+    uint32      depth;                  // queue depth (frames)
+    uint32      high_water;             // max queued frames
+    uint32      frames;                 // queued frames
+    uint32      drop_nonref;            // dropped non-reference video frames
+    uint32      drop_gop;               // dropped reference video frames (whole GOP)
+    uint32      drop_audio;             // dropped audio frames
+} R2FWSTAT;
+
+/**
+ * Single producer, single consumer frame ring of one stream. 
+ * The producer is the stream receive thread (RTSP/RTMP callbacks run on one thread),
+ * the consumer is the writer thread the stream is assigned to
+ */
+typedef struct
+{
+    uint32      used_flag   : 1;        // attached to a writer
+    uint32      gop_drop    : 1;        // dropping video until the next key frame
+    uint32      reserved    : 30;
+
+    volatile uint32 head;               // next put position, written by the producer only
+    volatile uint32 tail;               // next get position, written by the consumer only
+    uint32      mask;                   // depth - 1, depth is a power of 2
+    R2FWFRM   * frms;
+
+    RUA       * p_rua;
+    int         writer;                 // writer thread index
+    R2FWSTAT    stat;
+} R2FWQ;
+
+typedef struct
+{
+    uint32      run_flag    : 1;
+    uint32      reserved    : 31;
+
+    pthread_t   tid;
+    void      * p_sig;                  // wake up signal
+    void      * mutex;                  // held while the writer works on its queues
+    int         streams;                // attached streams
+} R2FWRITER;
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Start the writer threads, threads = 0 means the frames are written on the receive threads
+ */
+BOOL r2f_writer_init(int threads, int depth);
+void r2f_writer_deinit();
+
+/**
+ * Create the stream queue and assign it to the least loaded writer
+ */
+BOOL r2f_writer_attach(RUA * p_rua);
+
+/**
+ * Write the queued frames and release the stream queue,
+ * the stream receive callbacks must be stopped before
+ */
+void r2f_writer_detach(RUA * p_rua);
+
+/**
+ * Queue the frame, return FALSE if the stream has no writer and the frame should be
+ * written directly. A dropped frame returns TRUE, it is accounted in the stream statistics
+ */
+BOOL r2f_writer_put_video(RUA * p_rua, uint8 * p_data, int len, uint32 ts);
+BOOL r2f_writer_put_video_iov(RUA * p_rua, RTPFRMIOV * p_frm, uint32 ts);
+BOOL r2f_writer_put_audio(RUA * p_rua, uint8 * p_data, int len, uint32 ts);
+
+BOOL r2f_writer_get_stat(RUA * p_rua, R2FWSTAT * p_stat);
+
+/**
+ * Return TRUE if the video frame starts a key picture (IDR / IRAP), the parameter sets
+ * and SEI in front of it are skipped. The frames of the other codecs are all key frames
+ */
+BOOL r2f_video_key(int codec, uint8 * p_data, int len);
+BOOL r2f_video_iov_key(int codec, RTPFRMIOV * p_frm);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // R2F_WRITER_H
+
+